@@ -0,0 +1,75 @@
+#include "schema.h"
+#include "record.h"
+#include "variant.h"
+#include "util.h"
+#define __KVS_SCHEMA_INTERNAL_H__
+#include "aot.h"
+#undef __KVS_SCHEMA_INTERNAL_H__
+#include <pthread.h>
+
+static pthread_mutex_t codec_registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static kvs_schema_aot_codec *codec_registry = NULL;
+
+static uint64_t kvs_schema_aot_fingerprint_update(uint64_t hash, const void *data, size_t size) {
+  /* FNV-1a */
+  const uint8_t *cdata = data;
+  size_t idx;
+  for (idx = 0; idx < size; ++idx) {
+    hash ^= cdata[idx];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+/* unlike the jit fingerprint only whether a column has a dictionary counts, dictionaries are looked up through the columns */
+static uint64_t kvs_schema_aot_fingerprint_columns(uint64_t hash, const kvs_column **columns, size_t size) {
+  size_t idx;
+  uint64_t column[3];
+  hash = kvs_schema_aot_fingerprint_update(hash, &size, sizeof(size));
+  for (idx = 0; idx < size; ++idx) {
+    column[0] = columns[idx]->index;
+    column[1] = columns[idx]->type;
+    column[2] = columns[idx]->dictionary != NULL;
+    hash = kvs_schema_aot_fingerprint_update(hash, column, sizeof(column));
+  }
+  return hash;
+}
+
+uint64_t kvs_schema_aot_fingerprint(const kvs_column **keys, size_t key_size, const kvs_column **values, size_t value_size) {
+  uint64_t hash = 14695981039346656037ULL;
+  uint64_t layout[] = {
+    KVS_SCHEMA_AOT_VERSION,
+    kvs_variant_int32_offset(),
+    kvs_variant_int64_offset(),
+    kvs_variant_float_offset(),
+    kvs_variant_double_offset(),
+    kvs_variant_opaque_data_offset(),
+    kvs_variant_opaque_size_offset(),
+    kvs_record_fields_offset(),
+  };
+  hash = kvs_schema_aot_fingerprint_update(hash, layout, sizeof(layout));
+  hash = kvs_schema_aot_fingerprint_columns(hash, keys, key_size);
+  hash = kvs_schema_aot_fingerprint_columns(hash, values, value_size);
+  return hash;
+}
+
+void kvs_schema_aot_register(kvs_schema_aot_codec *codec) {
+  pthread_mutex_lock(&codec_registry_lock);
+  codec->next = codec_registry;
+  codec_registry = codec;
+  pthread_mutex_unlock(&codec_registry_lock);
+}
+
+const kvs_schema_aot_codec *kvs_schema_aot_codec_lookup(const kvs_column **keys, size_t key_size, const kvs_column **values, size_t value_size) {
+  uint64_t fingerprint = kvs_schema_aot_fingerprint(keys, key_size, values, value_size);
+  const kvs_schema_aot_codec *codec;
+  pthread_mutex_lock(&codec_registry_lock);
+  for (codec = codec_registry; codec != NULL && codec->fingerprint != fingerprint; codec = codec->next) {
+  }
+  pthread_mutex_unlock(&codec_registry_lock);
+  return codec;
+}
+
+/* registered codecs are static, nothing to release */
+void kvs_schema_aot_codec_destroy(const kvs_column **keys, size_t key_size, const kvs_column **values, size_t value_size, void *opaque) {
+}
@@ -0,0 +1,150 @@
+#ifndef __KVS_AOT_H__
+#define __KVS_AOT_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "schema.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Codecs emitted as C by codegen for a fixed set of columns and linked into the binary.
+ * Generated sources register themselves on load, schemas created with KVS_SCHEMA_FLAG_AOT
+ * pick them by fingerprint. Offsets of variant and record fields are baked into the
+ * generated code and covered by the fingerprint, so a stale codec is never matched.
+ **/
+#define KVS_SCHEMA_AOT_VERSION (2)
+
+/* a NULL key serializes the value only */
+typedef void (*kvs_schema_aot_serializer)(const kvs_column **keys, size_t key_size, const kvs_column **values, size_t value_size, kvs_record *record, kvs_buffer *key, kvs_buffer *value, void *opaque);
+typedef void (*kvs_schema_aot_deserializer)(const kvs_column **keys, size_t key_size, const kvs_column **values, size_t value_size, kvs_buffer *key, kvs_buffer *value, void *opaque, kvs_record *dest);
+
+typedef struct kvs_schema_aot_codec {
+  uint64_t fingerprint;
+  const char *name;
+  kvs_schema_aot_serializer serializer;
+  kvs_schema_aot_deserializer deserializer;
+  /* leave for the registry to initialize */
+  struct kvs_schema_aot_codec *next;
+} kvs_schema_aot_codec;
+
+uint64_t kvs_schema_aot_fingerprint(const kvs_column **keys, size_t key_size, const kvs_column **values, size_t value_size);
+void kvs_schema_aot_register(kvs_schema_aot_codec *codec);
+
+/* helpers for generated code */
+#define KVS_SCHEMA_AOT_ADDRESS(BASE, OFFSET) ((void *) (((uint8_t *) (BASE)) + (OFFSET)))
+#define KVS_SCHEMA_AOT_FIELD(TYPE, BASE, OFFSET) (*(TYPE *) KVS_SCHEMA_AOT_ADDRESS(BASE, OFFSET))
+
+static inline size_t kvs_schema_aot_encode_comparable_uint32(uint32_t u32, void *dest) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  u32 = __builtin_bswap32(u32);
+#endif
+  memcpy(dest, &u32, sizeof(u32));
+  return sizeof(u32);
+}
+
+static inline size_t kvs_schema_aot_encode_comparable_uint64(uint64_t u64, void *dest) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  u64 = __builtin_bswap64(u64);
+#endif
+  memcpy(dest, &u64, sizeof(u64));
+  return sizeof(u64);
+}
+
+static inline size_t kvs_schema_aot_encode_comparable_int32(int32_t i32, void *dest) {
+  return kvs_schema_aot_encode_comparable_uint32(((uint32_t) i32) ^ 0x80000000U, dest);
+}
+
+static inline size_t kvs_schema_aot_encode_comparable_int64(int64_t i64, void *dest) {
+  return kvs_schema_aot_encode_comparable_uint64(((uint64_t) i64) ^ 0x8000000000000000ULL, dest);
+}
+
+static inline size_t kvs_schema_aot_encode_comparable_float(float f, void *dest) {
+  uint32_t u32;
+  memcpy(&u32, &f, sizeof(u32));
+  return kvs_schema_aot_encode_comparable_uint32(f >= 0 ? u32 | 0x80000000U : ~u32, dest);
+}
+
+static inline size_t kvs_schema_aot_encode_comparable_double(double d, void *dest) {
+  uint64_t u64;
+  memcpy(&u64, &d, sizeof(u64));
+  return kvs_schema_aot_encode_comparable_uint64(d >= 0 ? u64 | 0x8000000000000000ULL : ~u64, dest);
+}
+
+static inline size_t kvs_schema_aot_encode_opaque(const void *data, int32_t size, void *dest) {
+  memcpy(dest, &size, sizeof(size));
+  memcpy(((uint8_t *) dest) + sizeof(size), data, size);
+  return sizeof(size) + size;
+}
+
+static inline uint32_t kvs_schema_aot_decode_comparable_uint32(const void *data) {
+  uint32_t u32;
+  memcpy(&u32, data, sizeof(u32));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  u32 = __builtin_bswap32(u32);
+#endif
+  return u32;
+}
+
+static inline uint64_t kvs_schema_aot_decode_comparable_uint64(const void *data) {
+  uint64_t u64;
+  memcpy(&u64, data, sizeof(u64));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  u64 = __builtin_bswap64(u64);
+#endif
+  return u64;
+}
+
+static inline int32_t kvs_schema_aot_decode_comparable_int32(const void *data) {
+  return (int32_t) (kvs_schema_aot_decode_comparable_uint32(data) ^ 0x80000000U);
+}
+
+static inline int64_t kvs_schema_aot_decode_comparable_int64(const void *data) {
+  return (int64_t) (kvs_schema_aot_decode_comparable_uint64(data) ^ 0x8000000000000000ULL);
+}
+
+static inline float kvs_schema_aot_decode_comparable_float(const void *data) {
+  float f;
+  uint32_t u32 = kvs_schema_aot_decode_comparable_uint32(data);
+  u32 = (u32 & 0x80000000U) == 0 ? ~u32 : u32 ^ 0x80000000U;
+  memcpy(&f, &u32, sizeof(f));
+  return f;
+}
+
+static inline double kvs_schema_aot_decode_comparable_double(const void *data) {
+  double d;
+  uint64_t u64 = kvs_schema_aot_decode_comparable_uint64(data);
+  u64 = (u64 & 0x8000000000000000ULL) == 0 ? ~u64 : u64 ^ 0x8000000000000000ULL;
+  memcpy(&d, &u64, sizeof(d));
+  return d;
+}
+
+/* a span crossing blocks of buffer is copied into scratch */
+static inline const uint8_t *kvs_schema_aot_fetch(kvs_buffer *buffer, size_t size, uint8_t *scratch) {
+  const void *data = kvs_buffer_peek(buffer, size);
+  if (data == NULL) {
+    kvs_buffer_read(buffer, scratch, size);
+    return scratch;
+  }
+  return data;
+}
+
+static inline void kvs_schema_aot_release(kvs_buffer *buffer, const uint8_t *data, size_t size, const uint8_t *scratch) {
+  if (data != scratch) {
+    kvs_buffer_skip(buffer, size);
+  }
+}
+
+#ifdef __KVS_SCHEMA_INTERNAL_H__
+const kvs_schema_aot_codec *kvs_schema_aot_codec_lookup(const kvs_column **keys, size_t key_size, const kvs_column **values, size_t value_size);
+void kvs_schema_aot_codec_destroy(const kvs_column **keys, size_t key_size, const kvs_column **values, size_t value_size, void *opaque);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __KVS_AOT_H__ */
@@ -0,0 +1,134 @@
+#include "arena.h"
+#include "util.h"
+#include <string.h>
+
+#define ARENA_ALIGN(size) (((size) + 7) & ~((size_t) 7))
+
+typedef struct kvs_arena_chunk kvs_arena_chunk;
+
+struct kvs_arena_chunk {
+  kvs_arena_chunk *next;
+  size_t size;
+  size_t capacity;
+  uint8_t *data;
+};
+
+struct kvs_arena {
+  /* the first chunk lives in the arena allocation, later ones are kept across resets */
+  kvs_arena_chunk *head;
+  kvs_arena_chunk *current;
+  /* oversized allocations, most recent first */
+  kvs_arena_chunk *large;
+  size_t chunk_size;
+  size_t size;
+};
+
+static kvs_arena_chunk *kvs_arena_chunk_init(void *memory, size_t capacity) {
+  kvs_arena_chunk *chunk = memory;
+  chunk->next = NULL;
+  chunk->size = 0;
+  chunk->capacity = capacity;
+  chunk->data = KVS_UNSAFE_CAST(chunk, ARENA_ALIGN(sizeof(kvs_arena_chunk)));
+  return chunk;
+}
+
+static kvs_arena_chunk *kvs_arena_chunk_create(size_t capacity) {
+  void *memory = malloc(ARENA_ALIGN(sizeof(kvs_arena_chunk)) + capacity);
+  if (memory == NULL) {
+    return NULL;
+  }
+  return kvs_arena_chunk_init(memory, capacity);
+}
+
+static void kvs_arena_chunk_destroy(kvs_arena_chunk *chunk, const kvs_arena_chunk *until) {
+  kvs_arena_chunk *next;
+  while (chunk != until) {
+    next = chunk->next;
+    free(chunk);
+    chunk = next;
+  }
+}
+
+kvs_arena *kvs_arena_create(size_t chunk_size) {
+  size_t offset = ARENA_ALIGN(sizeof(kvs_arena));
+  kvs_arena *arena;
+  chunk_size = ARENA_ALIGN(chunk_size);
+  if ((arena = malloc(offset + ARENA_ALIGN(sizeof(kvs_arena_chunk)) + chunk_size)) == NULL) {
+    return NULL;
+  }
+  arena->head = arena->current = kvs_arena_chunk_init(KVS_UNSAFE_CAST(arena, offset), chunk_size);
+  arena->large = NULL;
+  arena->chunk_size = chunk_size;
+  arena->size = 0;
+  return arena;
+}
+
+void kvs_arena_destroy(kvs_arena *arena) {
+  if (arena == NULL) {
+    return;
+  }
+  kvs_arena_chunk_destroy(arena->large, NULL);
+  kvs_arena_chunk_destroy(arena->head->next, NULL);
+  free(arena);
+}
+
+void *kvs_arena_allocate(kvs_arena *arena, size_t size) {
+  kvs_arena_chunk *chunk = arena->current;
+  void *result;
+  size = ARENA_ALIGN(size);
+  if (size > arena->chunk_size / 4) {
+    if ((chunk = kvs_arena_chunk_create(size)) == NULL) {
+      return NULL;
+    }
+    chunk->next = arena->large;
+    arena->large = chunk;
+    arena->size += size;
+    return chunk->data;
+  }
+  while (chunk->capacity - chunk->size < size) {
+    if (chunk->next == NULL && (chunk->next = kvs_arena_chunk_create(arena->chunk_size)) == NULL) {
+      return NULL;
+    }
+    chunk = arena->current = chunk->next;
+    chunk->size = 0;
+  }
+  result = chunk->data + chunk->size;
+  chunk->size += size;
+  arena->size += size;
+  return result;
+}
+
+void kvs_arena_reset(kvs_arena *arena) {
+  kvs_arena_chunk_destroy(arena->large, NULL);
+  arena->large = NULL;
+  arena->current = arena->head;
+  arena->head->size = 0;
+  arena->size = 0;
+}
+
+void kvs_arena_save(const kvs_arena *arena, kvs_arena_mark *mark) {
+  mark->chunk = arena->current;
+  mark->size = arena->current->size;
+  mark->large = arena->large;
+}
+
+void kvs_arena_restore(kvs_arena *arena, const kvs_arena_mark *mark) {
+  kvs_arena_chunk *chunk;
+  for (chunk = arena->large; chunk != mark->large; chunk = chunk->next) {
+    arena->size -= chunk->capacity;
+  }
+  kvs_arena_chunk_destroy(arena->large, mark->large);
+  arena->large = mark->large;
+  for (chunk = mark->chunk;; chunk = chunk->next) {
+    arena->size -= chunk->size - (chunk == mark->chunk ? mark->size : 0);
+    if (chunk == arena->current) {
+      break;
+    }
+  }
+  arena->current = mark->chunk;
+  arena->current->size = mark->size;
+}
+
+size_t kvs_arena_size(const kvs_arena *arena) {
+  return arena->size;
+}
@@ -0,0 +1,40 @@
+#ifndef __KVS_ARENA_H__
+#define __KVS_ARENA_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Bump allocator for memory that dies together, e.g. everything decoded during a scan.
+ * Allocations are 8 byte aligned and never freed one by one, reset releases all of them
+ * at once and keeps the chunks for reuse. Allocations larger than a quarter of a chunk
+ * get a chunk of their own, which reset gives back to the heap. Not thread safe, use one
+ * arena per thread.
+ **/
+typedef struct kvs_arena kvs_arena;
+
+/* position to return to with kvs_arena_restore, releasing everything allocated after it */
+typedef struct kvs_arena_mark {
+  void *chunk;
+  size_t size;
+  void *large;
+} kvs_arena_mark;
+
+kvs_arena *kvs_arena_create(size_t chunk_size);
+void kvs_arena_destroy(kvs_arena *arena);
+void *kvs_arena_allocate(kvs_arena *arena, size_t size);
+void kvs_arena_reset(kvs_arena *arena);
+void kvs_arena_save(const kvs_arena *arena, kvs_arena_mark *mark);
+void kvs_arena_restore(kvs_arena *arena, const kvs_arena_mark *mark);
+/* bytes handed out since the last reset */
+size_t kvs_arena_size(const kvs_arena *arena);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __KVS_ARENA_H__ */
@@ -0,0 +1,193 @@
+#include "batch.h"
+#include "util.h"
+#include <string.h>
+
+/* free arena tail a pair starts with, and block size once it spills */
+#define KVS_BATCH_BLOCK_SIZE (4096)
+
+typedef struct kvs_batch_arena {
+  uint8_t *data;
+  size_t size;
+  size_t capacity;
+  /* size + 1 offsets, entry idx spans [offsets[idx], offsets[idx + 1]) */
+  size_t *offsets;
+} kvs_batch_arena;
+
+struct kvs_batch {
+  kvs_batch_arena key;
+  kvs_batch_arena value;
+  size_t size;
+  size_t capacity;
+  /* memory of the buffers kvs_batch_begin places over the arena tails */
+  void *key_memory;
+  void *value_memory;
+  kvs_buffer *key_buffer;
+  kvs_buffer *value_buffer;
+};
+
+static kvs_status kvs_batch_arena_reserve(kvs_batch_arena *arena, size_t size) {
+  size_t capacity = arena->capacity;
+  uint8_t *data;
+  if (arena->size + size <= capacity) {
+    return KVS_OK;
+  }
+  while (capacity < arena->size + size) {
+    capacity = capacity == 0 ? 4096 : capacity * 2;
+  }
+  KVS_CHECK_OOM(data = realloc(arena->data, capacity));
+  arena->data = data;
+  arena->capacity = capacity;
+  return KVS_OK;
+}
+
+static kvs_status kvs_batch_arena_append(kvs_batch_arena *arena, size_t idx, kvs_buffer *buffer) {
+  kvs_status st;
+  size_t size = kvs_buffer_size(buffer);
+  /* discard anything left behind by a failed append */
+  arena->size = arena->offsets[idx];
+  KVS_DO(st, kvs_batch_arena_reserve(arena, size));
+  kvs_buffer_read(buffer, arena->data + arena->size, size);
+  arena->size += size;
+  arena->offsets[idx + 1] = arena->size;
+  return KVS_OK;
+}
+
+static kvs_buffer *kvs_batch_arena_embed(kvs_batch_arena *arena, void *memory) {
+  size_t available;
+  available = arena->capacity - arena->size;
+  return kvs_buffer_embed_data(memory, arena->data + arena->size, available > 0x7FFFFFFF ? 0x7FFFFFFF : (int32_t) available, KVS_BATCH_BLOCK_SIZE);
+}
+
+/* keep what buffer wrote in place, and copy in what spilled past the arena tail */
+static kvs_status kvs_batch_arena_commit(kvs_batch_arena *arena, size_t idx, kvs_buffer *buffer) {
+  kvs_status st;
+  struct iovec iov;
+  size_t size = kvs_buffer_size(buffer), in_place = 0;
+  if (kvs_buffer_iovec(buffer, &iov, 1) > 0 && iov.iov_base == arena->data + arena->size) {
+    in_place = iov.iov_len;
+  }
+  if (in_place < size) {
+    /* realloc keeps the bytes in place, copy only reads the blocks past them */
+    KVS_DO(st, kvs_batch_arena_reserve(arena, size));
+    kvs_buffer_copy(buffer, in_place, arena->data + arena->size + in_place, size - in_place);
+  }
+  arena->size += size;
+  arena->offsets[idx + 1] = arena->size;
+  return KVS_OK;
+}
+
+static kvs_status kvs_batch_grow(kvs_batch *batch) {
+  size_t capacity = batch->capacity == 0 ? 64 : batch->capacity * 2;
+  size_t *offsets;
+  KVS_CHECK_OOM(offsets = realloc(batch->key.offsets, sizeof(size_t) * (capacity + 1)));
+  batch->key.offsets = offsets;
+  KVS_CHECK_OOM(offsets = realloc(batch->value.offsets, sizeof(size_t) * (capacity + 1)));
+  batch->value.offsets = offsets;
+  batch->capacity = capacity;
+  return KVS_OK;
+}
+
+kvs_batch *kvs_batch_create(size_t capacity, size_t arena_size) {
+  kvs_batch *batch = calloc(1, sizeof(kvs_batch));
+  if (batch == NULL) {
+    return NULL;
+  }
+  batch->capacity = capacity;
+  if ((batch->key.offsets = malloc(sizeof(size_t) * (capacity + 1))) == NULL ||
+      (batch->value.offsets = malloc(sizeof(size_t) * (capacity + 1))) == NULL ||
+      KVS_FAILED(kvs_batch_arena_reserve(&batch->key, arena_size)) ||
+      KVS_FAILED(kvs_batch_arena_reserve(&batch->value, arena_size)) ||
+      (batch->key_memory = malloc(kvs_buffer_embedded_size(0))) == NULL ||
+      (batch->value_memory = malloc(kvs_buffer_embedded_size(0))) == NULL) {
+    kvs_batch_destroy(batch);
+    return NULL;
+  }
+  batch->key.offsets[0] = 0;
+  batch->value.offsets[0] = 0;
+  return batch;
+}
+
+void kvs_batch_destroy(kvs_batch *batch) {
+  if (batch == NULL) {
+    return;
+  }
+  if (batch->key_buffer != NULL) {
+    kvs_buffer_fini(batch->key_buffer);
+    kvs_buffer_fini(batch->value_buffer);
+  }
+  free(batch->key_memory);
+  free(batch->value_memory);
+  free(batch->key.data);
+  free(batch->key.offsets);
+  free(batch->value.data);
+  free(batch->value.offsets);
+  free(batch);
+}
+
+void kvs_batch_reset(kvs_batch *batch) {
+  batch->size = 0;
+  batch->key.size = 0;
+  batch->value.size = 0;
+}
+
+size_t kvs_batch_size(const kvs_batch *batch) {
+  return batch->size;
+}
+
+const void *kvs_batch_key(const kvs_batch *batch, size_t idx, size_t *size) {
+  *size = batch->key.offsets[idx + 1] - batch->key.offsets[idx];
+  return batch->key.data + batch->key.offsets[idx];
+}
+
+const void *kvs_batch_value(const kvs_batch *batch, size_t idx, size_t *size) {
+  *size = batch->value.offsets[idx + 1] - batch->value.offsets[idx];
+  return batch->value.data + batch->value.offsets[idx];
+}
+
+kvs_status kvs_batch_begin(kvs_batch *batch, kvs_buffer **key, kvs_buffer **value) {
+  kvs_status st;
+  if (batch->key_buffer != NULL) {
+    /* a pair begun but never committed is dropped */
+    kvs_buffer_fini(batch->key_buffer);
+    kvs_buffer_fini(batch->value_buffer);
+    batch->key_buffer = batch->value_buffer = NULL;
+  }
+  if (batch->size == batch->capacity) {
+    KVS_DO(st, kvs_batch_grow(batch));
+  }
+  batch->key.size = batch->key.offsets[batch->size];
+  batch->value.size = batch->value.offsets[batch->size];
+  KVS_DO(st, kvs_batch_arena_reserve(&batch->key, KVS_BATCH_BLOCK_SIZE));
+  KVS_DO(st, kvs_batch_arena_reserve(&batch->value, KVS_BATCH_BLOCK_SIZE));
+  *key = batch->key_buffer = kvs_batch_arena_embed(&batch->key, batch->key_memory);
+  *value = batch->value_buffer = kvs_batch_arena_embed(&batch->value, batch->value_memory);
+  return KVS_OK;
+}
+
+kvs_status kvs_batch_commit(kvs_batch *batch) {
+  kvs_status st = kvs_batch_arena_commit(&batch->key, batch->size, batch->key_buffer);
+  if (!KVS_FAILED(st) && KVS_FAILED(st = kvs_batch_arena_commit(&batch->value, batch->size, batch->value_buffer))) {
+    batch->key.size = batch->key.offsets[batch->size];
+  }
+  if (!KVS_FAILED(st)) {
+    batch->size++;
+  }
+  kvs_buffer_fini(batch->key_buffer);
+  kvs_buffer_fini(batch->value_buffer);
+  batch->key_buffer = batch->value_buffer = NULL;
+  return st;
+}
+
+kvs_status kvs_batch_append(kvs_batch *batch, kvs_buffer *key, kvs_buffer *value) {
+  kvs_status st;
+  if (batch->size == batch->capacity) {
+    KVS_DO(st, kvs_batch_grow(batch));
+  }
+  KVS_DO(st, kvs_batch_arena_append(&batch->key, batch->size, key));
+  if (KVS_FAILED(st = kvs_batch_arena_append(&batch->value, batch->size, value))) {
+    batch->key.size = batch->key.offsets[batch->size];
+    return st;
+  }
+  batch->size++;
+  return KVS_OK;
+}
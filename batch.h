@@ -0,0 +1,39 @@
+#ifndef __KVS_BATCH_H__
+#define __KVS_BATCH_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "buffer.h"
+#include "status.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Serialized key value pairs packed into one contiguous key arena and one value arena.
+ * Reset keeps all memory so a batch can be refilled without allocation.
+ **/
+typedef struct kvs_batch kvs_batch;
+
+kvs_batch *kvs_batch_create(size_t capacity, size_t arena_size);
+void kvs_batch_destroy(kvs_batch *batch);
+void kvs_batch_reset(kvs_batch *batch);
+size_t kvs_batch_size(const kvs_batch *batch);
+const void *kvs_batch_key(const kvs_batch *batch, size_t idx, size_t *size);
+const void *kvs_batch_value(const kvs_batch *batch, size_t idx, size_t *size);
+/**
+ * Buffers writing the next pair straight into the free tail of the arenas, what spills
+ * past it is copied in on commit. They are only valid until commit or the next begin,
+ * a pair begun and never committed is dropped.
+ **/
+kvs_status kvs_batch_begin(kvs_batch *batch, kvs_buffer **key, kvs_buffer **value);
+kvs_status kvs_batch_commit(kvs_batch *batch);
+/* copy a pair from buffers of the caller, which keep their content */
+kvs_status kvs_batch_append(kvs_batch *batch, kvs_buffer *key, kvs_buffer *value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __KVS_BATCH_H__ */
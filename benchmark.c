@@ -1,51 +1,872 @@
 #include "kvs.h"
 #include "cmdline.h"
-#include <sys/time.h>
+#include <time.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 
-static void elapsed(const char *suite, int64_t elapsed) {
-  printf("It took %lld us to benchmark '%s'\n", (long long) elapsed, suite);
-}
+/**
+ * Codec and store suite: every operation runs over every schema, value size distribution
+ * and codec, warmup runs first and are discarded, then the repetitions are measured.
+ * Throughput sums all measured repetitions. Latencies of operations too short to time one
+ * by one (serialize, deserialize, scan) are averages over groups of BENCH_GROUP. Codecs not
+ * running on their tier, e.g. aot outside the answers schema, are reported not available.
+ **/
+#define BENCH_GROUP (64)
+#define BENCH_SEEK_ROWS (16)
+#define BENCH_ROWS_PER_TXN (1000)
+#define BENCH_DEFAULT_ROWS (20000)
+#define BENCH_DEFAULT_REPETITIONS (5)
+#define BENCH_DEFAULT_WARMUPS (1)
 
-static int64_t benchmark(kvs_store *store, int32_t flags) {
-  struct timeval start, end;
-  kvs_store_cursor *cursor;
-  kvs_buffer *key, *value;
+#define BENCH_FIXED(NAME, TYPE) { NAME, KVS_VARIANT_TYPE_##TYPE, 0 }
+#define BENCH_OPAQUE(NAME) { NAME, KVS_VARIANT_TYPE_OPAQUE, 0 }
+
+static const kvs_column narrow_columns[] = {
+  { "id", KVS_VARIANT_TYPE_INT64, 1 },
+  BENCH_FIXED("count", INT32),
+  BENCH_FIXED("score", DOUBLE),
+  BENCH_OPAQUE("payload"),
+};
+
+static const kvs_column wide_columns[] = {
+  { "id", KVS_VARIANT_TYPE_INT64, 1 },
+  BENCH_FIXED("i0", INT32), BENCH_FIXED("l0", INT64), BENCH_FIXED("f0", FLOAT), BENCH_FIXED("d0", DOUBLE),
+  BENCH_FIXED("i1", INT32), BENCH_FIXED("l1", INT64), BENCH_FIXED("f1", FLOAT), BENCH_FIXED("d1", DOUBLE),
+  BENCH_FIXED("i2", INT32), BENCH_FIXED("l2", INT64), BENCH_FIXED("f2", FLOAT), BENCH_FIXED("d2", DOUBLE),
+  BENCH_FIXED("i3", INT32), BENCH_FIXED("l3", INT64), BENCH_FIXED("f3", FLOAT), BENCH_FIXED("d3", DOUBLE),
+  BENCH_FIXED("i4", INT32), BENCH_FIXED("l4", INT64), BENCH_FIXED("f4", FLOAT), BENCH_FIXED("d4", DOUBLE),
+  BENCH_FIXED("i5", INT32), BENCH_FIXED("l5", INT64), BENCH_FIXED("f5", FLOAT), BENCH_FIXED("d5", DOUBLE),
+  BENCH_OPAQUE("title"),
+  BENCH_OPAQUE("body"),
+};
+
+static const kvs_column strings_columns[] = {
+  { "key", KVS_VARIANT_TYPE_OPAQUE, 1 },
+  BENCH_OPAQUE("s0"), BENCH_OPAQUE("s1"), BENCH_OPAQUE("s2"), BENCH_OPAQUE("s3"),
+  BENCH_OPAQUE("s4"), BENCH_OPAQUE("s5"), BENCH_OPAQUE("s6"), BENCH_OPAQUE("s7"),
+};
+
+typedef struct bench_schema {
+  const char *name;
+  const kvs_column *columns;
+  size_t num_columns;
+} bench_schema;
+
+static bench_schema schemas[] = {
+  { "narrow", narrow_columns, sizeof(narrow_columns) / sizeof(narrow_columns[0]) },
+  { "wide", wide_columns, sizeof(wide_columns) / sizeof(wide_columns[0]) },
+  { "strings", strings_columns, sizeof(strings_columns) / sizeof(strings_columns[0]) },
+  /* columns of cmdline.c, the only ones with an aot codec, sized in main */
+  { "answers", columns_meta, 0 },
+};
+
+/* sizes of opaque values */
+typedef size_t (*bench_size_generator)(uint64_t *rng);
+
+typedef struct bench_distribution {
+  const char *name;
+  bench_size_generator size;
+} bench_distribution;
+
+/* what rows are encoded from and decoded into */
+typedef enum bench_binding {
+  BENCH_BINDING_RECORD = 0,
+  BENCH_BINDING_STRUCT,
+  BENCH_BINDING_FLAT
+} bench_binding;
+
+typedef struct bench_codec {
+  const char *name;
+  int32_t flags;
+  kvs_schema_tier tier;
+  bench_binding binding;
+  /* jit for KVS_JIT_CPU=generic, the target is fixed per process so these run in a child */
+  int32_t generic_target;
+} bench_codec;
+
+static const bench_codec codecs[] = {
+  { "interpreted", KVS_SCHEMA_FLAG_INTERPRETED, KVS_SCHEMA_TIER_INTERPRETED, BENCH_BINDING_RECORD, 0 },
+  { "prepared", KVS_SCHEMA_FLAG_PREPARED, KVS_SCHEMA_TIER_PREPARED, BENCH_BINDING_RECORD, 0 },
+  { "jit", KVS_SCHEMA_FLAG_JIT, KVS_SCHEMA_TIER_JIT, BENCH_BINDING_RECORD, 0 },
+  { "jit-generic", KVS_SCHEMA_FLAG_JIT, KVS_SCHEMA_TIER_JIT, BENCH_BINDING_RECORD, 1 },
+  { "aot", KVS_SCHEMA_FLAG_AOT, KVS_SCHEMA_TIER_AOT, BENCH_BINDING_RECORD, 0 },
+  { "struct", KVS_SCHEMA_FLAG_JIT, KVS_SCHEMA_TIER_JIT, BENCH_BINDING_STRUCT, 0 },
+  { "flat", KVS_SCHEMA_FLAG_JIT, KVS_SCHEMA_TIER_JIT, BENCH_BINDING_FLAT, 0 },
+};
+
+typedef struct bench_options {
+  const char *dir;
+  size_t rows;
+  int32_t repetitions;
+  int32_t warmups;
+  int32_t json;
+} bench_options;
+
+/* encoded rows are kept back to back in data, keys first */
+typedef struct bench_row {
+  size_t offset;
+  size_t key_size;
+  size_t value_size;
+} bench_row;
+
+typedef struct bench_dataset {
+  const bench_schema *schema;
+  const bench_distribution *distribution;
+  kvs_record **records;
+  size_t num_rows;
+  /* random permutation of rows for puts and lookups */
+  size_t *order;
+} bench_dataset;
+
+typedef struct bench_samples {
+  double *ns;
+  size_t size;
+  size_t capacity;
+} bench_samples;
+
+typedef struct bench_context {
+  const bench_options *options;
+  const bench_dataset *dataset;
+  const bench_codec *codec;
   kvs_schema *schema;
+  /* struct or flat binding over schema */
+  kvs_schema_struct *binding;
+  kvs_schema_struct_field *fields;
+  /* per row structs or flat records the binding encodes from */
+  void **objects;
+  /* rows as encoded by the codec, dictionary codes are per schema */
+  bench_row *rows;
+  uint8_t *data;
+  kvs_store *store;
+  char store_path[4096];
+  int32_t stores;
   kvs_record *record;
-  cursor = kvs_store_cursor_open(store);
-  schema = kvs_schema_create(columns_meta, columns_num, flags);
-  record = kvs_schema_record_create(schema);
-  key = kvs_buffer_create(4096);
-  value = kvs_buffer_create(4096);
-  gettimeofday(&start, NULL);
-  while (!KVS_FAILED(kvs_store_cursor_next(cursor, key, value))) {
-    kvs_schema_record_deserialize(schema, key, value, record);
-  }
-  gettimeofday(&end, NULL);
+  void *object;
+  kvs_flat_record *flat_record;
+  kvs_buffer *heap;
+  kvs_buffer *key;
+  kvs_buffer *value;
+} bench_context;
+
+/* one repetition, returns elapsed ns and adds to ops and bytes */
+typedef int64_t (*bench_run)(bench_context *ctx, bench_samples *samples, size_t *ops, size_t *bytes);
+
+typedef struct bench_operation {
+  const char *name;
+  bench_run run;
+} bench_operation;
+
+static int32_t results = 0;
+
+static uint64_t bench_random(uint64_t *rng) {
+  /* xorshift64* */
+  *rng ^= *rng >> 12;
+  *rng ^= *rng << 25;
+  *rng ^= *rng >> 27;
+  return *rng * 2685821657736338717ULL;
+}
+
+static size_t bench_size_small(uint64_t *rng) {
+  return 16;
+}
+
+static size_t bench_size_uniform(uint64_t *rng) {
+  return bench_random(rng) % 513;
+}
+
+/* mostly short values with a tail of large ones */
+static size_t bench_size_skewed(uint64_t *rng) {
+  return bench_random(rng) % 10 == 0 ? 2048 + bench_random(rng) % 4097 : 8 + bench_random(rng) % 57;
+}
+
+static const bench_distribution distributions[] = {
+  { "small", bench_size_small },
+  { "uniform", bench_size_uniform },
+  { "skewed", bench_size_skewed },
+};
+
+static int64_t bench_now(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+static void bench_samples_add(bench_samples *samples, double ns) {
+  if (samples->size == samples->capacity) {
+    samples->capacity = samples->capacity == 0 ? 4096 : samples->capacity * 2;
+    if ((samples->ns = realloc(samples->ns, sizeof(double) * samples->capacity)) == NULL) {
+      kvs_cmdline_fatal("Could not allocate samples");
+    }
+  }
+  samples->ns[samples->size++] = ns;
+}
+
+static int bench_samples_compare(const void *lhs, const void *rhs) {
+  double l = *(const double *) lhs, r = *(const double *) rhs;
+  return l < r ? -1 : l > r;
+}
+
+static double bench_percentile(const bench_samples *samples, double percentile) {
+  size_t idx;
+  if (samples->size == 0) {
+    return 0;
+  }
+  idx = (size_t) (percentile / 100.0 * (samples->size - 1) + 0.5);
+  return samples->ns[idx];
+}
+
+/* a buffer over encoded bytes without copying them, memory holds kvs_buffer_embedded_size(0) bytes */
+static kvs_buffer *bench_wrap(void *memory, const void *data, size_t size) {
+  kvs_buffer *buffer = kvs_buffer_embed_data(memory, (void *) data, size, 4096);
+  kvs_buffer_commit(buffer, size);
+  return buffer;
+}
+
+static void bench_fill(const bench_schema *schema, const bench_distribution *distribution, kvs_schema *kschema, kvs_record *record, size_t row, uint64_t *rng) {
+  char text[8192];
+  size_t idx, size, pos;
+  const kvs_column *column;
+  kvs_variant **variant;
+  for (idx = 0; idx < schema->num_columns; ++idx) {
+    column = &schema->columns[idx];
+    variant = kvs_schema_record_get(kschema, record, column->name);
+    switch (column->type) {
+      case KVS_VARIANT_TYPE_INT32:
+        kvs_variant_reset_int32(*variant, (int32_t) bench_random(rng));
+        break;
+      case KVS_VARIANT_TYPE_INT64:
+        /* even keys leave room for seeks between rows */
+        kvs_variant_reset_int64(*variant, column->pk ? (int64_t) row * 2 : (int64_t) bench_random(rng));
+        break;
+      case KVS_VARIANT_TYPE_FLOAT:
+        kvs_variant_reset_float(*variant, (float) (bench_random(rng) % 1000000) / 7.0f);
+        break;
+      case KVS_VARIANT_TYPE_DOUBLE:
+        kvs_variant_reset_double(*variant, (double) (bench_random(rng) % 1000000000) / 7.0);
+        break;
+      case KVS_VARIANT_TYPE_OPAQUE:
+        if (column->pk) {
+          size = snprintf(text, sizeof(text), "key%012zu", row * 2);
+        } else {
+          size = distribution->size(rng);
+          for (pos = 0; pos < size; ++pos) {
+            text[pos] = 'a' + bench_random(rng) % 26;
+          }
+        }
+        *variant = kvs_variant_reset_opaque(*variant, text, size);
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+static void bench_dataset_create(bench_dataset *dataset, const bench_schema *schema, const bench_distribution *distribution, size_t num_rows) {
+  size_t idx, swap, size;
+  uint64_t rng = 88172645463325252ULL;
+  kvs_schema *kschema = kvs_schema_create(schema->columns, schema->num_columns, 0);
+  memset(dataset, 0, sizeof(bench_dataset));
+  dataset->schema = schema;
+  dataset->distribution = distribution;
+  dataset->num_rows = num_rows;
+  dataset->records = calloc(num_rows, sizeof(kvs_record *));
+  dataset->order = calloc(num_rows, sizeof(size_t));
+  if (kschema == NULL || dataset->records == NULL || dataset->order == NULL) {
+    kvs_cmdline_fatal("Could not allocate dataset");
+  }
+  for (idx = 0; idx < num_rows; ++idx) {
+    dataset->records[idx] = kvs_schema_record_create(kschema);
+    bench_fill(schema, distribution, kschema, dataset->records[idx], idx, &rng);
+    dataset->order[idx] = idx;
+  }
+  for (idx = num_rows; idx > 1; --idx) {
+    swap = bench_random(&rng) % idx;
+    size = dataset->order[idx - 1];
+    dataset->order[idx - 1] = dataset->order[swap];
+    dataset->order[swap] = size;
+  }
+  kvs_schema_destroy(kschema);
+}
+
+static void bench_dataset_destroy(bench_dataset *dataset) {
+  size_t idx;
+  for (idx = 0; idx < dataset->num_rows; ++idx) {
+    kvs_record_destroy(dataset->records[idx]);
+  }
+  free(dataset->records);
+  free(dataset->order);
+}
+
+/* a struct with every column at its natural alignment, opaque columns as pointer and size */
+static size_t bench_struct_layout(const bench_schema *schema, kvs_schema_struct_field *fields) {
+  size_t idx, width, size = 0;
+  for (idx = 0; idx < schema->num_columns; ++idx) {
+    fields[idx].column = schema->columns[idx].name;
+    fields[idx].type = schema->columns[idx].type;
+    width = fields[idx].type == KVS_VARIANT_TYPE_OPAQUE ? sizeof(void *) : kvs_variant_type_size(fields[idx].type);
+    fields[idx].offset = size = (size + width - 1) / width * width;
+    size += width;
+    fields[idx].size_offset = 0;
+    if (fields[idx].type == KVS_VARIANT_TYPE_OPAQUE) {
+      fields[idx].size_offset = size;
+      size += sizeof(size_t);
+    }
+  }
+  return (size + sizeof(uint64_t) - 1) / sizeof(uint64_t) * sizeof(uint64_t);
+}
+
+/* opaque fields point into the dataset record */
+static void bench_struct_fill(bench_context *ctx, kvs_record *record, uint8_t *object) {
+  size_t idx;
+  const kvs_schema_struct_field *field;
+  const kvs_variant *variant;
+  for (idx = 0; idx < ctx->dataset->schema->num_columns; ++idx) {
+    field = &ctx->fields[idx];
+    variant = *kvs_schema_record_get(ctx->schema, record, field->column);
+    switch (field->type) {
+      case KVS_VARIANT_TYPE_INT32:
+        kvs_variant_get_int32(variant, (int32_t *) (object + field->offset));
+        break;
+      case KVS_VARIANT_TYPE_INT64:
+        kvs_variant_get_int64(variant, (int64_t *) (object + field->offset));
+        break;
+      case KVS_VARIANT_TYPE_FLOAT:
+        kvs_variant_get_float(variant, (float *) (object + field->offset));
+        break;
+      case KVS_VARIANT_TYPE_DOUBLE:
+        kvs_variant_get_double(variant, (double *) (object + field->offset));
+        break;
+      case KVS_VARIANT_TYPE_OPAQUE:
+        kvs_variant_get_opaque(variant, (const void **) (object + field->offset), (size_t *) (object + field->size_offset));
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+static void bench_flat_fill(bench_context *ctx, kvs_record *record, kvs_flat_record *flat) {
+  size_t idx, index, size;
+  int32_t i32;
+  int64_t i64;
+  float f;
+  double d;
+  const void *data;
+  const kvs_column *column;
+  const kvs_variant *variant;
+  for (idx = 0; idx < ctx->dataset->schema->num_columns; ++idx) {
+    column = &ctx->dataset->schema->columns[idx];
+    variant = *kvs_schema_record_get(ctx->schema, record, column->name);
+    kvs_schema_flat_column(ctx->binding, column->name, &index);
+    switch (column->type) {
+      case KVS_VARIANT_TYPE_INT32:
+        kvs_variant_get_int32(variant, &i32);
+        kvs_schema_flat_record_set_int32(ctx->binding, flat, index, i32);
+        break;
+      case KVS_VARIANT_TYPE_INT64:
+        kvs_variant_get_int64(variant, &i64);
+        kvs_schema_flat_record_set_int64(ctx->binding, flat, index, i64);
+        break;
+      case KVS_VARIANT_TYPE_FLOAT:
+        kvs_variant_get_float(variant, &f);
+        kvs_schema_flat_record_set_float(ctx->binding, flat, index, f);
+        break;
+      case KVS_VARIANT_TYPE_DOUBLE:
+        kvs_variant_get_double(variant, &d);
+        kvs_schema_flat_record_set_double(ctx->binding, flat, index, d);
+        break;
+      case KVS_VARIANT_TYPE_OPAQUE:
+        kvs_variant_get_opaque(variant, &data, &size);
+        kvs_schema_flat_record_set_opaque(ctx->binding, flat, index, data, size);
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+static void bench_encode(bench_context *ctx, size_t row, kvs_buffer *key, kvs_buffer *value) {
+  switch (ctx->codec->binding) {
+    case BENCH_BINDING_STRUCT:
+      kvs_schema_struct_serialize(ctx->binding, ctx->objects[row], key, value);
+      break;
+    case BENCH_BINDING_FLAT:
+      kvs_schema_flat_record_serialize(ctx->binding, ctx->objects[row], key, value);
+      break;
+    default:
+      kvs_schema_record_serialize(ctx->schema, ctx->dataset->records[row], key, value);
+      break;
+  }
+}
+
+static kvs_status bench_decode(bench_context *ctx, kvs_buffer *key, kvs_buffer *value) {
+  kvs_status st;
+  switch (ctx->codec->binding) {
+    case BENCH_BINDING_STRUCT:
+      st = kvs_schema_struct_deserialize(ctx->binding, key, value, ctx->heap, ctx->object);
+      kvs_buffer_skip(ctx->heap, kvs_buffer_size(ctx->heap));
+      return st;
+    case BENCH_BINDING_FLAT:
+      return kvs_schema_flat_record_deserialize(ctx->binding, key, value, ctx->flat_record);
+    default:
+      return kvs_schema_record_deserialize(ctx->schema, key, value, ctx->record);
+  }
+}
+
+/* bindings and rows encoded by the codec, returns 0 when the codec does not run on its tier */
+static int32_t bench_context_init(bench_context *ctx) {
+  size_t idx, size, object_size, capacity = 0, used = 0;
+  const bench_schema *schema = ctx->dataset->schema;
+  kvs_buffer *key, *value;
+  if ((ctx->schema = kvs_schema_create(schema->columns, schema->num_columns, ctx->codec->flags)) == NULL) {
+    /* e.g. jit in a build without llvm */
+    return 0;
+  }
+  if (ctx->codec->binding == BENCH_BINDING_RECORD) {
+    if (kvs_schema_codec_tier(ctx->schema) != ctx->codec->tier) {
+      return 0;
+    }
+  } else {
+    if ((ctx->fields = calloc(schema->num_columns, sizeof(kvs_schema_struct_field))) == NULL ||
+        (ctx->objects = calloc(ctx->dataset->num_rows, sizeof(void *))) == NULL) {
+      kvs_cmdline_fatal("Could not allocate bindings");
+    }
+    object_size = bench_struct_layout(schema, ctx->fields);
+    ctx->binding = ctx->codec->binding == BENCH_BINDING_STRUCT ? kvs_schema_struct_create(ctx->schema, ctx->fields, schema->num_columns) :
+      kvs_schema_flat_create(ctx->schema);
+    if (ctx->binding == NULL || kvs_schema_struct_tier(ctx->binding) != ctx->codec->tier) {
+      return 0;
+    }
+    for (idx = 0; idx < ctx->dataset->num_rows; ++idx) {
+      if (ctx->codec->binding == BENCH_BINDING_STRUCT) {
+        if ((ctx->objects[idx] = calloc(1, object_size)) == NULL) {
+          kvs_cmdline_fatal("Could not allocate bindings");
+        }
+        bench_struct_fill(ctx, ctx->dataset->records[idx], ctx->objects[idx]);
+      } else {
+        if ((ctx->objects[idx] = kvs_schema_flat_record_create(ctx->binding)) == NULL) {
+          kvs_cmdline_fatal("Could not allocate bindings");
+        }
+        bench_flat_fill(ctx, ctx->dataset->records[idx], ctx->objects[idx]);
+      }
+    }
+    if ((ctx->object = calloc(1, object_size)) == NULL || (ctx->heap = kvs_buffer_create(4096)) == NULL ||
+        (ctx->codec->binding == BENCH_BINDING_FLAT && (ctx->flat_record = kvs_schema_flat_record_create(ctx->binding)) == NULL)) {
+      kvs_cmdline_fatal("Could not allocate bindings");
+    }
+  }
+  if ((ctx->rows = calloc(ctx->dataset->num_rows, sizeof(bench_row))) == NULL) {
+    kvs_cmdline_fatal("Could not allocate dataset");
+  }
+  key = kvs_buffer_create_contiguous(4096);
+  value = kvs_buffer_create_contiguous(4096);
+  for (idx = 0; idx < ctx->dataset->num_rows; ++idx) {
+    bench_encode(ctx, idx, key, value);
+    ctx->rows[idx].offset = used;
+    ctx->rows[idx].key_size = kvs_buffer_size(key);
+    ctx->rows[idx].value_size = kvs_buffer_size(value);
+    size = ctx->rows[idx].key_size + ctx->rows[idx].value_size;
+    if (used + size > capacity) {
+      capacity = (used + size) * 2;
+      if ((ctx->data = realloc(ctx->data, capacity)) == NULL) {
+        kvs_cmdline_fatal("Could not allocate dataset");
+      }
+    }
+    kvs_buffer_read(key, ctx->data + used, ctx->rows[idx].key_size);
+    kvs_buffer_read(value, ctx->data + used + ctx->rows[idx].key_size, ctx->rows[idx].value_size);
+    used += size;
+  }
   kvs_buffer_destroy(key);
   kvs_buffer_destroy(value);
-  kvs_record_destroy(record);
-  kvs_schema_destroy(schema);
+  return 1;
+}
+
+static void bench_context_fini(bench_context *ctx) {
+  size_t idx;
+  if (ctx->objects != NULL) {
+    for (idx = 0; idx < ctx->dataset->num_rows; ++idx) {
+      if (ctx->codec->binding == BENCH_BINDING_FLAT) {
+        kvs_flat_record_destroy(ctx->objects[idx]);
+      } else {
+        free(ctx->objects[idx]);
+      }
+    }
+  }
+  if (ctx->flat_record != NULL) {
+    kvs_flat_record_destroy(ctx->flat_record);
+  }
+  if (ctx->heap != NULL) {
+    kvs_buffer_destroy(ctx->heap);
+  }
+  if (ctx->binding != NULL) {
+    kvs_schema_struct_destroy(ctx->binding);
+  }
+  if (ctx->schema != NULL) {
+    kvs_schema_destroy(ctx->schema);
+  }
+  free(ctx->objects);
+  free(ctx->object);
+  free(ctx->fields);
+  free(ctx->rows);
+  free(ctx->data);
+}
+
+static void bench_store_remove(bench_context *ctx) {
+  char path[4096 + 16];
+  if (ctx->store == NULL) {
+    return;
+  }
+  kvs_store_destroy(ctx->store);
+  ctx->store = NULL;
+  snprintf(path, sizeof(path), "%s/data.mdb", ctx->store_path);
+  unlink(path);
+  snprintf(path, sizeof(path), "%s/lock.mdb", ctx->store_path);
+  unlink(path);
+  rmdir(ctx->store_path);
+}
+
+static int64_t bench_serialize(bench_context *ctx, bench_samples *samples, size_t *ops, size_t *bytes) {
+  size_t idx;
+  int64_t start = bench_now(), group = start, now;
+  for (idx = 0; idx < ctx->dataset->num_rows; ++idx) {
+    bench_encode(ctx, idx, ctx->key, ctx->value);
+    *bytes += kvs_buffer_size(ctx->key) + kvs_buffer_size(ctx->value);
+    kvs_buffer_reset(ctx->key);
+    kvs_buffer_reset(ctx->value);
+    if ((idx + 1) % BENCH_GROUP == 0) {
+      now = bench_now();
+      bench_samples_add(samples, (double) (now - group) / BENCH_GROUP);
+      group = now;
+    }
+  }
+  *ops += ctx->dataset->num_rows;
+  return bench_now() - start;
+}
+
+static int64_t bench_deserialize(bench_context *ctx, bench_samples *samples, size_t *ops, size_t *bytes) {
+  size_t idx;
+  const bench_row *row;
+  uint64_t key_memory[16], value_memory[16];
+  kvs_buffer *key, *value;
+  int64_t start = bench_now(), group = start, now;
+  for (idx = 0; idx < ctx->dataset->num_rows; ++idx) {
+    row = &ctx->rows[idx];
+    key = bench_wrap(key_memory, ctx->data + row->offset, row->key_size);
+    value = bench_wrap(value_memory, ctx->data + row->offset + row->key_size, row->value_size);
+    if (KVS_FAILED(bench_decode(ctx, key, value))) {
+      kvs_cmdline_fatal("Could not deserialize row %zu\n", idx);
+    }
+    *bytes += row->key_size + row->value_size;
+    if ((idx + 1) % BENCH_GROUP == 0) {
+      now = bench_now();
+      bench_samples_add(samples, (double) (now - group) / BENCH_GROUP);
+      group = now;
+    }
+  }
+  *ops += ctx->dataset->num_rows;
+  return bench_now() - start;
+}
+
+/* every repetition loads a fresh store in random key order, the last one stays for the reads. Records are put
+ * through kvs_schema_record_put, struct and flat bindings encode into the buffers first */
+static int64_t bench_put(bench_context *ctx, bench_samples *samples, size_t *ops, size_t *bytes) {
+  kvs_status st;
+  size_t idx, row;
+  int64_t start, elapsed = 0, op;
+  kvs_store_txn *txn = NULL;
+  bench_store_remove(ctx);
+  snprintf(ctx->store_path, sizeof(ctx->store_path), "%s/store-%d", ctx->options->dir, ctx->stores++);
+  if ((ctx->store = kvs_store_open(ctx->store_path, KVS_STORE_FLAG_VOLATILE)) == NULL) {
+    kvs_cmdline_fatal("Could not open kvs store %s\n", ctx->store_path);
+  }
+  for (idx = 0; idx < ctx->dataset->num_rows; ++idx) {
+    row = ctx->dataset->order[idx];
+    start = bench_now();
+    if (txn == NULL && (txn = kvs_store_txn_begin(ctx->store, 0)) == NULL) {
+      kvs_cmdline_fatal("Could not begin transaction\n");
+    }
+    if (ctx->codec->binding == BENCH_BINDING_RECORD) {
+      st = kvs_schema_record_put(ctx->schema, txn, ctx->dataset->records[row], ctx->key, ctx->value);
+    } else {
+      bench_encode(ctx, row, ctx->key, ctx->value);
+      st = kvs_store_txn_put(txn, ctx->key, ctx->value);
+    }
+    if (KVS_FAILED(st)) {
+      kvs_cmdline_fatal("Could not put row %zu\n", row);
+    }
+    /* a commit counts towards the put that triggers it */
+    if ((idx + 1) % BENCH_ROWS_PER_TXN == 0 || idx + 1 == ctx->dataset->num_rows) {
+      if (KVS_FAILED(kvs_store_txn_commit(txn))) {
+        kvs_cmdline_fatal("Could not commit transaction\n");
+      }
+      txn = NULL;
+    }
+    op = bench_now() - start;
+    elapsed += op;
+    bench_samples_add(samples, (double) op);
+    *bytes += ctx->rows[row].key_size + ctx->rows[row].value_size;
+  }
+  *ops += ctx->dataset->num_rows;
+  return elapsed;
+}
+
+static int64_t bench_get(bench_context *ctx, bench_samples *samples, size_t *ops, size_t *bytes) {
+  size_t idx, value_size;
+  const void *value;
+  const bench_row *row;
+  uint64_t key_memory[16], value_memory[16];
+  int64_t start, elapsed = 0, op;
+  kvs_store_cursor *cursor = kvs_store_cursor_open(ctx->store);
+  if (cursor == NULL) {
+    kvs_cmdline_fatal("Could not open cursor\n");
+  }
+  for (idx = 0; idx < ctx->dataset->num_rows; ++idx) {
+    row = &ctx->rows[ctx->dataset->order[idx]];
+    start = bench_now();
+    if (KVS_FAILED(kvs_store_cursor_get_no_copy(cursor, ctx->data + row->offset, row->key_size, &value, &value_size)) ||
+        KVS_FAILED(bench_decode(ctx, bench_wrap(key_memory, ctx->data + row->offset, row->key_size), bench_wrap(value_memory, value, value_size)))) {
+      kvs_cmdline_fatal("Could not get row %zu\n", ctx->dataset->order[idx]);
+    }
+    op = bench_now() - start;
+    elapsed += op;
+    bench_samples_add(samples, (double) op);
+    *bytes += row->key_size + value_size;
+  }
   kvs_store_cursor_close(cursor);
-  return (end.tv_sec * 1000000L + end.tv_usec) - (start.tv_sec * 1000000L + start.tv_usec);
+  *ops += ctx->dataset->num_rows;
+  return elapsed;
+}
+
+/* position at a random row and decode the BENCH_SEEK_ROWS rows following it */
+static int64_t bench_seek(bench_context *ctx, bench_samples *samples, size_t *ops, size_t *bytes) {
+  size_t idx, num, key_size, value_size, seeks = ctx->dataset->num_rows / BENCH_SEEK_ROWS;
+  const void *key, *value;
+  const bench_row *row;
+  uint64_t key_memory[16], value_memory[16];
+  int64_t start, elapsed = 0, op;
+  kvs_store_cursor *cursor = kvs_store_cursor_open(ctx->store);
+  if (cursor == NULL) {
+    kvs_cmdline_fatal("Could not open cursor\n");
+  }
+  for (idx = 0; idx < seeks; ++idx) {
+    row = &ctx->rows[ctx->dataset->order[idx]];
+    start = bench_now();
+    if (KVS_FAILED(kvs_store_cursor_seek_no_copy(cursor, ctx->data + row->offset, row->key_size))) {
+      kvs_cmdline_fatal("Could not seek row %zu\n", ctx->dataset->order[idx]);
+    }
+    for (num = 0; num < BENCH_SEEK_ROWS && !KVS_FAILED(kvs_store_cursor_next_no_copy(cursor, &key, &key_size, &value, &value_size)); ++num) {
+      bench_decode(ctx, bench_wrap(key_memory, key, key_size), bench_wrap(value_memory, value, value_size));
+      *bytes += key_size + value_size;
+    }
+    op = bench_now() - start;
+    elapsed += op;
+    bench_samples_add(samples, (double) op);
+  }
+  kvs_store_cursor_close(cursor);
+  *ops += seeks;
+  return elapsed;
+}
+
+static int64_t bench_scan(bench_context *ctx, bench_samples *samples, size_t *ops, size_t *bytes) {
+  size_t rows = 0, key_size, value_size;
+  const void *key, *value;
+  uint64_t key_memory[16], value_memory[16];
+  int64_t start, group, now;
+  kvs_store_cursor *cursor = kvs_store_cursor_open(ctx->store);
+  if (cursor == NULL) {
+    kvs_cmdline_fatal("Could not open cursor\n");
+  }
+  group = start = bench_now();
+  while (!KVS_FAILED(kvs_store_cursor_next_no_copy(cursor, &key, &key_size, &value, &value_size))) {
+    bench_decode(ctx, bench_wrap(key_memory, key, key_size), bench_wrap(value_memory, value, value_size));
+    *bytes += key_size + value_size;
+    if (++rows % BENCH_GROUP == 0) {
+      now = bench_now();
+      bench_samples_add(samples, (double) (now - group) / BENCH_GROUP);
+      group = now;
+    }
+  }
+  now = bench_now();
+  kvs_store_cursor_close(cursor);
+  *ops += rows;
+  return now - start;
+}
+
+/* put comes first, the reads run against the store it loaded */
+static const bench_operation operations[] = {
+  { "serialize", bench_serialize },
+  { "deserialize", bench_deserialize },
+  { "put", bench_put },
+  { "get", bench_get },
+  { "seek", bench_seek },
+  { "scan", bench_scan },
+};
+
+static void bench_report(bench_context *ctx, const char *operation, bench_samples *samples, size_t ops, size_t bytes, int64_t elapsed,
+    double min_rate, double max_rate) {
+  double seconds = elapsed / 1e9, rate = seconds > 0 ? ops / seconds : 0, throughput = seconds > 0 ? bytes / seconds : 0;
+  qsort(samples->ns, samples->size, sizeof(double), bench_samples_compare);
+  if (ctx->options->json) {
+    printf("%s  {\"schema\": \"%s\", \"distribution\": \"%s\", \"codec\": \"%s\", \"operation\": \"%s\", "
+        "\"rows\": %zu, \"repetitions\": %d, \"ops\": %zu, \"bytes\": %zu, \"seconds\": %.6f, "
+        "\"ops_per_sec\": %.1f, \"ops_per_sec_min\": %.1f, \"ops_per_sec_max\": %.1f, \"bytes_per_sec\": %.1f, "
+        "\"latency_ns\": {\"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f, \"p999\": %.1f, \"max\": %.1f}}",
+        results == 0 ? "" : ",\n", ctx->dataset->schema->name, ctx->dataset->distribution->name, ctx->codec->name, operation,
+        ctx->dataset->num_rows, ctx->options->repetitions, ops, bytes, seconds, rate, min_rate, max_rate, throughput,
+        bench_percentile(samples, 50), bench_percentile(samples, 90), bench_percentile(samples, 99), bench_percentile(samples, 99.9),
+        bench_percentile(samples, 100));
+  } else {
+    printf("%-8s %-8s %-12s %-12s %12.0f %10.1f %10.0f %10.0f %10.0f %10.0f\n", ctx->dataset->schema->name,
+        ctx->dataset->distribution->name, ctx->codec->name, operation, rate, throughput / (1 << 20),
+        bench_percentile(samples, 50), bench_percentile(samples, 90), bench_percentile(samples, 99), bench_percentile(samples, 99.9));
+  }
+  results++;
+  fflush(stdout);
+}
+
+static void bench_operation_run(bench_context *ctx, const bench_operation *operation) {
+  int32_t repetition;
+  size_t ops = 0, bytes = 0, rep_ops, rep_bytes;
+  int64_t elapsed = 0, rep_elapsed;
+  double rate, min_rate = 0, max_rate = 0;
+  bench_samples samples = { NULL, 0, 0 }, discarded = { NULL, 0, 0 };
+  for (repetition = 0; repetition < ctx->options->warmups; ++repetition) {
+    rep_ops = rep_bytes = 0;
+    discarded.size = 0;
+    operation->run(ctx, &discarded, &rep_ops, &rep_bytes);
+  }
+  for (repetition = 0; repetition < ctx->options->repetitions; ++repetition) {
+    rep_ops = rep_bytes = 0;
+    rep_elapsed = operation->run(ctx, &samples, &rep_ops, &rep_bytes);
+    rate = rep_elapsed > 0 ? rep_ops * 1e9 / rep_elapsed : 0;
+    min_rate = repetition == 0 || rate < min_rate ? rate : min_rate;
+    max_rate = rate > max_rate ? rate : max_rate;
+    ops += rep_ops;
+    bytes += rep_bytes;
+    elapsed += rep_elapsed;
+  }
+  bench_report(ctx, operation->name, &samples, ops, bytes, elapsed, min_rate, max_rate);
+  free(samples.ns);
+  free(discarded.ns);
+}
+
+static void bench_codec_run(const bench_options *options, const bench_dataset *dataset, const bench_codec *codec) {
+  size_t idx;
+  bench_context ctx;
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.options = options;
+  ctx.dataset = dataset;
+  ctx.codec = codec;
+  if (!bench_context_init(&ctx)) {
+    if (!options->json) {
+      printf("%-8s %-8s %-12s not available\n", dataset->schema->name, dataset->distribution->name, codec->name);
+      fflush(stdout);
+    }
+    bench_context_fini(&ctx);
+    return;
+  }
+  ctx.record = kvs_schema_record_create(ctx.schema);
+  ctx.key = kvs_buffer_create(4096);
+  ctx.value = kvs_buffer_create(4096);
+  for (idx = 0; idx < sizeof(operations) / sizeof(operations[0]); ++idx) {
+    bench_operation_run(&ctx, &operations[idx]);
+  }
+  bench_store_remove(&ctx);
+  kvs_buffer_destroy(ctx.key);
+  kvs_buffer_destroy(ctx.value);
+  kvs_record_destroy(ctx.record);
+  bench_context_fini(&ctx);
+}
+
+static void bench_suite_run(const bench_options *options, int32_t generic_target) {
+  size_t schema, distribution, codec;
+  bench_dataset dataset;
+  for (schema = 0; schema < sizeof(schemas) / sizeof(schemas[0]); ++schema) {
+    for (distribution = 0; distribution < sizeof(distributions) / sizeof(distributions[0]); ++distribution) {
+      bench_dataset_create(&dataset, &schemas[schema], &distributions[distribution], options->rows);
+      for (codec = 0; codec < sizeof(codecs) / sizeof(codecs[0]); ++codec) {
+        if (codecs[codec].generic_target == generic_target) {
+          bench_codec_run(options, &dataset, &codecs[codec]);
+        }
+      }
+      bench_dataset_destroy(&dataset);
+    }
+  }
+}
+
+/* the jit target is fixed once llvm is initialized, so generic target codecs run first in a child */
+static void bench_generic_target_run(const bench_options *options) {
+  int status;
+  pid_t pid;
+  fflush(stdout);
+  if ((pid = fork()) < 0) {
+    kvs_cmdline_fatal("Could not fork generic target benchmark\n");
+  }
+  if (pid == 0) {
+    setenv("KVS_JIT_CPU", "generic", 1);
+    unsetenv("KVS_JIT_FEATURES");
+    bench_suite_run(options, 1);
+    fflush(stdout);
+    /* tell the parent whether a json separator is due */
+    _exit(results > 0);
+  }
+  if (waitpid(pid, &status, 0) == pid && WIFEXITED(status)) {
+    results += WEXITSTATUS(status);
+  }
+}
+
+static void usage(const char *program) {
+  printf("Usage:\n%s [-j] [-n rows] [-r repetitions] [-w warmups] <scratch dir>\n"
+      "  -j  print results as a json array\n"
+      "  -n  rows per dataset, %d by default\n"
+      "  -r  measured repetitions, %d by default\n"
+      "  -w  discarded warmup runs, %d by default\n",
+      program, BENCH_DEFAULT_ROWS, BENCH_DEFAULT_REPETITIONS, BENCH_DEFAULT_WARMUPS);
 }
 
 int main(int argc, char **argv) {
-  kvs_store *store;
-  if (argc != 2) {
-    printf("Usage:\n%s <path>\n", argv[0]);
+  int opt;
+  bench_options options = { NULL, BENCH_DEFAULT_ROWS, BENCH_DEFAULT_REPETITIONS, BENCH_DEFAULT_WARMUPS, 0 };
+  while ((opt = getopt(argc, argv, "jn:r:w:")) != -1) {
+    switch (opt) {
+      case 'j':
+        options.json = 1;
+        break;
+      case 'n':
+        options.rows = strtoul(optarg, NULL, 10);
+        break;
+      case 'r':
+        options.repetitions = strtol(optarg, NULL, 10);
+        break;
+      case 'w':
+        options.warmups = strtol(optarg, NULL, 10);
+        break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+  if (optind + 1 != argc || options.rows < BENCH_SEEK_ROWS || options.repetitions < 1 || options.warmups < 0) {
+    usage(argv[0]);
     return 1;
   }
-  store = kvs_store_open(argv[1], 0);
-  if (store == NULL) {
-    kvs_cmdline_fatal("Could not open kvs store");
+  options.dir = argv[optind];
+  schemas[sizeof(schemas) / sizeof(schemas[0]) - 1].num_columns = columns_num;
+  mkdir(options.dir, S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH);
+  if (options.json) {
+    printf("[\n");
+  } else {
+    printf("%-8s %-8s %-12s %-12s %12s %10s %10s %10s %10s %10s\n", "schema", "values", "codec", "operation",
+        "ops/s", "MiB/s", "p50 ns", "p90 ns", "p99 ns", "p99.9 ns");
+  }
+  bench_generic_target_run(&options);
+  bench_suite_run(&options, 0);
+  if (options.json) {
+    printf("\n]\n");
   }
-  /* warmup cache first */
-  benchmark(store, KVS_SCHEMA_FLAG_PREPARED);
-  elapsed("interpreted codec", benchmark(store, 0));
-  elapsed("prepared codec", benchmark(store, KVS_SCHEMA_FLAG_PREPARED));
-  elapsed("jit codec", benchmark(store, KVS_SCHEMA_FLAG_JIT));
-  kvs_store_destroy(store);
   return 0;
 }
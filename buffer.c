@@ -1,18 +1,33 @@
 #include "buffer.h"
+#include "checksum.h"
 #include "util.h"
 #include <string.h>
+#include <pthread.h>
 
 #define BUFFER_ALIGN(size, align) (((size) + (align) - 1) & ~((align) - 1))
 #define BUFFER_SIZE(size) BUFFER_ALIGN(size + sizeof(kvs_block_buffer), 8)
 
+/* blocks a buffer keeps for reuse, further ones go to the free list of the thread */
+#define KVS_BUFFER_SPARE_LIMIT (8)
+#define KVS_BUFFER_FREE_LIST_LIMIT (64)
+
 #define kvs_block_buffer_available(BUFFER) ((BUFFER)->capacity - (BUFFER)->size)
 #define kvs_block_buffer_size(BUFFER) ((BUFFER)->size)
 #define kvs_block_buffer_get(BUFFER, OFFSET) ((BUFFER)->buffer + (OFFSET))
 
 typedef enum kvs_block_buffer_flag {
-  KVS_BLOCK_BUFFER_FLAG_ATTACHED = 1 << 0
+  KVS_BLOCK_BUFFER_FLAG_ATTACHED = 1 << 0,
+  /* lives in memory of the embedded buffer, never freed */
+  KVS_BLOCK_BUFFER_FLAG_EMBEDDED = 1 << 1,
+  /* allocated from the arena of the buffer, released by arena reset */
+  KVS_BLOCK_BUFFER_FLAG_ARENA = 1 << 2
 } kvs_block_buffer_flag;
 
+typedef enum kvs_buffer_flag {
+  /* one block grown in place, data never spans blocks */
+  KVS_BUFFER_FLAG_CONTIGUOUS = 1 << 0
+} kvs_buffer_flag;
+
 typedef struct kvs_block_buffer kvs_block_buffer;
 
 struct kvs_block_buffer {
@@ -31,36 +46,118 @@ struct kvs_buffer {
   int32_t num_blocks;
   int32_t block_size;
   int32_t size;
+  int32_t flags;
+  int32_t num_spare;
+  kvs_block_buffer *spare;
+  kvs_arena *arena;
 };
 
+typedef struct kvs_block_free_list {
+  kvs_block_buffer *head;
+  int32_t size;
+  int32_t registered;
+} kvs_block_free_list;
+
+static __thread kvs_block_free_list block_free_list;
+static pthread_key_t block_free_list_key;
+static pthread_once_t block_free_list_once = PTHREAD_ONCE_INIT;
+
+static void kvs_block_free_list_fini(void *opaque) {
+  kvs_block_free_list *list = opaque;
+  kvs_block_buffer *next;
+  while (list->head != NULL) {
+    next = list->head->next;
+    free(list->head);
+    list->head = next;
+  }
+  list->size = 0;
+}
+
+static void kvs_block_free_list_init(void) {
+  pthread_key_create(&block_free_list_key, kvs_block_free_list_fini);
+}
+
+/* first fit, a block much larger than required stays for a request it suits better */
+static kvs_block_buffer *kvs_block_buffer_take(kvs_block_buffer **list, int32_t *size, int32_t required) {
+  kvs_block_buffer *block, **address;
+  for (address = list; (block = *address) != NULL; address = &block->next) {
+    if (block->capacity >= required && block->capacity / 4 <= required) {
+      *address = block->next;
+      (*size)--;
+      block->next = NULL;
+      block->offset = 0;
+      block->size = 0;
+      return block;
+    }
+  }
+  return NULL;
+}
+
 static void *kvs_block_buffer_allocate(kvs_block_buffer *buffer, size_t size) {
   void *result = buffer->buffer + buffer->size;
   buffer->size += size;
   return result;
 }
 
+static void kvs_block_buffer_release(kvs_block_buffer *buffer) {
+  if ((buffer->flags & (KVS_BLOCK_BUFFER_FLAG_EMBEDDED | KVS_BLOCK_BUFFER_FLAG_ARENA)) != 0) {
+    return;
+  }
+  if ((buffer->flags & KVS_BLOCK_BUFFER_FLAG_ATTACHED) == KVS_BLOCK_BUFFER_FLAG_ATTACHED || block_free_list.size >= KVS_BUFFER_FREE_LIST_LIMIT) {
+    if ((buffer->flags & KVS_BLOCK_BUFFER_FLAG_ATTACHED) == KVS_BLOCK_BUFFER_FLAG_ATTACHED) {
+      free(buffer->buffer);
+    }
+    free(buffer);
+    return;
+  }
+  if (!block_free_list.registered) {
+    /* hand the list to a key destructor so blocks cached by a thread are freed when it exits */
+    pthread_once(&block_free_list_once, kvs_block_free_list_init);
+    pthread_setspecific(block_free_list_key, &block_free_list);
+    block_free_list.registered = 1;
+  }
+  buffer->next = block_free_list.head;
+  block_free_list.head = buffer;
+  block_free_list.size++;
+}
+
 static void kvs_block_buffer_destroy(kvs_block_buffer **buffer_address, int32_t limit) {
   kvs_block_buffer *next;
   kvs_block_buffer *buffer = *buffer_address;
   while (buffer && limit > 0) {
     next = buffer->next;
-    if ((buffer->flags & KVS_BLOCK_BUFFER_FLAG_ATTACHED) == KVS_BLOCK_BUFFER_FLAG_ATTACHED) {
-      free(buffer->buffer);
-    }
-    free(buffer);
+    kvs_block_buffer_release(buffer);
     buffer = next;
     --limit;
   }
   *buffer_address = buffer;
 }
 
-static kvs_block_buffer *kvs_block_buffer_create(int32_t size)
+/* keep a drained block for the next allocation of buffer */
+static void kvs_buffer_spare(kvs_buffer *buffer, kvs_block_buffer *block) {
+  if (buffer->num_spare >= KVS_BUFFER_SPARE_LIMIT) {
+    kvs_block_buffer_release(block);
+    return;
+  }
+  block->next = buffer->spare;
+  buffer->spare = block;
+  buffer->num_spare++;
+}
+
+static kvs_block_buffer *kvs_block_buffer_create(int32_t size, kvs_arena *arena)
 {
   int32_t allocation_size = BUFFER_SIZE(size);
   int32_t capacity = allocation_size - sizeof(kvs_block_buffer);
-  kvs_block_buffer *new_buffer = malloc(allocation_size);
+  kvs_block_buffer *new_buffer;
+  if (arena == NULL && (new_buffer = kvs_block_buffer_take(&block_free_list.head, &block_free_list.size, capacity)) != NULL) {
+    return new_buffer;
+  }
+  if ((new_buffer = arena != NULL ? kvs_arena_allocate(arena, allocation_size) : malloc(allocation_size)) == NULL) {
+    return NULL;
+  }
   memset(new_buffer, 0, KVS_OFFSET_OF(kvs_block_buffer, buffer));
   new_buffer->capacity = capacity;
+  new_buffer->flags = arena != NULL ? KVS_BLOCK_BUFFER_FLAG_ARENA : 0;
   new_buffer->buffer = KVS_UNSAFE_CAST(new_buffer, sizeof(kvs_block_buffer));
   return new_buffer;
 }
@@ -76,20 +173,53 @@ static void kvs_block_buffer_chain(kvs_block_buffer **head, kvs_block_buffer **c
   *next_address = &next->next;
 }
 
-static kvs_block_buffer *kvs_block_buffer_check(kvs_block_buffer **head, kvs_block_buffer **current,
-    kvs_block_buffer ***next_address, int32_t *num_buffers, size_t required, int32_t chunk_size) {
-  kvs_block_buffer *current_buffer = *current;
+/* the block keeps its contents and stays in place when growing it fails */
+static kvs_status kvs_buffer_grow(kvs_buffer *buffer, size_t required) {
+  kvs_block_buffer *block = buffer->head, *grown;
+  int32_t used = block->size - block->offset;
+  int32_t capacity = block->capacity * 2;
+  if (capacity < used + (int32_t) required) {
+    capacity = used + (int32_t) required;
+  }
+  if (block->offset > 0) {
+    memmove(block->buffer, block->buffer + block->offset, used);
+    block->offset = 0;
+    block->size = used;
+  }
+  if (kvs_block_buffer_available(block) >= (int32_t) required) {
+    return KVS_OK;
+  }
+  KVS_CHECK_OOM(grown = realloc(block, BUFFER_SIZE(capacity)));
+  grown->capacity = BUFFER_SIZE(capacity) - sizeof(kvs_block_buffer);
+  grown->buffer = KVS_UNSAFE_CAST(grown, sizeof(kvs_block_buffer));
+  buffer->head = buffer->current = grown;
+  buffer->next = &grown->next;
+  return KVS_OK;
+}
+
+static kvs_block_buffer *kvs_buffer_check(kvs_buffer *buffer, size_t required) {
+  kvs_block_buffer *current_buffer = buffer->current;
   if (!current_buffer || kvs_block_buffer_available(current_buffer) < (int32_t)(required)) {
-    if ((int32_t) required < chunk_size) {
-      required = chunk_size;
+    if (current_buffer != NULL && (buffer->flags & KVS_BUFFER_FLAG_CONTIGUOUS) == KVS_BUFFER_FLAG_CONTIGUOUS) {
+      return KVS_FAILED(kvs_buffer_grow(buffer, required)) ? NULL : buffer->current;
+    }
+    if ((int32_t) required < buffer->block_size) {
+      required = buffer->block_size;
     }
-    kvs_block_buffer_chain(head, current, next_address, num_buffers, current_buffer = kvs_block_buffer_create(required));
+    if ((current_buffer = kvs_block_buffer_take(&buffer->spare, &buffer->num_spare, required)) == NULL &&
+        (current_buffer = kvs_block_buffer_create(required, buffer->arena)) == NULL) {
+      return NULL;
+    }
+    kvs_block_buffer_chain(&buffer->head, &buffer->current, &buffer->next, &buffer->num_blocks, current_buffer);
   }
   return current_buffer;
 }
 
 void *kvs_buffer_allocate(kvs_buffer *buffer, size_t size) {
-  kvs_block_buffer *block = kvs_block_buffer_check(&buffer->head, &buffer->current, &buffer->next, &buffer->num_blocks, size, buffer->block_size);
+  kvs_block_buffer *block = kvs_buffer_check(buffer, size);
+  if (block == NULL) {
+    return NULL;
+  }
   buffer->size += size;
   return kvs_block_buffer_allocate(block, size);
 }
@@ -100,33 +230,35 @@ void kvs_buffer_write(kvs_buffer *buffer, const void *data, size_t size) {
 
 size_t kvs_buffer_read(kvs_buffer *buffer, void *dest, size_t size) {
   char *cdest = dest;
-  int32_t left = size, read = size;
+  int32_t left = size, read;
   kvs_block_buffer *block;
-  while (left > 0 && (block = buffer->head) != NULL && read > 0) {
-    read = (left > block->size - block->offset) ? block->size : left;
+  while (left > 0 && (block = buffer->head) != NULL) {
+    read = (left > block->size - block->offset) ? block->size - block->offset : left;
     if (cdest != NULL) {
-      memcpy(cdest, block->buffer + block->offset, read);
+      memcpy(cdest + (size - left), block->buffer + block->offset, read);
     }
     block->offset += read;
+    buffer->size -= read;
+    left -= read;
     if (block->offset == block->size) {
       if (buffer->num_blocks > 1) {
-        kvs_block_buffer_destroy(&buffer->head, 1);
+        buffer->head = block->next;
         buffer->num_blocks--;
+        kvs_buffer_spare(buffer, block);
       } else {
         buffer->head->offset = 0;
         buffer->head->size = 0;
+        break;
       }
     }
-    buffer->size -= read;
-    left -= read;
   }
   return size - left;
 }
 
 
 void *kvs_buffer_reserve(kvs_buffer *buffer, size_t size) {
-  kvs_block_buffer *block = kvs_block_buffer_check(&buffer->head, &buffer->current, &buffer->next, &buffer->num_blocks, size, buffer->block_size);
-  return block->buffer + block->size;
+  kvs_block_buffer *block = kvs_buffer_check(buffer, size);
+  return block != NULL ? block->buffer + block->size : NULL;
 }
 
 void kvs_buffer_commit(kvs_buffer *buffer, size_t size) {
@@ -136,14 +268,96 @@ void kvs_buffer_commit(kvs_buffer *buffer, size_t size) {
 
 kvs_buffer *kvs_buffer_create(int32_t block_size) {
   kvs_buffer *buffer = calloc(1, sizeof(kvs_buffer));
+  if (buffer == NULL) {
+    return NULL;
+  }
   buffer->next = &buffer->current;
   buffer->block_size = block_size;
   return buffer;
 }
 
+kvs_buffer *kvs_buffer_create_with_arena(int32_t block_size, kvs_arena *arena) {
+  kvs_buffer *buffer = kvs_arena_allocate(arena, sizeof(kvs_buffer));
+  if (buffer == NULL) {
+    return NULL;
+  }
+  memset(buffer, 0, sizeof(kvs_buffer));
+  buffer->next = &buffer->current;
+  buffer->block_size = block_size;
+  buffer->arena = arena;
+  return buffer;
+}
+
+kvs_buffer *kvs_buffer_create_contiguous(int32_t capacity) {
+  kvs_buffer *buffer = kvs_buffer_create(capacity);
+  kvs_block_buffer *block;
+  if (buffer == NULL) {
+    return NULL;
+  }
+  if ((block = kvs_block_buffer_create(capacity, NULL)) == NULL) {
+    free(buffer);
+    return NULL;
+  }
+  buffer->flags = KVS_BUFFER_FLAG_CONTIGUOUS;
+  kvs_block_buffer_chain(&buffer->head, &buffer->current, &buffer->next, &buffer->num_blocks, block);
+  return buffer;
+}
+
+void kvs_buffer_reset(kvs_buffer *buffer) {
+  kvs_block_buffer *block, *next;
+  if (buffer->head == NULL) {
+    return;
+  }
+  for (block = buffer->head->next; block != NULL; block = next) {
+    next = block->next;
+    kvs_buffer_spare(buffer, block);
+  }
+  block = buffer->head;
+  block->next = NULL;
+  block->offset = 0;
+  block->size = 0;
+  buffer->current = block;
+  buffer->next = &block->next;
+  buffer->num_blocks = 1;
+  buffer->size = 0;
+}
+
 void kvs_buffer_destroy(kvs_buffer *buffer) {
   kvs_block_buffer_destroy(&buffer->head, 0x7FFFFFFF);
-  free(buffer);
+  kvs_block_buffer_destroy(&buffer->spare, 0x7FFFFFFF);
+  if (buffer->arena == NULL) {
+    free(buffer);
+  }
+}
+
+size_t kvs_buffer_embedded_size(int32_t capacity) {
+  return BUFFER_ALIGN(sizeof(kvs_buffer), 8) + BUFFER_SIZE(capacity);
+}
+
+kvs_buffer *kvs_buffer_embed(void *memory, int32_t capacity, int32_t block_size) {
+  kvs_buffer *buffer = memory;
+  kvs_block_buffer *block = KVS_UNSAFE_CAST(buffer, BUFFER_ALIGN(sizeof(kvs_buffer), 8));
+  memset(buffer, 0, sizeof(kvs_buffer));
+  memset(block, 0, KVS_OFFSET_OF(kvs_block_buffer, buffer));
+  block->capacity = BUFFER_SIZE(capacity) - sizeof(kvs_block_buffer);
+  block->flags = KVS_BLOCK_BUFFER_FLAG_EMBEDDED;
+  block->buffer = KVS_UNSAFE_CAST(block, sizeof(kvs_block_buffer));
+  buffer->next = &buffer->current;
+  buffer->block_size = block_size;
+  kvs_block_buffer_chain(&buffer->head, &buffer->current, &buffer->next, &buffer->num_blocks, block);
+  return buffer;
+}
+
+kvs_buffer *kvs_buffer_embed_data(void *memory, void *data, int32_t capacity, int32_t block_size) {
+  kvs_buffer *buffer = kvs_buffer_embed(memory, 0, block_size);
+  buffer->head->capacity = capacity;
+  buffer->head->buffer = data;
+  return buffer;
+}
+
+void kvs_buffer_fini(kvs_buffer *buffer) {
+  kvs_block_buffer_destroy(&buffer->head, 0x7FFFFFFF);
+  kvs_block_buffer_destroy(&buffer->spare, 0x7FFFFFFF);
 }
 
 size_t kvs_buffer_size(kvs_buffer *buffer) {
@@ -162,3 +376,54 @@ const void *kvs_buffer_peek(kvs_buffer *buffer, size_t size) {
     return NULL;
   }
 }
+
+size_t kvs_buffer_copy(const kvs_buffer *buffer, size_t offset, void *dest, size_t size) {
+  char *cdest = dest;
+  size_t available, copied = 0;
+  const kvs_block_buffer *block;
+  for (block = buffer->head; block != NULL && copied < size; block = block->next) {
+    available = block->size - block->offset;
+    if (offset >= available) {
+      offset -= available;
+      continue;
+    }
+    available -= offset;
+    if (available > size - copied) {
+      available = size - copied;
+    }
+    memcpy(cdest + copied, block->buffer + block->offset + offset, available);
+    copied += available;
+    offset = 0;
+  }
+  return copied;
+}
+
+uint32_t kvs_buffer_crc32c(const kvs_buffer *buffer, size_t size, uint32_t crc) {
+  size_t available;
+  const kvs_block_buffer *block;
+  for (block = buffer->head; block != NULL && size > 0; block = block->next) {
+    available = block->size - block->offset;
+    if (available > size) {
+      available = size;
+    }
+    crc = kvs_crc32c(crc, block->buffer + block->offset, available);
+    size -= available;
+  }
+  return crc;
+}
+
+size_t kvs_buffer_iovec(const kvs_buffer *buffer, struct iovec *iov, size_t max_iov) {
+  size_t count = 0;
+  const kvs_block_buffer *block;
+  for (block = buffer->head; block != NULL; block = block->next) {
+    if (block->size == block->offset) {
+      continue;
+    }
+    if (count < max_iov) {
+      iov[count].iov_base = block->buffer + block->offset;
+      iov[count].iov_len = block->size - block->offset;
+    }
+    ++count;
+  }
+  return count;
+}
@@ -3,21 +3,48 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <sys/uio.h>
+#include "arena.h"
 
 /**
  * LIMITATION: total size of chained buffer can not exceed 2GB
  **/
 typedef struct kvs_buffer kvs_buffer;
 
+/* allocate and reserve return NULL when no block can be added, the buffer is left as it was */
 void *kvs_buffer_allocate(kvs_buffer *buffer, size_t size);
 void kvs_buffer_write(kvs_buffer *buffer, const void *data, size_t size);
 void *kvs_buffer_reserve(kvs_buffer *buffer, size_t size);
 void kvs_buffer_commit(kvs_buffer *buffer, size_t size);
 kvs_buffer *kvs_buffer_create(int32_t block_size);
+/**
+ * A buffer of one block that grows in place, so its content is always contiguous for
+ * peek. Growing moves the data, pointers from allocate and reserve only stay valid until
+ * the next allocation; never use one as heap of decoded opaque values.
+ **/
+kvs_buffer *kvs_buffer_create_contiguous(int32_t capacity);
+/* drop the content, blocks are kept for the next writes */
+void kvs_buffer_reset(kvs_buffer *buffer);
+/* buffer and blocks come from arena and must not outlive its next reset, destroy is optional */
+kvs_buffer *kvs_buffer_create_with_arena(int32_t block_size, kvs_arena *arena);
 void kvs_buffer_destroy(kvs_buffer *buffer);
+/**
+ * Place a buffer and its first block of capacity bytes into caller owned memory of
+ * kvs_buffer_embedded_size(capacity) bytes, aligned to 8. Further blocks are heap
+ * allocated as usual, kvs_buffer_fini releases them without touching memory.
+ **/
+size_t kvs_buffer_embedded_size(int32_t capacity);
+kvs_buffer *kvs_buffer_embed(void *memory, int32_t capacity, int32_t block_size);
+/* like kvs_buffer_embed in kvs_buffer_embedded_size(0) bytes of memory, with the first block over capacity bytes of data */
+kvs_buffer *kvs_buffer_embed_data(void *memory, void *data, int32_t capacity, int32_t block_size);
+void kvs_buffer_fini(kvs_buffer *buffer);
 size_t kvs_buffer_size(kvs_buffer *buffer);
 size_t kvs_buffer_read(kvs_buffer *buffer, void *dest, size_t size);
 size_t kvs_buffer_skip(kvs_buffer *buffer, size_t size);
 const void *kvs_buffer_peek(kvs_buffer *buffer, size_t size);
+size_t kvs_buffer_copy(const kvs_buffer *buffer, size_t offset, void *dest, size_t size);
+uint32_t kvs_buffer_crc32c(const kvs_buffer *buffer, size_t size, uint32_t crc);
+/* describe the unread content in at most max_iov segments, returns the number of segments it takes */
+size_t kvs_buffer_iovec(const kvs_buffer *buffer, struct iovec *iov, size_t max_iov);
 
 #endif /* __KVS_BUFFER_H__ */
@@ -0,0 +1,61 @@
+#include "checksum.h"
+#include <pthread.h>
+#include <string.h>
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+#define KVS_CRC32C_POLY (0x82F63B78U)
+
+typedef uint32_t (*kvs_crc32c_impl)(uint32_t crc, const uint8_t *data, size_t size);
+
+static pthread_once_t init_crc32c = PTHREAD_ONCE_INIT;
+static uint32_t kvs_crc32c_table[256];
+static kvs_crc32c_impl kvs_crc32c_update = NULL;
+
+static uint32_t kvs_crc32c_software(uint32_t crc, const uint8_t *data, size_t size) {
+  while (size-- > 0) {
+    crc = kvs_crc32c_table[(crc ^ *(data++)) & 0xFF] ^ (crc >> 8);
+  }
+  return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+static uint32_t kvs_crc32c_sse42(uint32_t crc, const uint8_t *data, size_t size) {
+  uint64_t crc64 = crc, u64;
+  while (size >= sizeof(uint64_t)) {
+    memcpy(&u64, data, sizeof(u64));
+    crc64 = _mm_crc32_u64(crc64, u64);
+    data += sizeof(u64);
+    size -= sizeof(u64);
+  }
+  crc = (uint32_t) crc64;
+  while (size-- > 0) {
+    crc = _mm_crc32_u8(crc, *(data++));
+  }
+  return crc;
+}
+#endif
+
+static void kvs_crc32c_init_once(void) {
+  uint32_t idx, bit, crc;
+  for (idx = 0; idx < 256; ++idx) {
+    crc = idx;
+    for (bit = 0; bit < 8; ++bit) {
+      crc = (crc & 1) ? (crc >> 1) ^ KVS_CRC32C_POLY : (crc >> 1);
+    }
+    kvs_crc32c_table[idx] = crc;
+  }
+  kvs_crc32c_update = kvs_crc32c_software;
+#if defined(__x86_64__)
+  if (__builtin_cpu_supports("sse4.2")) {
+    kvs_crc32c_update = kvs_crc32c_sse42;
+  }
+#endif
+}
+
+uint32_t kvs_crc32c(uint32_t crc, const void *data, size_t size) {
+  pthread_once(&init_crc32c, kvs_crc32c_init_once);
+  return ~kvs_crc32c_update(~crc, data, size);
+}
@@ -0,0 +1,18 @@
+#ifndef __KVS_CHECKSUM_H__
+#define __KVS_CHECKSUM_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* CRC32C (Castagnoli), pass 0 to start and the previous result to extend */
+uint32_t kvs_crc32c(uint32_t crc, const void *data, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __KVS_CHECKSUM_H__ */
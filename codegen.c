@@ -0,0 +1,245 @@
+#include "kvs.h"
+#include "aot.h"
+#include "cmdline.h"
+#include "util.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define KVS_CODEGEN_MAX_COLUMNS (256)
+#define KVS_CODEGEN_MAX_LINE (1024)
+#define KVS_CODEGEN_DELIMITERS " \t\r\n"
+
+static const char *type_names[] = { "invalid", "int32", "int64", "float", "double", "opaque" };
+static const char *type_macros[] = { NULL, "INT32", "INT64", "FLOAT", "DOUBLE", NULL };
+static const char *type_ctypes[] = { NULL, "int32_t", "int64_t", "float", "double", NULL };
+
+/*
+ * One column per line in the shape of columns_meta: <name> <type> <pk> [dictionary],
+ * blank lines and lines starting with # are skipped.
+ */
+static size_t codegen_parse(const char *path, kvs_column *columns) {
+  char line[KVS_CODEGEN_MAX_LINE], *name, *type, *pk, *flag;
+  size_t num = 0, idx;
+  FILE *input = fopen(path, "r");
+  if (input == NULL) {
+    kvs_cmdline_fatal("Could not open schema '%s'\n", path);
+  }
+  while (fgets(line, sizeof(line), input) != NULL) {
+    if ((name = strtok(line, KVS_CODEGEN_DELIMITERS)) == NULL || *name == '#') {
+      continue;
+    }
+    if (num == KVS_CODEGEN_MAX_COLUMNS) {
+      kvs_cmdline_fatal("Too many columns in schema '%s'\n", path);
+    }
+    type = strtok(NULL, KVS_CODEGEN_DELIMITERS);
+    pk = strtok(NULL, KVS_CODEGEN_DELIMITERS);
+    flag = strtok(NULL, KVS_CODEGEN_DELIMITERS);
+    if (type == NULL || pk == NULL) {
+      kvs_cmdline_fatal("Malformed column '%s'\n", name);
+    }
+    memset(columns + num, 0, sizeof(kvs_column));
+    for (idx = KVS_VARIANT_TYPE_INT32; idx < KVS_ARRAY_SIZE(type_names); ++idx) {
+      if (strcmp(type, type_names[idx]) == 0) {
+        columns[num].type = idx;
+      }
+    }
+    if (columns[num].type == KVS_VARIANT_TYPE_INVALID) {
+      kvs_cmdline_fatal("Unknown type '%s' of column '%s'\n", type, name);
+    }
+    if (flag != NULL) {
+      if (strcmp(flag, "dictionary") != 0) {
+        kvs_cmdline_fatal("Unknown flag '%s' of column '%s'\n", flag, name);
+      }
+      columns[num].flags = KVS_COLUMN_FLAG_DICTIONARY;
+    }
+    columns[num].name = strdup(name);
+    columns[num].pk = strtol(pk, NULL, 10);
+    num++;
+  }
+  fclose(input);
+  return num;
+}
+
+static void codegen_identifier(char *dest, size_t size, const char *path) {
+  const char *base = strrchr(path, '/');
+  size_t idx;
+  base = base == NULL ? path : base + 1;
+  for (idx = 0; idx + 1 < size && base[idx] != '\0' && base[idx] != '.'; ++idx) {
+    dest[idx] = isalnum((unsigned char) base[idx]) ? base[idx] : '_';
+  }
+  dest[idx] = '\0';
+}
+
+static size_t codegen_max_span(const kvs_column **columns, size_t size, size_t max_span) {
+  size_t idx, span = 0;
+  for (idx = 0; idx < size; ++idx) {
+    if (columns[idx]->type == KVS_VARIANT_TYPE_OPAQUE) {
+      span = 0;
+    } else if ((span += kvs_variant_type_size(columns[idx]->type)) > max_span) {
+      max_span = span;
+    }
+  }
+  return max_span;
+}
+
+static void codegen_layout(FILE *out) {
+  fprintf(out, "#ifndef KVS_AOT_FIELDS\n");
+  fprintf(out, "#define KVS_AOT_FIELDS(RECORD) KVS_SCHEMA_AOT_FIELD(kvs_variant **, RECORD, %zu)\n", kvs_record_fields_offset());
+  fprintf(out, "#define KVS_AOT_INT32(VARIANT) KVS_SCHEMA_AOT_FIELD(int32_t, VARIANT, %zu)\n", kvs_variant_int32_offset());
+  fprintf(out, "#define KVS_AOT_INT64(VARIANT) KVS_SCHEMA_AOT_FIELD(int64_t, VARIANT, %zu)\n", kvs_variant_int64_offset());
+  fprintf(out, "#define KVS_AOT_FLOAT(VARIANT) KVS_SCHEMA_AOT_FIELD(float, VARIANT, %zu)\n", kvs_variant_float_offset());
+  fprintf(out, "#define KVS_AOT_DOUBLE(VARIANT) KVS_SCHEMA_AOT_FIELD(double, VARIANT, %zu)\n", kvs_variant_double_offset());
+  fprintf(out, "#define KVS_AOT_OPAQUE_DATA(VARIANT) KVS_SCHEMA_AOT_FIELD(const void *, VARIANT, %zu)\n", kvs_variant_opaque_data_offset());
+  fprintf(out, "#define KVS_AOT_OPAQUE_SIZE(VARIANT) KVS_SCHEMA_AOT_FIELD(int32_t, VARIANT, %zu)\n", kvs_variant_opaque_size_offset());
+  fprintf(out, "#endif\n\n");
+}
+
+/*
+ * Consecutive columns are encoded into one allocation sized up front, dictionary
+ * columns go through the variant api like in the jit codec.
+ */
+static void codegen_encoder(FILE *out, const kvs_column **columns, size_t size, int32_t comparable, const char *buffer, const char *array) {
+  size_t begin = 0, end, idx, fixed;
+  const kvs_column *column;
+  while (begin < size) {
+    if (columns[begin]->dictionary != NULL) {
+      fprintf(out, "  kvs_variant_serialize_dictionary(fields[%zu], %s[%zu]->dictionary, %s);\n", columns[begin]->index, array, begin, buffer);
+      ++begin;
+      continue;
+    }
+    for (end = begin, fixed = 0; end < size && columns[end]->dictionary == NULL; ++end) {
+      fixed += columns[end]->type == KVS_VARIANT_TYPE_OPAQUE ? (comparable ? 0 : sizeof(int32_t)) : kvs_variant_type_size(columns[end]->type);
+    }
+    fprintf(out, "  cursor = kvs_buffer_allocate(%s, %zu", buffer, fixed);
+    for (idx = begin; idx < end; ++idx) {
+      if (columns[idx]->type == KVS_VARIANT_TYPE_OPAQUE) {
+        fprintf(out, comparable ? " + kvs_variant_comparable_opaque_size(KVS_AOT_OPAQUE_SIZE(fields[%zu]))" : " + KVS_AOT_OPAQUE_SIZE(fields[%zu])", columns[idx]->index);
+      }
+    }
+    fprintf(out, ");\n");
+    for (idx = begin; idx < end; ++idx) {
+      column = columns[idx];
+      if (column->type == KVS_VARIANT_TYPE_OPAQUE) {
+        fprintf(out, "  cursor += kvs_%s_opaque(KVS_AOT_OPAQUE_DATA(fields[%zu]), KVS_AOT_OPAQUE_SIZE(fields[%zu]), cursor);\n",
+            comparable ? "variant_encode_comparable" : "schema_aot_encode", column->index, column->index);
+      } else if (comparable) {
+        fprintf(out, "  cursor += kvs_schema_aot_encode_comparable_%s(KVS_AOT_%s(fields[%zu]), cursor);\n",
+            type_names[column->type], type_macros[column->type], column->index);
+      } else {
+        fprintf(out, "  memcpy(cursor, &KVS_AOT_%s(fields[%zu]), sizeof(%s));\n", type_macros[column->type], column->index, type_ctypes[column->type]);
+        fprintf(out, "  cursor += sizeof(%s);\n", type_ctypes[column->type]);
+      }
+    }
+    begin = end;
+  }
+}
+
+/* runs of fixed size columns are decoded from one span of the buffer */
+static void codegen_decoder(FILE *out, const kvs_column **columns, size_t size, int32_t comparable, const char *buffer, const char *array) {
+  size_t begin = 0, end, idx, span, offset;
+  const kvs_column *column;
+  while (begin < size) {
+    column = columns[begin];
+    if (column->type == KVS_VARIANT_TYPE_OPAQUE) {
+      if (column->dictionary != NULL) {
+        fprintf(out, "  fields[%zu] = kvs_variant_deserialize_dictionary(fields[%zu], %s[%zu]->dictionary, %s);\n", column->index, column->index, array, begin, buffer);
+      } else {
+        fprintf(out, "  fields[%zu] = kvs_variant_deserialize%s_opaque(fields[%zu], %s);\n", column->index, comparable ? "_comparable" : "", column->index, buffer);
+      }
+      ++begin;
+      continue;
+    }
+    for (end = begin, span = 0; end < size && columns[end]->type != KVS_VARIANT_TYPE_OPAQUE; ++end) {
+      span += kvs_variant_type_size(columns[end]->type);
+    }
+    fprintf(out, "  data = kvs_schema_aot_fetch(%s, %zu, scratch);\n", buffer, span);
+    for (idx = begin, offset = 0; idx < end; ++idx) {
+      column = columns[idx];
+      if (comparable) {
+        fprintf(out, "  KVS_AOT_%s(fields[%zu]) = kvs_schema_aot_decode_comparable_%s(data + %zu);\n",
+            type_macros[column->type], column->index, type_names[column->type], offset);
+      } else {
+        fprintf(out, "  memcpy(&KVS_AOT_%s(fields[%zu]), data + %zu, sizeof(%s));\n", type_macros[column->type], column->index, offset, type_ctypes[column->type]);
+      }
+      offset += kvs_variant_type_size(column->type);
+    }
+    fprintf(out, "  kvs_schema_aot_release(%s, data, %zu, scratch);\n", buffer, span);
+    begin = end;
+  }
+}
+
+static void codegen_serializer(FILE *out, const char *name, const kvs_column **keys, size_t key_size, const kvs_column **values, size_t value_size) {
+  fprintf(out, "static void kvs_aot_%s_serializer(const kvs_column **keys, size_t key_size, const kvs_column **values, size_t value_size, kvs_record *record, kvs_buffer *key, kvs_buffer *value, void *opaque) {\n", name);
+  fprintf(out, "  kvs_variant **fields = KVS_AOT_FIELDS(record);\n");
+  fprintf(out, "  uint8_t *cursor;\n");
+  fprintf(out, "  if (key != NULL) {\n");
+  codegen_encoder(out, keys, key_size, 1, "key", "keys");
+  fprintf(out, "  }\n");
+  codegen_encoder(out, values, value_size, 0, "value", "values");
+  fprintf(out, "}\n\n");
+}
+
+static void codegen_deserializer(FILE *out, const char *name, const kvs_column **keys, size_t key_size, const kvs_column **values, size_t value_size) {
+  size_t max_span = codegen_max_span(values, value_size, codegen_max_span(keys, key_size, 0));
+  fprintf(out, "static void kvs_aot_%s_deserializer(const kvs_column **keys, size_t key_size, const kvs_column **values, size_t value_size, kvs_buffer *key, kvs_buffer *value, void *opaque, kvs_record *dest) {\n", name);
+  fprintf(out, "  kvs_variant **fields = KVS_AOT_FIELDS(dest);\n");
+  if (max_span != 0) {
+    fprintf(out, "  uint8_t scratch[%zu];\n", max_span);
+    fprintf(out, "  const uint8_t *data;\n");
+  }
+  codegen_decoder(out, keys, key_size, 1, "key", "keys");
+  codegen_decoder(out, values, value_size, 0, "value", "values");
+  fprintf(out, "}\n\n");
+}
+
+static void codegen(FILE *out, const char *name, const char *source, const kvs_schema *schema) {
+  size_t key_size, value_size;
+  const kvs_column **keys = kvs_schema_keys(schema, &key_size), **values = kvs_schema_values(schema, &value_size);
+  fprintf(out, "/* generated by codegen from %s, do not edit */\n", source);
+  fprintf(out, "#include \"aot.h\"\n");
+  fprintf(out, "#include <string.h>\n\n");
+  codegen_layout(out);
+  codegen_serializer(out, name, keys, key_size, values, value_size);
+  codegen_deserializer(out, name, keys, key_size, values, value_size);
+  fprintf(out, "static kvs_schema_aot_codec kvs_aot_%s_codec = {\n", name);
+  fprintf(out, "  0x%016llxULL, \"%s\", kvs_aot_%s_serializer, kvs_aot_%s_deserializer, NULL\n",
+      (unsigned long long) kvs_schema_aot_fingerprint(keys, key_size, values, value_size), name, name, name);
+  fprintf(out, "};\n\n");
+  fprintf(out, "static void kvs_aot_%s_register(void) __attribute__((constructor));\n", name);
+  fprintf(out, "static void kvs_aot_%s_register(void) {\n", name);
+  fprintf(out, "  kvs_schema_aot_register(&kvs_aot_%s_codec);\n", name);
+  fprintf(out, "}\n");
+}
+
+int main(int argc, char **argv) {
+  static kvs_column columns[KVS_CODEGEN_MAX_COLUMNS];
+  char name[64] = "columns";
+  const char *source = "columns_meta";
+  const kvs_column *meta = columns_meta;
+  size_t num = columns_num;
+  kvs_schema *schema;
+  FILE *out;
+  if (argc != 2 && argc != 3) {
+    printf("Usage:\n%s <output> [<schema>]\n", argv[0]);
+    return 1;
+  }
+  if (argc == 3) {
+    num = codegen_parse(source = argv[2], columns);
+    codegen_identifier(name, sizeof(name), argv[2]);
+    meta = columns;
+  }
+  schema = kvs_schema_create(meta, num, KVS_SCHEMA_FLAG_DEFAULT);
+  if (schema == NULL) {
+    kvs_cmdline_fatal("Invalid schema '%s'\n", source);
+  }
+  out = fopen(argv[1], "w");
+  if (out == NULL) {
+    kvs_cmdline_fatal("Could not open output '%s'\n", argv[1]);
+  }
+  codegen(out, name, source, schema);
+  fclose(out);
+  kvs_schema_destroy(schema);
+  return 0;
+}
@@ -0,0 +1,4 @@
+#include "aot.h"
+
+/* codec of columns_meta, generated by codegen at build time */
+#include "columns_aot.inc"
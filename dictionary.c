@@ -0,0 +1,194 @@
+#include "dictionary.h"
+#include "util.h"
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#define KVS_DICTIONARY_INITIAL_SLOTS (64)
+/* chunk k holds KVS_DICTIONARY_FIRST_CHUNK << k entries, enough chunks for every uint32_t code */
+#define KVS_DICTIONARY_FIRST_CHUNK_BITS (4)
+#define KVS_DICTIONARY_FIRST_CHUNK (1 << KVS_DICTIONARY_FIRST_CHUNK_BITS)
+#define KVS_DICTIONARY_CHUNKS (33 - KVS_DICTIONARY_FIRST_CHUNK_BITS)
+#define KVS_DICTIONARY_EMPTY_SLOT (0)
+
+typedef struct kvs_dictionary_entry {
+  uint32_t hash;
+  int32_t size;
+  const uint8_t *data;
+} kvs_dictionary_entry;
+
+/**
+ * Entries sit in chunks that never move, so decode reads them without the lock: an entry is
+ * written before size is published with a release store and decode checks codes against an
+ * acquire load of size. Probing takes the lock as a rehash frees the slots it walks.
+ **/
+struct kvs_dictionary {
+  kvs_dictionary_entry **chunks[KVS_DICTIONARY_CHUNKS];
+  size_t size;
+  /* open addressing table of code + 1, zero marks an empty slot */
+  uint32_t *slots;
+  size_t num_slots;
+  size_t persisted;
+  pthread_mutex_t lock;
+};
+
+static uint32_t kvs_dictionary_hash(const void *data, size_t size) {
+  /* FNV-1a */
+  const uint8_t *cdata = data;
+  uint32_t hash = 2166136261U;
+  size_t idx;
+  for (idx = 0; idx < size; ++idx) {
+    hash ^= cdata[idx];
+    hash *= 16777619U;
+  }
+  return hash;
+}
+
+static int32_t kvs_dictionary_chunk(size_t code) {
+  return 63 - __builtin_clzll((uint64_t) code + KVS_DICTIONARY_FIRST_CHUNK) - KVS_DICTIONARY_FIRST_CHUNK_BITS;
+}
+
+static kvs_dictionary_entry **kvs_dictionary_entry_slot(kvs_dictionary_entry **const *chunks, size_t code) {
+  int32_t chunk = kvs_dictionary_chunk(code);
+  return &chunks[chunk][code + KVS_DICTIONARY_FIRST_CHUNK - ((size_t) KVS_DICTIONARY_FIRST_CHUNK << chunk)];
+}
+
+static const kvs_dictionary_entry *kvs_dictionary_entry_get(const kvs_dictionary *dictionary, size_t code) {
+  return *kvs_dictionary_entry_slot(dictionary->chunks, code);
+}
+
+static size_t kvs_dictionary_probe(const kvs_dictionary *dictionary, const void *data, size_t size, uint32_t hash) {
+  size_t mask = dictionary->num_slots - 1, slot = hash & mask;
+  const kvs_dictionary_entry *entry;
+  uint32_t code;
+  while ((code = dictionary->slots[slot]) != KVS_DICTIONARY_EMPTY_SLOT) {
+    entry = kvs_dictionary_entry_get(dictionary, code - 1);
+    if (entry->hash == hash && entry->size == (int32_t) size && memcmp(entry->data, data, size) == 0) {
+      break;
+    }
+    slot = (slot + 1) & mask;
+  }
+  return slot;
+}
+
+static kvs_status kvs_dictionary_rehash(kvs_dictionary *dictionary, size_t num_slots) {
+  size_t idx, mask = num_slots - 1, slot;
+  uint32_t *slots;
+  KVS_CHECK_OOM(slots = calloc(num_slots, sizeof(uint32_t)));
+  for (idx = 0; idx < dictionary->size; ++idx) {
+    slot = kvs_dictionary_entry_get(dictionary, idx)->hash & mask;
+    while (slots[slot] != KVS_DICTIONARY_EMPTY_SLOT) {
+      slot = (slot + 1) & mask;
+    }
+    slots[slot] = idx + 1;
+  }
+  free(dictionary->slots);
+  dictionary->slots = slots;
+  dictionary->num_slots = num_slots;
+  return KVS_OK;
+}
+
+kvs_dictionary *kvs_dictionary_create(void) {
+  kvs_dictionary *dictionary = calloc(1, sizeof(kvs_dictionary));
+  if (dictionary == NULL) {
+    return NULL;
+  }
+  if (KVS_FAILED(kvs_dictionary_rehash(dictionary, KVS_DICTIONARY_INITIAL_SLOTS))) {
+    free(dictionary);
+    return NULL;
+  }
+  pthread_mutex_init(&dictionary->lock, NULL);
+  return dictionary;
+}
+
+void kvs_dictionary_destroy(kvs_dictionary *dictionary) {
+  size_t idx;
+  if (dictionary == NULL) {
+    return;
+  }
+  for (idx = 0; idx < dictionary->size; ++idx) {
+    free(*kvs_dictionary_entry_slot(dictionary->chunks, idx));
+  }
+  for (idx = 0; idx < KVS_DICTIONARY_CHUNKS; ++idx) {
+    free(dictionary->chunks[idx]);
+  }
+  free(dictionary->slots);
+  pthread_mutex_destroy(&dictionary->lock);
+  free(dictionary);
+}
+
+size_t kvs_dictionary_size(const kvs_dictionary *dictionary) {
+  return __atomic_load_n(&dictionary->size, __ATOMIC_ACQUIRE);
+}
+
+kvs_status kvs_dictionary_lookup(const kvs_dictionary *dictionary, const void *data, size_t size, uint32_t *code) {
+  kvs_status st = KVS_OK;
+  size_t slot;
+  pthread_mutex_t *lock = (pthread_mutex_t *) &dictionary->lock;
+  pthread_mutex_lock(lock);
+  slot = kvs_dictionary_probe(dictionary, data, size, kvs_dictionary_hash(data, size));
+  if (dictionary->slots[slot] == KVS_DICTIONARY_EMPTY_SLOT) {
+    st = KVS_DICTIONARY_NOT_FOUND;
+  } else {
+    *code = dictionary->slots[slot] - 1;
+  }
+  pthread_mutex_unlock(lock);
+  return st;
+}
+
+static kvs_status kvs_dictionary_insert(kvs_dictionary *dictionary, const void *data, size_t size, uint32_t *code) {
+  kvs_status st;
+  kvs_dictionary_entry *entry;
+  int32_t chunk;
+  uint32_t hash = kvs_dictionary_hash(data, size);
+  size_t slot = kvs_dictionary_probe(dictionary, data, size, hash);
+  if (dictionary->slots[slot] != KVS_DICTIONARY_EMPTY_SLOT) {
+    *code = dictionary->slots[slot] - 1;
+    return KVS_OK;
+  }
+  chunk = kvs_dictionary_chunk(dictionary->size);
+  if (dictionary->chunks[chunk] == NULL) {
+    KVS_CHECK_OOM(dictionary->chunks[chunk] = malloc(sizeof(kvs_dictionary_entry *) * ((size_t) KVS_DICTIONARY_FIRST_CHUNK << chunk)));
+  }
+  KVS_CHECK_OOM(entry = malloc(sizeof(kvs_dictionary_entry) + size));
+  entry->hash = hash;
+  entry->size = size;
+  entry->data = KVS_UNSAFE_CAST(entry, sizeof(kvs_dictionary_entry));
+  memcpy((void *) entry->data, data, size);
+  *kvs_dictionary_entry_slot(dictionary->chunks, dictionary->size) = entry;
+  dictionary->slots[slot] = dictionary->size + 1;
+  *code = dictionary->size;
+  __atomic_store_n(&dictionary->size, dictionary->size + 1, __ATOMIC_RELEASE);
+  /* keep the load factor under one half */
+  if (dictionary->size * 2 > dictionary->num_slots) {
+    KVS_DO(st, kvs_dictionary_rehash(dictionary, dictionary->num_slots * 2));
+  }
+  return KVS_OK;
+}
+
+kvs_status kvs_dictionary_encode(kvs_dictionary *dictionary, const void *data, size_t size, uint32_t *code) {
+  kvs_status st;
+  pthread_mutex_lock(&dictionary->lock);
+  st = kvs_dictionary_insert(dictionary, data, size, code);
+  pthread_mutex_unlock(&dictionary->lock);
+  return st;
+}
+
+kvs_status kvs_dictionary_decode(const kvs_dictionary *dictionary, uint32_t code, const void **data, size_t *size) {
+  const kvs_dictionary_entry *entry;
+  if (code >= __atomic_load_n(&dictionary->size, __ATOMIC_ACQUIRE)) {
+    return KVS_DICTIONARY_NOT_FOUND;
+  }
+  entry = kvs_dictionary_entry_get(dictionary, code);
+  *data = entry->data;
+  *size = entry->size;
+  return KVS_OK;
+}
+
+size_t kvs_dictionary_persisted(const kvs_dictionary *dictionary) {
+  return dictionary->persisted;
+}
+
+void kvs_dictionary_mark_persisted(kvs_dictionary *dictionary, size_t persisted) {
+  dictionary->persisted = persisted;
+}
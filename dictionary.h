@@ -0,0 +1,31 @@
+#ifndef __KVS_DICTIONARY_H__
+#define __KVS_DICTIONARY_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "status.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Maps distinct opaque values to dense codes starting from 0. Values are never
+ * removed, so pointers returned by decode stay valid until the dictionary is destroyed.
+ **/
+typedef struct kvs_dictionary kvs_dictionary;
+
+kvs_dictionary *kvs_dictionary_create(void);
+void kvs_dictionary_destroy(kvs_dictionary *dictionary);
+size_t kvs_dictionary_size(const kvs_dictionary *dictionary);
+kvs_status kvs_dictionary_encode(kvs_dictionary *dictionary, const void *data, size_t size, uint32_t *code);
+kvs_status kvs_dictionary_lookup(const kvs_dictionary *dictionary, const void *data, size_t size, uint32_t *code);
+kvs_status kvs_dictionary_decode(const kvs_dictionary *dictionary, uint32_t code, const void **data, size_t *size);
+size_t kvs_dictionary_persisted(const kvs_dictionary *dictionary);
+void kvs_dictionary_mark_persisted(kvs_dictionary *dictionary, size_t persisted);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __KVS_DICTIONARY_H__ */
@@ -2,12 +2,49 @@
 #include "cmdline.h"
 #include <stdio.h>
 #include <math.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <unistd.h>
 
-static void kvs_record_populate(kvs_store_txn *txn, kvs_schema *schema, 
-    kvs_schema_projection *projection, kvs_record *record, int32_t idx) {
+#define KVS_INIT_VERSIONS (10)
+#define KVS_INIT_DEFAULT_CHUNK (10000)
+
+/**
+ * Workers generate and serialize the versions of chunk sized runs of url tokens
+ * into batches, the main thread writes the batches in chunk order, one transaction each.
+ * Tokens are handed out in the byte order of their keys, so an empty store is loaded
+ * with sorted puts that only ever touch the rightmost pages.
+ **/
+typedef enum kvs_init_slot_state {
+  KVS_INIT_SLOT_FREE = 0,
+  KVS_INIT_SLOT_FILLING,
+  KVS_INIT_SLOT_READY
+} kvs_init_slot_state;
+
+typedef struct kvs_init_slot {
+  kvs_batch *batch;
+  kvs_init_slot_state state;
+} kvs_init_slot;
+
+typedef struct kvs_init_loader {
+  const kvs_schema *schema;
+  const kvs_schema_projection *projection;
+  int64_t number;
+  int64_t chunk;
+  pthread_mutex_t lock;
+  pthread_cond_t ready;
+  pthread_cond_t free;
+  /* chunk k goes through slot k % num_slots */
+  kvs_init_slot *slots;
+  size_t num_slots;
+  /* first token of the next chunk to hand out, number once all are */
+  int64_t next_token;
+  size_t next_chunk;
+} kvs_init_loader;
+
+static void kvs_record_populate(const kvs_schema_projection *projection, kvs_record *record, int32_t idx, int32_t ver) {
   char buffer[4096];
-  int32_t ver, size;
-  kvs_buffer *key, *value;
+  int32_t size;
   kvs_variant **url_token = kvs_schema_projection_record_get(projection, record, 0);
   kvs_variant **version = kvs_schema_projection_record_get(projection, record, 1);
   kvs_variant **content = kvs_schema_projection_record_get(projection, record, 2);
@@ -27,62 +64,194 @@ static void kvs_record_populate(kvs_store_txn *txn, kvs_schema *schema,
   kvs_variant **score = kvs_schema_projection_record_get(projection, record, 16);
   kvs_variant **credit = kvs_schema_projection_record_get(projection, record, 17);
   *url_token = kvs_variant_reset_opaque(*url_token, buffer, snprintf(buffer, sizeof(buffer), "url_token_%d", idx));
-  key = kvs_buffer_create(1024);
-  value = kvs_buffer_create(1024);
-  for (ver = 0; ver < 10; ++ver) {
-    kvs_variant_reset_int32(*version, ver);
-    size = snprintf(buffer, sizeof(buffer), "content for (url_token_%d:%d)", idx, ver);
-    *content = kvs_variant_reset_opaque(*content, buffer, size);
-    kvs_variant_reset_int32(*word_len, size);
-    kvs_variant_reset_int64(*member_id, idx + ver + 100);
-    kvs_variant_reset_int64(*question_id, idx + ver + 200);
-    kvs_variant_reset_int32(*is_copyable, idx + ver % 2);
-    kvs_variant_reset_int32(*copyright_status, idx + ver % 2);
-    kvs_variant_reset_int32(*is_delete, idx + ver % 2);
-    kvs_variant_reset_int32(*is_muted, idx + ver % 2);
-    kvs_variant_reset_int32(*is_collapsed, idx + ver % 2);
-    *status_info = kvs_variant_reset_opaque(*status_info, buffer, snprintf(buffer, sizeof(buffer), "status info for (url_token_%d:%d)", idx, ver));
-    kvs_variant_reset_int32(*comment_permission, idx + ver % 8);
-    kvs_variant_reset_int64(*delete_by, idx + ver + 3000);
-    kvs_variant_reset_int64(*created, idx + ver + 100000L),
-    kvs_variant_reset_int64(*last_updated, idx + ver + 200000L);
-    kvs_variant_reset_float(*score, logf(idx + ver + 1));
-    kvs_variant_reset_double(*credit, log(idx + ver + 1) * 2.0);
-    kvs_record_update_checksum(projection, record, 18);
-    kvs_schema_record_serialize(schema, record, key, value);
-    if (KVS_FAILED(kvs_store_txn_put(txn, key, value))) {
+  kvs_variant_reset_int32(*version, ver);
+  size = snprintf(buffer, sizeof(buffer), "content for (url_token_%d:%d)", idx, ver);
+  *content = kvs_variant_reset_opaque(*content, buffer, size);
+  kvs_variant_reset_int32(*word_len, size);
+  kvs_variant_reset_int64(*member_id, idx + ver + 100);
+  kvs_variant_reset_int64(*question_id, idx + ver + 200);
+  kvs_variant_reset_int32(*is_copyable, idx + ver % 2);
+  kvs_variant_reset_int32(*copyright_status, idx + ver % 2);
+  kvs_variant_reset_int32(*is_delete, idx + ver % 2);
+  kvs_variant_reset_int32(*is_muted, idx + ver % 2);
+  kvs_variant_reset_int32(*is_collapsed, idx + ver % 2);
+  *status_info = kvs_variant_reset_opaque(*status_info, buffer, snprintf(buffer, sizeof(buffer), "status info #%d", (idx + ver) % 16));
+  kvs_variant_reset_int32(*comment_permission, idx + ver % 8);
+  kvs_variant_reset_int64(*delete_by, idx + ver + 3000);
+  kvs_variant_reset_int64(*created, idx + ver + 100000L),
+  kvs_variant_reset_int64(*last_updated, idx + ver + 200000L);
+  kvs_variant_reset_float(*score, logf(idx + ver + 1));
+  kvs_variant_reset_double(*credit, log(idx + ver + 1) * 2.0);
+}
+
+/* token after the given one in byte order of "url_token_<token>", number after the last */
+static int64_t kvs_init_next_token(int64_t token, int64_t number) {
+  if (token == 0) {
+    return number > 1 ? 1 : number;
+  }
+  if (token * 10 < number) {
+    return token * 10;
+  }
+  while (token % 10 == 9 || token + 1 >= number) {
+    if ((token /= 10) == 0) {
+      return number;
+    }
+  }
+  return token + 1;
+}
+
+static void *kvs_init_worker(void *arg) {
+  kvs_init_loader *loader = arg;
+  kvs_init_slot *slot;
+  kvs_record *records[KVS_INIT_VERSIONS];
+  int64_t token, idx;
+  int32_t ver;
+  for (ver = 0; ver < KVS_INIT_VERSIONS; ++ver) {
+    records[ver] = kvs_schema_record_create(loader->schema);
+  }
+  for (;;) {
+    pthread_mutex_lock(&loader->lock);
+    while (loader->next_token < loader->number && loader->slots[loader->next_chunk % loader->num_slots].state != KVS_INIT_SLOT_FREE) {
+      pthread_cond_wait(&loader->free, &loader->lock);
+    }
+    if (loader->next_token == loader->number) {
+      pthread_mutex_unlock(&loader->lock);
+      break;
+    }
+    slot = &loader->slots[loader->next_chunk++ % loader->num_slots];
+    slot->state = KVS_INIT_SLOT_FILLING;
+    token = loader->next_token;
+    for (idx = 0; idx < loader->chunk && loader->next_token < loader->number; ++idx) {
+      loader->next_token = kvs_init_next_token(loader->next_token, loader->number);
+    }
+    pthread_mutex_unlock(&loader->lock);
+    kvs_batch_reset(slot->batch);
+    for (; idx > 0; --idx, token = kvs_init_next_token(token, loader->number)) {
+      for (ver = 0; ver < KVS_INIT_VERSIONS; ++ver) {
+        kvs_record_populate(loader->projection, records[ver], (int32_t) token, ver);
+      }
+      if (KVS_FAILED(kvs_schema_record_serialize_batch(loader->schema, records, KVS_INIT_VERSIONS, slot->batch))) {
+        kvs_cmdline_fatal("Failed to serialize data");
+      }
+    }
+    pthread_mutex_lock(&loader->lock);
+    slot->state = KVS_INIT_SLOT_READY;
+    pthread_cond_broadcast(&loader->ready);
+    pthread_mutex_unlock(&loader->lock);
+  }
+  for (ver = 0; ver < KVS_INIT_VERSIONS; ++ver) {
+    kvs_record_destroy(records[ver]);
+  }
+  return NULL;
+}
+
+/* new dictionary values are saved with the first chunk that may refer to them */
+static void kvs_init_write(kvs_init_loader *loader, kvs_store *store) {
+  size_t chunk, num_chunks = (loader->number + loader->chunk - 1) / loader->chunk;
+  kvs_init_slot *slot;
+  kvs_store_txn *txn;
+  for (chunk = 0; chunk < num_chunks; ++chunk) {
+    slot = &loader->slots[chunk % loader->num_slots];
+    pthread_mutex_lock(&loader->lock);
+    while (slot->state != KVS_INIT_SLOT_READY) {
+      pthread_cond_wait(&loader->ready, &loader->lock);
+    }
+    pthread_mutex_unlock(&loader->lock);
+    if ((txn = kvs_store_txn_begin(store, 0)) == NULL) {
+      kvs_cmdline_fatal("Failed to begin transaction");
+    }
+    if (KVS_FAILED(kvs_schema_record_put_batch(loader->schema, txn, slot->batch))) {
       kvs_cmdline_fatal("Failed to put data");
     }
+    if (KVS_FAILED(kvs_store_txn_commit(txn))) {
+      kvs_cmdline_fatal("Failed to commit data");
+    }
+    pthread_mutex_lock(&loader->lock);
+    slot->state = KVS_INIT_SLOT_FREE;
+    pthread_cond_broadcast(&loader->free);
+    pthread_mutex_unlock(&loader->lock);
   }
-  kvs_buffer_destroy(key);
-  kvs_buffer_destroy(value);
+}
+
+static void usage(const char *program) {
+  printf("Usage:\n%s [-t threads] [-c records per transaction] <path> <number of records>\n"
+      "  -t  generating threads, online cpus - 1 by default\n"
+      "  -c  records committed together, each with %d versions, %d by default\n",
+      program, KVS_INIT_VERSIONS, KVS_INIT_DEFAULT_CHUNK);
 }
 
 int main(int argc, char **argv) {
-  int32_t number, idx;
+  int opt;
+  int64_t threads = sysconf(_SC_NPROCESSORS_ONLN) - 1, idx;
+  struct timeval start, end;
+  double seconds;
+  pthread_t *workers;
   kvs_store *store;
-  kvs_store_txn *txn;
   kvs_schema *schema;
   kvs_schema_projection *projection;
-  kvs_record *record;
-  if (argc != 3) {
-    printf("Usage:\n%s <path> <number of records>\n", argv[0]);
+  kvs_init_loader loader = { NULL, NULL, 0, KVS_INIT_DEFAULT_CHUNK, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER };
+  while ((opt = getopt(argc, argv, "t:c:")) != -1) {
+    switch (opt) {
+      case 't':
+        threads = strtol(optarg, NULL, 10);
+        break;
+      case 'c':
+        loader.chunk = strtol(optarg, NULL, 10);
+        break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+  if (optind + 2 != argc || loader.chunk < 1) {
+    usage(argv[0]);
     return 1;
   }
-  number = strtol(argv[2], NULL, 10);
-  store = kvs_store_open(argv[1], 0);
+  threads = threads < 1 ? 1 : threads;
+  loader.number = strtol(argv[optind + 1], NULL, 10);
+  loader.number = loader.number < 0 ? 0 : loader.number;
+  store = kvs_store_open(argv[optind], 0);
   if (store == NULL) {
     kvs_cmdline_fatal("Could not open kvs store");
   }
-  schema = kvs_schema_create(columns_meta, columns_num, KVS_SCHEMA_FLAG_JIT);
+  schema = kvs_schema_create(columns_meta, columns_num, columns_flags | KVS_SCHEMA_FLAG_AOT | KVS_SCHEMA_FLAG_JIT);
+  if (KVS_FAILED(kvs_schema_dictionary_load(schema, store))) {
+    kvs_cmdline_fatal("Could not load schema dictionaries");
+  }
   projection = kvs_schema_projection_create(schema, columns_name, columns_num);
-  record = kvs_schema_record_create(schema);
-  txn = kvs_store_txn_begin(store, 0);
-  for (idx = 0; idx < number; ++idx) {
-    kvs_record_populate(txn, schema, projection, record, idx);
+  loader.schema = schema;
+  loader.projection = projection;
+  /* enough for every worker to fill one while the writer drains another */
+  loader.num_slots = threads * 2;
+  workers = calloc(threads, sizeof(pthread_t));
+  loader.slots = calloc(loader.num_slots, sizeof(kvs_init_slot));
+  if (workers == NULL || loader.slots == NULL) {
+    kvs_cmdline_fatal("Could not allocate loader");
+  }
+  for (idx = 0; idx < (int64_t) loader.num_slots; ++idx) {
+    if ((loader.slots[idx].batch = kvs_batch_create(loader.chunk * KVS_INIT_VERSIONS, 4096)) == NULL) {
+      kvs_cmdline_fatal("Could not allocate loader");
+    }
+  }
+  gettimeofday(&start, NULL);
+  for (idx = 0; idx < threads; ++idx) {
+    if (pthread_create(&workers[idx], NULL, kvs_init_worker, &loader) != 0) {
+      kvs_cmdline_fatal("Could not start worker thread");
+    }
+  }
+  kvs_init_write(&loader, store);
+  for (idx = 0; idx < threads; ++idx) {
+    pthread_join(workers[idx], NULL);
+  }
+  gettimeofday(&end, NULL);
+  seconds = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+  printf("loaded %lld rows in %.2f s, %.0f rows/s\n", (long long) loader.number * KVS_INIT_VERSIONS, seconds,
+      seconds > 0 ? loader.number * KVS_INIT_VERSIONS / seconds : 0);
+  for (idx = 0; idx < (int64_t) loader.num_slots; ++idx) {
+    kvs_batch_destroy(loader.slots[idx].batch);
   }
-  kvs_store_txn_commit(txn);
-  kvs_record_destroy(record);
+  free(loader.slots);
+  free(workers);
   kvs_schema_projection_destroy(projection);
   kvs_schema_destroy(schema);
   kvs_store_destroy(store);
@@ -1,12 +1,16 @@
 #include "schema.h"
 #include "buffer.h"
 #include "record.h"
+#include "util.h"
 #define __KVS_SCHEMA_INTERNAL_H__
 #include "interpret.h"
 #undef __KVS_SCHEMA_INTERNAL_H__
 #include <string.h>
 
-static uint8_t kvs_schema_interpreter_codec = 0;
+#define STRUCT_FIELD(TYPE, OBJECT, OFFSET) (*(TYPE *) KVS_UNSAFE_CAST(OBJECT, OFFSET))
+
+/* never written, only a non NULL opaque shared by every interpreted schema */
+static const uint8_t kvs_schema_interpreter_codec = 0;
 
 static void kvs_schema_interpret_serialize_key(const kvs_column **columns, size_t size, kvs_record *record, kvs_buffer *buffer) {
   size_t idx;
@@ -58,7 +62,13 @@ static void kvs_schema_interpret_serialize_value(const kvs_column **columns, siz
         kvs_variant_serialize_double(variant, buffer);
         break;
       case KVS_VARIANT_TYPE_OPAQUE:
-        kvs_variant_serialize_opaque(variant, buffer);
+        if (column->dictionary != NULL) {
+          kvs_variant_serialize_dictionary(variant, column->dictionary, buffer);
+        } else if (column->vlog != NULL) {
+          kvs_variant_serialize_separated(variant, column->vlog, buffer);
+        } else {
+          kvs_variant_serialize_opaque(variant, buffer);
+        }
         break;
       default:
         break;
@@ -66,8 +76,14 @@ static void kvs_schema_interpret_serialize_value(const kvs_column **columns, siz
   }
 }
 
-void kvs_schema_interpret_serializer(const kvs_column **keys, size_t key_size, const kvs_column **values, size_t value_size, kvs_record *record, kvs_buffer *key, kvs_buffer *value, void *opaque) {
+void kvs_schema_interpret_key_serializer(const kvs_column **keys, size_t key_size, kvs_record *record, kvs_buffer *key) {
   kvs_schema_interpret_serialize_key(keys, key_size, record, key);
+}
+
+void kvs_schema_interpret_serializer(const kvs_column **keys, size_t key_size, const kvs_column **values, size_t value_size, kvs_record *record, kvs_buffer *key, kvs_buffer *value, void *opaque) {
+  if (key != NULL) {
+    kvs_schema_interpret_serialize_key(keys, key_size, record, key);
+  }
   kvs_schema_interpret_serialize_value(values, value_size, record, value);
 }
 
@@ -121,7 +137,13 @@ static void kvs_schema_interpret_deserialize_value(const kvs_column **columns, s
         *variant = kvs_variant_deserialize_double(*variant, buffer);
         break;
       case KVS_VARIANT_TYPE_OPAQUE:
-        *variant = kvs_variant_deserialize_opaque(*variant, buffer);
+        if (column->dictionary != NULL) {
+          *variant = kvs_variant_deserialize_dictionary(*variant, column->dictionary, buffer);
+        } else if (column->vlog != NULL) {
+          *variant = kvs_variant_deserialize_separated(*variant, column->vlog, buffer);
+        } else {
+          *variant = kvs_variant_deserialize_opaque(*variant, buffer);
+        }
         break;
       default:
         break;
@@ -135,8 +157,146 @@ void kvs_schema_interpret_deserializer(const kvs_column **keys, size_t key_size,
 }
 
 void *kvs_schema_interpret_codec_create(const kvs_column **keys, size_t key_size, const kvs_column **values, size_t value_size) {
-  return &kvs_schema_interpreter_codec;
+  return (void *) &kvs_schema_interpreter_codec;
 }
 
 void kvs_schema_interpret_codec_destroy(const kvs_column **keys, size_t key_size, const kvs_column **values, size_t value_size, void *opaque) {
 }
+
+static void kvs_schema_interpret_struct_serialize_key(const kvs_column **columns, size_t size, const kvs_schema_struct_field **fields, const void *object, kvs_buffer *buffer) {
+  size_t idx, nbytes;
+  const kvs_schema_struct_field *field;
+  for (idx = 0; idx < size; ++idx) {
+    field = fields[columns[idx]->index];
+    switch (columns[idx]->type) {
+      case KVS_VARIANT_TYPE_INT32:
+        kvs_variant_encode_comparable_int32(STRUCT_FIELD(int32_t, object, field->offset), kvs_buffer_allocate(buffer, sizeof(int32_t)));
+        break;
+      case KVS_VARIANT_TYPE_INT64:
+        kvs_variant_encode_comparable_int64(STRUCT_FIELD(int64_t, object, field->offset), kvs_buffer_allocate(buffer, sizeof(int64_t)));
+        break;
+      case KVS_VARIANT_TYPE_FLOAT:
+        kvs_variant_encode_comparable_float(STRUCT_FIELD(float, object, field->offset), kvs_buffer_allocate(buffer, sizeof(float)));
+        break;
+      case KVS_VARIANT_TYPE_DOUBLE:
+        kvs_variant_encode_comparable_double(STRUCT_FIELD(double, object, field->offset), kvs_buffer_allocate(buffer, sizeof(double)));
+        break;
+      case KVS_VARIANT_TYPE_OPAQUE:
+        nbytes = STRUCT_FIELD(size_t, object, field->size_offset);
+        kvs_variant_encode_comparable_opaque(STRUCT_FIELD(const void *, object, field->offset), nbytes,
+            kvs_buffer_allocate(buffer, kvs_variant_comparable_opaque_size(nbytes)));
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+static void kvs_schema_interpret_struct_serialize_value(const kvs_column **columns, size_t size, const kvs_schema_struct_field **fields, const void *object, kvs_buffer *buffer) {
+  size_t idx;
+  const kvs_column *column;
+  const kvs_schema_struct_field *field;
+  for (idx = 0; idx < size; ++idx) {
+    column = columns[idx];
+    field = fields[column->index];
+    switch (column->type) {
+      case KVS_VARIANT_TYPE_INT32:
+      case KVS_VARIANT_TYPE_FLOAT:
+        kvs_buffer_write(buffer, KVS_UNSAFE_CAST(object, field->offset), sizeof(int32_t));
+        break;
+      case KVS_VARIANT_TYPE_INT64:
+      case KVS_VARIANT_TYPE_DOUBLE:
+        kvs_buffer_write(buffer, KVS_UNSAFE_CAST(object, field->offset), sizeof(int64_t));
+        break;
+      case KVS_VARIANT_TYPE_OPAQUE:
+        if (column->dictionary != NULL) {
+          kvs_variant_encode_dictionary(STRUCT_FIELD(const void *, object, field->offset), STRUCT_FIELD(size_t, object, field->size_offset),
+              column->dictionary, buffer);
+        } else if (column->vlog != NULL) {
+          kvs_variant_encode_separated(STRUCT_FIELD(const void *, object, field->offset), STRUCT_FIELD(size_t, object, field->size_offset),
+              column->vlog, buffer);
+        } else {
+          kvs_variant_encode_opaque(STRUCT_FIELD(const void *, object, field->offset), STRUCT_FIELD(size_t, object, field->size_offset), buffer);
+        }
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+void kvs_schema_interpret_struct_serializer(const kvs_column **keys, size_t key_size, const kvs_column **values, size_t value_size, const kvs_schema_struct_field **fields, const void *object, kvs_buffer *key, kvs_buffer *value, void *opaque) {
+  kvs_schema_interpret_struct_serialize_key(keys, key_size, fields, object, key);
+  kvs_schema_interpret_struct_serialize_value(values, value_size, fields, object, value);
+}
+
+static void kvs_schema_interpret_struct_deserialize_key(const kvs_column **columns, size_t size, const kvs_schema_struct_field **fields, kvs_buffer *buffer, kvs_buffer *heap, void *object) {
+  size_t idx;
+  const kvs_schema_struct_field *field;
+  for (idx = 0; idx < size; ++idx) {
+    field = fields[columns[idx]->index];
+    switch (columns[idx]->type) {
+      case KVS_VARIANT_TYPE_INT32:
+        STRUCT_FIELD(int32_t, object, field->offset) = kvs_variant_decode_comparable_int32(buffer);
+        break;
+      case KVS_VARIANT_TYPE_INT64:
+        STRUCT_FIELD(int64_t, object, field->offset) = kvs_variant_decode_comparable_int64(buffer);
+        break;
+      case KVS_VARIANT_TYPE_FLOAT:
+        STRUCT_FIELD(float, object, field->offset) = kvs_variant_decode_comparable_float(buffer);
+        break;
+      case KVS_VARIANT_TYPE_DOUBLE:
+        STRUCT_FIELD(double, object, field->offset) = kvs_variant_decode_comparable_double(buffer);
+        break;
+      case KVS_VARIANT_TYPE_OPAQUE:
+        STRUCT_FIELD(const void *, object, field->offset) = kvs_variant_decode_comparable_opaque(buffer, heap, KVS_UNSAFE_CAST(object, field->size_offset));
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+static void kvs_schema_interpret_struct_deserialize_value(const kvs_column **columns, size_t size, const kvs_schema_struct_field **fields, kvs_buffer *buffer, kvs_buffer *heap, void *object) {
+  size_t idx;
+  uint32_t code;
+  const kvs_column *column;
+  const kvs_schema_struct_field *field;
+  for (idx = 0; idx < size; ++idx) {
+    column = columns[idx];
+    field = fields[column->index];
+    switch (column->type) {
+      case KVS_VARIANT_TYPE_INT32:
+      case KVS_VARIANT_TYPE_FLOAT:
+        kvs_buffer_read(buffer, KVS_UNSAFE_CAST(object, field->offset), sizeof(int32_t));
+        break;
+      case KVS_VARIANT_TYPE_INT64:
+      case KVS_VARIANT_TYPE_DOUBLE:
+        kvs_buffer_read(buffer, KVS_UNSAFE_CAST(object, field->offset), sizeof(int64_t));
+        break;
+      case KVS_VARIANT_TYPE_OPAQUE:
+        if (column->dictionary != NULL) {
+          kvs_variant_decode_dictionary(column->dictionary, buffer, &code, KVS_UNSAFE_CAST(object, field->offset), KVS_UNSAFE_CAST(object, field->size_offset));
+        } else if (column->vlog != NULL) {
+          STRUCT_FIELD(const void *, object, field->offset) = kvs_variant_decode_separated(column->vlog, buffer, heap, KVS_UNSAFE_CAST(object, field->size_offset));
+        } else {
+          STRUCT_FIELD(const void *, object, field->offset) = kvs_variant_decode_opaque(buffer, heap, KVS_UNSAFE_CAST(object, field->size_offset));
+        }
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+void kvs_schema_interpret_struct_deserializer(const kvs_column **keys, size_t key_size, const kvs_column **values, size_t value_size, const kvs_schema_struct_field **fields, kvs_buffer *key, kvs_buffer *value, kvs_buffer *heap, void *opaque, void *object) {
+  kvs_schema_interpret_struct_deserialize_key(keys, key_size, fields, key, heap, object);
+  kvs_schema_interpret_struct_deserialize_value(values, value_size, fields, value, heap, object);
+}
+
+void *kvs_schema_interpret_struct_codec_create(const kvs_column **keys, size_t key_size, const kvs_column **values, size_t value_size, const kvs_schema_struct_field **fields) {
+  return (void *) &kvs_schema_interpreter_codec;
+}
+
+void kvs_schema_interpret_struct_codec_destroy(const kvs_column **keys, size_t key_size, const kvs_column **values, size_t value_size, void *opaque) {
+}
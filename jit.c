@@ -1,66 +1,100 @@
 #include "schema.h"
 #include "util.h"
 #define __KVS_SCHEMA_INTERNAL_H__
+#include "interpret.h"
 #include "jit.h"
 #undef __KVS_SCHEMA_INTERNAL_H__
 #include <llvm-c/Analysis.h>
 #include <llvm-c/BitReader.h>
 #include <llvm-c/BitWriter.h>
 #include <llvm-c/Core.h>
-#include <llvm-c/OrcBindings.h>
+#include <llvm-c/Error.h>
+#include <llvm-c/LLJIT.h>
+#include <llvm-c/Object.h>
+#include <llvm-c/Orc.h>
 #include <llvm-c/Support.h>
 #include <llvm-c/Target.h>
+#include <llvm-c/TargetMachine.h>
 #include <llvm-c/Transforms/IPO.h>
 #include <llvm-c/Transforms/PassManagerBuilder.h>
 #include <llvm-c/Transforms/Scalar.h>
+#include <llvm-c/Transforms/Utils.h>
+#include <llvm/Config/llvm-config.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdarg.h>
 #include <pthread.h>
+#include <stdlib.h>
 #include <unistd.h>
+#include <limits.h>
 
 #define KVS_JIT_CHECK_LLVM_ERROR(ERR, X) if ((X) == NULL) { return KVS_SCHEMA_JIT_##ERR; }
 #define KVS_JIT_CHECK_LLVM_ERROR_GOTO(ST, ERR, LABEL, X) if ((X) == NULL) { ST = KVS_SCHEMA_JIT_##ERR ; goto LABEL; }
 #define KVS_JIT_CHECK_NOT_NULL(X) if ((X) == NULL) { return NULL; }
 
+#ifndef PATH_MAX
+#define PATH_MAX (1024)
+#endif
+
+/* bump whenever generated code changes shape, cached objects of older versions are then ignored */
+#define KVS_SCHEMA_JIT_CACHE_VERSION (2)
+
+typedef enum kvs_schema_jit_entry {
+  KVS_SCHEMA_JIT_ENTRY_SERIALIZE = 1 << 0,
+  KVS_SCHEMA_JIT_ENTRY_DESERIALIZE = 1 << 1,
+  KVS_SCHEMA_JIT_ENTRY_ALL = KVS_SCHEMA_JIT_ENTRY_SERIALIZE | KVS_SCHEMA_JIT_ENTRY_DESERIALIZE
+} kvs_schema_jit_entry;
+
 typedef struct llvm_context {
+  /* context and module only live while an entry point is compiled */
+  LLVMContextRef context;
   LLVMModuleRef module;
-  LLVMSharedModuleRef shared_module;
-  LLVMOrcModuleHandle orc;
+  LLVMOrcResourceTrackerRef tracker;
+  int32_t cacheable;
+  int32_t generation;
+  uint64_t fingerprint;
+  uint64_t serialize_size;
+  uint64_t deserialize_size;
 
   LLVMValueRef record_get;
   LLVMValueRef record_get_deref;
-  LLVMValueRef serialize_comparable_int32;
-  LLVMValueRef serialize_comparable_int64;
-  LLVMValueRef serialize_comparable_float;
-  LLVMValueRef serialize_comparable_double;
-  LLVMValueRef serialize_comparable_opaque;
-  LLVMValueRef deserialize_comparable_int32;
-  LLVMValueRef deserialize_comparable_int64;
-  LLVMValueRef deserialize_comparable_float;
-  LLVMValueRef deserialize_comparable_double;
+  LLVMValueRef comparable_opaque_size;
+  LLVMValueRef encode_comparable_opaque;
   LLVMValueRef deserialize_comparable_opaque;
   LLVMValueRef deserialize_opaque;
-  LLVMValueRef buffer_write;
-  LLVMValueRef buffer_read;
-  LLVMValueRef reset_opaque;
+  LLVMValueRef serialize_dictionary;
+  LLVMValueRef deserialize_dictionary;
+  LLVMValueRef buffer_allocate;
+  LLVMValueRef buffer_fetch;
+  LLVMValueRef buffer_release;
+  LLVMValueRef opaque_comparable_size;
+  LLVMValueRef opaque_encode_comparable;
+  LLVMValueRef opaque_serialize_dictionary;
+  LLVMValueRef opaque_deserialize;
+  LLVMValueRef opaque_deserialize_comparable;
+  LLVMValueRef opaque_deserialize_dictionary;
+  LLVMValueRef memcpy;
+  LLVMValueRef bswap32;
+  LLVMValueRef bswap64;
 
   LLVMTypeRef entry_type;
+  LLVMTypeRef struct_deserialize_type;
+  LLVMTypeRef int8_type;
   LLVMTypeRef int32_type;
   LLVMTypeRef int64_type;
+  LLVMTypeRef float_type;
+  LLVMTypeRef double_type;
   LLVMTypeRef void_type;
-  LLVMTypeRef int32_pointer;
+  LLVMTypeRef int8_pointer;
   LLVMTypeRef int64_pointer;
   LLVMValueRef int64_pointer_size;
+  LLVMValueRef sign_mask_int32;
+  LLVMValueRef sign_mask_int64;
 
-  LLVMValueRef variant_int32_size;
   LLVMValueRef variant_int32_offset;
   LLVMValueRef variant_int64_offset;
-  LLVMValueRef variant_int64_size;
   LLVMValueRef variant_float_offset;
-  LLVMValueRef variant_float_size;
   LLVMValueRef variant_double_offset;
-  LLVMValueRef variant_double_size;
   LLVMValueRef variant_opaque_data_offset;
   LLVMValueRef variant_opaque_size_offset;
   LLVMValueRef variant_opaque_size_size;
@@ -74,131 +108,176 @@ typedef struct llvm_context {
 typedef void (*jit_serializer_entry)(const kvs_record *record, kvs_buffer *key, kvs_buffer *value);
 typedef void (*jit_deserializer_entry)(kvs_record *record, const kvs_buffer *key, const kvs_buffer *value);
 
+typedef struct kvs_schema_jit_column {
+  size_t index;
+  kvs_variant_type type;
+  const kvs_dictionary *dictionary;
+} kvs_schema_jit_column;
+
 typedef struct kvs_schema_jit_codec {
   llvm_context llvm;
+  /* entry points are published once compiled, lazy codecs start with none */
   jit_serializer_entry serializer;
   jit_deserializer_entry deserializer;
+  /* serializes compilation of the entry points, codecs compile in parallel */
+  pthread_mutex_t lock;
+  int32_t failed;
+  /* registry of codecs shared by structurally identical schemas */
+  struct kvs_schema_jit_codec *next;
+  int32_t references;
+  size_t key_size;
+  size_t value_size;
+  kvs_schema_jit_column *columns;
 } kvs_schema_jit_codec;
 
+typedef void (*jit_struct_serializer_entry)(const void *object, kvs_buffer *key, kvs_buffer *value);
+typedef void (*jit_struct_deserializer_entry)(void *object, kvs_buffer *key, kvs_buffer *value, kvs_buffer *heap);
+
+typedef struct kvs_schema_jit_struct_codec {
+  llvm_context llvm;
+  jit_struct_serializer_entry serializer;
+  jit_struct_deserializer_entry deserializer;
+} kvs_schema_jit_struct_codec;
+
+static const unsigned char llvm_runtime_bitcode[] __attribute__((aligned(16))) = {
+#include "jitrt.bc.inc"
+};
+
 static pthread_once_t init_llvm = PTHREAD_ONCE_INIT;
-static LLVMTargetMachineRef llvm_target_machine = NULL;
-static LLVMOrcJITStackRef llvm_orc = NULL;
+static LLVMTargetRef llvm_target = NULL;
+static char *llvm_triple = NULL;
+static char *llvm_cpu = NULL;
+static char *llvm_features = NULL;
+static LLVMOrcLLJITRef llvm_jit = NULL;
+static pthread_mutex_t codec_registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static kvs_schema_jit_codec *codec_registry = NULL;
+/* struct codecs are neither shared nor cached, each one takes a generation of its own */
+static int32_t struct_codec_generation = 0;
+/* codecs compile in parallel, keep their perf map lines whole */
+static pthread_mutex_t perf_map_lock = PTHREAD_MUTEX_INITIALIZER;
 
 static void kvs_fini_llvm_once(void) {
-  if (llvm_orc != NULL) {
-    LLVMOrcDisposeInstance(llvm_orc);
-  }
-  if (llvm_target_machine != NULL) {
-    LLVMDisposeTargetMachine(llvm_target_machine);
+  if (llvm_jit != NULL) {
+    LLVMConsumeError(LLVMOrcDisposeLLJIT(llvm_jit));
   }
+  LLVMDisposeMessage(llvm_features);
+  LLVMDisposeMessage(llvm_cpu);
+  LLVMDisposeMessage(llvm_triple);
   LLVMShutdown();
 }
 
+/* target machines are not thread safe, so every compilation creates its own */
+static LLVMTargetMachineRef kvs_schema_jit_target_machine(void) {
+  return LLVMCreateTargetMachine(llvm_target, llvm_triple, llvm_cpu, llvm_features,
+      LLVMCodeGenLevelAggressive, LLVMRelocDefault, LLVMCodeModelJITDefault);
+}
+
 static void kvs_init_llvm_once(void) {
-  char     *error = NULL;
+  char *error = NULL;
+  LLVMTargetMachineRef target_machine;
+  LLVMOrcLLJITBuilderRef builder;
+  LLVMOrcDefinitionGeneratorRef generator;
   LLVMInitializeNativeTarget();
   LLVMInitializeNativeAsmPrinter();
   LLVMInitializeNativeAsmParser();
-  char *llvm_triple = LLVMGetDefaultTargetTriple();
-  LLVMTargetRef llvm_target = NULL;
-  LLVMGetTargetFromTriple(llvm_triple, &llvm_target, &error);
-  llvm_target_machine = LLVMCreateTargetMachine(llvm_target, llvm_triple, "", "",
-      LLVMCodeGenLevelAggressive, LLVMRelocDefault, LLVMCodeModelJITDefault);
-  LLVMDisposeMessage(llvm_triple);
-  LLVMLoadLibraryPermanently(NULL);
-  llvm_orc = LLVMOrcCreateInstance(llvm_target_machine);
   atexit(kvs_fini_llvm_once);
+  llvm_triple = LLVMGetDefaultTargetTriple();
+  /* KVS_JIT_CPU (with optional KVS_JIT_FEATURES) pins the target, e.g. "generic" for reproducible code */
+  const char *cpu = getenv("KVS_JIT_CPU"), *features = getenv("KVS_JIT_FEATURES");
+  llvm_cpu = cpu != NULL ? LLVMCreateMessage(cpu) : LLVMGetHostCPUName();
+  llvm_features = features != NULL ? LLVMCreateMessage(features) : cpu != NULL ? LLVMCreateMessage("") : LLVMGetHostCPUFeatures();
+  if (LLVMGetTargetFromTriple(llvm_triple, &llvm_target, &error)) {
+    LLVMDisposeMessage(error);
+    return;
+  }
+  if ((target_machine = kvs_schema_jit_target_machine()) == NULL) {
+    return;
+  }
+  /* the builder takes the ownership of the target machine, lljit the ownership of the builder */
+  builder = LLVMOrcCreateLLJITBuilder();
+  LLVMOrcLLJITBuilderSetJITTargetMachineBuilder(builder, LLVMOrcJITTargetMachineBuilderCreateFromTargetMachine(target_machine));
+  if (LLVMOrcCreateLLJIT(&llvm_jit, builder) != NULL) {
+    llvm_jit = NULL;
+    return;
+  }
+  if (LLVMOrcCreateDynamicLibrarySearchGeneratorForProcess(&generator, LLVMOrcLLJITGetGlobalPrefix(llvm_jit), NULL, NULL) != NULL) {
+    LLVMConsumeError(LLVMOrcDisposeLLJIT(llvm_jit));
+    llvm_jit = NULL;
+    return;
+  }
+  LLVMOrcJITDylibAddGenerator(LLVMOrcLLJITGetMainJITDylib(llvm_jit), generator);
 }
 
 static void kvs_init_llvm(void) {
   pthread_once(&init_llvm, kvs_init_llvm_once);
 }
 
-#ifndef PATH_MAX
-#define PATH_MAX (1024)
-#endif
-#ifdef __LINUX__
-static size_t populate_exec_path(char *buffer, size_t limit) {
-  if (readlink("/proc/self/exe", buffer, limit) == -1) {
-    buffer = getcwd(buffer, limit);
-  } else {
-    *strrchr(buffer, '/') = '\0';
-  }
-  return strlen(buffer);
-}
-#else
-#ifdef __DARWIN__
-#include <mach-o/dyld.h>
-static size_t populate_exec_path(char *buffer, size_t limit) {
-  uint32_t size = limit;
-  _NSGetExecutablePath(buffer, &size);
-  buffer[size] = '\0';
-  *strrchr(buffer, '/') = '\0';
-  return strlen(buffer);
-}
-#endif
-#endif
-
-static kvs_status load_byte_code(const char *filename, LLVMModuleRef *module) {
-  kvs_status st = KVS_OK;
-  char *msg;
-  char pathbuf[PATH_MAX];
-  memset(pathbuf, 0, sizeof(pathbuf));
-  char *start = pathbuf + populate_exec_path(pathbuf, PATH_MAX - 1);
-  snprintf(start, sizeof(pathbuf) - (start - pathbuf), "/%s", filename);
-  LLVMMemoryBufferRef buf;
-  if (LLVMCreateMemoryBufferWithContentsOfFile(pathbuf, &buf, &msg)) {
-    free(msg);
-    return KVS_OUT_OF_MEMORY;
-  }
-  if (LLVMParseBitcode2(buf, module)) {
-    st = KVS_SCHEMA_JIT_INVALID_RUNTIME;
-  }
-  LLVMDisposeMemoryBuffer(buf);
-  return st;
-}
-
+/* every compilation parses the runtime into its own context, contexts are never shared between threads */
 static kvs_status kvs_jit_llvm_context_init(llvm_context *llvm) {
-  kvs_status st;
-  kvs_init_llvm();
-  KVS_CHECK_OOM(llvm->module = LLVMModuleCreateWithName("kvs_jit"));
-  KVS_DO(st, load_byte_code("jitrt.bc", &llvm->module));
-  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, llvm->int32_type = LLVMInt32Type());
-  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, llvm->int64_type = LLVMInt64Type());
-  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, llvm->void_type = LLVMVoidType());
-  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, llvm->int32_pointer = LLVMPointerType(llvm->int32_type, 0));
+  LLVMMemoryBufferRef bitcode;
+  LLVMBool failed;
+  KVS_CHECK_OOM(llvm->context = LLVMContextCreate());
+  KVS_JIT_CHECK_LLVM_ERROR(INVALID_RUNTIME, bitcode = LLVMCreateMemoryBufferWithMemoryRange((const char *) llvm_runtime_bitcode,
+        sizeof(llvm_runtime_bitcode), "jitrt.bc", 0));
+  failed = LLVMParseBitcodeInContext2(llvm->context, bitcode, &llvm->module);
+  LLVMDisposeMemoryBuffer(bitcode);
+  if (failed) {
+    llvm->module = NULL;
+    return KVS_SCHEMA_JIT_INVALID_RUNTIME;
+  }
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, llvm->int8_type = LLVMInt8TypeInContext(llvm->context));
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, llvm->int32_type = LLVMInt32TypeInContext(llvm->context));
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, llvm->int64_type = LLVMInt64TypeInContext(llvm->context));
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, llvm->float_type = LLVMFloatTypeInContext(llvm->context));
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, llvm->double_type = LLVMDoubleTypeInContext(llvm->context));
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, llvm->void_type = LLVMVoidTypeInContext(llvm->context));
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, llvm->int8_pointer = LLVMPointerType(llvm->int8_type, 0));
   KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, llvm->int64_pointer = LLVMPointerType(llvm->int64_type, 0));
   KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, llvm->int64_pointer_size = LLVMConstInt(llvm->int64_type, sizeof(int64_t), 0));
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, llvm->sign_mask_int32 = LLVMConstInt(llvm->int32_type, 0x80000000ULL, 0));
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, llvm->sign_mask_int64 = LLVMConstInt(llvm->int64_type, 0x8000000000000000ULL, 0));
   LLVMTypeRef params[] = {
     llvm->int64_type, /* record */
     llvm->int64_type, /* kvs_buffer *key */
     llvm->int64_type, /* kvs_buffer *value */
   };
   KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, llvm->entry_type = LLVMFunctionType(llvm->void_type, params, KVS_ARRAY_SIZE(params), 0));
+  LLVMTypeRef struct_params[] = {
+    llvm->int64_type, /* object */
+    llvm->int64_type, /* kvs_buffer *key */
+    llvm->int64_type, /* kvs_buffer *value */
+    llvm->int64_type, /* kvs_buffer *heap */
+  };
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, llvm->struct_deserialize_type = LLVMFunctionType(llvm->void_type, struct_params, KVS_ARRAY_SIZE(struct_params), 0));
   KVS_JIT_CHECK_LLVM_ERROR(INVALID_RUNTIME, llvm->record_get = LLVMGetNamedFunction(llvm->module, "kvs_jit_rt_record_get"));
   KVS_JIT_CHECK_LLVM_ERROR(INVALID_RUNTIME, llvm->record_get_deref = LLVMGetNamedFunction(llvm->module, "kvs_jit_rt_record_get_deref"));
-  KVS_JIT_CHECK_LLVM_ERROR(INVALID_RUNTIME, llvm->serialize_comparable_int32 = LLVMGetNamedFunction(llvm->module, "kvs_jit_rt_variant_serialize_comparable_int32"));
-  KVS_JIT_CHECK_LLVM_ERROR(INVALID_RUNTIME, llvm->serialize_comparable_int64 = LLVMGetNamedFunction(llvm->module, "kvs_jit_rt_variant_serialize_comparable_int64"));
-  KVS_JIT_CHECK_LLVM_ERROR(INVALID_RUNTIME, llvm->serialize_comparable_float = LLVMGetNamedFunction(llvm->module, "kvs_jit_rt_variant_serialize_comparable_float"));
-  KVS_JIT_CHECK_LLVM_ERROR(INVALID_RUNTIME, llvm->serialize_comparable_double = LLVMGetNamedFunction(llvm->module, "kvs_jit_rt_variant_serialize_comparable_double"));
-  KVS_JIT_CHECK_LLVM_ERROR(INVALID_RUNTIME, llvm->serialize_comparable_opaque = LLVMGetNamedFunction(llvm->module, "kvs_jit_rt_variant_serialize_comparable_opaque"));
-  KVS_JIT_CHECK_LLVM_ERROR(INVALID_RUNTIME, llvm->deserialize_comparable_int32 = LLVMGetNamedFunction(llvm->module, "kvs_jit_rt_variant_deserialize_comparable_int32"));
-  KVS_JIT_CHECK_LLVM_ERROR(INVALID_RUNTIME, llvm->deserialize_comparable_int64 = LLVMGetNamedFunction(llvm->module, "kvs_jit_rt_variant_deserialize_comparable_int64"));
-  KVS_JIT_CHECK_LLVM_ERROR(INVALID_RUNTIME, llvm->deserialize_comparable_float = LLVMGetNamedFunction(llvm->module, "kvs_jit_rt_variant_deserialize_comparable_float"));
-  KVS_JIT_CHECK_LLVM_ERROR(INVALID_RUNTIME, llvm->deserialize_comparable_double = LLVMGetNamedFunction(llvm->module, "kvs_jit_rt_variant_deserialize_comparable_double"));
+  KVS_JIT_CHECK_LLVM_ERROR(INVALID_RUNTIME, llvm->comparable_opaque_size = LLVMGetNamedFunction(llvm->module, "kvs_jit_rt_variant_comparable_opaque_size"));
+  KVS_JIT_CHECK_LLVM_ERROR(INVALID_RUNTIME, llvm->encode_comparable_opaque = LLVMGetNamedFunction(llvm->module, "kvs_jit_rt_variant_encode_comparable_opaque"));
   KVS_JIT_CHECK_LLVM_ERROR(INVALID_RUNTIME, llvm->deserialize_comparable_opaque = LLVMGetNamedFunction(llvm->module, "kvs_jit_rt_variant_deserialize_comparable_opaque"));
   KVS_JIT_CHECK_LLVM_ERROR(INVALID_RUNTIME, llvm->deserialize_opaque = LLVMGetNamedFunction(llvm->module, "kvs_jit_rt_variant_deserialize_opaque"));
-  KVS_JIT_CHECK_LLVM_ERROR(INVALID_RUNTIME, llvm->buffer_write = LLVMGetNamedFunction(llvm->module, "kvs_jit_rt_buffer_write"));
-  KVS_JIT_CHECK_LLVM_ERROR(INVALID_RUNTIME, llvm->buffer_read = LLVMGetNamedFunction(llvm->module, "kvs_jit_rt_buffer_read"));
+  KVS_JIT_CHECK_LLVM_ERROR(INVALID_RUNTIME, llvm->serialize_dictionary = LLVMGetNamedFunction(llvm->module, "kvs_jit_rt_variant_serialize_dictionary"));
+  KVS_JIT_CHECK_LLVM_ERROR(INVALID_RUNTIME, llvm->deserialize_dictionary = LLVMGetNamedFunction(llvm->module, "kvs_jit_rt_variant_deserialize_dictionary"));
+  KVS_JIT_CHECK_LLVM_ERROR(INVALID_RUNTIME, llvm->buffer_allocate = LLVMGetNamedFunction(llvm->module, "kvs_jit_rt_buffer_allocate"));
+  KVS_JIT_CHECK_LLVM_ERROR(INVALID_RUNTIME, llvm->buffer_fetch = LLVMGetNamedFunction(llvm->module, "kvs_jit_rt_buffer_fetch"));
+  KVS_JIT_CHECK_LLVM_ERROR(INVALID_RUNTIME, llvm->buffer_release = LLVMGetNamedFunction(llvm->module, "kvs_jit_rt_buffer_release"));
+  KVS_JIT_CHECK_LLVM_ERROR(INVALID_RUNTIME, llvm->opaque_comparable_size = LLVMGetNamedFunction(llvm->module, "kvs_jit_rt_opaque_comparable_size"));
+  KVS_JIT_CHECK_LLVM_ERROR(INVALID_RUNTIME, llvm->opaque_encode_comparable = LLVMGetNamedFunction(llvm->module, "kvs_jit_rt_opaque_encode_comparable"));
+  KVS_JIT_CHECK_LLVM_ERROR(INVALID_RUNTIME, llvm->opaque_serialize_dictionary = LLVMGetNamedFunction(llvm->module, "kvs_jit_rt_opaque_serialize_dictionary"));
+  KVS_JIT_CHECK_LLVM_ERROR(INVALID_RUNTIME, llvm->opaque_deserialize = LLVMGetNamedFunction(llvm->module, "kvs_jit_rt_opaque_deserialize"));
+  KVS_JIT_CHECK_LLVM_ERROR(INVALID_RUNTIME, llvm->opaque_deserialize_comparable = LLVMGetNamedFunction(llvm->module, "kvs_jit_rt_opaque_deserialize_comparable"));
+  KVS_JIT_CHECK_LLVM_ERROR(INVALID_RUNTIME, llvm->opaque_deserialize_dictionary = LLVMGetNamedFunction(llvm->module, "kvs_jit_rt_opaque_deserialize_dictionary"));
+  LLVMTypeRef memcpy_params[] = { llvm->int8_pointer, llvm->int8_pointer, llvm->int64_type };
+  if ((llvm->memcpy = LLVMGetNamedFunction(llvm->module, "memcpy")) == NULL) {
+    KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, llvm->memcpy = LLVMAddFunction(llvm->module, "memcpy",
+          LLVMFunctionType(llvm->int8_pointer, memcpy_params, KVS_ARRAY_SIZE(memcpy_params), 0)));
+  }
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, llvm->bswap32 = LLVMAddFunction(llvm->module, "llvm.bswap.i32", LLVMFunctionType(llvm->int32_type, &llvm->int32_type, 1, 0)));
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, llvm->bswap64 = LLVMAddFunction(llvm->module, "llvm.bswap.i64", LLVMFunctionType(llvm->int64_type, &llvm->int64_type, 1, 0)));
 
   KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, llvm->variant_int32_offset = LLVMConstInt(llvm->int64_type, kvs_variant_int32_offset(), 0));
-  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, llvm->variant_int32_size = LLVMConstInt(llvm->int64_type, sizeof(int32_t), 0));
   KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, llvm->variant_int64_offset = LLVMConstInt(llvm->int64_type, kvs_variant_int64_offset(), 0));
-  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, llvm->variant_int64_size = LLVMConstInt(llvm->int64_type, sizeof(int64_t), 0));
   KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, llvm->variant_float_offset = LLVMConstInt(llvm->int64_type, kvs_variant_float_offset(), 0));
-  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, llvm->variant_float_size = LLVMConstInt(llvm->int64_type, sizeof(float), 0));
   KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, llvm->variant_double_offset = LLVMConstInt(llvm->int64_type, kvs_variant_double_offset(), 0));
-  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, llvm->variant_double_size = LLVMConstInt(llvm->int64_type, sizeof(double), 0));
   KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, llvm->variant_opaque_data_offset = LLVMConstInt(llvm->int64_type, kvs_variant_opaque_data_offset(), 0));
   KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, llvm->variant_opaque_size_offset = LLVMConstInt(llvm->int64_type, kvs_variant_opaque_size_offset(), 0));
   KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, llvm->variant_opaque_size_size = LLVMConstInt(llvm->int64_type, sizeof(int32_t), 0));
@@ -207,13 +286,24 @@ static kvs_status kvs_jit_llvm_context_init(llvm_context *llvm) {
   return KVS_OK;
 }
 
-static void kvs_jit_llvm_context_fini(llvm_context *llvm) {
-  if (llvm->shared_module != NULL) {
-    LLVMOrcRemoveModule(llvm_orc, llvm->orc);
-    LLVMOrcDisposeSharedModuleRef(llvm->shared_module);
-  }
+/* drops the module and its context once the entry points are compiled, the code stays with the tracker */
+static void kvs_jit_llvm_context_release(llvm_context *llvm) {
   if (llvm->module != NULL) {
     LLVMDisposeModule(llvm->module);
+    llvm->module = NULL;
+  }
+  if (llvm->context != NULL) {
+    LLVMContextDispose(llvm->context);
+    llvm->context = NULL;
+  }
+}
+
+static void kvs_jit_llvm_context_fini(llvm_context *llvm) {
+  kvs_jit_llvm_context_release(llvm);
+  if (llvm->tracker != NULL) {
+    LLVMConsumeError(LLVMOrcResourceTrackerRemove(llvm->tracker));
+    LLVMOrcReleaseResourceTracker(llvm->tracker);
+    llvm->tracker = NULL;
   }
 }
 
@@ -232,47 +322,172 @@ static const char *llvm_serialize_name(llvm_context *llvm, const char *fmt, ...)
   return llvm->name_buffer;
 }
 
-static kvs_status kvs_schema_jit_generate_primitive_serializer(llvm_context *llvm, LLVMBuilderRef builder, LLVMValueRef buffer, LLVMValueRef field, LLVMValueRef offset, LLVMValueRef size) {
-  LLVMValueRef data = LLVMBuildAdd(builder, field, offset, llvm_name_with_suffix(llvm, "@primitive_address"));
-  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, data);
-  LLVMValueRef buffer_write_args[] = { buffer, data, size };
-  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, LLVMBuildCall(builder, llvm->buffer_write, buffer_write_args, KVS_ARRAY_SIZE(buffer_write_args), ""));
-  return KVS_OK;
+static LLVMValueRef kvs_schema_jit_build_call(LLVMBuilderRef builder, LLVMValueRef function, LLVMValueRef *args, unsigned size, const char *name) {
+  return LLVMBuildCall2(builder, LLVMGlobalGetValueType(function), function, args, size, name);
+}
+
+static LLVMValueRef kvs_schema_jit_generate_pointer(llvm_context *llvm, LLVMBuilderRef builder, LLVMValueRef address, LLVMValueRef offset, LLVMTypeRef type) {
+  LLVMValueRef field_address = LLVMBuildAdd(builder, address, offset, llvm_name_with_suffix(llvm, "@address"));
+  KVS_JIT_CHECK_NOT_NULL(field_address);
+  return LLVMBuildIntToPtr(builder, field_address, LLVMPointerType(type, 0), llvm_name_with_suffix(llvm, "@pointer"));
+}
+
+static LLVMValueRef kvs_schema_jit_generate_load(llvm_context *llvm, LLVMBuilderRef builder, LLVMValueRef address, LLVMValueRef offset, LLVMTypeRef type, uint32_t alignment) {
+  LLVMValueRef pointer = kvs_schema_jit_generate_pointer(llvm, builder, address, offset, type);
+  KVS_JIT_CHECK_NOT_NULL(pointer);
+  LLVMValueRef value = LLVMBuildLoad2(builder, type, pointer, llvm_name_with_suffix(llvm, "@load"));
+  KVS_JIT_CHECK_NOT_NULL(value);
+  LLVMSetAlignment(value, alignment);
+  return value;
 }
 
-static kvs_status kvs_schema_jit_generate_opaque_serializer(llvm_context *llvm, LLVMBuilderRef builder, LLVMValueRef buffer, LLVMValueRef field, LLVMValueRef data_offset, LLVMValueRef size_offset, LLVMValueRef size_size) {
-  LLVMValueRef size = LLVMBuildAdd(builder, field, size_offset, llvm_name_with_suffix(llvm, "@opaque_size_address"));
-  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, size);
-  LLVMValueRef data = LLVMBuildAdd(builder, field, data_offset, llvm_name_with_suffix(llvm, "@opaque_data_address"));
-  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, data);
-  LLVMValueRef buffer_write_args[] = { buffer, size, size_size };
-  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, LLVMBuildCall(builder, llvm->buffer_write, buffer_write_args, KVS_ARRAY_SIZE(buffer_write_args), ""));
-  LLVMValueRef size_int32_ptr = LLVMBuildIntToPtr(builder, size, llvm->int32_pointer, llvm_name_with_suffix(llvm, "@opaque_size_int32_address"));
-  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, size_int32_ptr);
-  LLVMValueRef size_int32 = LLVMBuildLoad(builder, size_int32_ptr, llvm_name_with_suffix(llvm, "@opaque_size_int32"));
-  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, size_int32);
-  LLVMValueRef size_int64 = LLVMBuildIntCast(builder, size_int32, llvm->int64_type, llvm_name_with_suffix(llvm, "@opaque_size_int64"));
-  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, size_int64);
-  LLVMValueRef data_int64_ptr = LLVMBuildIntToPtr(builder, data, llvm->int64_pointer, llvm_name_with_suffix(llvm, "@opaque_data_pointer_to_address"));
-  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, data_int64_ptr);
-  LLVMValueRef data_int64 = LLVMBuildLoad(builder, data_int64_ptr, llvm_name_with_suffix(llvm, "@opaque_data_address"));
-  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, data_int64);
-
-  buffer_write_args[1] = data_int64;
-  buffer_write_args[2] = size_int64;
-  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, LLVMBuildCall(builder, llvm->buffer_write, buffer_write_args, KVS_ARRAY_SIZE(buffer_write_args), ""));
+static LLVMValueRef kvs_schema_jit_generate_store(llvm_context *llvm, LLVMBuilderRef builder, LLVMValueRef value, LLVMValueRef address, LLVMValueRef offset, LLVMTypeRef type, uint32_t alignment) {
+  LLVMValueRef pointer = kvs_schema_jit_generate_pointer(llvm, builder, address, offset, type);
+  KVS_JIT_CHECK_NOT_NULL(pointer);
+  LLVMValueRef store = LLVMBuildStore(builder, value, pointer);
+  KVS_JIT_CHECK_NOT_NULL(store);
+  LLVMSetAlignment(store, alignment);
+  return store;
+}
+
+static LLVMValueRef kvs_schema_jit_generate_big_endian(llvm_context *llvm, LLVMBuilderRef builder, LLVMValueRef value, LLVMValueRef bswap) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  return kvs_schema_jit_build_call(builder, bswap, &value, 1, llvm_name_with_suffix(llvm, "@bswap"));
+#else
+  return value;
+#endif
+}
+
+static size_t kvs_schema_jit_fixed_size(kvs_variant_type type) {
+  switch (type) {
+    case KVS_VARIANT_TYPE_INT32:
+    case KVS_VARIANT_TYPE_FLOAT:
+      return sizeof(int32_t);
+    case KVS_VARIANT_TYPE_INT64:
+    case KVS_VARIANT_TYPE_DOUBLE:
+      return sizeof(int64_t);
+    default:
+      return 0;
+  }
+}
+
+static LLVMValueRef kvs_schema_jit_variant_offset(llvm_context *llvm, kvs_variant_type type) {
+  switch (type) {
+    case KVS_VARIANT_TYPE_INT32:
+      return llvm->variant_int32_offset;
+    case KVS_VARIANT_TYPE_INT64:
+      return llvm->variant_int64_offset;
+    case KVS_VARIANT_TYPE_FLOAT:
+      return llvm->variant_float_offset;
+    case KVS_VARIANT_TYPE_DOUBLE:
+      return llvm->variant_double_offset;
+    default:
+      return NULL;
+  }
+}
+
+static LLVMValueRef kvs_schema_jit_generate_encoded_size(llvm_context *llvm, LLVMBuilderRef builder, LLVMValueRef variant, kvs_variant_type type, int32_t comparable) {
+  if (type != KVS_VARIANT_TYPE_OPAQUE) {
+    return LLVMConstInt(llvm->int64_type, kvs_schema_jit_fixed_size(type), 0);
+  }
+  if (comparable) {
+    return kvs_schema_jit_build_call(builder, llvm->comparable_opaque_size, &variant, 1, llvm_name_with_suffix(llvm, "@encoded_size"));
+  }
+  LLVMValueRef size = kvs_schema_jit_generate_load(llvm, builder, variant, llvm->variant_opaque_size_offset, llvm->int32_type, sizeof(int32_t));
+  KVS_JIT_CHECK_NOT_NULL(size);
+  KVS_JIT_CHECK_NOT_NULL(size = LLVMBuildZExt(builder, size, llvm->int64_type, llvm_name_with_suffix(llvm, "@opaque_size")));
+  return LLVMBuildAdd(builder, size, llvm->variant_opaque_size_size, llvm_name_with_suffix(llvm, "@encoded_size"));
+}
+
+/* stores the comparable form of the value at base + offset at cursor and returns the cursor past it, opaque values are read from a variant at base */
+static LLVMValueRef kvs_schema_jit_generate_comparable_encoder(llvm_context *llvm, LLVMBuilderRef builder, LLVMValueRef base, LLVMValueRef offset, LLVMValueRef cursor, kvs_variant_type type) {
+  size_t size = kvs_schema_jit_fixed_size(type);
+  int32_t narrow = size == sizeof(int32_t);
+  LLVMTypeRef int_type = narrow ? llvm->int32_type : llvm->int64_type;
+  LLVMValueRef sign_mask = narrow ? llvm->sign_mask_int32 : llvm->sign_mask_int64;
+  LLVMValueRef bits, real, positive, zero = LLVMConstInt(llvm->int64_type, 0, 0);
+  LLVMValueRef args[] = { base, cursor };
+  switch (type) {
+    case KVS_VARIANT_TYPE_INT32:
+    case KVS_VARIANT_TYPE_INT64:
+      KVS_JIT_CHECK_NOT_NULL(bits = kvs_schema_jit_generate_load(llvm, builder, base, offset, int_type, size));
+      KVS_JIT_CHECK_NOT_NULL(bits = LLVMBuildXor(builder, bits, sign_mask, llvm_name_with_suffix(llvm, "@flip")));
+      break;
+    case KVS_VARIANT_TYPE_FLOAT:
+    case KVS_VARIANT_TYPE_DOUBLE:
+      KVS_JIT_CHECK_NOT_NULL(bits = kvs_schema_jit_generate_load(llvm, builder, base, offset, int_type, size));
+      KVS_JIT_CHECK_NOT_NULL(real = kvs_schema_jit_generate_load(llvm, builder, base, offset, narrow ? llvm->float_type : llvm->double_type, size));
+      KVS_JIT_CHECK_NOT_NULL(positive = LLVMBuildFCmp(builder, LLVMRealOGE, real, LLVMConstReal(narrow ? llvm->float_type : llvm->double_type, 0.0), llvm_name_with_suffix(llvm, "@positive")));
+      KVS_JIT_CHECK_NOT_NULL(bits = LLVMBuildSelect(builder, positive,
+            LLVMBuildOr(builder, bits, sign_mask, llvm_name_with_suffix(llvm, "@set_sign")),
+            LLVMBuildNot(builder, bits, llvm_name_with_suffix(llvm, "@invert")), llvm_name_with_suffix(llvm, "@flip")));
+      break;
+    case KVS_VARIANT_TYPE_OPAQUE:
+      KVS_JIT_CHECK_NOT_NULL(bits = kvs_schema_jit_build_call(builder, llvm->encode_comparable_opaque, args, KVS_ARRAY_SIZE(args), llvm_name_with_suffix(llvm, "@encoded_size")));
+      return LLVMBuildAdd(builder, cursor, bits, llvm_name_with_suffix(llvm, "@cursor"));
+    default:
+      return cursor;
+  }
+  KVS_JIT_CHECK_NOT_NULL(bits = kvs_schema_jit_generate_big_endian(llvm, builder, bits, narrow ? llvm->bswap32 : llvm->bswap64));
+  KVS_JIT_CHECK_NOT_NULL(kvs_schema_jit_generate_store(llvm, builder, bits, cursor, zero, int_type, 1));
+  return LLVMBuildAdd(builder, cursor, LLVMConstInt(llvm->int64_type, size, 0), llvm_name_with_suffix(llvm, "@cursor"));
+}
+
+/* stores the value at base + offset in native layout at cursor and returns the cursor past it, opaque values are read from a variant at base */
+static LLVMValueRef kvs_schema_jit_generate_value_encoder(llvm_context *llvm, LLVMBuilderRef builder, LLVMValueRef base, LLVMValueRef offset, LLVMValueRef cursor, kvs_variant_type type) {
+  size_t size = kvs_schema_jit_fixed_size(type);
+  LLVMValueRef zero = LLVMConstInt(llvm->int64_type, 0, 0), bits, data, dest, opaque_size;
+  if (type == KVS_VARIANT_TYPE_OPAQUE) {
+    KVS_JIT_CHECK_NOT_NULL(bits = kvs_schema_jit_generate_load(llvm, builder, base, llvm->variant_opaque_size_offset, llvm->int32_type, sizeof(int32_t)));
+    KVS_JIT_CHECK_NOT_NULL(kvs_schema_jit_generate_store(llvm, builder, bits, cursor, zero, llvm->int32_type, 1));
+    KVS_JIT_CHECK_NOT_NULL(opaque_size = LLVMBuildZExt(builder, bits, llvm->int64_type, llvm_name_with_suffix(llvm, "@opaque_size")));
+    KVS_JIT_CHECK_NOT_NULL(data = kvs_schema_jit_generate_load(llvm, builder, base, llvm->variant_opaque_data_offset, llvm->int64_type, sizeof(int64_t)));
+    KVS_JIT_CHECK_NOT_NULL(cursor = LLVMBuildAdd(builder, cursor, llvm->variant_opaque_size_size, llvm_name_with_suffix(llvm, "@opaque_data_cursor")));
+    KVS_JIT_CHECK_NOT_NULL(dest = LLVMBuildIntToPtr(builder, cursor, llvm->int8_pointer, llvm_name_with_suffix(llvm, "@opaque_dest")));
+    KVS_JIT_CHECK_NOT_NULL(data = LLVMBuildIntToPtr(builder, data, llvm->int8_pointer, llvm_name_with_suffix(llvm, "@opaque_data")));
+    LLVMValueRef args[] = { dest, data, opaque_size };
+    KVS_JIT_CHECK_NOT_NULL(kvs_schema_jit_build_call(builder, llvm->memcpy, args, KVS_ARRAY_SIZE(args), ""));
+    return LLVMBuildAdd(builder, cursor, opaque_size, llvm_name_with_suffix(llvm, "@cursor"));
+  }
+  if (size == 0) {
+    return cursor;
+  }
+  LLVMTypeRef int_type = size == sizeof(int32_t) ? llvm->int32_type : llvm->int64_type;
+  KVS_JIT_CHECK_NOT_NULL(bits = kvs_schema_jit_generate_load(llvm, builder, base, offset, int_type, size));
+  KVS_JIT_CHECK_NOT_NULL(kvs_schema_jit_generate_store(llvm, builder, bits, cursor, zero, int_type, 1));
+  return LLVMBuildAdd(builder, cursor, LLVMConstInt(llvm->int64_type, size, 0), llvm_name_with_suffix(llvm, "@cursor"));
+}
+
+/* loads a fixed size column at data + offset into target + target_offset */
+static kvs_status kvs_schema_jit_generate_fixed_decoder(llvm_context *llvm, LLVMBuilderRef builder, LLVMValueRef data, size_t offset,
+    LLVMValueRef target, LLVMValueRef target_offset, kvs_variant_type type, int32_t comparable) {
+  size_t size = kvs_schema_jit_fixed_size(type);
+  int32_t narrow = size == sizeof(int32_t);
+  LLVMTypeRef int_type = narrow ? llvm->int32_type : llvm->int64_type;
+  LLVMValueRef sign_mask = narrow ? llvm->sign_mask_int32 : llvm->sign_mask_int64, bits, sign, negative;
+  bits = kvs_schema_jit_generate_load(llvm, builder, data, LLVMConstInt(llvm->int64_type, offset, 0), int_type, 1);
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, bits);
+  if (comparable) {
+    KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, bits = kvs_schema_jit_generate_big_endian(llvm, builder, bits, narrow ? llvm->bswap32 : llvm->bswap64));
+    if (type == KVS_VARIANT_TYPE_INT32 || type == KVS_VARIANT_TYPE_INT64) {
+      KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, bits = LLVMBuildXor(builder, bits, sign_mask, llvm_name_with_suffix(llvm, "@flip")));
+    } else {
+      KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, sign = LLVMBuildAnd(builder, bits, sign_mask, llvm_name_with_suffix(llvm, "@sign")));
+      KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, negative = LLVMBuildICmp(builder, LLVMIntEQ, sign, LLVMConstInt(narrow ? llvm->int32_type : llvm->int64_type, 0, 0), llvm_name_with_suffix(llvm, "@negative")));
+      KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, bits = LLVMBuildSelect(builder, negative,
+            LLVMBuildNot(builder, bits, llvm_name_with_suffix(llvm, "@invert")),
+            LLVMBuildXor(builder, bits, sign_mask, llvm_name_with_suffix(llvm, "@clear_sign")), llvm_name_with_suffix(llvm, "@flip")));
+    }
+  }
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, kvs_schema_jit_generate_store(llvm, builder, bits, target, target_offset, int_type, size));
   return KVS_OK;
 }
 
-static kvs_status kvs_schema_jit_generate_primitive_deserializer(llvm_context *llvm, LLVMBuilderRef builder, LLVMValueRef buffer, LLVMValueRef field, LLVMValueRef offset, LLVMValueRef size) {
-  LLVMValueRef data_address_ptr = LLVMBuildIntToPtr(builder, field, llvm->int64_pointer, llvm_name_with_suffix(llvm, "@pointer_to_address"));
-  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, data_address_ptr);
-  LLVMValueRef data_address = LLVMBuildLoad(builder, data_address_ptr, llvm_name_with_suffix(llvm, "@address"));
-  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, data_address);
-  LLVMValueRef data = LLVMBuildAdd(builder, data_address, offset, llvm_name_with_suffix(llvm, "@primitive_address"));
-  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, data);
-  LLVMValueRef buffer_read_args[] = { buffer, data, size };
-  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, LLVMBuildCall(builder, llvm->buffer_read, buffer_read_args, KVS_ARRAY_SIZE(buffer_read_args), ""));
+static kvs_status kvs_schema_jit_generate_dictionary_codec(llvm_context *llvm, LLVMBuilderRef builder, LLVMValueRef codec, LLVMValueRef buffer, LLVMValueRef field, kvs_dictionary *dictionary) {
+  LLVMValueRef dictionary_address = LLVMConstInt(llvm->int64_type, (uintptr_t) dictionary, 0);
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, dictionary_address);
+  LLVMValueRef args[] = { field, dictionary_address, buffer };
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, kvs_schema_jit_build_call(builder, codec, args, KVS_ARRAY_SIZE(args), ""));
   return KVS_OK;
 }
 
@@ -313,26 +528,286 @@ cleanup_exit:
   return st;
 }
 
-static uint64_t kvs_schema_jit_resolve_symbol(const char *symname, void *ctx) {
+static const char *kvs_schema_jit_cache_dir(void) {
+  const char *dir = getenv("KVS_JIT_CACHE_DIR");
+  return (dir != NULL && *dir != '\0') ? dir : NULL;
+}
+
+static const char *kvs_schema_jit_dump_dir(void) {
+  const char *dir = getenv("KVS_JIT_DUMP_DIR");
+  return (dir != NULL && *dir != '\0') ? dir : NULL;
+}
+
+static int32_t kvs_schema_jit_perf_map(void) {
+  const char *perf_map = getenv("KVS_JIT_PERF_MAP");
+  return perf_map != NULL && *perf_map != '\0' && strcmp(perf_map, "0") != 0;
+}
+
+static uint64_t kvs_schema_jit_fingerprint_update(uint64_t hash, const void *data, size_t size) {
+  /* FNV-1a */
+  const uint8_t *cdata = data;
+  size_t idx;
+  for (idx = 0; idx < size; ++idx) {
+    hash ^= cdata[idx];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+static uint64_t kvs_schema_jit_fingerprint_string(uint64_t hash, const char *string) {
+  return string != NULL ? kvs_schema_jit_fingerprint_update(hash, string, strlen(string) + 1) : hash;
+}
+
+static uint64_t kvs_schema_jit_fingerprint_columns(uint64_t hash, const kvs_column **columns, size_t size) {
+  size_t idx;
+  hash = kvs_schema_jit_fingerprint_update(hash, &size, sizeof(size));
+  for (idx = 0; idx < size; ++idx) {
+    hash = kvs_schema_jit_fingerprint_update(hash, &columns[idx]->index, sizeof(columns[idx]->index));
+    hash = kvs_schema_jit_fingerprint_update(hash, &columns[idx]->type, sizeof(columns[idx]->type));
+    hash = kvs_schema_jit_fingerprint_update(hash, &columns[idx]->dictionary, sizeof(columns[idx]->dictionary));
+  }
+  return hash;
+}
+
+static int32_t kvs_schema_jit_cacheable(const kvs_column **values, size_t value_size) {
+  size_t idx;
+  if (kvs_schema_jit_cache_dir() == NULL) {
+    return 0;
+  }
+  /* dictionary codecs embed the address of the dictionary */
+  for (idx = 0; idx < value_size; ++idx) {
+    if (values[idx]->dictionary != NULL) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static uint64_t kvs_schema_jit_fingerprint(const kvs_column **keys, size_t key_size, const kvs_column **values, size_t value_size) {
+  uint64_t hash = 14695981039346656037ULL;
+  size_t layout[] = {
+    kvs_variant_int32_offset(),
+    kvs_variant_int64_offset(),
+    kvs_variant_float_offset(),
+    kvs_variant_double_offset(),
+    kvs_variant_opaque_data_offset(),
+    kvs_variant_opaque_size_offset(),
+    kvs_record_fields_offset(),
+  };
+  int32_t version = KVS_SCHEMA_JIT_CACHE_VERSION;
+  hash = kvs_schema_jit_fingerprint_update(hash, &version, sizeof(version));
+  hash = kvs_schema_jit_fingerprint_update(hash, LLVM_VERSION_STRING, sizeof(LLVM_VERSION_STRING));
+  hash = kvs_schema_jit_fingerprint_string(hash, llvm_triple);
+  hash = kvs_schema_jit_fingerprint_string(hash, llvm_cpu);
+  hash = kvs_schema_jit_fingerprint_string(hash, llvm_features);
+  hash = kvs_schema_jit_fingerprint_update(hash, llvm_runtime_bitcode, sizeof(llvm_runtime_bitcode));
+  hash = kvs_schema_jit_fingerprint_update(hash, layout, sizeof(layout));
+  hash = kvs_schema_jit_fingerprint_columns(hash, keys, key_size);
+  hash = kvs_schema_jit_fingerprint_columns(hash, values, value_size);
+  return hash;
+}
+
+/* objects and dumps of lazily compiled entry points are kept apart from the ones of whole codecs */
+static void kvs_schema_jit_file_path(char *path, size_t size, const char *dir, const llvm_context *llvm, int32_t entries, const char *extension) {
+  static const char *suffixes[] = { "", "-serialize", "-deserialize", "" };
+  snprintf(path, size, "%s/kvs-jit-%016llx%s.%s", dir, (unsigned long long) llvm->fingerprint, suffixes[entries & KVS_SCHEMA_JIT_ENTRY_ALL], extension);
+}
+
+/* every codec links into the same dylib, so colliding fingerprints get a generation to keep symbols apart */
+static const char *kvs_schema_jit_symbol(llvm_context *llvm, char *buffer, size_t size, const char *name) {
+  if (llvm->generation == 0) {
+    snprintf(buffer, size, "kvs_jit_%016llx_%s", (unsigned long long) llvm->fingerprint, name);
+  } else {
+    snprintf(buffer, size, "kvs_jit_%016llx_%d_%s", (unsigned long long) llvm->fingerprint, llvm->generation, name);
+  }
+  return buffer;
+}
+
+/* only the entry points stay visible, the inlined runtime copies of every codec must not clash in the dylib */
+static void kvs_schema_jit_internalize(llvm_context *llvm) {
+  char serialize[64], deserialize[64];
+  const char *name;
+  LLVMValueRef value;
+  kvs_schema_jit_symbol(llvm, serialize, sizeof(serialize), "serialize");
+  kvs_schema_jit_symbol(llvm, deserialize, sizeof(deserialize), "deserialize");
+  for (value = LLVMGetFirstFunction(llvm->module); value != NULL; value = LLVMGetNextFunction(value)) {
+    name = LLVMGetValueName(value);
+    if (!LLVMIsDeclaration(value) && strcmp(name, serialize) != 0 && strcmp(name, deserialize) != 0) {
+      LLVMSetLinkage(value, LLVMInternalLinkage);
+    }
+  }
+  for (value = LLVMGetFirstGlobal(llvm->module); value != NULL; value = LLVMGetNextGlobal(value)) {
+    if (!LLVMIsDeclaration(value)) {
+      LLVMSetLinkage(value, LLVMInternalLinkage);
+    }
+  }
+}
+
+/* perf needs code sizes, which only the symbol table of the object knows */
+static void kvs_schema_jit_symbol_sizes(llvm_context *llvm, LLVMMemoryBufferRef object) {
+  char serialize[64], deserialize[64];
+  const char *name;
+  LLVMObjectFileRef file;
+  LLVMSymbolIteratorRef symbol;
+  LLVMMemoryBufferRef view = LLVMCreateMemoryBufferWithMemoryRange(LLVMGetBufferStart(object), LLVMGetBufferSize(object), "kvs-jit", 0);
+  /* object file takes the ownership of the view, even on failure */
+  if (view == NULL || (file = LLVMCreateObjectFile(view)) == NULL) {
+    return;
+  }
+  kvs_schema_jit_symbol(llvm, serialize, sizeof(serialize), "serialize");
+  kvs_schema_jit_symbol(llvm, deserialize, sizeof(deserialize), "deserialize");
+  for (symbol = LLVMGetSymbols(file); !LLVMIsSymbolIteratorAtEnd(file, symbol); LLVMMoveToNextSymbol(symbol)) {
+    name = LLVMGetSymbolName(symbol);
 #ifdef __DARWIN__
-  /* strip the leading underscore on darwin */
-  void *data = (LLVMSearchForAddressOfSymbol(symname + 1));
-#else
-  void *data = (LLVMSearchForAddressOfSymbol(symname));
+    name += *name == '_';
 #endif
-  return (uintptr_t) data;
+    if (strcmp(name, serialize) == 0) {
+      llvm->serialize_size = LLVMGetSymbolSize(symbol);
+    } else if (strcmp(name, deserialize) == 0) {
+      llvm->deserialize_size = LLVMGetSymbolSize(symbol);
+    }
+  }
+  LLVMDisposeSymbolIterator(symbol);
+  LLVMDisposeObjectFile(file);
 }
 
-static kvs_status kvs_schema_jit_compile(llvm_context *llvm) {
+/* names the entry point after its columns in /tmp/perf-<pid>.map, e.g. kvs_jit_<fingerprint>_serialize(k:opaque|v:int32) */
+static void kvs_schema_jit_perf_map_add(uint64_t address, uint64_t size, const char *symbol,
+    const kvs_column **keys, size_t key_size, const kvs_column **values, size_t value_size) {
+  static const char *type_names[] = { "invalid", "int32", "int64", "float", "double", "opaque" };
+  char path[64];
+  const kvs_column *column;
+  size_t idx;
+  FILE *file;
+  if (size == 0) {
+    return;
+  }
+  snprintf(path, sizeof(path), "/tmp/perf-%ld.map", (long) getpid());
+  pthread_mutex_lock(&perf_map_lock);
+  if ((file = fopen(path, "a")) == NULL) {
+    pthread_mutex_unlock(&perf_map_lock);
+    return;
+  }
+  fprintf(file, "%llx %llx %s(", (unsigned long long) address, (unsigned long long) size, symbol);
+  for (idx = 0; idx < key_size + value_size; ++idx) {
+    column = idx < key_size ? keys[idx] : values[idx - key_size];
+    fprintf(file, "%s%s:%s%s", idx == 0 ? "" : idx == key_size ? "|" : ",", column->name,
+        type_names[column->type], column->dictionary != NULL ? "[dictionary]" : "");
+  }
+  fprintf(file, ")\n");
+  fclose(file);
+  pthread_mutex_unlock(&perf_map_lock);
+}
+
+static void kvs_schema_jit_dump(llvm_context *llvm, LLVMTargetMachineRef target_machine, int32_t entries) {
+  char path[PATH_MAX], *msg = NULL;
+  const char *dir = kvs_schema_jit_dump_dir();
+  LLVMModuleRef module;
+  if (dir == NULL) {
+    return;
+  }
+  kvs_schema_jit_file_path(path, sizeof(path), dir, llvm, entries, "ll");
+  if (LLVMPrintModuleToFile(llvm->module, path, &msg)) {
+    LLVMDisposeMessage(msg);
+    msg = NULL;
+  }
+  kvs_schema_jit_file_path(path, sizeof(path), dir, llvm, entries, "s");
+  /* code generation may rewrite the module it runs on, so emit assembly from a copy */
+  if ((module = LLVMCloneModule(llvm->module)) != NULL) {
+    if (LLVMTargetMachineEmitToFile(target_machine, module, path, LLVMAssemblyFile, &msg)) {
+      LLVMDisposeMessage(msg);
+    }
+    LLVMDisposeModule(module);
+  }
+}
+
+static kvs_status kvs_schema_jit_add_object(llvm_context *llvm, LLVMMemoryBufferRef object) {
+  LLVMErrorRef error;
+  if (kvs_schema_jit_perf_map()) {
+    kvs_schema_jit_symbol_sizes(llvm, object);
+  }
+  /* lljit takes the ownership of object buffer */
+  if ((error = LLVMOrcLLJITAddObjectFileWithRT(llvm_jit, llvm->tracker, object)) != NULL) {
+    LLVMConsumeError(error);
+    return KVS_SCHEMA_JIT_INTERNAL_ERROR;
+  }
+  return KVS_OK;
+}
+
+static kvs_status kvs_schema_jit_cache_load(llvm_context *llvm, int32_t entries) {
+  char path[PATH_MAX], *msg = NULL;
+  LLVMMemoryBufferRef object;
+  /* dumps are written while compiling, so a cached object would leave them out */
+  if (!llvm->cacheable || kvs_schema_jit_dump_dir() != NULL) {
+    return KVS_SCHEMA_JIT_CACHE_MISS;
+  }
+  kvs_schema_jit_file_path(path, sizeof(path), kvs_schema_jit_cache_dir(), llvm, entries, "o");
+  if (access(path, R_OK) != 0) {
+    return KVS_SCHEMA_JIT_CACHE_MISS;
+  }
+  if (LLVMCreateMemoryBufferWithContentsOfFile(path, &object, &msg)) {
+    LLVMDisposeMessage(msg);
+    return KVS_SCHEMA_JIT_CACHE_MISS;
+  }
+  return kvs_schema_jit_add_object(llvm, object);
+}
+
+static void kvs_schema_jit_cache_store(llvm_context *llvm, int32_t entries, LLVMMemoryBufferRef object) {
+  /* room for the pid suffix, a truncated name could collide with another process */
+  char path[PATH_MAX], temp[PATH_MAX + 24];
+  FILE *file;
+  size_t size = LLVMGetBufferSize(object);
+  kvs_schema_jit_file_path(path, sizeof(path), kvs_schema_jit_cache_dir(), llvm, entries, "o");
+  snprintf(temp, sizeof(temp), "%s.%ld", path, (long) getpid());
+  if ((file = fopen(temp, "wb")) == NULL) {
+    return;
+  }
+  if (fwrite(LLVMGetBufferStart(object), 1, size, file) != size) {
+    fclose(file);
+    unlink(temp);
+    return;
+  }
+  /* rename is atomic so concurrent readers never see a partial object */
+  if (fclose(file) != 0 || rename(temp, path) != 0) {
+    unlink(temp);
+  }
+}
+
+static kvs_status kvs_schema_jit_compile(llvm_context *llvm, int32_t entries) {
+  char *msg = NULL;
+  LLVMMemoryBufferRef object;
+  LLVMTargetMachineRef target_machine;
+  LLVMTargetDataRef data_layout;
+  LLVMBool failed;
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, target_machine = kvs_schema_jit_target_machine());
+  data_layout = LLVMCreateTargetDataLayout(target_machine);
+  LLVMSetModuleDataLayout(llvm->module, data_layout);
+  LLVMDisposeTargetData(data_layout);
+  LLVMSetTarget(llvm->module, llvm_triple);
+  kvs_schema_jit_internalize(llvm);
   kvs_schema_jit_optimize(llvm->module);
-  LLVMSharedModuleRef shared_module = LLVMOrcMakeSharedModule(llvm->module);
-  if (LLVMOrcAddEagerlyCompiledIR(llvm_orc, &llvm->orc, shared_module, kvs_schema_jit_resolve_symbol, NULL) != LLVMOrcErrSuccess) {
+  kvs_schema_jit_dump(llvm, target_machine, entries);
+  failed = LLVMTargetMachineEmitToMemoryBuffer(target_machine, llvm->module, LLVMObjectFile, &msg, &object);
+  LLVMDisposeTargetMachine(target_machine);
+  kvs_jit_llvm_context_release(llvm);
+  if (failed) {
+    LLVMDisposeMessage(msg);
     return KVS_SCHEMA_JIT_INTERNAL_ERROR;
-  } else {
-    llvm->shared_module = shared_module;
-    llvm->module = NULL;
-    return KVS_OK;
   }
+  if (llvm->cacheable) {
+    kvs_schema_jit_cache_store(llvm, entries, object);
+  }
+  return kvs_schema_jit_add_object(llvm, object);
+}
+
+static kvs_status kvs_schema_jit_lookup(llvm_context *llvm, const char *name, LLVMOrcExecutorAddress *address) {
+  char symbol[64];
+  LLVMErrorRef error = LLVMOrcLLJITLookup(llvm_jit, address, kvs_schema_jit_symbol(llvm, symbol, sizeof(symbol), name));
+  if (error != NULL) {
+    LLVMConsumeError(error);
+    return KVS_SCHEMA_JIT_INTERNAL_ERROR;
+  }
+  return *address == 0 ? KVS_SCHEMA_JIT_INTERNAL_ERROR : KVS_OK;
 }
 
 static LLVMValueRef kvs_schema_jit_codec_generate_record_get(llvm_context *llvm, LLVMBuilderRef builder, LLVMValueRef fields_array_address, LLVMValueRef field_index) {
@@ -347,210 +822,614 @@ static LLVMValueRef kvs_schema_jit_codec_generate_record_get_deref(llvm_context
   KVS_JIT_CHECK_NOT_NULL(field_ptr_address);
   LLVMValueRef field_ptr_address_ptr = LLVMBuildIntToPtr(builder, field_ptr_address, llvm->int64_pointer, llvm_name_with_suffix(llvm, "@field_pointer_address_pointer"));
   KVS_JIT_CHECK_NOT_NULL(field_ptr_address_ptr);
-  return LLVMBuildLoad(builder, field_ptr_address_ptr, llvm_name_with_suffix(llvm, "@field_pointer"));
+  return LLVMBuildLoad2(builder, llvm->int64_type, field_ptr_address_ptr, llvm_name_with_suffix(llvm, "@field_pointer"));
 }
 
-void *kvs_schema_jit_codec_create(const kvs_column **keys, size_t key_size, const kvs_column **values, size_t value_size) {
-  size_t idx;
-  kvs_status st;
-  LLVMBuilderRef builder = NULL;
-  LLVMValueRef deserializer = NULL, serializer = NULL;
-  kvs_schema_jit_codec *jit = calloc(1, sizeof(kvs_schema_jit_codec));
-  KVS_CHECK_OOM_GOTO(st, cleanup_exit, jit);
-  KVS_DO_GOTO(st, cleanup_exit, kvs_jit_llvm_context_init(&jit->llvm));
-  llvm_context *llvm = &jit->llvm;
-  KVS_JIT_CHECK_LLVM_ERROR_GOTO(st, INTERNAL_ERROR, cleanup_exit, builder = LLVMCreateBuilderInContext(LLVMGetGlobalContext()));
-  KVS_JIT_CHECK_LLVM_ERROR_GOTO(st, INTERNAL_ERROR, cleanup_exit, serializer = LLVMAddFunction(llvm->module, "serialize", llvm->entry_type));
-  LLVMBasicBlockRef body = LLVMAppendBasicBlock(serializer, "serialize_body");
-  KVS_JIT_CHECK_LLVM_ERROR_GOTO(st, INTERNAL_ERROR, cleanup_exit, body);
-  LLVMPositionBuilderAtEnd(builder, body);
-  LLVMValueRef record = LLVMGetParam(serializer, 0);
-  KVS_JIT_CHECK_LLVM_ERROR_GOTO(st, INTERNAL_ERROR, cleanup_exit, record);
-  LLVMValueRef key = LLVMGetParam(serializer, 1);
-  KVS_JIT_CHECK_LLVM_ERROR_GOTO(st, INTERNAL_ERROR, cleanup_exit, key);
-  LLVMValueRef value = LLVMGetParam(serializer, 2);
-  KVS_JIT_CHECK_LLVM_ERROR_GOTO(st, INTERNAL_ERROR, cleanup_exit, value);
+static LLVMValueRef kvs_schema_jit_codec_generate_fields(llvm_context *llvm, LLVMBuilderRef builder, LLVMValueRef record) {
   LLVMValueRef fields_address = LLVMBuildAdd(builder, record, llvm->record_fields_offset, "fields_address");
-  KVS_JIT_CHECK_LLVM_ERROR_GOTO(st, INTERNAL_ERROR, cleanup_exit, fields_address);
+  KVS_JIT_CHECK_NOT_NULL(fields_address);
   LLVMValueRef fields_address_ptr = LLVMBuildIntToPtr(builder, fields_address, llvm->int64_pointer, "fields_address_pointer");
-  KVS_JIT_CHECK_LLVM_ERROR_GOTO(st, INTERNAL_ERROR, cleanup_exit, fields_address_ptr);
-  LLVMValueRef fields_array_address = LLVMBuildLoad(builder, fields_address_ptr, "fields_array_address");
-  KVS_JIT_CHECK_LLVM_ERROR_GOTO(st, INTERNAL_ERROR, cleanup_exit, fields_array_address);
-
-  for (idx = 0; idx < key_size; ++idx) {
-    const kvs_column *column = keys[idx];
-    LLVMValueRef field_index = LLVMConstInt(llvm->int64_type, column->index, 0);
-    KVS_JIT_CHECK_LLVM_ERROR_GOTO(st, INTERNAL_ERROR, cleanup_exit, field_index);
-    llvm_serialize_name(llvm, "pk@%zd", idx);
-    LLVMValueRef field = kvs_schema_jit_codec_generate_record_get(llvm, builder, fields_array_address, field_index);
-    KVS_JIT_CHECK_LLVM_ERROR_GOTO(st, INTERNAL_ERROR, cleanup_exit, field);
-    LLVMValueRef serialize_args[] = { field, key };
-    switch (column->type) {
-      case KVS_VARIANT_TYPE_INT32:
-        KVS_JIT_CHECK_LLVM_ERROR_GOTO(st, INTERNAL_ERROR, cleanup_exit, 
-            LLVMBuildCall(builder, llvm->serialize_comparable_int32, serialize_args, KVS_ARRAY_SIZE(serialize_args), ""));
-        break;
-      case KVS_VARIANT_TYPE_INT64:
-        KVS_JIT_CHECK_LLVM_ERROR_GOTO(st, INTERNAL_ERROR, cleanup_exit, 
-            LLVMBuildCall(builder, llvm->serialize_comparable_int64, serialize_args, KVS_ARRAY_SIZE(serialize_args), ""));
-        break;
-      case KVS_VARIANT_TYPE_FLOAT:
-        KVS_JIT_CHECK_LLVM_ERROR_GOTO(st, INTERNAL_ERROR, cleanup_exit, 
-            LLVMBuildCall(builder, llvm->serialize_comparable_float, serialize_args, KVS_ARRAY_SIZE(serialize_args), ""));
-        break;
-      case KVS_VARIANT_TYPE_DOUBLE:
-        KVS_JIT_CHECK_LLVM_ERROR_GOTO(st, INTERNAL_ERROR, cleanup_exit, 
-            LLVMBuildCall(builder, llvm->serialize_comparable_double, serialize_args, KVS_ARRAY_SIZE(serialize_args), ""));
-        break;
-      case KVS_VARIANT_TYPE_OPAQUE:
-        KVS_JIT_CHECK_LLVM_ERROR_GOTO(st, INTERNAL_ERROR, cleanup_exit, 
-            LLVMBuildCall(builder, llvm->serialize_comparable_opaque, serialize_args, KVS_ARRAY_SIZE(serialize_args), ""));
-        break;
-      default:
-        break;
+  KVS_JIT_CHECK_NOT_NULL(fields_address_ptr);
+  return LLVMBuildLoad2(builder, llvm->int64_type, fields_address_ptr, "fields_array_address");
+}
+
+static LLVMValueRef kvs_schema_jit_codec_generate_variant(llvm_context *llvm, LLVMBuilderRef builder, LLVMValueRef fields, const kvs_column *column, int32_t deref) {
+  LLVMValueRef field_index = LLVMConstInt(llvm->int64_type, column->index, 0);
+  KVS_JIT_CHECK_NOT_NULL(field_index);
+  if (deref) {
+    return kvs_schema_jit_codec_generate_record_get_deref(llvm, builder, fields, field_index);
+  } else {
+    return kvs_schema_jit_codec_generate_record_get(llvm, builder, fields, field_index);
+  }
+}
+
+/*
+ * Consecutive columns are encoded into one allocation sized up front, only
+ * dictionary columns, whose encoded size is not known in advance, go through
+ * the runtime and split the record into several allocations.
+ */
+static kvs_status kvs_schema_jit_codec_generate_encoder(llvm_context *llvm, LLVMBuilderRef builder, LLVMValueRef fields, LLVMValueRef buffer,
+    const kvs_column **columns, size_t size, int32_t comparable, const char *prefix) {
+  kvs_status st;
+  size_t begin = 0, end, idx;
+  LLVMValueRef variant, total, column_size, cursor;
+  while (begin < size) {
+    if (columns[begin]->dictionary != NULL) {
+      llvm_serialize_name(llvm, "%s@%zd", prefix, begin);
+      KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, variant = kvs_schema_jit_codec_generate_variant(llvm, builder, fields, columns[begin], 1));
+      KVS_DO(st, kvs_schema_jit_generate_dictionary_codec(llvm, builder, llvm->serialize_dictionary, buffer, variant, columns[begin]->dictionary));
+      ++begin;
+      continue;
     }
+    for (end = begin; end < size && columns[end]->dictionary == NULL; ++end) {
+    }
+    total = LLVMConstInt(llvm->int64_type, 0, 0);
+    for (idx = begin; idx < end; ++idx) {
+      llvm_serialize_name(llvm, "%s@%zd", prefix, idx);
+      KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, variant = kvs_schema_jit_codec_generate_variant(llvm, builder, fields, columns[idx], 1));
+      KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, column_size = kvs_schema_jit_generate_encoded_size(llvm, builder, variant, columns[idx]->type, comparable));
+      KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, total = LLVMBuildAdd(builder, total, column_size, llvm_name_with_suffix(llvm, "@total")));
+    }
+    LLVMValueRef allocate_args[] = { buffer, total };
+    llvm_serialize_name(llvm, "%s@%zd", prefix, begin);
+    KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, cursor = kvs_schema_jit_build_call(builder, llvm->buffer_allocate, allocate_args, KVS_ARRAY_SIZE(allocate_args), llvm_name_with_suffix(llvm, "@allocate")));
+    for (idx = begin; idx < end; ++idx) {
+      llvm_serialize_name(llvm, "%s@%zd", prefix, idx);
+      KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, variant = kvs_schema_jit_codec_generate_variant(llvm, builder, fields, columns[idx], 1));
+      if (comparable) {
+        cursor = kvs_schema_jit_generate_comparable_encoder(llvm, builder, variant, kvs_schema_jit_variant_offset(llvm, columns[idx]->type), cursor, columns[idx]->type);
+      } else {
+        cursor = kvs_schema_jit_generate_value_encoder(llvm, builder, variant, kvs_schema_jit_variant_offset(llvm, columns[idx]->type), cursor, columns[idx]->type);
+      }
+      KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, cursor);
+    }
+    begin = end;
   }
+  return KVS_OK;
+}
 
-  for (idx = 0; idx < value_size; ++idx) {
-    const kvs_column *column = values[idx];
-    LLVMValueRef field_index = LLVMConstInt(llvm->int64_type, column->index, 0);
-    KVS_JIT_CHECK_LLVM_ERROR_GOTO(st, INTERNAL_ERROR, cleanup_exit, field_index);
-    llvm_serialize_name(llvm, "column@%zd", idx);
-    LLVMValueRef field = kvs_schema_jit_codec_generate_record_get_deref(llvm, builder, fields_array_address, field_index);
-    KVS_JIT_CHECK_LLVM_ERROR_GOTO(st, INTERNAL_ERROR, cleanup_exit, field);
-    switch (column->type) {
-      case KVS_VARIANT_TYPE_INT32:
-        KVS_DO_GOTO(st, cleanup_exit, kvs_schema_jit_generate_primitive_serializer(llvm, builder, value, field, llvm->variant_int32_offset, llvm->variant_int32_size));
-        break;
-      case KVS_VARIANT_TYPE_INT64:
-        KVS_DO_GOTO(st, cleanup_exit, kvs_schema_jit_generate_primitive_serializer(llvm, builder, value, field, llvm->variant_int64_offset, llvm->variant_int64_size));
-        break;
-      case KVS_VARIANT_TYPE_FLOAT:
-        KVS_DO_GOTO(st, cleanup_exit, kvs_schema_jit_generate_primitive_serializer(llvm, builder, value, field, llvm->variant_float_offset, llvm->variant_float_size));
-        break;
-      case KVS_VARIANT_TYPE_DOUBLE:
-        KVS_DO_GOTO(st, cleanup_exit, kvs_schema_jit_generate_primitive_serializer(llvm, builder, value, field, llvm->variant_double_offset, llvm->variant_double_size));
-        break;
-      case KVS_VARIANT_TYPE_OPAQUE:
-        KVS_DO_GOTO(st, cleanup_exit, kvs_schema_jit_generate_opaque_serializer(llvm, builder, value, field, llvm->variant_opaque_data_offset, llvm->variant_opaque_size_offset, llvm->variant_opaque_size_size));
-        break;
-      default:
-        break;
+static size_t kvs_schema_jit_codec_max_span(const kvs_column **columns, size_t size, size_t max_span) {
+  size_t idx, span = 0;
+  for (idx = 0; idx < size; ++idx) {
+    if (columns[idx]->type == KVS_VARIANT_TYPE_OPAQUE) {
+      span = 0;
+    } else if ((span += kvs_schema_jit_fixed_size(columns[idx]->type)) > max_span) {
+      max_span = span;
     }
   }
-  KVS_JIT_CHECK_LLVM_ERROR_GOTO(st, INTERNAL_ERROR, cleanup_exit, LLVMBuildRetVoid(builder));
+  return max_span;
+}
+
+/*
+ * Runs of fixed size columns are decoded with plain loads from one span of
+ * the buffer, which is copied into scratch only when it crosses blocks.
+ */
+static kvs_status kvs_schema_jit_codec_generate_decoder(llvm_context *llvm, LLVMBuilderRef builder, LLVMValueRef fields, LLVMValueRef buffer, LLVMValueRef scratch,
+    const kvs_column **columns, size_t size, int32_t comparable, const char *prefix) {
+  kvs_status st;
+  size_t begin = 0, end, idx, span, offset;
+  LLVMValueRef field, data, span_size;
+  while (begin < size) {
+    if (columns[begin]->type == KVS_VARIANT_TYPE_OPAQUE) {
+      llvm_serialize_name(llvm, "%s@%zd", prefix, begin);
+      KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, field = kvs_schema_jit_codec_generate_variant(llvm, builder, fields, columns[begin], 0));
+      if (columns[begin]->dictionary != NULL) {
+        KVS_DO(st, kvs_schema_jit_generate_dictionary_codec(llvm, builder, llvm->deserialize_dictionary, buffer, field, columns[begin]->dictionary));
+      } else {
+        LLVMValueRef args[] = { field, buffer };
+        KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, kvs_schema_jit_build_call(builder, comparable ? llvm->deserialize_comparable_opaque : llvm->deserialize_opaque, args, KVS_ARRAY_SIZE(args), ""));
+      }
+      ++begin;
+      continue;
+    }
+    for (end = begin, span = 0; end < size && columns[end]->type != KVS_VARIANT_TYPE_OPAQUE; ++end) {
+      span += kvs_schema_jit_fixed_size(columns[end]->type);
+    }
+    llvm_serialize_name(llvm, "%s@%zd", prefix, begin);
+    KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, span_size = LLVMConstInt(llvm->int64_type, span, 0));
+    LLVMValueRef fetch_args[] = { buffer, span_size, scratch };
+    KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, data = kvs_schema_jit_build_call(builder, llvm->buffer_fetch, fetch_args, KVS_ARRAY_SIZE(fetch_args), llvm_name_with_suffix(llvm, "@span")));
+    for (idx = begin, offset = 0; idx < end; ++idx) {
+      llvm_serialize_name(llvm, "%s@%zd", prefix, idx);
+      KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, field = kvs_schema_jit_codec_generate_variant(llvm, builder, fields, columns[idx], 1));
+      KVS_DO(st, kvs_schema_jit_generate_fixed_decoder(llvm, builder, data, offset, field, kvs_schema_jit_variant_offset(llvm, columns[idx]->type), columns[idx]->type, comparable));
+      offset += kvs_schema_jit_fixed_size(columns[idx]->type);
+    }
+    LLVMValueRef release_args[] = { buffer, data, span_size, scratch };
+    KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, kvs_schema_jit_build_call(builder, llvm->buffer_release, release_args, KVS_ARRAY_SIZE(release_args), ""));
+    begin = end;
+  }
+  return KVS_OK;
+}
+
+static kvs_status kvs_schema_jit_codec_generate_serializer(llvm_context *llvm, LLVMBuilderRef builder, const kvs_column **keys, size_t key_size, const kvs_column **values, size_t value_size) {
+  kvs_status st;
+  char symbol[64];
+  LLVMValueRef function, record, key, value, fields, no_key;
+  LLVMBasicBlockRef body, encode_key, encode_value;
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, function = LLVMAddFunction(llvm->module, kvs_schema_jit_symbol(llvm, symbol, sizeof(symbol), "serialize"), llvm->entry_type));
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, body = LLVMAppendBasicBlockInContext(llvm->context, function, "serialize_body"));
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, encode_key = LLVMAppendBasicBlockInContext(llvm->context, function, "serialize_key"));
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, encode_value = LLVMAppendBasicBlockInContext(llvm->context, function, "serialize_value"));
+  LLVMPositionBuilderAtEnd(builder, body);
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, record = LLVMGetParam(function, 0));
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, key = LLVMGetParam(function, 1));
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, value = LLVMGetParam(function, 2));
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, fields = kvs_schema_jit_codec_generate_fields(llvm, builder, record));
+  /* a NULL key serializes the value only */
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, no_key = LLVMBuildIsNull(builder, key, "no_key"));
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, LLVMBuildCondBr(builder, no_key, encode_value, encode_key));
+  LLVMPositionBuilderAtEnd(builder, encode_key);
+  KVS_DO(st, kvs_schema_jit_codec_generate_encoder(llvm, builder, fields, key, keys, key_size, 1, "pk"));
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, LLVMBuildBr(builder, encode_value));
+  LLVMPositionBuilderAtEnd(builder, encode_value);
+  KVS_DO(st, kvs_schema_jit_codec_generate_encoder(llvm, builder, fields, value, values, value_size, 0, "column"));
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, LLVMBuildRetVoid(builder));
+  return KVS_OK;
+}
 
-  KVS_JIT_CHECK_LLVM_ERROR_GOTO(st, INTERNAL_ERROR, cleanup_exit, 
-      deserializer = LLVMAddFunction(llvm->module, "deserialize", llvm->entry_type));
-  KVS_JIT_CHECK_LLVM_ERROR_GOTO(st, INTERNAL_ERROR, cleanup_exit, 
-      body = LLVMAppendBasicBlock(deserializer, "deserialize_body"));
+static kvs_status kvs_schema_jit_codec_generate_deserializer(llvm_context *llvm, LLVMBuilderRef builder, const kvs_column **keys, size_t key_size, const kvs_column **values, size_t value_size) {
+  kvs_status st;
+  char symbol[64];
+  size_t max_span;
+  LLVMValueRef function, record, key, value, fields, scratch;
+  LLVMBasicBlockRef body;
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, function = LLVMAddFunction(llvm->module, kvs_schema_jit_symbol(llvm, symbol, sizeof(symbol), "deserialize"), llvm->entry_type));
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, body = LLVMAppendBasicBlockInContext(llvm->context, function, "deserialize_body"));
   LLVMPositionBuilderAtEnd(builder, body);
-  KVS_JIT_CHECK_LLVM_ERROR_GOTO(st, INTERNAL_ERROR, cleanup_exit, record = LLVMGetParam(deserializer, 0));
-  KVS_JIT_CHECK_LLVM_ERROR_GOTO(st, INTERNAL_ERROR, cleanup_exit, key = LLVMGetParam(deserializer, 1));
-  KVS_JIT_CHECK_LLVM_ERROR_GOTO(st, INTERNAL_ERROR, cleanup_exit, value = LLVMGetParam(deserializer, 2));
-  KVS_JIT_CHECK_LLVM_ERROR_GOTO(st, INTERNAL_ERROR, cleanup_exit, fields_address = LLVMBuildAdd(builder, record, llvm->record_fields_offset, "fields_address"));
-  KVS_JIT_CHECK_LLVM_ERROR_GOTO(st, INTERNAL_ERROR, cleanup_exit, fields_address_ptr = LLVMBuildIntToPtr(builder, fields_address, llvm->int64_pointer, "fields_address_pointer"));
-  KVS_JIT_CHECK_LLVM_ERROR_GOTO(st, INTERNAL_ERROR, cleanup_exit, fields_array_address = LLVMBuildLoad(builder, fields_address_ptr, "fields_array_address"));
-
-  for (idx = 0; idx < key_size; ++idx) {
-    const kvs_column *column = keys[idx];
-    LLVMValueRef field_index = LLVMConstInt(llvm->int64_type, column->index, 0);
-    KVS_JIT_CHECK_LLVM_ERROR_GOTO(st, INTERNAL_ERROR, cleanup_exit, field_index);
-    llvm_serialize_name(llvm, "pk@%zd", idx);
-    LLVMValueRef field = kvs_schema_jit_codec_generate_record_get(llvm, builder, fields_array_address, field_index);
-    KVS_JIT_CHECK_LLVM_ERROR_GOTO(st, INTERNAL_ERROR, cleanup_exit, field);
-    LLVMValueRef deserialize_args[] = { field, key };
-    switch (column->type) {
-      case KVS_VARIANT_TYPE_INT32:
-        KVS_JIT_CHECK_LLVM_ERROR_GOTO(st, INTERNAL_ERROR, cleanup_exit, 
-            LLVMBuildCall(builder, llvm->deserialize_comparable_int32, deserialize_args, KVS_ARRAY_SIZE(deserialize_args), ""));
-        break;
-      case KVS_VARIANT_TYPE_INT64:
-        KVS_JIT_CHECK_LLVM_ERROR_GOTO(st, INTERNAL_ERROR, cleanup_exit, 
-            LLVMBuildCall(builder, llvm->deserialize_comparable_int64, deserialize_args, KVS_ARRAY_SIZE(deserialize_args), ""));
-        break;
-      case KVS_VARIANT_TYPE_FLOAT:
-        KVS_JIT_CHECK_LLVM_ERROR_GOTO(st, INTERNAL_ERROR, cleanup_exit, 
-            LLVMBuildCall(builder, llvm->deserialize_comparable_float, deserialize_args, KVS_ARRAY_SIZE(deserialize_args), ""));
-        break;
-      case KVS_VARIANT_TYPE_DOUBLE:
-        KVS_JIT_CHECK_LLVM_ERROR_GOTO(st, INTERNAL_ERROR, cleanup_exit, 
-            LLVMBuildCall(builder, llvm->deserialize_comparable_double, deserialize_args, KVS_ARRAY_SIZE(deserialize_args), ""));
-        break;
-      case KVS_VARIANT_TYPE_OPAQUE:
-        KVS_JIT_CHECK_LLVM_ERROR_GOTO(st, INTERNAL_ERROR, cleanup_exit, 
-            LLVMBuildCall(builder, llvm->deserialize_comparable_opaque, deserialize_args, KVS_ARRAY_SIZE(deserialize_args), ""));
-        break;
-      default:
-        break;
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, record = LLVMGetParam(function, 0));
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, key = LLVMGetParam(function, 1));
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, value = LLVMGetParam(function, 2));
+  /* scratch lives in the entry block so it stays a static allocation after inlining */
+  max_span = kvs_schema_jit_codec_max_span(values, value_size, kvs_schema_jit_codec_max_span(keys, key_size, 1));
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, scratch = LLVMBuildAlloca(builder, LLVMArrayType(llvm->int8_type, max_span), "scratch"));
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, scratch = LLVMBuildPtrToInt(builder, scratch, llvm->int64_type, "scratch_address"));
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, fields = kvs_schema_jit_codec_generate_fields(llvm, builder, record));
+  KVS_DO(st, kvs_schema_jit_codec_generate_decoder(llvm, builder, fields, key, scratch, keys, key_size, 1, "pk"));
+  KVS_DO(st, kvs_schema_jit_codec_generate_decoder(llvm, builder, fields, value, scratch, values, value_size, 0, "column"));
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, LLVMBuildRetVoid(builder));
+  return KVS_OK;
+}
+
+static kvs_status kvs_schema_jit_codec_generate(llvm_context *llvm, int32_t entries, const kvs_column **keys, size_t key_size, const kvs_column **values, size_t value_size) {
+  kvs_status st = KVS_OK;
+  LLVMBuilderRef builder = NULL;
+  KVS_JIT_CHECK_LLVM_ERROR_GOTO(st, INTERNAL_ERROR, cleanup_exit, builder = LLVMCreateBuilderInContext(llvm->context));
+  if ((entries & KVS_SCHEMA_JIT_ENTRY_SERIALIZE) == KVS_SCHEMA_JIT_ENTRY_SERIALIZE) {
+    KVS_DO_GOTO(st, cleanup_exit, kvs_schema_jit_codec_generate_serializer(llvm, builder, keys, key_size, values, value_size));
+  }
+  if ((entries & KVS_SCHEMA_JIT_ENTRY_DESERIALIZE) == KVS_SCHEMA_JIT_ENTRY_DESERIALIZE) {
+    KVS_DO_GOTO(st, cleanup_exit, kvs_schema_jit_codec_generate_deserializer(llvm, builder, keys, key_size, values, value_size));
+  }
+cleanup_exit:
+  if (builder != NULL) { LLVMDisposeBuilder(builder); }
+  return st;
+}
+
+static int32_t kvs_schema_jit_codec_match(const kvs_schema_jit_codec *codec, const kvs_column **keys, size_t key_size, const kvs_column **values, size_t value_size) {
+  size_t idx;
+  const kvs_column *column;
+  if (codec->key_size != key_size || codec->value_size != value_size) {
+    return 0;
+  }
+  for (idx = 0; idx < key_size + value_size; ++idx) {
+    column = idx < key_size ? keys[idx] : values[idx - key_size];
+    if (codec->columns[idx].index != column->index || codec->columns[idx].type != column->type || codec->columns[idx].dictionary != column->dictionary) {
+      return 0;
     }
   }
+  return 1;
+}
 
-  for (idx = 0; idx < value_size; ++idx) {
-    const kvs_column *column = values[idx];
-    LLVMValueRef field_index = LLVMConstInt(llvm->int64_type, column->index, 0);
-    KVS_JIT_CHECK_LLVM_ERROR_GOTO(st, INTERNAL_ERROR, cleanup_exit, field_index);
-    llvm_serialize_name(llvm, "column@%zd", idx);
-    LLVMValueRef field = kvs_schema_jit_codec_generate_record_get(llvm, builder, fields_array_address, field_index);
-    KVS_JIT_CHECK_LLVM_ERROR_GOTO(st, INTERNAL_ERROR, cleanup_exit, field);
-    switch (column->type) {
-      case KVS_VARIANT_TYPE_INT32:
-        KVS_DO_GOTO(st, cleanup_exit, kvs_schema_jit_generate_primitive_deserializer(llvm, builder, value, field, llvm->variant_int32_offset, llvm->variant_int32_size));
-        break;
-      case KVS_VARIANT_TYPE_INT64:
-        KVS_DO_GOTO(st, cleanup_exit, kvs_schema_jit_generate_primitive_deserializer(llvm, builder, value, field, llvm->variant_int64_offset, llvm->variant_int64_size));
-        break;
-      case KVS_VARIANT_TYPE_FLOAT:
-        KVS_DO_GOTO(st, cleanup_exit, kvs_schema_jit_generate_primitive_deserializer(llvm, builder, value, field, llvm->variant_float_offset, llvm->variant_float_size));
-        break;
-      case KVS_VARIANT_TYPE_DOUBLE:
-        KVS_DO_GOTO(st, cleanup_exit, kvs_schema_jit_generate_primitive_deserializer(llvm, builder, value, field, llvm->variant_double_offset, llvm->variant_double_size));
-        break;
-      case KVS_VARIANT_TYPE_OPAQUE:
-        {
-          LLVMValueRef args[] = { field, value };
-          KVS_JIT_CHECK_LLVM_ERROR_GOTO(st, INTERNAL_ERROR, cleanup_exit, LLVMBuildCall(builder, llvm->deserialize_opaque, args, KVS_ARRAY_SIZE(args), ""));
-        }
-        break;
-      default:
-        break;
+static kvs_status kvs_schema_jit_codec_compile(kvs_schema_jit_codec *jit, int32_t entries, const kvs_column **keys, size_t key_size, const kvs_column **values, size_t value_size) {
+  kvs_status st;
+  char symbol[64];
+  llvm_context *llvm = &jit->llvm;
+  LLVMOrcExecutorAddress serialize_addr = 0, deserialize_addr = 0;
+  if (llvm->tracker == NULL) {
+    KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, llvm->tracker = LLVMOrcJITDylibCreateResourceTracker(LLVMOrcLLJITGetMainJITDylib(llvm_jit)));
+  }
+  if (KVS_FAILED(kvs_schema_jit_cache_load(llvm, entries))) {
+    if (KVS_FAILED(st = kvs_jit_llvm_context_init(llvm)) ||
+        KVS_FAILED(st = kvs_schema_jit_codec_generate(llvm, entries, keys, key_size, values, value_size)) ||
+        KVS_FAILED(st = kvs_schema_jit_compile(llvm, entries))) {
+      kvs_jit_llvm_context_release(llvm);
+      return st;
+    }
+  }
+  if ((entries & KVS_SCHEMA_JIT_ENTRY_SERIALIZE) == KVS_SCHEMA_JIT_ENTRY_SERIALIZE) {
+    KVS_DO(st, kvs_schema_jit_lookup(llvm, "serialize", &serialize_addr));
+    if (kvs_schema_jit_perf_map()) {
+      kvs_schema_jit_perf_map_add(serialize_addr, llvm->serialize_size, kvs_schema_jit_symbol(llvm, symbol, sizeof(symbol), "serialize"), keys, key_size, values, value_size);
+    }
+    __atomic_store_n(&jit->serializer, (jit_serializer_entry) serialize_addr, __ATOMIC_RELEASE);
+  }
+  if ((entries & KVS_SCHEMA_JIT_ENTRY_DESERIALIZE) == KVS_SCHEMA_JIT_ENTRY_DESERIALIZE) {
+    KVS_DO(st, kvs_schema_jit_lookup(llvm, "deserialize", &deserialize_addr));
+    if (kvs_schema_jit_perf_map()) {
+      kvs_schema_jit_perf_map_add(deserialize_addr, llvm->deserialize_size, kvs_schema_jit_symbol(llvm, symbol, sizeof(symbol), "deserialize"), keys, key_size, values, value_size);
     }
+    __atomic_store_n(&jit->deserializer, (jit_deserializer_entry) deserialize_addr, __ATOMIC_RELEASE);
+  }
+  return KVS_OK;
+}
+
+/* compiles the missing entry points, the first caller compiles while the others wait */
+static kvs_status kvs_schema_jit_codec_ensure(kvs_schema_jit_codec *jit, int32_t entries, const kvs_column **keys, size_t key_size, const kvs_column **values, size_t value_size) {
+  kvs_status st = KVS_OK;
+  pthread_mutex_lock(&jit->lock);
+  if (jit->serializer != NULL) {
+    entries &= ~KVS_SCHEMA_JIT_ENTRY_SERIALIZE;
   }
+  if (jit->deserializer != NULL) {
+    entries &= ~KVS_SCHEMA_JIT_ENTRY_DESERIALIZE;
+  }
+  if ((entries & jit->failed) != 0) {
+    st = KVS_SCHEMA_JIT_INTERNAL_ERROR;
+  } else if (entries != 0 && KVS_FAILED(st = kvs_schema_jit_codec_compile(jit, entries, keys, key_size, values, value_size))) {
+    jit->failed |= entries;
+  }
+  pthread_mutex_unlock(&jit->lock);
+  return st;
+}
 
-  KVS_JIT_CHECK_LLVM_ERROR_GOTO(st, INTERNAL_ERROR, cleanup_exit, LLVMBuildRetVoid(builder));
-  LLVMDisposeBuilder(builder);
-  KVS_DO_GOTO(st, cleanup_exit, kvs_schema_jit_compile(llvm));
-  LLVMOrcTargetAddress serialize_addr = 0, deserialize_addr = 0;
-  if (LLVMOrcGetSymbolAddress(llvm_orc, &serialize_addr, "serialize") != LLVMOrcErrSuccess) {
-    goto cleanup_exit;
+static void *kvs_schema_jit_codec_open(const kvs_column **keys, size_t key_size, const kvs_column **values, size_t value_size, int32_t entries) {
+  size_t idx;
+  uint64_t fingerprint;
+  int32_t cacheable = 1, generation = 0;
+  const kvs_column *column;
+  kvs_schema_jit_codec *jit = NULL;
+  kvs_init_llvm();
+  if (llvm_jit == NULL) {
+    return NULL;
   }
-  if (LLVMOrcGetSymbolAddress(llvm_orc, &deserialize_addr, "deserialize") != LLVMOrcErrSuccess) {
-    goto cleanup_exit;
+  fingerprint = kvs_schema_jit_fingerprint(keys, key_size, values, value_size);
+  pthread_mutex_lock(&codec_registry_lock);
+  for (jit = codec_registry; jit != NULL; jit = jit->next) {
+    if (jit->llvm.fingerprint == fingerprint) {
+      if (kvs_schema_jit_codec_match(jit, keys, key_size, values, value_size)) {
+        jit->references++;
+        break;
+      }
+      /* never share a cached object between colliding fingerprints */
+      cacheable = 0;
+      generation = jit->llvm.generation >= generation ? jit->llvm.generation + 1 : generation;
+    }
+  }
+  if (jit == NULL) {
+    jit = calloc(1, sizeof(kvs_schema_jit_codec) + sizeof(kvs_schema_jit_column) * (key_size + value_size));
+    if (jit == NULL) {
+      pthread_mutex_unlock(&codec_registry_lock);
+      return NULL;
+    }
+    pthread_mutex_init(&jit->lock, NULL);
+    jit->references = 1;
+    jit->key_size = key_size;
+    jit->value_size = value_size;
+    jit->columns = KVS_UNSAFE_CAST(jit, sizeof(kvs_schema_jit_codec));
+    for (idx = 0; idx < key_size + value_size; ++idx) {
+      column = idx < key_size ? keys[idx] : values[idx - key_size];
+      jit->columns[idx].index = column->index;
+      jit->columns[idx].type = column->type;
+      jit->columns[idx].dictionary = column->dictionary;
+    }
+    jit->llvm.fingerprint = fingerprint;
+    jit->llvm.generation = generation;
+    jit->llvm.cacheable = cacheable && kvs_schema_jit_cacheable(values, value_size);
+    jit->next = codec_registry;
+    codec_registry = jit;
+  }
+  pthread_mutex_unlock(&codec_registry_lock);
+  /* compilation runs outside of the registry lock so distinct codecs compile in parallel */
+  if (KVS_FAILED(kvs_schema_jit_codec_ensure(jit, entries, keys, key_size, values, value_size))) {
+    kvs_schema_jit_codec_destroy(keys, key_size, values, value_size, jit);
+    return NULL;
   }
-  jit->serializer = (jit_serializer_entry) serialize_addr;
-  jit->deserializer = (jit_deserializer_entry) deserialize_addr;
   return jit;
-cleanup_exit:
-  if (jit != NULL) { kvs_jit_llvm_context_fini(&jit->llvm); free(jit); }
-  if (builder != NULL) { LLVMDisposeBuilder(builder); }
-  return NULL;
+}
+
+void *kvs_schema_jit_codec_create(const kvs_column **keys, size_t key_size, const kvs_column **values, size_t value_size) {
+  return kvs_schema_jit_codec_open(keys, key_size, values, value_size, KVS_SCHEMA_JIT_ENTRY_ALL);
+}
+
+void *kvs_schema_jit_lazy_codec_create(const kvs_column **keys, size_t key_size, const kvs_column **values, size_t value_size) {
+  return kvs_schema_jit_codec_open(keys, key_size, values, value_size, 0);
 }
 
 void kvs_schema_jit_codec_destroy(const kvs_column **keys, size_t key_size, const kvs_column **values, size_t value_size, void *opaque) {
-  kvs_schema_jit_codec *codec = opaque;
+  kvs_schema_jit_codec *codec = opaque, **current;
   if (codec == NULL) {
     return;
   }
+  pthread_mutex_lock(&codec_registry_lock);
+  if (--codec->references > 0) {
+    pthread_mutex_unlock(&codec_registry_lock);
+    return;
+  }
+  for (current = &codec_registry; *current != NULL; current = &(*current)->next) {
+    if (*current == codec) {
+      *current = codec->next;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&codec_registry_lock);
   kvs_jit_llvm_context_fini(&codec->llvm);
+  pthread_mutex_destroy(&codec->lock);
   free(codec);
 }
 
+/* entry points that fail to compile lazily fall back to the interpreter */
 void kvs_schema_jit_serializer(const kvs_column **keys, size_t key_size, const kvs_column **values, size_t value_size, kvs_record *record, kvs_buffer *key, kvs_buffer *value, void *opaque) {
-  kvs_schema_jit_codec *serializer = opaque;
-  serializer->serializer(record, key, value);
+  kvs_schema_jit_codec *codec = opaque;
+  jit_serializer_entry serializer = __atomic_load_n(&codec->serializer, __ATOMIC_ACQUIRE);
+  if (serializer == NULL) {
+    if (KVS_FAILED(kvs_schema_jit_codec_ensure(codec, KVS_SCHEMA_JIT_ENTRY_SERIALIZE, keys, key_size, values, value_size))) {
+      kvs_schema_interpret_serializer(keys, key_size, values, value_size, record, key, value, NULL);
+      return;
+    }
+    serializer = __atomic_load_n(&codec->serializer, __ATOMIC_ACQUIRE);
+  }
+  serializer(record, key, value);
 }
 
 void kvs_schema_jit_deserializer(const kvs_column **keys, size_t key_size, const kvs_column **values, size_t value_size, kvs_buffer *key, kvs_buffer *value, void *opaque, kvs_record *dest) {
-  kvs_schema_jit_codec *serializer = opaque;
-  serializer->deserializer(dest, key, value);
+  kvs_schema_jit_codec *codec = opaque;
+  jit_deserializer_entry deserializer = __atomic_load_n(&codec->deserializer, __ATOMIC_ACQUIRE);
+  if (deserializer == NULL) {
+    if (KVS_FAILED(kvs_schema_jit_codec_ensure(codec, KVS_SCHEMA_JIT_ENTRY_DESERIALIZE, keys, key_size, values, value_size))) {
+      kvs_schema_interpret_deserializer(keys, key_size, values, value_size, key, value, NULL, dest);
+      return;
+    }
+    deserializer = __atomic_load_n(&codec->deserializer, __ATOMIC_ACQUIRE);
+  }
+  deserializer(dest, key, value);
+}
+
+static LLVMValueRef kvs_schema_jit_struct_generate_field_load(llvm_context *llvm, LLVMBuilderRef builder, LLVMValueRef object, size_t offset) {
+  return kvs_schema_jit_generate_load(llvm, builder, object, LLVMConstInt(llvm->int64_type, offset, 0), llvm->int64_type, sizeof(int64_t));
+}
+
+static LLVMValueRef kvs_schema_jit_struct_generate_field_address(llvm_context *llvm, LLVMBuilderRef builder, LLVMValueRef object, size_t offset) {
+  return LLVMBuildAdd(builder, object, LLVMConstInt(llvm->int64_type, offset, 0), llvm_name_with_suffix(llvm, "@field_address"));
+}
+
+static LLVMValueRef kvs_schema_jit_struct_generate_encoded_size(llvm_context *llvm, LLVMBuilderRef builder, LLVMValueRef object,
+    const kvs_schema_struct_field *field, int32_t comparable) {
+  LLVMValueRef size;
+  if (field->type != KVS_VARIANT_TYPE_OPAQUE) {
+    return LLVMConstInt(llvm->int64_type, kvs_schema_jit_fixed_size(field->type), 0);
+  }
+  KVS_JIT_CHECK_NOT_NULL(size = kvs_schema_jit_struct_generate_field_load(llvm, builder, object, field->size_offset));
+  if (comparable) {
+    return kvs_schema_jit_build_call(builder, llvm->opaque_comparable_size, &size, 1, llvm_name_with_suffix(llvm, "@encoded_size"));
+  }
+  return LLVMBuildAdd(builder, size, llvm->variant_opaque_size_size, llvm_name_with_suffix(llvm, "@encoded_size"));
+}
+
+static LLVMValueRef kvs_schema_jit_struct_generate_opaque_encoder(llvm_context *llvm, LLVMBuilderRef builder, LLVMValueRef object,
+    const kvs_schema_struct_field *field, LLVMValueRef cursor, int32_t comparable) {
+  LLVMValueRef data, size, encoded_size, dest, source;
+  KVS_JIT_CHECK_NOT_NULL(data = kvs_schema_jit_struct_generate_field_load(llvm, builder, object, field->offset));
+  KVS_JIT_CHECK_NOT_NULL(size = kvs_schema_jit_struct_generate_field_load(llvm, builder, object, field->size_offset));
+  if (comparable) {
+    LLVMValueRef args[] = { data, size, cursor };
+    KVS_JIT_CHECK_NOT_NULL(encoded_size = kvs_schema_jit_build_call(builder, llvm->opaque_encode_comparable, args, KVS_ARRAY_SIZE(args), llvm_name_with_suffix(llvm, "@encoded_size")));
+    return LLVMBuildAdd(builder, cursor, encoded_size, llvm_name_with_suffix(llvm, "@cursor"));
+  }
+  KVS_JIT_CHECK_NOT_NULL(encoded_size = LLVMBuildTrunc(builder, size, llvm->int32_type, llvm_name_with_suffix(llvm, "@opaque_size")));
+  KVS_JIT_CHECK_NOT_NULL(kvs_schema_jit_generate_store(llvm, builder, encoded_size, cursor, LLVMConstInt(llvm->int64_type, 0, 0), llvm->int32_type, 1));
+  KVS_JIT_CHECK_NOT_NULL(cursor = LLVMBuildAdd(builder, cursor, llvm->variant_opaque_size_size, llvm_name_with_suffix(llvm, "@opaque_data_cursor")));
+  KVS_JIT_CHECK_NOT_NULL(dest = LLVMBuildIntToPtr(builder, cursor, llvm->int8_pointer, llvm_name_with_suffix(llvm, "@opaque_dest")));
+  KVS_JIT_CHECK_NOT_NULL(source = LLVMBuildIntToPtr(builder, data, llvm->int8_pointer, llvm_name_with_suffix(llvm, "@opaque_data")));
+  LLVMValueRef args[] = { dest, source, size };
+  KVS_JIT_CHECK_NOT_NULL(kvs_schema_jit_build_call(builder, llvm->memcpy, args, KVS_ARRAY_SIZE(args), ""));
+  return LLVMBuildAdd(builder, cursor, size, llvm_name_with_suffix(llvm, "@cursor"));
+}
+
+/* same runs as the record encoder, fields are loaded from the struct instead of variants */
+static kvs_status kvs_schema_jit_struct_generate_encoder(llvm_context *llvm, LLVMBuilderRef builder, LLVMValueRef object, LLVMValueRef buffer,
+    const kvs_column **columns, size_t size, const kvs_schema_struct_field **fields, int32_t comparable, const char *prefix) {
+  size_t begin = 0, end, idx;
+  const kvs_schema_struct_field *field;
+  LLVMValueRef data, data_size, total, column_size, cursor;
+  while (begin < size) {
+    field = fields[columns[begin]->index];
+    if (columns[begin]->dictionary != NULL) {
+      llvm_serialize_name(llvm, "%s@%zd", prefix, begin);
+      KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, data = kvs_schema_jit_struct_generate_field_load(llvm, builder, object, field->offset));
+      KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, data_size = kvs_schema_jit_struct_generate_field_load(llvm, builder, object, field->size_offset));
+      LLVMValueRef args[] = { data, data_size, LLVMConstInt(llvm->int64_type, (uintptr_t) columns[begin]->dictionary, 0), buffer };
+      KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, kvs_schema_jit_build_call(builder, llvm->opaque_serialize_dictionary, args, KVS_ARRAY_SIZE(args), ""));
+      ++begin;
+      continue;
+    }
+    for (end = begin; end < size && columns[end]->dictionary == NULL; ++end) {
+    }
+    total = LLVMConstInt(llvm->int64_type, 0, 0);
+    for (idx = begin; idx < end; ++idx) {
+      llvm_serialize_name(llvm, "%s@%zd", prefix, idx);
+      KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, column_size = kvs_schema_jit_struct_generate_encoded_size(llvm, builder, object, fields[columns[idx]->index], comparable));
+      KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, total = LLVMBuildAdd(builder, total, column_size, llvm_name_with_suffix(llvm, "@total")));
+    }
+    LLVMValueRef allocate_args[] = { buffer, total };
+    llvm_serialize_name(llvm, "%s@%zd", prefix, begin);
+    KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, cursor = kvs_schema_jit_build_call(builder, llvm->buffer_allocate, allocate_args, KVS_ARRAY_SIZE(allocate_args), llvm_name_with_suffix(llvm, "@allocate")));
+    for (idx = begin; idx < end; ++idx) {
+      llvm_serialize_name(llvm, "%s@%zd", prefix, idx);
+      field = fields[columns[idx]->index];
+      if (field->type == KVS_VARIANT_TYPE_OPAQUE) {
+        cursor = kvs_schema_jit_struct_generate_opaque_encoder(llvm, builder, object, field, cursor, comparable);
+      } else if (comparable) {
+        cursor = kvs_schema_jit_generate_comparable_encoder(llvm, builder, object, LLVMConstInt(llvm->int64_type, field->offset, 0), cursor, field->type);
+      } else {
+        cursor = kvs_schema_jit_generate_value_encoder(llvm, builder, object, LLVMConstInt(llvm->int64_type, field->offset, 0), cursor, field->type);
+      }
+      KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, cursor);
+    }
+    begin = end;
+  }
+  return KVS_OK;
+}
+
+/* opaque fields are decoded into heap, or point into the dictionary, fixed size runs are loaded as in the record decoder */
+static kvs_status kvs_schema_jit_struct_generate_decoder(llvm_context *llvm, LLVMBuilderRef builder, LLVMValueRef object, LLVMValueRef buffer, LLVMValueRef heap,
+    LLVMValueRef scratch, const kvs_column **columns, size_t size, const kvs_schema_struct_field **fields, int32_t comparable, const char *prefix) {
+  kvs_status st;
+  size_t begin = 0, end, idx, span, offset;
+  const kvs_schema_struct_field *field;
+  LLVMValueRef data, data_field, size_field, span_size;
+  while (begin < size) {
+    field = fields[columns[begin]->index];
+    if (field->type == KVS_VARIANT_TYPE_OPAQUE) {
+      llvm_serialize_name(llvm, "%s@%zd", prefix, begin);
+      KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, data_field = kvs_schema_jit_struct_generate_field_address(llvm, builder, object, field->offset));
+      KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, size_field = kvs_schema_jit_struct_generate_field_address(llvm, builder, object, field->size_offset));
+      if (columns[begin]->dictionary != NULL) {
+        LLVMValueRef args[] = { data_field, size_field, LLVMConstInt(llvm->int64_type, (uintptr_t) columns[begin]->dictionary, 0), buffer };
+        KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, kvs_schema_jit_build_call(builder, llvm->opaque_deserialize_dictionary, args, KVS_ARRAY_SIZE(args), ""));
+      } else {
+        LLVMValueRef args[] = { data_field, size_field, buffer, heap };
+        KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, kvs_schema_jit_build_call(builder, comparable ? llvm->opaque_deserialize_comparable : llvm->opaque_deserialize, args, KVS_ARRAY_SIZE(args), ""));
+      }
+      ++begin;
+      continue;
+    }
+    for (end = begin, span = 0; end < size && columns[end]->type != KVS_VARIANT_TYPE_OPAQUE; ++end) {
+      span += kvs_schema_jit_fixed_size(columns[end]->type);
+    }
+    llvm_serialize_name(llvm, "%s@%zd", prefix, begin);
+    KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, span_size = LLVMConstInt(llvm->int64_type, span, 0));
+    LLVMValueRef fetch_args[] = { buffer, span_size, scratch };
+    KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, data = kvs_schema_jit_build_call(builder, llvm->buffer_fetch, fetch_args, KVS_ARRAY_SIZE(fetch_args), llvm_name_with_suffix(llvm, "@span")));
+    for (idx = begin, offset = 0; idx < end; ++idx) {
+      llvm_serialize_name(llvm, "%s@%zd", prefix, idx);
+      field = fields[columns[idx]->index];
+      KVS_DO(st, kvs_schema_jit_generate_fixed_decoder(llvm, builder, data, offset, object, LLVMConstInt(llvm->int64_type, field->offset, 0), field->type, comparable));
+      offset += kvs_schema_jit_fixed_size(field->type);
+    }
+    LLVMValueRef release_args[] = { buffer, data, span_size, scratch };
+    KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, kvs_schema_jit_build_call(builder, llvm->buffer_release, release_args, KVS_ARRAY_SIZE(release_args), ""));
+    begin = end;
+  }
+  return KVS_OK;
+}
+
+static kvs_status kvs_schema_jit_struct_generate_serializer(llvm_context *llvm, LLVMBuilderRef builder, const kvs_column **keys, size_t key_size,
+    const kvs_column **values, size_t value_size, const kvs_schema_struct_field **fields) {
+  kvs_status st;
+  char symbol[64];
+  LLVMValueRef function, object, key, value;
+  LLVMBasicBlockRef body;
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, function = LLVMAddFunction(llvm->module, kvs_schema_jit_symbol(llvm, symbol, sizeof(symbol), "serialize"), llvm->entry_type));
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, body = LLVMAppendBasicBlockInContext(llvm->context, function, "serialize_body"));
+  LLVMPositionBuilderAtEnd(builder, body);
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, object = LLVMGetParam(function, 0));
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, key = LLVMGetParam(function, 1));
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, value = LLVMGetParam(function, 2));
+  KVS_DO(st, kvs_schema_jit_struct_generate_encoder(llvm, builder, object, key, keys, key_size, fields, 1, "pk"));
+  KVS_DO(st, kvs_schema_jit_struct_generate_encoder(llvm, builder, object, value, values, value_size, fields, 0, "column"));
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, LLVMBuildRetVoid(builder));
+  return KVS_OK;
+}
+
+static kvs_status kvs_schema_jit_struct_generate_deserializer(llvm_context *llvm, LLVMBuilderRef builder, const kvs_column **keys, size_t key_size,
+    const kvs_column **values, size_t value_size, const kvs_schema_struct_field **fields) {
+  kvs_status st;
+  char symbol[64];
+  size_t max_span;
+  LLVMValueRef function, object, key, value, heap, scratch;
+  LLVMBasicBlockRef body;
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, function = LLVMAddFunction(llvm->module, kvs_schema_jit_symbol(llvm, symbol, sizeof(symbol), "deserialize"), llvm->struct_deserialize_type));
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, body = LLVMAppendBasicBlockInContext(llvm->context, function, "deserialize_body"));
+  LLVMPositionBuilderAtEnd(builder, body);
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, object = LLVMGetParam(function, 0));
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, key = LLVMGetParam(function, 1));
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, value = LLVMGetParam(function, 2));
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, heap = LLVMGetParam(function, 3));
+  max_span = kvs_schema_jit_codec_max_span(values, value_size, kvs_schema_jit_codec_max_span(keys, key_size, 1));
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, scratch = LLVMBuildAlloca(builder, LLVMArrayType(llvm->int8_type, max_span), "scratch"));
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, scratch = LLVMBuildPtrToInt(builder, scratch, llvm->int64_type, "scratch_address"));
+  KVS_DO(st, kvs_schema_jit_struct_generate_decoder(llvm, builder, object, key, heap, scratch, keys, key_size, fields, 1, "pk"));
+  KVS_DO(st, kvs_schema_jit_struct_generate_decoder(llvm, builder, object, value, heap, scratch, values, value_size, fields, 0, "column"));
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, LLVMBuildRetVoid(builder));
+  return KVS_OK;
+}
+
+static kvs_status kvs_schema_jit_struct_codec_generate(llvm_context *llvm, const kvs_column **keys, size_t key_size,
+    const kvs_column **values, size_t value_size, const kvs_schema_struct_field **fields) {
+  kvs_status st = KVS_OK;
+  LLVMBuilderRef builder = NULL;
+  KVS_JIT_CHECK_LLVM_ERROR_GOTO(st, INTERNAL_ERROR, cleanup_exit, builder = LLVMCreateBuilderInContext(llvm->context));
+  KVS_DO_GOTO(st, cleanup_exit, kvs_schema_jit_struct_generate_serializer(llvm, builder, keys, key_size, values, value_size, fields));
+  KVS_DO_GOTO(st, cleanup_exit, kvs_schema_jit_struct_generate_deserializer(llvm, builder, keys, key_size, values, value_size, fields));
+cleanup_exit:
+  if (builder != NULL) { LLVMDisposeBuilder(builder); }
+  return st;
+}
+
+static kvs_status kvs_schema_jit_struct_codec_compile(kvs_schema_jit_struct_codec *jit, const kvs_column **keys, size_t key_size,
+    const kvs_column **values, size_t value_size, const kvs_schema_struct_field **fields) {
+  kvs_status st;
+  char symbol[64];
+  llvm_context *llvm = &jit->llvm;
+  LLVMOrcExecutorAddress serialize_addr = 0, deserialize_addr = 0;
+  KVS_JIT_CHECK_LLVM_ERROR(INTERNAL_ERROR, llvm->tracker = LLVMOrcJITDylibCreateResourceTracker(LLVMOrcLLJITGetMainJITDylib(llvm_jit)));
+  if (KVS_FAILED(st = kvs_jit_llvm_context_init(llvm)) ||
+      KVS_FAILED(st = kvs_schema_jit_struct_codec_generate(llvm, keys, key_size, values, value_size, fields)) ||
+      KVS_FAILED(st = kvs_schema_jit_compile(llvm, KVS_SCHEMA_JIT_ENTRY_ALL))) {
+    kvs_jit_llvm_context_release(llvm);
+    return st;
+  }
+  KVS_DO(st, kvs_schema_jit_lookup(llvm, "serialize", &serialize_addr));
+  KVS_DO(st, kvs_schema_jit_lookup(llvm, "deserialize", &deserialize_addr));
+  if (kvs_schema_jit_perf_map()) {
+    kvs_schema_jit_perf_map_add(serialize_addr, llvm->serialize_size, kvs_schema_jit_symbol(llvm, symbol, sizeof(symbol), "serialize"), keys, key_size, values, value_size);
+    kvs_schema_jit_perf_map_add(deserialize_addr, llvm->deserialize_size, kvs_schema_jit_symbol(llvm, symbol, sizeof(symbol), "deserialize"), keys, key_size, values, value_size);
+  }
+  jit->serializer = (jit_struct_serializer_entry) serialize_addr;
+  jit->deserializer = (jit_struct_deserializer_entry) deserialize_addr;
+  return KVS_OK;
+}
+
+/* fields are indexed by column index */
+void *kvs_schema_jit_struct_codec_create(const kvs_column **keys, size_t key_size, const kvs_column **values, size_t value_size, const kvs_schema_struct_field **fields) {
+  size_t idx;
+  uint64_t layout[2];
+  const kvs_column *column;
+  kvs_schema_jit_struct_codec *jit;
+  kvs_init_llvm();
+  if (llvm_jit == NULL || (jit = calloc(1, sizeof(kvs_schema_jit_struct_codec))) == NULL) {
+    return NULL;
+  }
+  /* offsets only keep dumps of different structs apart, symbols are unique by generation */
+  jit->llvm.fingerprint = kvs_schema_jit_fingerprint(keys, key_size, values, value_size);
+  for (idx = 0; idx < key_size + value_size; ++idx) {
+    column = idx < key_size ? keys[idx] : values[idx - key_size];
+    layout[0] = fields[column->index]->offset;
+    layout[1] = fields[column->index]->size_offset;
+    jit->llvm.fingerprint = kvs_schema_jit_fingerprint_update(jit->llvm.fingerprint, layout, sizeof(layout));
+  }
+  jit->llvm.generation = __atomic_add_fetch(&struct_codec_generation, 1, __ATOMIC_RELAXED);
+  if (KVS_FAILED(kvs_schema_jit_struct_codec_compile(jit, keys, key_size, values, value_size, fields))) {
+    kvs_schema_jit_struct_codec_destroy(keys, key_size, values, value_size, jit);
+    return NULL;
+  }
+  return jit;
+}
+
+void kvs_schema_jit_struct_codec_destroy(const kvs_column **keys, size_t key_size, const kvs_column **values, size_t value_size, void *opaque) {
+  kvs_schema_jit_struct_codec *codec = opaque;
+  if (codec == NULL) {
+    return;
+  }
+  kvs_jit_llvm_context_fini(&codec->llvm);
+  free(codec);
+}
+
+void kvs_schema_jit_struct_serializer(const kvs_column **keys, size_t key_size, const kvs_column **values, size_t value_size, const kvs_schema_struct_field **fields, const void *object, kvs_buffer *key, kvs_buffer *value, void *opaque) {
+  ((kvs_schema_jit_struct_codec *) opaque)->serializer(object, key, value);
+}
+
+void kvs_schema_jit_struct_deserializer(const kvs_column **keys, size_t key_size, const kvs_column **values, size_t value_size, const kvs_schema_struct_field **fields, kvs_buffer *key, kvs_buffer *value, kvs_buffer *heap, void *opaque, void *object) {
+  ((kvs_schema_jit_struct_codec *) opaque)->deserializer(object, key, value, heap);
 }
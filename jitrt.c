@@ -12,73 +12,98 @@ int64_t kvs_jit_rt_record_get_deref(int64_t record, int64_t idx) {
   return (int64_t)(intptr_t) (*kvs_record_get((kvs_record *)(intptr_t) record, (size_t) idx));
 }
 
-void kvs_jit_rt_buffer_write(int64_t buffer, int64_t data, int64_t size);
-void kvs_jit_rt_buffer_write(int64_t buffer, int64_t data, int64_t size) {
-  kvs_buffer_write((kvs_buffer *)(intptr_t) buffer, (void *)(intptr_t) data, (size_t) size);
+void kvs_jit_rt_variant_deserialize_comparable_opaque(int64_t variant, int64_t buffer);
+void kvs_jit_rt_variant_deserialize_comparable_opaque(int64_t variant, int64_t buffer) {
+  kvs_variant **real_variant = (kvs_variant **)(intptr_t) variant;
+  *real_variant = kvs_variant_deserialize_comparable_opaque(*real_variant, (void *)(intptr_t) buffer);
 }
 
-void kvs_jit_rt_buffer_read(int64_t buffer, int64_t data, int64_t size);
-void kvs_jit_rt_buffer_read(int64_t buffer, int64_t data, int64_t size) {
-  kvs_buffer_read((kvs_buffer *)(intptr_t) buffer, (void *)(intptr_t) data, (size_t) size);
+void kvs_jit_rt_variant_deserialize_opaque(int64_t variant, int64_t buffer);
+void kvs_jit_rt_variant_deserialize_opaque(int64_t variant, int64_t buffer) {
+  kvs_variant **real_variant = (kvs_variant **)(intptr_t) variant;
+  *real_variant = kvs_variant_deserialize_opaque(*real_variant, (kvs_buffer *) buffer);
 }
 
-void kvs_jit_rt_variant_serialize_comparable_int32(int64_t variant, int64_t buffer);
-void kvs_jit_rt_variant_serialize_comparable_int32(int64_t variant, int64_t buffer) {
-  kvs_variant_serialize_comparable_int32(*(kvs_variant **)(intptr_t) variant, (void *)(intptr_t) buffer);
+void kvs_jit_rt_variant_serialize_dictionary(int64_t variant, int64_t dictionary, int64_t buffer);
+void kvs_jit_rt_variant_serialize_dictionary(int64_t variant, int64_t dictionary, int64_t buffer) {
+  kvs_variant_serialize_dictionary((kvs_variant *)(intptr_t) variant, (kvs_dictionary *)(intptr_t) dictionary, (kvs_buffer *)(intptr_t) buffer);
 }
 
-void kvs_jit_rt_variant_serialize_comparable_int64(int64_t variant, int64_t buffer);
-void kvs_jit_rt_variant_serialize_comparable_int64(int64_t variant, int64_t buffer) {
-  kvs_variant_serialize_comparable_int64(*(kvs_variant **)(intptr_t) variant, (void *)(intptr_t) buffer);
+void kvs_jit_rt_variant_deserialize_dictionary(int64_t variant, int64_t dictionary, int64_t buffer);
+void kvs_jit_rt_variant_deserialize_dictionary(int64_t variant, int64_t dictionary, int64_t buffer) {
+  kvs_variant **real_variant = (kvs_variant **)(intptr_t) variant;
+  *real_variant = kvs_variant_deserialize_dictionary(*real_variant, (kvs_dictionary *)(intptr_t) dictionary, (kvs_buffer *)(intptr_t) buffer);
 }
 
-void kvs_jit_rt_variant_serialize_comparable_float(int64_t variant, int64_t buffer);
-void kvs_jit_rt_variant_serialize_comparable_float(int64_t variant, int64_t buffer) {
-  kvs_variant_serialize_comparable_float(*(kvs_variant **)(intptr_t) variant, (void *)(intptr_t) buffer);
+int64_t kvs_jit_rt_buffer_allocate(int64_t buffer, int64_t size);
+int64_t kvs_jit_rt_buffer_allocate(int64_t buffer, int64_t size) {
+  return (int64_t)(intptr_t) kvs_buffer_allocate((kvs_buffer *)(intptr_t) buffer, (size_t) size);
 }
 
-void kvs_jit_rt_variant_serialize_comparable_double(int64_t variant, int64_t buffer);
-void kvs_jit_rt_variant_serialize_comparable_double(int64_t variant, int64_t buffer) {
-  kvs_variant_serialize_comparable_double(*(kvs_variant **)(intptr_t) variant, (void *)(intptr_t) buffer);
+int64_t kvs_jit_rt_buffer_fetch(int64_t buffer, int64_t size, int64_t scratch);
+int64_t kvs_jit_rt_buffer_fetch(int64_t buffer, int64_t size, int64_t scratch) {
+  const void *data = kvs_buffer_peek((kvs_buffer *)(intptr_t) buffer, (size_t) size);
+  if (data == NULL) {
+    /* span crosses blocks, fall back to copy */
+    kvs_buffer_read((kvs_buffer *)(intptr_t) buffer, (void *)(intptr_t) scratch, (size_t) size);
+    return scratch;
+  }
+  return (int64_t)(intptr_t) data;
 }
 
-void kvs_jit_rt_variant_serialize_comparable_opaque(int64_t variant, int64_t buffer);
-void kvs_jit_rt_variant_serialize_comparable_opaque(int64_t variant, int64_t buffer) {
-  kvs_variant_serialize_comparable_opaque(*(kvs_variant **)(intptr_t) variant, (void *)(intptr_t) buffer);
+void kvs_jit_rt_buffer_release(int64_t buffer, int64_t data, int64_t size, int64_t scratch);
+void kvs_jit_rt_buffer_release(int64_t buffer, int64_t data, int64_t size, int64_t scratch) {
+  if (data != scratch) {
+    kvs_buffer_skip((kvs_buffer *)(intptr_t) buffer, (size_t) size);
+  }
 }
 
-void kvs_jit_rt_variant_deserialize_comparable_int32(int64_t variant, int64_t buffer);
-void kvs_jit_rt_variant_deserialize_comparable_int32(int64_t variant, int64_t buffer) {
-  kvs_variant **real_variant = (kvs_variant **)(intptr_t) variant;
-  *real_variant = kvs_variant_deserialize_comparable_int32(*real_variant, (void *)(intptr_t) buffer);
+int64_t kvs_jit_rt_variant_comparable_opaque_size(int64_t variant);
+int64_t kvs_jit_rt_variant_comparable_opaque_size(int64_t variant) {
+  const void *data;
+  size_t size;
+  kvs_variant_get_opaque((kvs_variant *)(intptr_t) variant, &data, &size);
+  return (int64_t) kvs_variant_comparable_opaque_size(size);
 }
 
-void kvs_jit_rt_variant_deserialize_comparable_int64(int64_t variant, int64_t buffer);
-void kvs_jit_rt_variant_deserialize_comparable_int64(int64_t variant, int64_t buffer) {
-  kvs_variant **real_variant = (kvs_variant **)(intptr_t) variant;
-  *real_variant = kvs_variant_deserialize_comparable_int64(*real_variant, (void *)(intptr_t) buffer);
+int64_t kvs_jit_rt_variant_encode_comparable_opaque(int64_t variant, int64_t dest);
+int64_t kvs_jit_rt_variant_encode_comparable_opaque(int64_t variant, int64_t dest) {
+  const void *data;
+  size_t size;
+  kvs_variant_get_opaque((kvs_variant *)(intptr_t) variant, &data, &size);
+  return (int64_t) kvs_variant_encode_comparable_opaque(data, size, (void *)(intptr_t) dest);
 }
 
-void kvs_jit_rt_variant_deserialize_comparable_float(int64_t variant, int64_t buffer);
-void kvs_jit_rt_variant_deserialize_comparable_float(int64_t variant, int64_t buffer) {
-  kvs_variant **real_variant = (kvs_variant **)(intptr_t) variant;
-  *real_variant = kvs_variant_deserialize_comparable_float(*real_variant, (void *)(intptr_t) buffer);
+int64_t kvs_jit_rt_opaque_comparable_size(int64_t size);
+int64_t kvs_jit_rt_opaque_comparable_size(int64_t size) {
+  return (int64_t) kvs_variant_comparable_opaque_size((size_t) size);
 }
 
-void kvs_jit_rt_variant_deserialize_comparable_double(int64_t variant, int64_t buffer);
-void kvs_jit_rt_variant_deserialize_comparable_double(int64_t variant, int64_t buffer) {
-  kvs_variant **real_variant = (kvs_variant **)(intptr_t) variant;
-  *real_variant = kvs_variant_deserialize_comparable_double(*real_variant, (void *)(intptr_t) buffer);
+int64_t kvs_jit_rt_opaque_encode_comparable(int64_t data, int64_t size, int64_t dest);
+int64_t kvs_jit_rt_opaque_encode_comparable(int64_t data, int64_t size, int64_t dest) {
+  return (int64_t) kvs_variant_encode_comparable_opaque((const void *)(intptr_t) data, (size_t) size, (void *)(intptr_t) dest);
 }
 
-void kvs_jit_rt_variant_deserialize_comparable_opaque(int64_t variant, int64_t buffer);
-void kvs_jit_rt_variant_deserialize_comparable_opaque(int64_t variant, int64_t buffer) {
-  kvs_variant **real_variant = (kvs_variant **)(intptr_t) variant;
-  *real_variant = kvs_variant_deserialize_comparable_opaque(*real_variant, (void *)(intptr_t) buffer);
+void kvs_jit_rt_opaque_serialize_dictionary(int64_t data, int64_t size, int64_t dictionary, int64_t buffer);
+void kvs_jit_rt_opaque_serialize_dictionary(int64_t data, int64_t size, int64_t dictionary, int64_t buffer) {
+  kvs_variant_encode_dictionary((const void *)(intptr_t) data, (size_t) size, (kvs_dictionary *)(intptr_t) dictionary, (kvs_buffer *)(intptr_t) buffer);
 }
 
-void kvs_jit_rt_variant_deserialize_opaque(int64_t variant, int64_t buffer);
-void kvs_jit_rt_variant_deserialize_opaque(int64_t variant, int64_t buffer) {
-  kvs_variant **real_variant = (kvs_variant **)(intptr_t) variant;
-  *real_variant = kvs_variant_deserialize_opaque(*real_variant, (kvs_buffer *) buffer);
+void kvs_jit_rt_opaque_deserialize(int64_t field, int64_t size_field, int64_t buffer, int64_t heap);
+void kvs_jit_rt_opaque_deserialize(int64_t field, int64_t size_field, int64_t buffer, int64_t heap) {
+  *(const void **)(intptr_t) field = kvs_variant_decode_opaque((kvs_buffer *)(intptr_t) buffer,
+      (kvs_buffer *)(intptr_t) heap, (size_t *)(intptr_t) size_field);
+}
+
+void kvs_jit_rt_opaque_deserialize_comparable(int64_t field, int64_t size_field, int64_t buffer, int64_t heap);
+void kvs_jit_rt_opaque_deserialize_comparable(int64_t field, int64_t size_field, int64_t buffer, int64_t heap) {
+  *(const void **)(intptr_t) field = kvs_variant_decode_comparable_opaque((kvs_buffer *)(intptr_t) buffer,
+      (kvs_buffer *)(intptr_t) heap, (size_t *)(intptr_t) size_field);
+}
+
+void kvs_jit_rt_opaque_deserialize_dictionary(int64_t field, int64_t size_field, int64_t dictionary, int64_t buffer);
+void kvs_jit_rt_opaque_deserialize_dictionary(int64_t field, int64_t size_field, int64_t dictionary, int64_t buffer) {
+  uint32_t code;
+  kvs_variant_decode_dictionary((const kvs_dictionary *)(intptr_t) dictionary, (kvs_buffer *)(intptr_t) buffer,
+      &code, (const void **)(intptr_t) field, (size_t *)(intptr_t) size_field);
 }
@@ -0,0 +1,577 @@
+#include "kvs.h"
+#include "cmdline.h"
+#include <time.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+/**
+ * Per operation cost of the variant encoders and the codec entry points. Every case runs a
+ * tight loop over one function, hardware counters of the calling thread are read around the
+ * loop and divided by the iterations. Of all repetitions the one with the least cycles, or
+ * the least time without counters, is reported. Counters the kernel does not grant are
+ * reported as unavailable, without any only the time is measured.
+ **/
+#define MICRO_BATCH (256)
+#define MICRO_DEFAULT_ITERATIONS (1 << 16)
+#define MICRO_DEFAULT_REPETITIONS (5)
+#define MICRO_MAX_VALUE (4096)
+
+typedef enum micro_counter {
+  MICRO_COUNTER_CYCLES = 0,
+  MICRO_COUNTER_INSTRUCTIONS,
+  MICRO_COUNTER_CACHE_MISSES,
+  MICRO_COUNTER_BRANCH_MISSES,
+  MICRO_COUNTER_NUM
+} micro_counter;
+
+static const char *counter_names[MICRO_COUNTER_NUM] = { "cycles", "instructions", "cache_misses", "branch_misses" };
+
+typedef struct micro_counters {
+  /* group leader first, -1 for counters that could not be opened */
+  int fds[MICRO_COUNTER_NUM];
+  /* position of each counter in a group read */
+  int32_t slots[MICRO_COUNTER_NUM];
+  int32_t num_open;
+  int leader;
+} micro_counters;
+
+typedef struct micro_sample {
+  double ns;
+  double counts[MICRO_COUNTER_NUM];
+} micro_sample;
+
+typedef struct micro_state {
+  kvs_variant *variant;
+  kvs_buffer *buffer;
+  /* MICRO_BATCH encodings of variant back to back, or one row for the codec cases */
+  uint8_t *encoded;
+  size_t encoded_size;
+  size_t key_size;
+  kvs_schema *schema;
+  kvs_record *record;
+  kvs_buffer *key;
+  kvs_buffer *value;
+} micro_state;
+
+typedef void (*micro_run)(micro_state *state, size_t iterations);
+
+typedef struct micro_case {
+  const char *group;
+  const char *name;
+  micro_run run;
+  kvs_variant_type type;
+  /* of opaque values */
+  size_t size;
+  /* opaque values of zero bytes, every one of them is escaped by the comparable encoding */
+  int32_t zeros;
+} micro_case;
+
+static int64_t micro_now(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+#ifdef __linux__
+static int micro_counter_open(micro_counter counter, int group) {
+  static const uint64_t configs[MICRO_COUNTER_NUM] = {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+  };
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = configs[counter];
+  attr.disabled = group == -1;
+  /* user space only, allowed up to perf_event_paranoid 2 */
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP;
+  return (int) syscall(__NR_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+static void micro_counters_open(micro_counters *counters) {
+  int32_t idx;
+  counters->leader = -1;
+  counters->num_open = 0;
+  for (idx = 0; idx < MICRO_COUNTER_NUM; ++idx) {
+    counters->fds[idx] = micro_counter_open(idx, counters->leader);
+    counters->slots[idx] = counters->fds[idx] == -1 ? -1 : counters->num_open++;
+    if (counters->leader == -1) {
+      counters->leader = counters->fds[idx];
+    }
+  }
+  if (counters->leader == -1) {
+    fprintf(stderr, "perf events are not available (%s), measuring time only\n", strerror(errno));
+  }
+}
+
+static void micro_counters_close(micro_counters *counters) {
+  int32_t idx;
+  for (idx = 0; idx < MICRO_COUNTER_NUM; ++idx) {
+    if (counters->fds[idx] != -1) {
+      close(counters->fds[idx]);
+    }
+  }
+}
+
+static void micro_counters_start(micro_counters *counters) {
+  if (counters->leader != -1) {
+    ioctl(counters->leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(counters->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+  }
+}
+
+static void micro_counters_stop(micro_counters *counters, micro_sample *sample) {
+  int32_t idx;
+  /* number of counters followed by their values */
+  uint64_t values[1 + MICRO_COUNTER_NUM];
+  for (idx = 0; idx < MICRO_COUNTER_NUM; ++idx) {
+    sample->counts[idx] = -1;
+  }
+  if (counters->leader == -1) {
+    return;
+  }
+  ioctl(counters->leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+  if (read(counters->leader, values, sizeof(values)) < (ssize_t) sizeof(uint64_t)) {
+    return;
+  }
+  for (idx = 0; idx < MICRO_COUNTER_NUM; ++idx) {
+    if (counters->slots[idx] != -1 && (uint64_t) counters->slots[idx] < values[0]) {
+      sample->counts[idx] = (double) values[1 + counters->slots[idx]];
+    }
+  }
+}
+#else
+static void micro_counters_open(micro_counters *counters) {
+  int32_t idx;
+  for (idx = 0; idx < MICRO_COUNTER_NUM; ++idx) {
+    counters->fds[idx] = -1;
+    counters->slots[idx] = -1;
+  }
+  counters->leader = -1;
+  counters->num_open = 0;
+  fprintf(stderr, "perf events are only supported on linux, measuring time only\n");
+}
+
+static void micro_counters_close(micro_counters *counters) {
+}
+
+static void micro_counters_start(micro_counters *counters) {
+}
+
+static void micro_counters_stop(micro_counters *counters, micro_sample *sample) {
+  int32_t idx;
+  for (idx = 0; idx < MICRO_COUNTER_NUM; ++idx) {
+    sample->counts[idx] = -1;
+  }
+}
+#endif
+
+/* a buffer over bytes without copying them, memory holds kvs_buffer_embedded_size(0) bytes */
+static kvs_buffer *micro_wrap(void *memory, const void *data, size_t size) {
+  kvs_buffer *buffer = kvs_buffer_embed_data(memory, (void *) data, size, 4096);
+  kvs_buffer_commit(buffer, size);
+  return buffer;
+}
+
+#define MICRO_SERIALIZER(NAME, FUNCTION)                                 \
+  static void NAME(micro_state *state, size_t iterations) {              \
+    size_t idx;                                                          \
+    for (idx = 0; idx < iterations; ++idx) {                             \
+      FUNCTION(state->variant, state->buffer);                           \
+      if ((idx + 1) % MICRO_BATCH == 0) {                                \
+        kvs_buffer_reset(state->buffer);                                 \
+      }                                                                  \
+    }                                                                    \
+    kvs_buffer_reset(state->buffer);                                     \
+  }
+
+/* decodes MICRO_BATCH encodings at a time into the same variant */
+#define MICRO_DESERIALIZER(NAME, FUNCTION)                               \
+  static void NAME(micro_state *state, size_t iterations) {              \
+    size_t idx;                                                          \
+    uint64_t memory[16];                                                 \
+    kvs_buffer *data = NULL;                                             \
+    for (idx = 0; idx < iterations; ++idx) {                             \
+      if (idx % MICRO_BATCH == 0) {                                      \
+        data = micro_wrap(memory, state->encoded, state->encoded_size);  \
+      }                                                                  \
+      state->variant = FUNCTION(state->variant, data);                   \
+    }                                                                    \
+  }
+
+MICRO_SERIALIZER(micro_serialize_int32, kvs_variant_serialize_int32)
+MICRO_SERIALIZER(micro_serialize_int64, kvs_variant_serialize_int64)
+MICRO_SERIALIZER(micro_serialize_float, kvs_variant_serialize_float)
+MICRO_SERIALIZER(micro_serialize_double, kvs_variant_serialize_double)
+MICRO_SERIALIZER(micro_serialize_opaque, kvs_variant_serialize_opaque)
+MICRO_SERIALIZER(micro_serialize_comparable_int32, kvs_variant_serialize_comparable_int32)
+MICRO_SERIALIZER(micro_serialize_comparable_int64, kvs_variant_serialize_comparable_int64)
+MICRO_SERIALIZER(micro_serialize_comparable_float, kvs_variant_serialize_comparable_float)
+MICRO_SERIALIZER(micro_serialize_comparable_double, kvs_variant_serialize_comparable_double)
+MICRO_SERIALIZER(micro_serialize_comparable_opaque, kvs_variant_serialize_comparable_opaque)
+
+MICRO_DESERIALIZER(micro_deserialize_int32, kvs_variant_deserialize_int32)
+MICRO_DESERIALIZER(micro_deserialize_int64, kvs_variant_deserialize_int64)
+MICRO_DESERIALIZER(micro_deserialize_float, kvs_variant_deserialize_float)
+MICRO_DESERIALIZER(micro_deserialize_double, kvs_variant_deserialize_double)
+MICRO_DESERIALIZER(micro_deserialize_opaque, kvs_variant_deserialize_opaque)
+MICRO_DESERIALIZER(micro_deserialize_comparable_int32, kvs_variant_deserialize_comparable_int32)
+MICRO_DESERIALIZER(micro_deserialize_comparable_int64, kvs_variant_deserialize_comparable_int64)
+MICRO_DESERIALIZER(micro_deserialize_comparable_float, kvs_variant_deserialize_comparable_float)
+MICRO_DESERIALIZER(micro_deserialize_comparable_double, kvs_variant_deserialize_comparable_double)
+MICRO_DESERIALIZER(micro_deserialize_comparable_opaque, kvs_variant_deserialize_comparable_opaque)
+
+/* what decoding costs when every value gets a variant of its own */
+static void micro_deserialize_comparable_opaque_fresh(micro_state *state, size_t iterations) {
+  size_t idx;
+  uint64_t memory[16];
+  kvs_buffer *data = NULL;
+  for (idx = 0; idx < iterations; ++idx) {
+    if (idx % MICRO_BATCH == 0) {
+      data = micro_wrap(memory, state->encoded, state->encoded_size);
+    }
+    kvs_variant_destroy(kvs_variant_deserialize_comparable_opaque(NULL, data));
+  }
+}
+
+static void micro_create_opaque(micro_state *state, size_t iterations) {
+  size_t idx;
+  const void *data;
+  size_t size;
+  kvs_variant_get_opaque(state->variant, &data, &size);
+  for (idx = 0; idx < iterations; ++idx) {
+    kvs_variant_destroy(kvs_variant_create_from_opaque(data, size));
+  }
+}
+
+static void micro_reset_opaque(micro_state *state, size_t iterations) {
+  size_t idx;
+  const void *data;
+  size_t size;
+  kvs_variant *variant = kvs_variant_create_opaque();
+  kvs_variant_get_opaque(state->variant, &data, &size);
+  for (idx = 0; idx < iterations; ++idx) {
+    variant = kvs_variant_reset_opaque(variant, data, size);
+  }
+  kvs_variant_destroy(variant);
+}
+
+static void micro_record_serialize(micro_state *state, size_t iterations) {
+  size_t idx;
+  for (idx = 0; idx < iterations; ++idx) {
+    kvs_schema_record_serialize(state->schema, state->record, state->key, state->value);
+    kvs_buffer_reset(state->key);
+    kvs_buffer_reset(state->value);
+  }
+}
+
+static void micro_record_deserialize(micro_state *state, size_t iterations) {
+  size_t idx;
+  uint64_t key_memory[16], value_memory[16];
+  for (idx = 0; idx < iterations; ++idx) {
+    kvs_schema_record_deserialize(state->schema, micro_wrap(key_memory, state->encoded, state->key_size),
+        micro_wrap(value_memory, state->encoded + state->key_size, state->encoded_size - state->key_size), state->record);
+  }
+}
+
+/* decoding into a new record each time, as code that does not reuse records does */
+static void micro_record_deserialize_fresh(micro_state *state, size_t iterations) {
+  size_t idx;
+  kvs_record *record;
+  uint64_t key_memory[16], value_memory[16];
+  for (idx = 0; idx < iterations; ++idx) {
+    record = kvs_schema_record_create(state->schema);
+    kvs_schema_record_deserialize(state->schema, micro_wrap(key_memory, state->encoded, state->key_size),
+        micro_wrap(value_memory, state->encoded + state->key_size, state->encoded_size - state->key_size), record);
+    kvs_record_destroy(record);
+  }
+}
+
+#define MICRO_FIXED(GROUP, FUNCTION, TYPE) { GROUP, #TYPE, FUNCTION, KVS_VARIANT_TYPE_##TYPE, 0, 0 }
+#define MICRO_OPAQUE(GROUP, NAME, FUNCTION, SIZE, ZEROS) { GROUP, NAME, FUNCTION, KVS_VARIANT_TYPE_OPAQUE, SIZE, ZEROS }
+
+static const micro_case variant_cases[] = {
+  MICRO_FIXED("serialize", micro_serialize_int32, INT32),
+  MICRO_FIXED("serialize", micro_serialize_int64, INT64),
+  MICRO_FIXED("serialize", micro_serialize_float, FLOAT),
+  MICRO_FIXED("serialize", micro_serialize_double, DOUBLE),
+  MICRO_OPAQUE("serialize", "OPAQUE/16", micro_serialize_opaque, 16, 0),
+  MICRO_OPAQUE("serialize", "OPAQUE/256", micro_serialize_opaque, 256, 0),
+  MICRO_OPAQUE("serialize", "OPAQUE/4096", micro_serialize_opaque, 4096, 0),
+  MICRO_FIXED("deserialize", micro_deserialize_int32, INT32),
+  MICRO_FIXED("deserialize", micro_deserialize_int64, INT64),
+  MICRO_FIXED("deserialize", micro_deserialize_float, FLOAT),
+  MICRO_FIXED("deserialize", micro_deserialize_double, DOUBLE),
+  MICRO_OPAQUE("deserialize", "OPAQUE/16", micro_deserialize_opaque, 16, 0),
+  MICRO_OPAQUE("deserialize", "OPAQUE/256", micro_deserialize_opaque, 256, 0),
+  MICRO_OPAQUE("deserialize", "OPAQUE/4096", micro_deserialize_opaque, 4096, 0),
+  MICRO_FIXED("serialize_comparable", micro_serialize_comparable_int32, INT32),
+  MICRO_FIXED("serialize_comparable", micro_serialize_comparable_int64, INT64),
+  MICRO_FIXED("serialize_comparable", micro_serialize_comparable_float, FLOAT),
+  MICRO_FIXED("serialize_comparable", micro_serialize_comparable_double, DOUBLE),
+  MICRO_OPAQUE("serialize_comparable", "OPAQUE/16", micro_serialize_comparable_opaque, 16, 0),
+  MICRO_OPAQUE("serialize_comparable", "OPAQUE/256", micro_serialize_comparable_opaque, 256, 0),
+  MICRO_OPAQUE("serialize_comparable", "OPAQUE/256/zeros", micro_serialize_comparable_opaque, 256, 1),
+  MICRO_FIXED("deserialize_comparable", micro_deserialize_comparable_int32, INT32),
+  MICRO_FIXED("deserialize_comparable", micro_deserialize_comparable_int64, INT64),
+  MICRO_FIXED("deserialize_comparable", micro_deserialize_comparable_float, FLOAT),
+  MICRO_FIXED("deserialize_comparable", micro_deserialize_comparable_double, DOUBLE),
+  MICRO_OPAQUE("deserialize_comparable", "OPAQUE/16", micro_deserialize_comparable_opaque, 16, 0),
+  MICRO_OPAQUE("deserialize_comparable", "OPAQUE/256", micro_deserialize_comparable_opaque, 256, 0),
+  MICRO_OPAQUE("deserialize_comparable", "OPAQUE/256/zeros", micro_deserialize_comparable_opaque, 256, 1),
+  MICRO_OPAQUE("deserialize_comparable", "OPAQUE/16/fresh", micro_deserialize_comparable_opaque_fresh, 16, 0),
+  MICRO_OPAQUE("deserialize_comparable", "OPAQUE/256/fresh", micro_deserialize_comparable_opaque_fresh, 256, 0),
+  MICRO_OPAQUE("allocate", "create_from_opaque/16", micro_create_opaque, 16, 0),
+  MICRO_OPAQUE("allocate", "create_from_opaque/256", micro_create_opaque, 256, 0),
+  MICRO_OPAQUE("allocate", "reset_opaque/16", micro_reset_opaque, 16, 0),
+  MICRO_OPAQUE("allocate", "reset_opaque/256", micro_reset_opaque, 256, 0),
+};
+
+static const micro_case codec_cases[] = {
+  { "record", "serialize", micro_record_serialize },
+  { "record", "deserialize", micro_record_deserialize },
+  { "record", "deserialize/fresh", micro_record_deserialize_fresh },
+};
+
+typedef struct micro_codec {
+  const char *name;
+  int32_t flags;
+} micro_codec;
+
+static const micro_codec codecs[] = {
+  { "interpreted", KVS_SCHEMA_FLAG_INTERPRETED },
+  { "prepared", KVS_SCHEMA_FLAG_PREPARED },
+  { "jit", KVS_SCHEMA_FLAG_JIT },
+};
+
+/* the opaque key is encoded comparable, so both key escaping and value copies show up */
+static const kvs_column codec_columns[] = {
+  { "key", KVS_VARIANT_TYPE_OPAQUE, 1 },
+  { "version", KVS_VARIANT_TYPE_INT32, 1 },
+  { "count", KVS_VARIANT_TYPE_INT32, 0 },
+  { "created", KVS_VARIANT_TYPE_INT64, 0 },
+  { "score", KVS_VARIANT_TYPE_FLOAT, 0 },
+  { "credit", KVS_VARIANT_TYPE_DOUBLE, 0 },
+  { "title", KVS_VARIANT_TYPE_OPAQUE, 0 },
+  { "body", KVS_VARIANT_TYPE_OPAQUE, 0 },
+};
+
+static int32_t results = 0;
+
+static void micro_measure(micro_counters *counters, micro_run run, micro_state *state, size_t iterations, int32_t repetitions, micro_sample *best) {
+  int32_t repetition;
+  int64_t start;
+  micro_sample sample;
+  /* page in code and data, let lazily compiled codecs compile */
+  run(state, iterations / 8 + 1);
+  for (repetition = 0; repetition < repetitions; ++repetition) {
+    start = micro_now();
+    micro_counters_start(counters);
+    run(state, iterations);
+    micro_counters_stop(counters, &sample);
+    sample.ns = (double) (micro_now() - start);
+    if (repetition == 0 || (sample.counts[MICRO_COUNTER_CYCLES] >= 0 ? sample.counts[MICRO_COUNTER_CYCLES] < best->counts[MICRO_COUNTER_CYCLES]
+          : sample.ns < best->ns)) {
+      *best = sample;
+    }
+  }
+}
+
+static void micro_report(const char *group, const char *name, const micro_sample *sample, size_t iterations, int32_t json) {
+  int32_t idx;
+  double counts[MICRO_COUNTER_NUM];
+  for (idx = 0; idx < MICRO_COUNTER_NUM; ++idx) {
+    counts[idx] = sample->counts[idx] >= 0 ? sample->counts[idx] / iterations : -1;
+  }
+  if (json) {
+    printf("%s  {\"group\": \"%s\", \"case\": \"%s\", \"iterations\": %zu, \"ns\": %.2f", results == 0 ? "" : ",\n",
+        group, name, iterations, sample->ns / iterations);
+    for (idx = 0; idx < MICRO_COUNTER_NUM; ++idx) {
+      if (counts[idx] >= 0) {
+        printf(", \"%s\": %.3f", counter_names[idx], counts[idx]);
+      } else {
+        printf(", \"%s\": null", counter_names[idx]);
+      }
+    }
+    printf("}");
+  } else {
+    printf("%-24s %-24s %9.2f", group, name, sample->ns / iterations);
+    for (idx = 0; idx < MICRO_COUNTER_NUM; ++idx) {
+      if (counts[idx] >= 0) {
+        printf(" %12.2f", counts[idx]);
+      } else {
+        printf(" %12s", "n/a");
+      }
+    }
+    if (counts[MICRO_COUNTER_CYCLES] > 0 && counts[MICRO_COUNTER_INSTRUCTIONS] >= 0) {
+      printf(" %6.2f\n", counts[MICRO_COUNTER_INSTRUCTIONS] / counts[MICRO_COUNTER_CYCLES]);
+    } else {
+      printf(" %6s\n", "n/a");
+    }
+  }
+  results++;
+  fflush(stdout);
+}
+
+static kvs_variant *micro_variant(kvs_variant_type type, size_t size, int32_t zeros) {
+  size_t idx;
+  uint8_t data[MICRO_MAX_VALUE];
+  switch (type) {
+    case KVS_VARIANT_TYPE_INT32:
+      return kvs_variant_create_from_int32(-123456789);
+    case KVS_VARIANT_TYPE_INT64:
+      return kvs_variant_create_from_int64(-1234567890123LL);
+    case KVS_VARIANT_TYPE_FLOAT:
+      return kvs_variant_create_from_float(-1234.5f);
+    case KVS_VARIANT_TYPE_DOUBLE:
+      return kvs_variant_create_from_double(-12345.678);
+    default:
+      for (idx = 0; idx < size; ++idx) {
+        data[idx] = zeros ? 0 : 'a' + idx % 26;
+      }
+      return kvs_variant_create_from_opaque(data, size);
+  }
+}
+
+static void micro_variant_case(micro_counters *counters, const micro_case *mcase, size_t iterations, int32_t repetitions, int32_t json) {
+  size_t idx;
+  micro_sample best;
+  micro_state state;
+  kvs_buffer *encoded = kvs_buffer_create_contiguous(MICRO_BATCH * 64);
+  int32_t comparable = strstr(mcase->group, "comparable") != NULL;
+  memset(&state, 0, sizeof(state));
+  state.variant = micro_variant(mcase->type, mcase->size, mcase->zeros);
+  state.buffer = kvs_buffer_create(4096);
+  for (idx = 0; idx < MICRO_BATCH; ++idx) {
+    if (comparable) {
+      kvs_variant_serialize_comparable(state.variant, encoded);
+    } else {
+      kvs_variant_serialize(state.variant, encoded);
+    }
+  }
+  state.encoded_size = kvs_buffer_size(encoded);
+  if ((state.encoded = malloc(state.encoded_size)) == NULL) {
+    kvs_cmdline_fatal("Could not allocate encoded values\n");
+  }
+  kvs_buffer_read(encoded, state.encoded, state.encoded_size);
+  micro_measure(counters, mcase->run, &state, iterations, repetitions, &best);
+  micro_report(mcase->group, mcase->name, &best, iterations, json);
+  free(state.encoded);
+  kvs_buffer_destroy(encoded);
+  kvs_buffer_destroy(state.buffer);
+  kvs_variant_destroy(state.variant);
+}
+
+static void micro_codec_cases(micro_counters *counters, const micro_codec *codec, size_t iterations, int32_t repetitions, int32_t json) {
+  size_t idx;
+  micro_sample best;
+  micro_state state;
+  kvs_variant **variant;
+  char text[512];
+  memset(&state, 0, sizeof(state));
+  if ((state.schema = kvs_schema_create(codec_columns, sizeof(codec_columns) / sizeof(codec_columns[0]), codec->flags)) == NULL) {
+    if (!json) {
+      printf("%-24s codec is not available\n", codec->name);
+    }
+    return;
+  }
+  state.record = kvs_schema_record_create(state.schema);
+  state.key = kvs_buffer_create(4096);
+  state.value = kvs_buffer_create(4096);
+  variant = kvs_schema_record_get(state.schema, state.record, "key");
+  *variant = kvs_variant_reset_opaque(*variant, text, snprintf(text, sizeof(text), "https://example.com/questions/%d", 1234567));
+  kvs_variant_reset_int32(*kvs_schema_record_get(state.schema, state.record, "version"), 3);
+  kvs_variant_reset_int32(*kvs_schema_record_get(state.schema, state.record, "count"), 42);
+  kvs_variant_reset_int64(*kvs_schema_record_get(state.schema, state.record, "created"), 1500000000000LL);
+  kvs_variant_reset_float(*kvs_schema_record_get(state.schema, state.record, "score"), 3.5f);
+  kvs_variant_reset_double(*kvs_schema_record_get(state.schema, state.record, "credit"), 1.25);
+  variant = kvs_schema_record_get(state.schema, state.record, "title");
+  *variant = kvs_variant_reset_opaque(*variant, text, snprintf(text, sizeof(text), "what does a codec cost per record"));
+  for (idx = 0; idx < sizeof(text); ++idx) {
+    text[idx] = 'a' + idx % 26;
+  }
+  variant = kvs_schema_record_get(state.schema, state.record, "body");
+  *variant = kvs_variant_reset_opaque(*variant, text, sizeof(text));
+  kvs_schema_record_serialize(state.schema, state.record, state.key, state.value);
+  state.key_size = kvs_buffer_size(state.key);
+  state.encoded_size = state.key_size + kvs_buffer_size(state.value);
+  if ((state.encoded = malloc(state.encoded_size)) == NULL) {
+    kvs_cmdline_fatal("Could not allocate encoded row\n");
+  }
+  kvs_buffer_read(state.key, state.encoded, state.key_size);
+  kvs_buffer_read(state.value, state.encoded + state.key_size, state.encoded_size - state.key_size);
+  kvs_buffer_reset(state.key);
+  kvs_buffer_reset(state.value);
+  for (idx = 0; idx < sizeof(codec_cases) / sizeof(codec_cases[0]); ++idx) {
+    micro_measure(counters, codec_cases[idx].run, &state, iterations, repetitions, &best);
+    micro_report(codec->name, codec_cases[idx].name, &best, iterations, json);
+  }
+  free(state.encoded);
+  kvs_buffer_destroy(state.key);
+  kvs_buffer_destroy(state.value);
+  kvs_record_destroy(state.record);
+  kvs_schema_destroy(state.schema);
+}
+
+static void usage(const char *program) {
+  printf("Usage:\n%s [-j] [-n iterations] [-r repetitions]\n"
+      "  -j  print results as a json array\n"
+      "  -n  calls per measurement, %d by default\n"
+      "  -r  measurements per case, the cheapest is reported, %d by default\n",
+      program, MICRO_DEFAULT_ITERATIONS, MICRO_DEFAULT_REPETITIONS);
+}
+
+int main(int argc, char **argv) {
+  int opt;
+  size_t idx, iterations = MICRO_DEFAULT_ITERATIONS;
+  int32_t repetitions = MICRO_DEFAULT_REPETITIONS, json = 0;
+  micro_counters counters;
+  while ((opt = getopt(argc, argv, "jn:r:")) != -1) {
+    switch (opt) {
+      case 'j':
+        json = 1;
+        break;
+      case 'n':
+        iterations = strtoul(optarg, NULL, 10);
+        break;
+      case 'r':
+        repetitions = strtol(optarg, NULL, 10);
+        break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+  if (optind != argc || iterations < 1 || repetitions < 1) {
+    usage(argv[0]);
+    return 1;
+  }
+  micro_counters_open(&counters);
+  if (json) {
+    printf("[\n");
+  } else {
+    printf("%-24s %-24s %9s %12s %12s %12s %12s %6s\n", "group", "case", "ns/op", "cycles/op", "instr/op",
+        "cache-mis/op", "branch-mis/op", "ipc");
+  }
+  for (idx = 0; idx < sizeof(variant_cases) / sizeof(variant_cases[0]); ++idx) {
+    micro_variant_case(&counters, &variant_cases[idx], iterations, repetitions, json);
+  }
+  for (idx = 0; idx < sizeof(codecs) / sizeof(codecs[0]); ++idx) {
+    micro_codec_cases(&counters, &codecs[idx], iterations, repetitions, json);
+  }
+  if (json) {
+    printf("\n]\n");
+  }
+  micro_counters_close(&counters);
+  return 0;
+}
@@ -7,6 +7,8 @@
 #undef __KVS_SCHEMA_INTERNAL_H__
 #include <string.h>
 
+#define STRUCT_FIELD(TYPE, OBJECT, OFFSET) (*(TYPE *) KVS_UNSAFE_CAST(OBJECT, OFFSET))
+
 typedef void (*kvs_schema_prepared_field_serializer)(const kvs_variant *variant, kvs_buffer *buffer);
 
 typedef struct kvs_schema_prepared_serializer_descriptor {
@@ -31,13 +33,19 @@ void kvs_schema_prepared_serializer(const kvs_column **keys, size_t key_size, co
   const kvs_variant *variant;
   kvs_schema_prepared_codec *codec = opaque;
   kvs_schema_prepared_serializer_descriptor *descriptor = codec->serializer;
-  for (idx = 0; idx < key_size; ++idx) {
+  for (idx = 0; key != NULL && idx < key_size; ++idx) {
     variant = *kvs_record_get(record, keys[idx]->index);
     descriptor->key[idx](variant, key);
   }
   for (idx = 0; idx < value_size; ++idx) {
     variant = *kvs_record_get(record, values[idx]->index);
-    descriptor->value[idx](variant, value);
+    if (values[idx]->dictionary != NULL) {
+      kvs_variant_serialize_dictionary(variant, values[idx]->dictionary, value);
+    } else if (values[idx]->vlog != NULL) {
+      kvs_variant_serialize_separated(variant, values[idx]->vlog, value);
+    } else {
+      descriptor->value[idx](variant, value);
+    }
   }
 }
 
@@ -163,6 +171,190 @@ void kvs_schema_prepared_deserializer(const kvs_column **keys, size_t key_size,
   }
   for (idx = 0; idx < value_size; ++idx) {
     variant = kvs_record_get(record, values[idx]->index);
-    *variant = descriptor->value[idx](*variant, value);
+    if (values[idx]->dictionary != NULL) {
+      *variant = kvs_variant_deserialize_dictionary(*variant, values[idx]->dictionary, value);
+    } else if (values[idx]->vlog != NULL) {
+      *variant = kvs_variant_deserialize_separated(*variant, values[idx]->vlog, value);
+    } else {
+      *variant = descriptor->value[idx](*variant, value);
+    }
+  }
+}
+
+typedef struct kvs_schema_prepared_struct_column kvs_schema_prepared_struct_column;
+typedef void (*kvs_schema_prepared_struct_field_serializer)(const kvs_schema_prepared_struct_column *column, const void *object, kvs_buffer *buffer);
+typedef void (*kvs_schema_prepared_struct_field_deserializer)(const kvs_schema_prepared_struct_column *column, kvs_buffer *buffer, kvs_buffer *heap, void *object);
+
+/* keys then values in encoding order, with field offsets resolved */
+struct kvs_schema_prepared_struct_column {
+  kvs_schema_prepared_struct_field_serializer serializer;
+  kvs_schema_prepared_struct_field_deserializer deserializer;
+  size_t offset;
+  size_t size_offset;
+  kvs_dictionary *dictionary;
+  const kvs_vlog_binding *vlog;
+};
+
+static void kvs_schema_prepared_struct_serialize_comparable_int32(const kvs_schema_prepared_struct_column *column, const void *object, kvs_buffer *buffer) {
+  kvs_variant_encode_comparable_int32(STRUCT_FIELD(int32_t, object, column->offset), kvs_buffer_allocate(buffer, sizeof(int32_t)));
+}
+
+static void kvs_schema_prepared_struct_serialize_comparable_int64(const kvs_schema_prepared_struct_column *column, const void *object, kvs_buffer *buffer) {
+  kvs_variant_encode_comparable_int64(STRUCT_FIELD(int64_t, object, column->offset), kvs_buffer_allocate(buffer, sizeof(int64_t)));
+}
+
+static void kvs_schema_prepared_struct_serialize_comparable_float(const kvs_schema_prepared_struct_column *column, const void *object, kvs_buffer *buffer) {
+  kvs_variant_encode_comparable_float(STRUCT_FIELD(float, object, column->offset), kvs_buffer_allocate(buffer, sizeof(float)));
+}
+
+static void kvs_schema_prepared_struct_serialize_comparable_double(const kvs_schema_prepared_struct_column *column, const void *object, kvs_buffer *buffer) {
+  kvs_variant_encode_comparable_double(STRUCT_FIELD(double, object, column->offset), kvs_buffer_allocate(buffer, sizeof(double)));
+}
+
+static void kvs_schema_prepared_struct_serialize_comparable_opaque(const kvs_schema_prepared_struct_column *column, const void *object, kvs_buffer *buffer) {
+  size_t size = STRUCT_FIELD(size_t, object, column->size_offset);
+  kvs_variant_encode_comparable_opaque(STRUCT_FIELD(const void *, object, column->offset), size,
+      kvs_buffer_allocate(buffer, kvs_variant_comparable_opaque_size(size)));
+}
+
+static void kvs_schema_prepared_struct_serialize_fixed32(const kvs_schema_prepared_struct_column *column, const void *object, kvs_buffer *buffer) {
+  kvs_buffer_write(buffer, KVS_UNSAFE_CAST(object, column->offset), sizeof(int32_t));
+}
+
+static void kvs_schema_prepared_struct_serialize_fixed64(const kvs_schema_prepared_struct_column *column, const void *object, kvs_buffer *buffer) {
+  kvs_buffer_write(buffer, KVS_UNSAFE_CAST(object, column->offset), sizeof(int64_t));
+}
+
+static void kvs_schema_prepared_struct_serialize_opaque(const kvs_schema_prepared_struct_column *column, const void *object, kvs_buffer *buffer) {
+  kvs_variant_encode_opaque(STRUCT_FIELD(const void *, object, column->offset), STRUCT_FIELD(size_t, object, column->size_offset), buffer);
+}
+
+static void kvs_schema_prepared_struct_serialize_dictionary(const kvs_schema_prepared_struct_column *column, const void *object, kvs_buffer *buffer) {
+  kvs_variant_encode_dictionary(STRUCT_FIELD(const void *, object, column->offset), STRUCT_FIELD(size_t, object, column->size_offset),
+      column->dictionary, buffer);
+}
+
+static void kvs_schema_prepared_struct_serialize_separated(const kvs_schema_prepared_struct_column *column, const void *object, kvs_buffer *buffer) {
+  kvs_variant_encode_separated(STRUCT_FIELD(const void *, object, column->offset), STRUCT_FIELD(size_t, object, column->size_offset),
+      column->vlog, buffer);
+}
+
+static void kvs_schema_prepared_struct_deserialize_comparable_int32(const kvs_schema_prepared_struct_column *column, kvs_buffer *buffer, kvs_buffer *heap, void *object) {
+  STRUCT_FIELD(int32_t, object, column->offset) = kvs_variant_decode_comparable_int32(buffer);
+}
+
+static void kvs_schema_prepared_struct_deserialize_comparable_int64(const kvs_schema_prepared_struct_column *column, kvs_buffer *buffer, kvs_buffer *heap, void *object) {
+  STRUCT_FIELD(int64_t, object, column->offset) = kvs_variant_decode_comparable_int64(buffer);
+}
+
+static void kvs_schema_prepared_struct_deserialize_comparable_float(const kvs_schema_prepared_struct_column *column, kvs_buffer *buffer, kvs_buffer *heap, void *object) {
+  STRUCT_FIELD(float, object, column->offset) = kvs_variant_decode_comparable_float(buffer);
+}
+
+static void kvs_schema_prepared_struct_deserialize_comparable_double(const kvs_schema_prepared_struct_column *column, kvs_buffer *buffer, kvs_buffer *heap, void *object) {
+  STRUCT_FIELD(double, object, column->offset) = kvs_variant_decode_comparable_double(buffer);
+}
+
+static void kvs_schema_prepared_struct_deserialize_comparable_opaque(const kvs_schema_prepared_struct_column *column, kvs_buffer *buffer, kvs_buffer *heap, void *object) {
+  STRUCT_FIELD(const void *, object, column->offset) = kvs_variant_decode_comparable_opaque(buffer, heap, KVS_UNSAFE_CAST(object, column->size_offset));
+}
+
+static void kvs_schema_prepared_struct_deserialize_fixed32(const kvs_schema_prepared_struct_column *column, kvs_buffer *buffer, kvs_buffer *heap, void *object) {
+  kvs_buffer_read(buffer, KVS_UNSAFE_CAST(object, column->offset), sizeof(int32_t));
+}
+
+static void kvs_schema_prepared_struct_deserialize_fixed64(const kvs_schema_prepared_struct_column *column, kvs_buffer *buffer, kvs_buffer *heap, void *object) {
+  kvs_buffer_read(buffer, KVS_UNSAFE_CAST(object, column->offset), sizeof(int64_t));
+}
+
+static void kvs_schema_prepared_struct_deserialize_opaque(const kvs_schema_prepared_struct_column *column, kvs_buffer *buffer, kvs_buffer *heap, void *object) {
+  STRUCT_FIELD(const void *, object, column->offset) = kvs_variant_decode_opaque(buffer, heap, KVS_UNSAFE_CAST(object, column->size_offset));
+}
+
+static void kvs_schema_prepared_struct_deserialize_dictionary(const kvs_schema_prepared_struct_column *column, kvs_buffer *buffer, kvs_buffer *heap, void *object) {
+  uint32_t code;
+  kvs_variant_decode_dictionary(column->dictionary, buffer, &code, KVS_UNSAFE_CAST(object, column->offset), KVS_UNSAFE_CAST(object, column->size_offset));
+}
+
+static void kvs_schema_prepared_struct_deserialize_separated(const kvs_schema_prepared_struct_column *column, kvs_buffer *buffer, kvs_buffer *heap, void *object) {
+  STRUCT_FIELD(const void *, object, column->offset) = kvs_variant_decode_separated(column->vlog, buffer, heap, KVS_UNSAFE_CAST(object, column->size_offset));
+}
+
+void *kvs_schema_prepared_struct_codec_create(const kvs_column **keys, size_t key_size, const kvs_column **values, size_t value_size, const kvs_schema_struct_field **fields) {
+  size_t idx;
+  const kvs_column *column;
+  kvs_schema_prepared_struct_column *descriptor, *codec = malloc(sizeof(kvs_schema_prepared_struct_column) * (key_size + value_size));
+  if (codec == NULL) {
+    return NULL;
+  }
+  for (idx = 0; idx < key_size + value_size; ++idx) {
+    column = idx < key_size ? keys[idx] : values[idx - key_size];
+    descriptor = codec + idx;
+    descriptor->offset = fields[column->index]->offset;
+    descriptor->size_offset = fields[column->index]->size_offset;
+    descriptor->dictionary = column->dictionary;
+    descriptor->vlog = column->vlog;
+    switch (column->type) {
+      case KVS_VARIANT_TYPE_INT32:
+        descriptor->serializer = idx < key_size ? kvs_schema_prepared_struct_serialize_comparable_int32 : kvs_schema_prepared_struct_serialize_fixed32;
+        descriptor->deserializer = idx < key_size ? kvs_schema_prepared_struct_deserialize_comparable_int32 : kvs_schema_prepared_struct_deserialize_fixed32;
+        break;
+      case KVS_VARIANT_TYPE_INT64:
+        descriptor->serializer = idx < key_size ? kvs_schema_prepared_struct_serialize_comparable_int64 : kvs_schema_prepared_struct_serialize_fixed64;
+        descriptor->deserializer = idx < key_size ? kvs_schema_prepared_struct_deserialize_comparable_int64 : kvs_schema_prepared_struct_deserialize_fixed64;
+        break;
+      case KVS_VARIANT_TYPE_FLOAT:
+        descriptor->serializer = idx < key_size ? kvs_schema_prepared_struct_serialize_comparable_float : kvs_schema_prepared_struct_serialize_fixed32;
+        descriptor->deserializer = idx < key_size ? kvs_schema_prepared_struct_deserialize_comparable_float : kvs_schema_prepared_struct_deserialize_fixed32;
+        break;
+      case KVS_VARIANT_TYPE_DOUBLE:
+        descriptor->serializer = idx < key_size ? kvs_schema_prepared_struct_serialize_comparable_double : kvs_schema_prepared_struct_serialize_fixed64;
+        descriptor->deserializer = idx < key_size ? kvs_schema_prepared_struct_deserialize_comparable_double : kvs_schema_prepared_struct_deserialize_fixed64;
+        break;
+      case KVS_VARIANT_TYPE_OPAQUE:
+        if (idx < key_size) {
+          descriptor->serializer = kvs_schema_prepared_struct_serialize_comparable_opaque;
+          descriptor->deserializer = kvs_schema_prepared_struct_deserialize_comparable_opaque;
+        } else if (column->dictionary != NULL) {
+          descriptor->serializer = kvs_schema_prepared_struct_serialize_dictionary;
+          descriptor->deserializer = kvs_schema_prepared_struct_deserialize_dictionary;
+        } else if (column->vlog != NULL) {
+          descriptor->serializer = kvs_schema_prepared_struct_serialize_separated;
+          descriptor->deserializer = kvs_schema_prepared_struct_deserialize_separated;
+        } else {
+          descriptor->serializer = kvs_schema_prepared_struct_serialize_opaque;
+          descriptor->deserializer = kvs_schema_prepared_struct_deserialize_opaque;
+        }
+        break;
+      default:
+        break;
+    }
+  }
+  return codec;
+}
+
+void kvs_schema_prepared_struct_codec_destroy(const kvs_column **keys, size_t key_size, const kvs_column **values, size_t value_size, void *opaque) {
+  free(opaque);
+}
+
+void kvs_schema_prepared_struct_serializer(const kvs_column **keys, size_t key_size, const kvs_column **values, size_t value_size, const kvs_schema_struct_field **fields, const void *object, kvs_buffer *key, kvs_buffer *value, void *opaque) {
+  size_t idx;
+  const kvs_schema_prepared_struct_column *codec = opaque;
+  for (idx = 0; idx < key_size; ++idx) {
+    codec[idx].serializer(codec + idx, object, key);
+  }
+  for (; idx < key_size + value_size; ++idx) {
+    codec[idx].serializer(codec + idx, object, value);
+  }
+}
+
+void kvs_schema_prepared_struct_deserializer(const kvs_column **keys, size_t key_size, const kvs_column **values, size_t value_size, const kvs_schema_struct_field **fields, kvs_buffer *key, kvs_buffer *value, kvs_buffer *heap, void *opaque, void *object) {
+  size_t idx;
+  const kvs_schema_prepared_struct_column *codec = opaque;
+  for (idx = 0; idx < key_size; ++idx) {
+    codec[idx].deserializer(codec + idx, key, heap, object);
+  }
+  for (; idx < key_size + value_size; ++idx) {
+    codec[idx].deserializer(codec + idx, value, heap, object);
   }
 }
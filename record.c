@@ -1,11 +1,20 @@
 #include "util.h"
 #include "record.h"
+#include <string.h>
+
+#define FLAT_RECORD_ALIGN(size) (((size) + 7) & ~((size_t) 7))
 
 struct kvs_record {
   kvs_variant **fields;
   size_t size;
 };
 
+struct kvs_flat_record {
+  kvs_buffer *arena;
+  size_t slot_size;
+  uint8_t *slots;
+};
+
 kvs_record *kvs_record_create(kvs_variant **dfts, size_t size) {
   size_t idx;
   kvs_record *record = malloc(sizeof(kvs_record) + (sizeof(kvs_variant *) * size));
@@ -39,3 +48,39 @@ kvs_variant **kvs_record_get(kvs_record *record, size_t idx) {
 size_t kvs_record_fields_offset(void) {
   return KVS_OFFSET_OF(kvs_record, fields);
 }
+
+kvs_flat_record *kvs_flat_record_create(size_t slot_size, int32_t arena_size) {
+  size_t slots_offset = FLAT_RECORD_ALIGN(sizeof(kvs_flat_record));
+  size_t arena_offset = slots_offset + FLAT_RECORD_ALIGN(slot_size);
+  kvs_flat_record *record = malloc(arena_offset + kvs_buffer_embedded_size(arena_size));
+  if (record == NULL) {
+    return NULL;
+  }
+  record->slot_size = slot_size;
+  record->slots = KVS_UNSAFE_CAST(record, slots_offset);
+  record->arena = kvs_buffer_embed(KVS_UNSAFE_CAST(record, arena_offset), arena_size, arena_size);
+  memset(record->slots, 0, slot_size);
+  return record;
+}
+
+void kvs_flat_record_destroy(kvs_flat_record *record) {
+  kvs_buffer_fini(record->arena);
+  free(record);
+}
+
+void *kvs_flat_record_slots(kvs_flat_record *record) {
+  return record->slots;
+}
+
+kvs_buffer *kvs_flat_record_arena(kvs_flat_record *record) {
+  return record->arena;
+}
+
+void kvs_flat_record_release(kvs_flat_record *record) {
+  kvs_buffer_reset(record->arena);
+}
+
+void kvs_flat_record_clear(kvs_flat_record *record) {
+  memset(record->slots, 0, record->slot_size);
+  kvs_flat_record_release(record);
+}
@@ -2,6 +2,7 @@
 #define __KVS_RECORD_H__
 
 #include "variant.h"
+#include "buffer.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -15,6 +16,22 @@ kvs_variant **kvs_record_get(kvs_record *record, size_t idx);
 
 size_t kvs_record_fields_offset(void);
 
+/**
+ * A record in one allocation: zeroed fixed width slots of slot_size bytes, laid out by
+ * the schema, followed by an inline arena of arena_size bytes holding opaque data that
+ * slots point to. The arena spills into heap blocks once it is full.
+ **/
+typedef struct kvs_flat_record kvs_flat_record;
+
+kvs_flat_record *kvs_flat_record_create(size_t slot_size, int32_t arena_size);
+void kvs_flat_record_destroy(kvs_flat_record *record);
+void *kvs_flat_record_slots(kvs_flat_record *record);
+kvs_buffer *kvs_flat_record_arena(kvs_flat_record *record);
+/* drop the opaque data in the arena, slots keep pointing to it */
+void kvs_flat_record_release(kvs_flat_record *record);
+/* reset slots to their defaults and release the arena */
+void kvs_flat_record_clear(kvs_flat_record *record);
+
 #ifdef __cplusplus
 }
 #endif
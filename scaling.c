@@ -0,0 +1,150 @@
+#include "kvs.h"
+#include "cmdline.h"
+#include <sys/time.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+typedef struct scaling_gate {
+  pthread_mutex_t lock;
+  pthread_cond_t open;
+  int32_t ready;
+  int32_t started;
+} scaling_gate;
+
+typedef struct scaling_reader {
+  pthread_t thread;
+  kvs_store *store;
+  const kvs_schema *schema;
+  scaling_gate *gate;
+  int64_t rows;
+  int32_t failed;
+} scaling_reader;
+
+static int64_t now_us(void) {
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return now.tv_sec * 1000000L + now.tv_usec;
+}
+
+/* every reader scans the whole store with its own read transaction, record and buffers over the shared schema */
+static void *scaling_reader_run(void *arg) {
+  scaling_reader *reader = arg;
+  kvs_store_cursor *cursor = kvs_store_cursor_open(reader->store);
+  kvs_record *record = kvs_schema_record_create(reader->schema);
+  kvs_buffer *key = kvs_buffer_create(4096), *value = kvs_buffer_create(4096);
+  pthread_mutex_lock(&reader->gate->lock);
+  reader->gate->ready++;
+  pthread_cond_broadcast(&reader->gate->open);
+  while (!reader->gate->started) {
+    pthread_cond_wait(&reader->gate->open, &reader->gate->lock);
+  }
+  pthread_mutex_unlock(&reader->gate->lock);
+  if (cursor == NULL) {
+    reader->failed = 1;
+  }
+  while (cursor != NULL && !KVS_FAILED(kvs_store_cursor_next(cursor, key, value))) {
+    if (KVS_FAILED(kvs_schema_record_deserialize(reader->schema, key, value, record))) {
+      reader->failed = 1;
+      break;
+    }
+    reader->rows++;
+  }
+  kvs_buffer_destroy(key);
+  kvs_buffer_destroy(value);
+  kvs_record_destroy(record);
+  if (cursor != NULL) {
+    kvs_store_cursor_close(cursor);
+  }
+  return NULL;
+}
+
+/* rows decoded per second by all readers together, timed from the gate opening to the last reader finishing */
+static double scaling(kvs_store *store, const kvs_schema *schema, int32_t threads) {
+  int32_t idx;
+  int64_t start, rows = 0;
+  scaling_gate gate = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, 0 };
+  scaling_reader *readers = calloc(threads, sizeof(scaling_reader));
+  if (readers == NULL) {
+    kvs_cmdline_fatal("Could not allocate readers");
+  }
+  for (idx = 0; idx < threads; ++idx) {
+    readers[idx].store = store;
+    readers[idx].schema = schema;
+    readers[idx].gate = &gate;
+    if (pthread_create(&readers[idx].thread, NULL, scaling_reader_run, &readers[idx]) != 0) {
+      kvs_cmdline_fatal("Could not start reader thread");
+    }
+  }
+  /* transactions and records are set up before the clock starts */
+  pthread_mutex_lock(&gate.lock);
+  while (gate.ready < threads) {
+    pthread_cond_wait(&gate.open, &gate.lock);
+  }
+  gate.started = 1;
+  start = now_us();
+  pthread_cond_broadcast(&gate.open);
+  pthread_mutex_unlock(&gate.lock);
+  for (idx = 0; idx < threads; ++idx) {
+    pthread_join(readers[idx].thread, NULL);
+    if (readers[idx].failed) {
+      kvs_cmdline_fatal("Reader failed to open a read transaction or hit an invalid record checksum\n");
+    }
+    rows += readers[idx].rows;
+  }
+  start = now_us() - start;
+  free(readers);
+  return start > 0 ? rows * 1000000.0 / start : 0;
+}
+
+static void scaling_tier(kvs_store *store, const char *name, int32_t flags, int32_t max_threads) {
+  int32_t threads;
+  double rate, single = 0;
+  kvs_schema *schema = kvs_schema_create(columns_meta, columns_num, columns_flags | flags);
+  if (schema == NULL) {
+    printf("%s codec is not available\n", name);
+    return;
+  }
+  if (KVS_FAILED(kvs_schema_dictionary_load(schema, store))) {
+    kvs_cmdline_fatal("Could not load schema dictionaries");
+  }
+  /* warmup cache and lazily compiled code first */
+  scaling(store, schema, 1);
+  printf("%s codec\n", name);
+  printf("  threads        rows/s  rows/s/thread  speedup\n");
+  /* doubling thread counts, the last run uses max_threads */
+  for (threads = 1;; threads = threads * 2 < max_threads ? threads * 2 : max_threads) {
+    rate = scaling(store, schema, threads);
+    if (threads == 1) {
+      single = rate;
+    }
+    printf("  %7d  %12.0f  %13.0f  %6.2fx\n", threads, rate, rate / threads, single > 0 ? rate / single : 0);
+    if (threads == max_threads) {
+      break;
+    }
+  }
+  kvs_schema_destroy(schema);
+}
+
+int main(int argc, char **argv) {
+  kvs_store *store;
+  int32_t max_threads;
+  if (argc != 2 && argc != 3) {
+    printf("Usage:\n%s <path> [max threads, defaults to online cpus]\n", argv[0]);
+    return 1;
+  }
+  max_threads = argc == 3 ? strtol(argv[2], NULL, 10) : sysconf(_SC_NPROCESSORS_ONLN);
+  if (max_threads < 1) {
+    max_threads = 1;
+  }
+  store = kvs_store_open(argv[1], 0);
+  if (store == NULL) {
+    kvs_cmdline_fatal("Could not open kvs store");
+  }
+  scaling_tier(store, "prepared", KVS_SCHEMA_FLAG_PREPARED, max_threads);
+  scaling_tier(store, "jit", KVS_SCHEMA_FLAG_JIT, max_threads);
+  scaling_tier(store, "aot", KVS_SCHEMA_FLAG_AOT, max_threads);
+  kvs_store_destroy(store);
+  return 0;
+}
@@ -2,13 +2,33 @@
 #include "record.h"
 #include "util.h"
 #include "status.h"
+#include "checksum.h"
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
 
+#define KVS_SCHEMA_COMPILE_QUEUED (1)
+#define KVS_SCHEMA_COMPILE_RUNNING (2)
+
+/* a NULL key serializes the value only */
 typedef void (*kvs_schema_serializer)(const kvs_column **keys, size_t key_size, const kvs_column **values, size_t value_size, kvs_record *record, kvs_buffer *key, kvs_buffer *value, void *opaque);
 typedef void (*kvs_schema_codec_destructor)(const kvs_column **keys, size_t key_size, const kvs_column **values, size_t value_size, void *opaque);
 typedef void (*kvs_schema_deserializer)(const kvs_column **keys, size_t key_size, const kvs_column **values, size_t value_size, kvs_buffer *key, kvs_buffer *value, void *opaque, kvs_record *dest);
 
+typedef void (*kvs_schema_struct_serializer)(const kvs_column **keys, size_t key_size, const kvs_column **values, size_t value_size, const kvs_schema_struct_field **fields, const void *object, kvs_buffer *key, kvs_buffer *value, void *opaque);
+typedef void (*kvs_schema_struct_deserializer)(const kvs_column **keys, size_t key_size, const kvs_column **values, size_t value_size, const kvs_schema_struct_field **fields, kvs_buffer *key, kvs_buffer *value, kvs_buffer *heap, void *opaque, void *object);
+
+typedef struct kvs_schema_codec {
+  kvs_schema_tier tier;
+  void *opaque;
+  kvs_schema_serializer serializer;
+  kvs_schema_deserializer deserializer;
+  kvs_schema_codec_destructor destructor;
+} kvs_schema_codec;
+
 struct kvs_schema {
   kvs_column *columns;
   kvs_variant **dfts;
@@ -17,35 +37,208 @@ struct kvs_schema {
   size_t key_size;
   const kvs_column **values;
   size_t value_size;
-  void *codec;
-  kvs_schema_serializer serializer;
-  kvs_schema_deserializer deserializer;
-  kvs_schema_codec_destructor codec_destructor;
+  /* points to baseline until the tiered compilation publishes optimized */
+  const kvs_schema_codec *codec;
+  kvs_schema_codec baseline;
+  kvs_schema_codec optimized;
+  /* guarded by the compile pool lock */
+  struct kvs_schema *compile_next;
+  int32_t compiling;
+  int32_t flags;
+  uint32_t checksum_sampling;
 };
 
 struct kvs_schema_projection {
   size_t *index;
 };
 
+struct kvs_schema_struct {
+  const kvs_schema *schema;
+  kvs_schema_tier tier;
+  void *opaque;
+  kvs_schema_struct_serializer serializer;
+  kvs_schema_struct_deserializer deserializer;
+  kvs_schema_codec_destructor destructor;
+  /* copies of the bound fields indexed by column index */
+  const kvs_schema_struct_field **fields;
+  /* layout computed by the schema for flat records, 0 for caller structs */
+  size_t flat_size;
+  int32_t arena_size;
+};
+
+#define KVS_SCHEMA_FLAT_ALIGN(size) (((size) + 7) & ~((size_t) 7))
+/* inline arena of flat records, per opaque column with at least the minimum */
+#define KVS_SCHEMA_FLAT_OPAQUE_SIZE (64)
+#define KVS_SCHEMA_FLAT_ARENA_MIN_SIZE (256)
+/* stack room for the buffer header kvs_schema_record_put places over reserved rows */
+#define KVS_SCHEMA_RESERVED_BUFFER_WORDS (16)
+/* rows rewritten per transaction by value log collection */
+#define KVS_SCHEMA_VALUE_LOG_ROWS_PER_TXN (1024)
+
 #define __KVS_SCHEMA_INTERNAL_H__
 #include "interpret.h"
 #include "prepared.h"
+#include "aot.h"
+#ifndef KVS_WITHOUT_JIT
 #include "jit.h"
+#endif
 #undef __KVS_SCHEMA_INTERNAL_H__
 
+static kvs_status kvs_schema_codec_create(kvs_schema *schema, kvs_schema_codec *codec, kvs_schema_tier tier) {
+  const kvs_schema_aot_codec *aot;
+  codec->tier = tier;
+  switch (tier) {
+    case KVS_SCHEMA_TIER_AOT:
+      if ((aot = kvs_schema_aot_codec_lookup(schema->keys, schema->key_size, schema->values, schema->value_size)) == NULL) {
+        return KVS_SCHEMA_AOT_NOT_FOUND;
+      }
+      codec->serializer = aot->serializer;
+      codec->deserializer = aot->deserializer;
+      codec->opaque = (void *) aot;
+      codec->destructor = kvs_schema_aot_codec_destroy;
+      break;
+    case KVS_SCHEMA_TIER_JIT:
+#ifdef KVS_WITHOUT_JIT
+      return KVS_SCHEMA_JIT_NOT_SUPPORTED;
+#else
+      codec->serializer = kvs_schema_jit_serializer;
+      codec->deserializer = kvs_schema_jit_deserializer;
+      if ((schema->flags & (KVS_SCHEMA_FLAG_JIT_LAZY | KVS_SCHEMA_FLAG_TIERED)) == KVS_SCHEMA_FLAG_JIT_LAZY) {
+        codec->opaque = kvs_schema_jit_lazy_codec_create(schema->keys, schema->key_size, schema->values, schema->value_size);
+      } else {
+        codec->opaque = kvs_schema_jit_codec_create(schema->keys, schema->key_size, schema->values, schema->value_size);
+      }
+      codec->destructor = kvs_schema_jit_codec_destroy;
+      break;
+#endif
+    case KVS_SCHEMA_TIER_PREPARED:
+      codec->serializer = kvs_schema_prepared_serializer;
+      codec->deserializer = kvs_schema_prepared_deserializer;
+      codec->opaque = kvs_schema_prepared_codec_create(schema->keys, schema->key_size, schema->values, schema->value_size);
+      codec->destructor = kvs_schema_prepared_codec_destroy;
+      break;
+    default:
+      codec->serializer = kvs_schema_interpret_serializer;
+      codec->deserializer = kvs_schema_interpret_deserializer;
+      codec->opaque = kvs_schema_interpret_codec_create(schema->keys, schema->key_size, schema->values, schema->value_size);
+      codec->destructor = kvs_schema_interpret_codec_destroy;
+      break;
+  }
+  if (codec->opaque == NULL) {
+    return tier == KVS_SCHEMA_TIER_JIT ? KVS_SCHEMA_JIT_INTERNAL_ERROR : KVS_OUT_OF_MEMORY;
+  }
+  return KVS_OK;
+}
+
+static void kvs_schema_codec_destroy(kvs_schema *schema, kvs_schema_codec *codec) {
+  if (codec->opaque != NULL) {
+    codec->destructor(schema->keys, schema->key_size, schema->values, schema->value_size, codec->opaque);
+  }
+}
+
+static void kvs_schema_codec_compile(kvs_schema *schema) {
+  if (!KVS_FAILED(kvs_schema_codec_create(schema, &schema->optimized, KVS_SCHEMA_TIER_JIT))) {
+    /* baseline stays alive until destroy, readers already using it are not affected */
+    __atomic_store_n(&schema->codec, &schema->optimized, __ATOMIC_RELEASE);
+  }
+}
+
+/* background compilations of tiered schemas share a pool of at most one worker per core */
+static pthread_mutex_t compile_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t compile_pool_done = PTHREAD_COND_INITIALIZER;
+static kvs_schema *compile_pool_head = NULL;
+static kvs_schema **compile_pool_tail = &compile_pool_head;
+static long compile_pool_workers = 0;
+
+static void *kvs_schema_compile_pool_worker(void *arg) {
+  kvs_schema *schema;
+  pthread_mutex_lock(&compile_pool_lock);
+  while ((schema = compile_pool_head) != NULL) {
+    if ((compile_pool_head = schema->compile_next) == NULL) {
+      compile_pool_tail = &compile_pool_head;
+    }
+    schema->compiling = KVS_SCHEMA_COMPILE_RUNNING;
+    pthread_mutex_unlock(&compile_pool_lock);
+    kvs_schema_codec_compile(schema);
+    pthread_mutex_lock(&compile_pool_lock);
+    schema->compiling = 0;
+    pthread_cond_broadcast(&compile_pool_done);
+  }
+  /* idle workers exit, the next submit starts new ones */
+  compile_pool_workers--;
+  pthread_mutex_unlock(&compile_pool_lock);
+  return NULL;
+}
+
+/* requires the compile pool lock */
+static void kvs_schema_compile_pool_remove(kvs_schema *schema) {
+  kvs_schema **current;
+  for (current = &compile_pool_head; *current != NULL; current = &(*current)->compile_next) {
+    if (*current == schema) {
+      if ((*current = schema->compile_next) == NULL) {
+        compile_pool_tail = current;
+      }
+      schema->compiling = 0;
+      return;
+    }
+  }
+}
+
+static void kvs_schema_compile_pool_submit(kvs_schema *schema) {
+  pthread_t worker;
+  pthread_attr_t attr;
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  pthread_mutex_lock(&compile_pool_lock);
+  schema->compiling = KVS_SCHEMA_COMPILE_QUEUED;
+  schema->compile_next = NULL;
+  *compile_pool_tail = schema;
+  compile_pool_tail = &schema->compile_next;
+  if (compile_pool_workers < (cores > 0 ? cores : 1)) {
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&worker, &attr, kvs_schema_compile_pool_worker, NULL) == 0) {
+      compile_pool_workers++;
+    }
+    pthread_attr_destroy(&attr);
+  }
+  if (compile_pool_workers == 0) {
+    /* without any worker the schema stays on its baseline codec */
+    kvs_schema_compile_pool_remove(schema);
+  }
+  pthread_mutex_unlock(&compile_pool_lock);
+}
+
+static const kvs_schema_codec *kvs_schema_codec_current(const kvs_schema *schema) {
+  return __atomic_load_n(&schema->codec, __ATOMIC_ACQUIRE);
+}
+
 kvs_schema *kvs_schema_create(const kvs_column *columns, size_t size, int32_t flags) {
   size_t idx, fixed = 0, varlen, fixed_size, key_size = 0, key = 0, value = 0;
+  int32_t separated = 0;
   kvs_schema *schema;
   kvs_column *current;
   for (idx = 0; idx < size; ++idx) {
     if (columns[idx].pk) {
       key_size++;
     }
+    if ((columns[idx].flags & KVS_COLUMN_FLAG_DICTIONARY) == KVS_COLUMN_FLAG_DICTIONARY &&
+        (columns[idx].pk || columns[idx].type != KVS_VARIANT_TYPE_OPAQUE)) {
+      return NULL;
+    }
+    if ((columns[idx].flags & KVS_COLUMN_FLAG_SEPARATE) == KVS_COLUMN_FLAG_SEPARATE) {
+      if (columns[idx].pk || columns[idx].type != KVS_VARIANT_TYPE_OPAQUE || (columns[idx].flags & KVS_COLUMN_FLAG_DICTIONARY) != 0) {
+        return NULL;
+      }
+      separated = 1;
+    }
   }
   if (key_size == 0) {
     return NULL;
   }
-  schema = malloc(sizeof(kvs_schema) + (sizeof(kvs_column) * size) + (sizeof(kvs_column *) * size) + (sizeof(kvs_variant *) * size));
+  schema = calloc(1, sizeof(kvs_schema) + (sizeof(kvs_column) * size) + (sizeof(kvs_column *) * size) + (sizeof(kvs_variant *) * size));
+  if (schema == NULL) {
+    return NULL;
+  }
   schema->columns = KVS_UNSAFE_CAST(schema, sizeof(kvs_schema));
   schema->keys = KVS_UNSAFE_CAST(schema->columns, sizeof(kvs_column) * size);
   schema->values = KVS_UNSAFE_CAST(schema->keys, sizeof(kvs_column *) * key_size);
@@ -63,6 +256,23 @@ kvs_schema *kvs_schema_create(const kvs_column *columns, size_t size, int32_t fl
       current->index = varlen;
     }
     current->name = strdup(columns[idx].name);
+    current->dictionary = NULL;
+    current->vlog = NULL;
+    /* without its dictionary or binding the column would silently fall back to the plain opaque encoding */
+    if ((current->flags & KVS_COLUMN_FLAG_DICTIONARY) == KVS_COLUMN_FLAG_DICTIONARY &&
+        (current->dictionary = kvs_dictionary_create()) == NULL) {
+      goto cleanup_exit;
+    }
+    if ((current->flags & KVS_COLUMN_FLAG_SEPARATE) == KVS_COLUMN_FLAG_SEPARATE) {
+      if ((current->vlog = malloc(sizeof(kvs_vlog_binding))) == NULL) {
+        goto cleanup_exit;
+      }
+      current->vlog->log = NULL;
+      current->vlog->threshold = current->threshold > 0 ? current->threshold : KVS_VLOG_DEFAULT_THRESHOLD;
+    }
+    if (current->name == NULL || schema->dfts[current->index] == NULL) {
+      goto cleanup_exit;
+    }
     if (current->pk) {
       schema->keys[key++] = current;
     } else {
@@ -71,36 +281,81 @@ kvs_schema *kvs_schema_create(const kvs_column *columns, size_t size, int32_t fl
   }
   schema->key_size = key_size;
   schema->value_size = size - key_size;
-  if ((flags & KVS_SCHEMA_FLAG_JIT) == KVS_SCHEMA_FLAG_JIT) {
-    schema->serializer = kvs_schema_jit_serializer;
-    schema->deserializer = kvs_schema_jit_deserializer;
-    schema->codec = kvs_schema_jit_codec_create(schema->keys, schema->key_size, schema->values, schema->value_size);
-    schema->codec_destructor = kvs_schema_jit_codec_destroy;
-  } else if ((flags & KVS_SCHEMA_FLAG_PREPARED) == KVS_SCHEMA_FLAG_PREPARED) {
-    schema->serializer = kvs_schema_prepared_serializer;
-    schema->deserializer = kvs_schema_prepared_deserializer;
-    schema->codec = kvs_schema_prepared_codec_create(schema->keys, schema->key_size, schema->values, schema->value_size);
-    schema->codec_destructor = kvs_schema_prepared_codec_destroy;
-  } else {
-    schema->serializer = kvs_schema_interpret_serializer;
-    schema->deserializer = kvs_schema_interpret_deserializer;
-    schema->codec = kvs_schema_interpret_codec_create(schema->keys, schema->key_size, schema->values, schema->value_size);
-    schema->codec_destructor = kvs_schema_interpret_codec_destroy;
+  if (separated && (flags & (KVS_SCHEMA_FLAG_JIT | KVS_SCHEMA_FLAG_AOT)) != 0) {
+    /* neither generated codec knows value log pointers */
+    flags = (flags & ~(KVS_SCHEMA_FLAG_JIT | KVS_SCHEMA_FLAG_TIERED | KVS_SCHEMA_FLAG_JIT_LAZY | KVS_SCHEMA_FLAG_AOT)) | KVS_SCHEMA_FLAG_PREPARED;
   }
-  if (schema->codec == NULL) {
-    kvs_schema_destroy(schema);
-    schema = NULL;
+  schema->flags = flags;
+  schema->checksum_sampling = 1;
+  schema->codec = &schema->baseline;
+  if ((flags & KVS_SCHEMA_FLAG_AOT) == KVS_SCHEMA_FLAG_AOT &&
+      !KVS_FAILED(kvs_schema_codec_create(schema, &schema->baseline, KVS_SCHEMA_TIER_AOT))) {
+    /* a generated codec needs neither preparation nor compilation */
+  } else if ((flags & (KVS_SCHEMA_FLAG_JIT | KVS_SCHEMA_FLAG_TIERED)) == (KVS_SCHEMA_FLAG_JIT | KVS_SCHEMA_FLAG_TIERED)) {
+    if (KVS_FAILED(kvs_schema_codec_create(schema, &schema->baseline, KVS_SCHEMA_TIER_PREPARED))) {
+      goto cleanup_exit;
+    }
+    kvs_schema_compile_pool_submit(schema);
+  } else if ((flags & KVS_SCHEMA_FLAG_JIT) == KVS_SCHEMA_FLAG_JIT) {
+    if (KVS_FAILED(kvs_schema_codec_create(schema, &schema->baseline, KVS_SCHEMA_TIER_JIT))) {
+      goto cleanup_exit;
+    }
+  } else if ((flags & KVS_SCHEMA_FLAG_PREPARED) == KVS_SCHEMA_FLAG_PREPARED) {
+    if (KVS_FAILED(kvs_schema_codec_create(schema, &schema->baseline, KVS_SCHEMA_TIER_PREPARED))) {
+      goto cleanup_exit;
+    }
+  } else if (KVS_FAILED(kvs_schema_codec_create(schema, &schema->baseline, KVS_SCHEMA_TIER_INTERPRETED))) {
+    goto cleanup_exit;
   }
   return schema;
+cleanup_exit:
+  kvs_schema_destroy(schema);
+  return NULL;
+}
+
+const kvs_column **kvs_schema_keys(const kvs_schema *schema, size_t *size) {
+  *size = schema->key_size;
+  return schema->keys;
+}
+
+const kvs_column **kvs_schema_values(const kvs_schema *schema, size_t *size) {
+  *size = schema->value_size;
+  return schema->values;
+}
+
+kvs_schema_tier kvs_schema_codec_tier(const kvs_schema *schema) {
+  return kvs_schema_codec_current(schema)->tier;
+}
+
+void kvs_schema_codec_wait(kvs_schema *schema) {
+  pthread_mutex_lock(&compile_pool_lock);
+  while (schema->compiling) {
+    pthread_cond_wait(&compile_pool_done, &compile_pool_lock);
+  }
+  pthread_mutex_unlock(&compile_pool_lock);
+}
+
+/* a compilation still queued is dropped, a running one is waited for */
+static void kvs_schema_codec_cancel(kvs_schema *schema) {
+  pthread_mutex_lock(&compile_pool_lock);
+  if (schema->compiling == KVS_SCHEMA_COMPILE_QUEUED) {
+    kvs_schema_compile_pool_remove(schema);
+  }
+  pthread_mutex_unlock(&compile_pool_lock);
+  kvs_schema_codec_wait(schema);
 }
 
 void kvs_schema_destroy(kvs_schema *schema) {
   size_t idx;
+  kvs_schema_codec_cancel(schema);
+  kvs_schema_codec_destroy(schema, &schema->optimized);
+  kvs_schema_codec_destroy(schema, &schema->baseline);
   for (idx = 0; idx < schema->size; ++idx) {
     kvs_variant_destroy(schema->dfts[idx]);
     free((char *) schema->columns[idx].name);
+    kvs_dictionary_destroy(schema->columns[idx].dictionary);
+    free(schema->columns[idx].vlog);
   }
-  schema->codec_destructor(schema->keys, schema->key_size, schema->values, schema->value_size, schema->codec);
   free(schema);
 }
 
@@ -108,12 +363,210 @@ kvs_record *kvs_schema_record_create(const kvs_schema *schema) {
   return kvs_record_create(schema->dfts, schema->size);
 }
 
-void kvs_schema_record_serialize(const kvs_schema *schema, kvs_record *record, kvs_buffer *key, kvs_buffer *value) {
-  schema->serializer(schema->keys, schema->key_size, schema->values, schema->value_size, record, key, value, schema->codec);
+static void kvs_schema_checksum_append(kvs_buffer *key, kvs_buffer *value) {
+  uint32_t crc = kvs_buffer_crc32c(key, kvs_buffer_size(key), 0);
+  crc = kvs_buffer_crc32c(value, kvs_buffer_size(value), crc);
+  kvs_buffer_write(value, &crc, sizeof(crc));
 }
 
-void kvs_schema_record_deserialize(const kvs_schema *schema, kvs_buffer *key, kvs_buffer *value, kvs_record *dest) {
-  schema->deserializer(schema->keys, schema->key_size, schema->values, schema->value_size, key, value, schema->codec, dest);
+/* leaves the checksum in value for the caller to skip once the record is decoded */
+static kvs_status kvs_schema_checksum_verify(const kvs_schema *schema, kvs_buffer *key, kvs_buffer *value) {
+  uint32_t expected, crc;
+  size_t value_size;
+  if ((value_size = kvs_buffer_size(value)) < sizeof(expected)) {
+    return KVS_SCHEMA_CHECKSUM_MISMATCH;
+  }
+  value_size -= sizeof(expected);
+  kvs_buffer_copy(value, value_size, &expected, sizeof(expected));
+  /* sample on the stored checksum itself so no state is shared between readers */
+  if (schema->checksum_sampling <= 1 || expected % schema->checksum_sampling == 0) {
+    crc = kvs_buffer_crc32c(key, kvs_buffer_size(key), 0);
+    crc = kvs_buffer_crc32c(value, value_size, crc);
+    if (crc != expected) {
+      kvs_buffer_skip(key, kvs_buffer_size(key));
+      kvs_buffer_skip(value, kvs_buffer_size(value));
+      return KVS_SCHEMA_CHECKSUM_MISMATCH;
+    }
+  }
+  return KVS_OK;
+}
+
+kvs_status kvs_schema_record_serialize(const kvs_schema *schema, kvs_record *record, kvs_buffer *key, kvs_buffer *value) {
+  const kvs_schema_codec *codec = kvs_schema_codec_current(schema);
+  codec->serializer(schema->keys, schema->key_size, schema->values, schema->value_size, record, key, value, codec->opaque);
+  if ((schema->flags & KVS_SCHEMA_FLAG_CHECKSUM) == KVS_SCHEMA_FLAG_CHECKSUM) {
+    kvs_schema_checksum_append(key, value);
+  }
+  /* dictionary values that could not be encoded */
+  return kvs_variant_codec_status();
+}
+
+kvs_status kvs_schema_record_serialize_batch(const kvs_schema *schema, kvs_record **records, size_t num_records, kvs_batch *batch) {
+  size_t idx;
+  kvs_status st;
+  kvs_buffer *key, *value;
+  for (idx = 0; idx < num_records; ++idx) {
+    KVS_DO(st, kvs_batch_begin(batch, &key, &value));
+    /* the uncommitted pair is dropped by the next begin */
+    KVS_DO(st, kvs_schema_record_serialize(schema, records[idx], key, value));
+    KVS_DO(st, kvs_batch_commit(batch));
+  }
+  return KVS_OK;
+}
+
+/* exact encoded size of the value of record, 0 when only encoding tells */
+static size_t kvs_schema_record_value_size(const kvs_schema *schema, kvs_record *record) {
+  size_t idx, size, total = 0;
+  const kvs_column *column;
+  const kvs_variant *variant;
+  for (idx = 0; idx < schema->value_size; ++idx) {
+    column = schema->values[idx];
+    variant = *kvs_record_get(record, column->index);
+    if (column->vlog != NULL) {
+      /* the value log decides between pointer and inline value on append */
+      return 0;
+    } else if (column->dictionary != NULL) {
+      if ((size = kvs_variant_dictionary_serialized_size(variant, column->dictionary)) == 0) {
+        return 0;
+      }
+      total += size;
+    } else {
+      total += kvs_variant_serialized_size(variant);
+    }
+  }
+  if ((schema->flags & KVS_SCHEMA_FLAG_CHECKSUM) == KVS_SCHEMA_FLAG_CHECKSUM) {
+    total += sizeof(uint32_t);
+  }
+  return total;
+}
+
+static kvs_status kvs_schema_record_put_row(const kvs_schema *schema, kvs_store_txn *txn, kvs_record *record, kvs_buffer *key, kvs_buffer *value) {
+  kvs_status st, del_st;
+  void *data;
+  kvs_buffer *reserved;
+  uint64_t memory[KVS_SCHEMA_RESERVED_BUFFER_WORDS];
+  const kvs_schema_codec *codec = kvs_schema_codec_current(schema);
+  size_t size = kvs_schema_record_value_size(schema, record);
+  if (size == 0 || kvs_buffer_embedded_size(0) > sizeof(memory)) {
+    if (KVS_FAILED(st = kvs_schema_record_serialize(schema, record, key, value))) {
+      kvs_buffer_skip(key, kvs_buffer_size(key));
+      kvs_buffer_skip(value, kvs_buffer_size(value));
+      return st;
+    }
+    return kvs_store_txn_put(txn, key, value);
+  }
+  /* the store takes the key before the value is written, so the codec only writes the value */
+  kvs_schema_interpret_key_serializer(schema->keys, schema->key_size, record, key);
+  if (KVS_FAILED(st = kvs_store_txn_put_reserve(txn, key, size, &data))) {
+    kvs_buffer_skip(key, kvs_buffer_size(key));
+    return st;
+  }
+  reserved = kvs_buffer_embed_data(memory, data, size, size);
+  codec->serializer(schema->keys, schema->key_size, schema->values, schema->value_size, record, NULL, reserved, codec->opaque);
+  if ((schema->flags & KVS_SCHEMA_FLAG_CHECKSUM) == KVS_SCHEMA_FLAG_CHECKSUM) {
+    kvs_schema_checksum_append(key, reserved);
+  }
+  /* a failed encoding or a size mismatch, which spills into a heap block, leaves an incomplete row that is deleted again */
+  if (!KVS_FAILED(st = kvs_variant_codec_status()) && kvs_buffer_size(reserved) == size && kvs_buffer_peek(reserved, size) == data) {
+    kvs_buffer_skip(key, kvs_buffer_size(key));
+  } else {
+    st = KVS_FAILED(st) ? st : KVS_INSUFFICIENT_BUFFER;
+    del_st = kvs_store_txn_del(txn, key);
+    st = KVS_FAILED(del_st) ? del_st : st;
+  }
+  kvs_buffer_fini(reserved);
+  return st;
+}
+
+kvs_status kvs_schema_record_put(const kvs_schema *schema, kvs_store_txn *txn, kvs_record *record, kvs_buffer *key, kvs_buffer *value) {
+  kvs_status st;
+  KVS_DO(st, kvs_schema_record_put_row(schema, txn, record, key, value));
+  /* codes the record added to a dictionary are written with it */
+  return kvs_schema_dictionary_save(schema, txn);
+}
+
+kvs_status kvs_schema_record_put_batch(const kvs_schema *schema, kvs_store_txn *txn, const kvs_batch *batch) {
+  kvs_status st;
+  KVS_DO(st, kvs_store_txn_put_batch(txn, batch));
+  return kvs_schema_dictionary_save(schema, txn);
+}
+
+/* key and value buffers are expected to hold exactly one record */
+kvs_status kvs_schema_record_deserialize(const kvs_schema *schema, kvs_buffer *key, kvs_buffer *value, kvs_record *dest) {
+  kvs_status st;
+  const kvs_schema_codec *codec = kvs_schema_codec_current(schema);
+  if ((schema->flags & KVS_SCHEMA_FLAG_CHECKSUM) != KVS_SCHEMA_FLAG_CHECKSUM) {
+    codec->deserializer(schema->keys, schema->key_size, schema->values, schema->value_size, key, value, codec->opaque, dest);
+    /* dictionary and separated values that could not be read are left empty */
+    return kvs_variant_codec_status();
+  }
+  KVS_DO(st, kvs_schema_checksum_verify(schema, key, value));
+  codec->deserializer(schema->keys, schema->key_size, schema->values, schema->value_size, key, value, codec->opaque, dest);
+  kvs_buffer_skip(value, sizeof(uint32_t));
+  return kvs_variant_codec_status();
+}
+
+void kvs_schema_set_checksum_sampling(kvs_schema *schema, uint32_t interval) {
+  schema->checksum_sampling = interval;
+}
+
+kvs_status kvs_schema_key_vencode(const kvs_schema *schema, void *dest, size_t *size, size_t num_keys, va_list args) {
+  size_t idx, offset = 0, part, opaque_size;
+  uint8_t *cdest = dest, scratch[sizeof(int64_t)];
+  const void *opaque;
+  int32_t i32;
+  int64_t i64;
+  double d;
+  if (num_keys > schema->key_size) {
+    return KVS_SCHEMA_COLUMN_NOT_FOUND;
+  }
+  for (idx = 0; idx < num_keys; ++idx) {
+    switch (schema->keys[idx]->type) {
+      case KVS_VARIANT_TYPE_INT32:
+        i32 = va_arg(args, int32_t);
+        part = kvs_variant_encode_comparable_int32(i32, offset + sizeof(i32) <= *size ? cdest + offset : scratch);
+        break;
+      case KVS_VARIANT_TYPE_INT64:
+        i64 = va_arg(args, int64_t);
+        part = kvs_variant_encode_comparable_int64(i64, offset + sizeof(i64) <= *size ? cdest + offset : scratch);
+        break;
+      case KVS_VARIANT_TYPE_FLOAT:
+        d = va_arg(args, double);
+        part = kvs_variant_encode_comparable_float((float) d, offset + sizeof(float) <= *size ? cdest + offset : scratch);
+        break;
+      case KVS_VARIANT_TYPE_DOUBLE:
+        d = va_arg(args, double);
+        part = kvs_variant_encode_comparable_double(d, offset + sizeof(d) <= *size ? cdest + offset : scratch);
+        break;
+      case KVS_VARIANT_TYPE_OPAQUE:
+        opaque = va_arg(args, const void *);
+        opaque_size = va_arg(args, size_t);
+        part = kvs_variant_comparable_opaque_size(opaque_size);
+        if (offset + part <= *size) {
+          kvs_variant_encode_comparable_opaque(opaque, opaque_size, cdest + offset);
+        }
+        break;
+      default:
+        part = 0;
+        break;
+    }
+    offset += part;
+  }
+  if (offset > *size) {
+    *size = offset;
+    return KVS_INSUFFICIENT_BUFFER;
+  }
+  *size = offset;
+  return KVS_OK;
+}
+
+kvs_status kvs_schema_key_encode(const kvs_schema *schema, void *dest, size_t *size, size_t num_keys, ...) {
+  kvs_status st;
+  va_list args;
+  va_start(args, num_keys);
+  st = kvs_schema_key_vencode(schema, dest, size, num_keys, args);
+  va_end(args);
+  return st;
 }
 
 static kvs_status kvs_schema_column_lookup(const kvs_schema *schema, const char *column, size_t *index) {
@@ -159,3 +612,543 @@ void kvs_schema_projection_destroy(kvs_schema_projection *projection) {
 kvs_variant **kvs_schema_projection_record_get(const kvs_schema_projection *projection, kvs_record *record, size_t index) {
   return kvs_record_get(record, projection->index[index]);
 }
+
+kvs_schema_struct *kvs_schema_struct_create(const kvs_schema *schema, const kvs_schema_struct_field *fields, size_t num_fields) {
+  size_t idx, index;
+  kvs_schema_struct_field *copies;
+  kvs_schema_struct *binding;
+  if (num_fields != schema->size || (binding = calloc(1, sizeof(kvs_schema_struct) +
+      ((sizeof(kvs_schema_struct_field *) + sizeof(kvs_schema_struct_field)) * num_fields))) == NULL) {
+    return NULL;
+  }
+  binding->schema = schema;
+  binding->fields = KVS_UNSAFE_CAST(binding, sizeof(kvs_schema_struct));
+  copies = KVS_UNSAFE_CAST(binding->fields, sizeof(kvs_schema_struct_field *) * num_fields);
+  for (idx = 0; idx < num_fields; ++idx) {
+    if (KVS_FAILED(kvs_schema_column_lookup(schema, fields[idx].column, &index)) || binding->fields[index] != NULL) {
+      goto cleanup_exit;
+    }
+    copies[idx] = fields[idx];
+    binding->fields[index] = copies + idx;
+  }
+  for (idx = 0; idx < schema->size; ++idx) {
+    if (binding->fields[schema->columns[idx].index]->type != schema->columns[idx].type) {
+      goto cleanup_exit;
+    }
+  }
+#ifndef KVS_WITHOUT_JIT
+  if ((schema->flags & KVS_SCHEMA_FLAG_JIT) == KVS_SCHEMA_FLAG_JIT &&
+      (binding->opaque = kvs_schema_jit_struct_codec_create(schema->keys, schema->key_size, schema->values, schema->value_size, binding->fields)) != NULL) {
+    binding->tier = KVS_SCHEMA_TIER_JIT;
+    binding->serializer = kvs_schema_jit_struct_serializer;
+    binding->deserializer = kvs_schema_jit_struct_deserializer;
+    binding->destructor = kvs_schema_jit_struct_codec_destroy;
+    return binding;
+  }
+#endif
+  /* aot codecs only target records, jit schemas fall back to prepared like a tiered baseline */
+  if ((schema->flags & (KVS_SCHEMA_FLAG_PREPARED | KVS_SCHEMA_FLAG_JIT)) != 0) {
+    binding->tier = KVS_SCHEMA_TIER_PREPARED;
+    binding->serializer = kvs_schema_prepared_struct_serializer;
+    binding->deserializer = kvs_schema_prepared_struct_deserializer;
+    binding->destructor = kvs_schema_prepared_struct_codec_destroy;
+    binding->opaque = kvs_schema_prepared_struct_codec_create(schema->keys, schema->key_size, schema->values, schema->value_size, binding->fields);
+  } else {
+    binding->tier = KVS_SCHEMA_TIER_INTERPRETED;
+    binding->serializer = kvs_schema_interpret_struct_serializer;
+    binding->deserializer = kvs_schema_interpret_struct_deserializer;
+    binding->destructor = kvs_schema_interpret_struct_codec_destroy;
+    binding->opaque = kvs_schema_interpret_struct_codec_create(schema->keys, schema->key_size, schema->values, schema->value_size, binding->fields);
+  }
+  if (binding->opaque != NULL) {
+    return binding;
+  }
+cleanup_exit:
+  free(binding);
+  return NULL;
+}
+
+void kvs_schema_struct_destroy(kvs_schema_struct *binding) {
+  const kvs_schema *schema;
+  if (binding == NULL) {
+    return;
+  }
+  schema = binding->schema;
+  binding->destructor(schema->keys, schema->key_size, schema->values, schema->value_size, binding->opaque);
+  free(binding);
+}
+
+kvs_schema_tier kvs_schema_struct_tier(const kvs_schema_struct *binding) {
+  return binding->tier;
+}
+
+kvs_status kvs_schema_struct_serialize(const kvs_schema_struct *binding, const void *object, kvs_buffer *key, kvs_buffer *value) {
+  const kvs_schema *schema = binding->schema;
+  binding->serializer(schema->keys, schema->key_size, schema->values, schema->value_size, binding->fields, object, key, value, binding->opaque);
+  if ((schema->flags & KVS_SCHEMA_FLAG_CHECKSUM) == KVS_SCHEMA_FLAG_CHECKSUM) {
+    kvs_schema_checksum_append(key, value);
+  }
+  return kvs_variant_codec_status();
+}
+
+kvs_status kvs_schema_struct_deserialize(const kvs_schema_struct *binding, kvs_buffer *key, kvs_buffer *value, kvs_buffer *heap, void *object) {
+  kvs_status st;
+  const kvs_schema *schema = binding->schema;
+  if ((schema->flags & KVS_SCHEMA_FLAG_CHECKSUM) != KVS_SCHEMA_FLAG_CHECKSUM) {
+    binding->deserializer(schema->keys, schema->key_size, schema->values, schema->value_size, binding->fields, key, value, heap, binding->opaque, object);
+    return kvs_variant_codec_status();
+  }
+  KVS_DO(st, kvs_schema_checksum_verify(schema, key, value));
+  binding->deserializer(schema->keys, schema->key_size, schema->values, schema->value_size, binding->fields, key, value, heap, binding->opaque, object);
+  kvs_buffer_skip(value, sizeof(uint32_t));
+  return kvs_variant_codec_status();
+}
+
+static size_t kvs_schema_flat_place(const kvs_schema *schema, kvs_schema_struct_field *fields, size_t offset, kvs_variant_type type, size_t size) {
+  size_t idx;
+  for (idx = 0; idx < schema->size; ++idx) {
+    if (schema->columns[idx].type == type) {
+      fields[idx].column = schema->columns[idx].name;
+      fields[idx].type = type;
+      fields[idx].offset = offset;
+      fields[idx].size_offset = type == KVS_VARIANT_TYPE_OPAQUE ? offset + sizeof(const void *) : 0;
+      offset += size;
+    }
+  }
+  return offset;
+}
+
+kvs_schema_struct *kvs_schema_flat_create(const kvs_schema *schema) {
+  size_t idx, size;
+  int32_t arena_size = 0;
+  kvs_schema_struct_field *fields;
+  kvs_schema_struct *binding;
+  if ((fields = malloc(sizeof(kvs_schema_struct_field) * schema->size)) == NULL) {
+    return NULL;
+  }
+  /* widest first so every slot is naturally aligned without padding */
+  size = kvs_schema_flat_place(schema, fields, 0, KVS_VARIANT_TYPE_OPAQUE, sizeof(const void *) + sizeof(size_t));
+  size = kvs_schema_flat_place(schema, fields, size, KVS_VARIANT_TYPE_INT64, sizeof(int64_t));
+  size = kvs_schema_flat_place(schema, fields, size, KVS_VARIANT_TYPE_DOUBLE, sizeof(double));
+  size = kvs_schema_flat_place(schema, fields, size, KVS_VARIANT_TYPE_INT32, sizeof(int32_t));
+  size = kvs_schema_flat_place(schema, fields, size, KVS_VARIANT_TYPE_FLOAT, sizeof(float));
+  for (idx = 0; idx < schema->size; ++idx) {
+    if (schema->columns[idx].type == KVS_VARIANT_TYPE_OPAQUE && schema->columns[idx].dictionary == NULL) {
+      arena_size += KVS_SCHEMA_FLAT_OPAQUE_SIZE;
+    }
+  }
+  if ((binding = kvs_schema_struct_create(schema, fields, schema->size)) != NULL) {
+    binding->flat_size = KVS_SCHEMA_FLAT_ALIGN(size);
+    binding->arena_size = arena_size < KVS_SCHEMA_FLAT_ARENA_MIN_SIZE ? KVS_SCHEMA_FLAT_ARENA_MIN_SIZE : arena_size;
+  }
+  free(fields);
+  return binding;
+}
+
+kvs_flat_record *kvs_schema_flat_record_create(const kvs_schema_struct *flat) {
+  if (flat->flat_size == 0) {
+    return NULL;
+  }
+  return kvs_flat_record_create(flat->flat_size, flat->arena_size);
+}
+
+kvs_status kvs_schema_flat_record_serialize(const kvs_schema_struct *flat, kvs_flat_record *record, kvs_buffer *key, kvs_buffer *value) {
+  return kvs_schema_struct_serialize(flat, kvs_flat_record_slots(record), key, value);
+}
+
+kvs_status kvs_schema_flat_record_deserialize(const kvs_schema_struct *flat, kvs_buffer *key, kvs_buffer *value, kvs_flat_record *dest) {
+  kvs_flat_record_release(dest);
+  return kvs_schema_struct_deserialize(flat, key, value, kvs_flat_record_arena(dest), kvs_flat_record_slots(dest));
+}
+
+kvs_status kvs_schema_flat_column(const kvs_schema_struct *flat, const char *column, size_t *index) {
+  return kvs_schema_column_lookup(flat->schema, column, index);
+}
+
+static void *kvs_schema_flat_slot(const kvs_schema_struct *flat, kvs_flat_record *record, size_t index, kvs_variant_type type, kvs_status *st) {
+  if (index >= flat->schema->size) {
+    *st = KVS_SCHEMA_COLUMN_NOT_FOUND;
+    return NULL;
+  }
+  if (flat->fields[index]->type != type) {
+    *st = KVS_INVALID_VARIANT_TYPE;
+    return NULL;
+  }
+  *st = KVS_OK;
+  return KVS_UNSAFE_CAST(kvs_flat_record_slots(record), flat->fields[index]->offset);
+}
+
+kvs_status kvs_schema_flat_record_get_int32(const kvs_schema_struct *flat, kvs_flat_record *record, size_t index, int32_t *dest) {
+  kvs_status st;
+  int32_t *slot = kvs_schema_flat_slot(flat, record, index, KVS_VARIANT_TYPE_INT32, &st);
+  if (slot != NULL) {
+    *dest = *slot;
+  }
+  return st;
+}
+
+kvs_status kvs_schema_flat_record_get_int64(const kvs_schema_struct *flat, kvs_flat_record *record, size_t index, int64_t *dest) {
+  kvs_status st;
+  int64_t *slot = kvs_schema_flat_slot(flat, record, index, KVS_VARIANT_TYPE_INT64, &st);
+  if (slot != NULL) {
+    *dest = *slot;
+  }
+  return st;
+}
+
+kvs_status kvs_schema_flat_record_get_float(const kvs_schema_struct *flat, kvs_flat_record *record, size_t index, float *dest) {
+  kvs_status st;
+  float *slot = kvs_schema_flat_slot(flat, record, index, KVS_VARIANT_TYPE_FLOAT, &st);
+  if (slot != NULL) {
+    *dest = *slot;
+  }
+  return st;
+}
+
+kvs_status kvs_schema_flat_record_get_double(const kvs_schema_struct *flat, kvs_flat_record *record, size_t index, double *dest) {
+  kvs_status st;
+  double *slot = kvs_schema_flat_slot(flat, record, index, KVS_VARIANT_TYPE_DOUBLE, &st);
+  if (slot != NULL) {
+    *dest = *slot;
+  }
+  return st;
+}
+
+kvs_status kvs_schema_flat_record_get_opaque(const kvs_schema_struct *flat, kvs_flat_record *record, size_t index, const void **data, size_t *size) {
+  kvs_status st;
+  const void **slot = kvs_schema_flat_slot(flat, record, index, KVS_VARIANT_TYPE_OPAQUE, &st);
+  if (slot != NULL) {
+    *data = slot[0];
+    *size = *(size_t *) (slot + 1);
+  }
+  return st;
+}
+
+kvs_status kvs_schema_flat_record_set_int32(const kvs_schema_struct *flat, kvs_flat_record *record, size_t index, int32_t to) {
+  kvs_status st;
+  int32_t *slot = kvs_schema_flat_slot(flat, record, index, KVS_VARIANT_TYPE_INT32, &st);
+  if (slot != NULL) {
+    *slot = to;
+  }
+  return st;
+}
+
+kvs_status kvs_schema_flat_record_set_int64(const kvs_schema_struct *flat, kvs_flat_record *record, size_t index, int64_t to) {
+  kvs_status st;
+  int64_t *slot = kvs_schema_flat_slot(flat, record, index, KVS_VARIANT_TYPE_INT64, &st);
+  if (slot != NULL) {
+    *slot = to;
+  }
+  return st;
+}
+
+kvs_status kvs_schema_flat_record_set_float(const kvs_schema_struct *flat, kvs_flat_record *record, size_t index, float to) {
+  kvs_status st;
+  float *slot = kvs_schema_flat_slot(flat, record, index, KVS_VARIANT_TYPE_FLOAT, &st);
+  if (slot != NULL) {
+    *slot = to;
+  }
+  return st;
+}
+
+kvs_status kvs_schema_flat_record_set_double(const kvs_schema_struct *flat, kvs_flat_record *record, size_t index, double to) {
+  kvs_status st;
+  double *slot = kvs_schema_flat_slot(flat, record, index, KVS_VARIANT_TYPE_DOUBLE, &st);
+  if (slot != NULL) {
+    *slot = to;
+  }
+  return st;
+}
+
+kvs_status kvs_schema_flat_record_set_opaque(const kvs_schema_struct *flat, kvs_flat_record *record, size_t index, const void *to, size_t size) {
+  kvs_status st;
+  void *data = NULL;
+  const void **slot = kvs_schema_flat_slot(flat, record, index, KVS_VARIANT_TYPE_OPAQUE, &st);
+  if (slot != NULL) {
+    if (size > 0) {
+      KVS_CHECK_OOM(data = kvs_buffer_allocate(kvs_flat_record_arena(record), size));
+      memcpy(data, to, size);
+    }
+    slot[0] = data;
+    *(size_t *) (slot + 1) = size;
+  }
+  return st;
+}
+
+kvs_status kvs_schema_dictionary_load(const kvs_schema *schema, kvs_store *store) {
+  size_t idx;
+  kvs_status st;
+  const kvs_column *column;
+  for (idx = 0; idx < schema->size; ++idx) {
+    column = schema->columns + idx;
+    if (column->dictionary != NULL) {
+      KVS_DO(st, kvs_store_dictionary_load(store, column->name, column->dictionary));
+    }
+  }
+  return KVS_OK;
+}
+
+kvs_status kvs_schema_dictionary_save(const kvs_schema *schema, kvs_store_txn *txn) {
+  size_t idx;
+  kvs_status st;
+  const kvs_column *column;
+  for (idx = 0; idx < schema->size; ++idx) {
+    column = schema->columns + idx;
+    /* nothing to write unless a code was added since the last committed save */
+    if (column->dictionary != NULL && kvs_dictionary_size(column->dictionary) > kvs_dictionary_persisted(column->dictionary)) {
+      KVS_DO(st, kvs_store_txn_dictionary_save(txn, column->name, column->dictionary));
+    }
+  }
+  return KVS_OK;
+}
+
+kvs_status kvs_schema_dictionary_lookup(const kvs_schema *schema, const char *column, const void *data, size_t size, uint32_t *code) {
+  size_t index;
+  kvs_status st;
+  KVS_DO(st, kvs_schema_column_lookup(schema, column, &index));
+  if (schema->columns[index].dictionary == NULL) {
+    return KVS_SCHEMA_INVALID_DICTIONARY;
+  }
+  return kvs_dictionary_lookup(schema->columns[index].dictionary, data, size, code);
+}
+
+kvs_status kvs_schema_value_log_attach(const kvs_schema *schema, kvs_store *store) {
+  size_t idx;
+  for (idx = 0; idx < schema->size; ++idx) {
+    if (schema->columns[idx].vlog != NULL) {
+      schema->columns[idx].vlog->log = kvs_store_value_log(store);
+    }
+  }
+  return KVS_OK;
+}
+
+typedef struct kvs_schema_value_log_collection {
+  const kvs_schema *schema;
+  kvs_vlog *vlog;
+  /* sealed segments in id order with the bytes rows still point to, only the victims once chosen */
+  uint32_t *segments;
+  uint64_t *sizes;
+  uint64_t *live;
+  size_t num_segments;
+  /* positions of the pointers in the row at hand */
+  size_t *offsets;
+} kvs_schema_value_log_collection;
+
+static int kvs_schema_value_log_segment_compare(const void *left, const void *right) {
+  uint32_t lid = *(const uint32_t *) left, rid = *(const uint32_t *) right;
+  return lid < rid ? -1 : lid > rid;
+}
+
+static const uint32_t *kvs_schema_value_log_segment_find(const kvs_schema_value_log_collection *collection, uint32_t segment) {
+  return bsearch(&segment, collection->segments, collection->num_segments, sizeof(uint32_t), kvs_schema_value_log_segment_compare);
+}
+
+/* walks the encoded value columns, pointers follow the tag in place of an opaque size */
+static kvs_status kvs_schema_value_log_pointers(const kvs_schema *schema, const uint8_t *value, size_t size, size_t *offsets, size_t *num) {
+  size_t idx, offset = 0;
+  int32_t nbytes;
+  const kvs_column *column;
+  *num = 0;
+  for (idx = 0; idx < schema->value_size; ++idx) {
+    column = schema->values[idx];
+    if (column->type != KVS_VARIANT_TYPE_OPAQUE) {
+      offset += kvs_variant_type_size(column->type);
+    } else if (column->dictionary != NULL) {
+      while (offset < size && (value[offset++] & 0x80) != 0) {
+      }
+    } else {
+      if (offset + sizeof(nbytes) > size) {
+        return KVS_STORE_CORRUPTED;
+      }
+      memcpy(&nbytes, value + offset, sizeof(nbytes));
+      offset += sizeof(nbytes);
+      if (column->vlog != NULL && nbytes == KVS_VLOG_POINTER_TAG) {
+        offsets[(*num)++] = offset;
+        offset += KVS_VLOG_POINTER_SIZE;
+      } else if (nbytes >= 0) {
+        offset += nbytes;
+      } else {
+        return KVS_STORE_CORRUPTED;
+      }
+    }
+    if (offset > size) {
+      return KVS_STORE_CORRUPTED;
+    }
+  }
+  return KVS_OK;
+}
+
+static kvs_status kvs_schema_value_log_measure(kvs_schema_value_log_collection *collection, kvs_store *store) {
+  const void *key, *value;
+  size_t key_size, value_size, idx, num;
+  const uint32_t *segment;
+  kvs_vlog_pointer pointer;
+  kvs_status st;
+  kvs_store_cursor *cursor = kvs_store_cursor_open(store);
+  if (cursor == NULL) {
+    return KVS_STORE_INTERNAL_ERROR;
+  }
+  while ((st = kvs_store_cursor_next_no_copy(cursor, &key, &key_size, &value, &value_size)) == KVS_OK) {
+    KVS_DO_GOTO(st, cleanup_exit, kvs_schema_value_log_pointers(collection->schema, value, value_size, collection->offsets, &num));
+    for (idx = 0; idx < num; ++idx) {
+      kvs_vlog_pointer_decode(((const uint8_t *) value) + collection->offsets[idx], &pointer);
+      if ((segment = kvs_schema_value_log_segment_find(collection, pointer.segment)) != NULL) {
+        collection->live[segment - collection->segments] += pointer.size;
+      }
+    }
+  }
+  if (st == KVS_STORE_EOF) {
+    st = KVS_OK;
+  }
+cleanup_exit:
+  kvs_store_cursor_close(cursor);
+  return st;
+}
+
+static kvs_status kvs_schema_value_log_relocate(void *arg, const void *key, size_t key_size, const void *value, size_t value_size, kvs_buffer *dest) {
+  kvs_schema_value_log_collection *collection = arg;
+  const kvs_schema *schema = collection->schema;
+  kvs_vlog_pointer pointer, moved;
+  size_t idx, num;
+  const void *data;
+  uint8_t *copy = NULL;
+  uint32_t crc;
+  kvs_status st;
+  KVS_DO(st, kvs_schema_value_log_pointers(schema, value, value_size, collection->offsets, &num));
+  for (idx = 0; idx < num; ++idx) {
+    kvs_vlog_pointer_decode(((const uint8_t *) value) + collection->offsets[idx], &pointer);
+    if (kvs_schema_value_log_segment_find(collection, pointer.segment) == NULL) {
+      continue;
+    }
+    if (copy == NULL) {
+      memcpy(copy = kvs_buffer_allocate(dest, value_size), value, value_size);
+    }
+    KVS_DO(st, kvs_vlog_get(collection->vlog, &pointer, &data));
+    KVS_DO(st, kvs_vlog_append(collection->vlog, data, pointer.size, &moved));
+    kvs_vlog_pointer_encode(&moved, copy + collection->offsets[idx]);
+  }
+  if (copy != NULL && (schema->flags & KVS_SCHEMA_FLAG_CHECKSUM) == KVS_SCHEMA_FLAG_CHECKSUM) {
+    crc = kvs_crc32c(0, key, key_size);
+    crc = kvs_crc32c(crc, copy, value_size - sizeof(crc));
+    memcpy(copy + value_size - sizeof(crc), &crc, sizeof(crc));
+  }
+  return KVS_OK;
+}
+
+kvs_status kvs_schema_value_log_collect(const kvs_schema *schema, kvs_store *store, double max_live) {
+  kvs_schema_value_log_collection collection;
+  size_t idx, num, victims = 0, moved = 0;
+  kvs_status st = KVS_OK;
+  void *memory;
+  collection.schema = schema;
+  collection.vlog = kvs_store_value_log(store);
+  /* segments retired by the previous collection stay mapped while readers from before it are left, nothing more is retired meanwhile */
+  if (!kvs_store_readers_past_fence(store)) {
+    return KVS_OK;
+  }
+  kvs_vlog_release(collection.vlog);
+  if ((num = kvs_vlog_sealed(collection.vlog, NULL, NULL, 0)) == 0) {
+    return KVS_OK;
+  }
+  KVS_CHECK_OOM(memory = calloc(1, ((sizeof(uint64_t) * 2 + sizeof(uint32_t)) * num) + (sizeof(size_t) * schema->value_size)));
+  collection.sizes = memory;
+  collection.live = collection.sizes + num;
+  collection.offsets = KVS_UNSAFE_CAST(collection.live, sizeof(uint64_t) * num);
+  collection.segments = KVS_UNSAFE_CAST(collection.offsets, sizeof(size_t) * schema->value_size);
+  /* a segment sealed meanwhile waits for the next collection */
+  if ((idx = kvs_vlog_sealed(collection.vlog, collection.segments, collection.sizes, num)) < num) {
+    num = idx;
+  }
+  collection.num_segments = num;
+  KVS_DO_GOTO(st, cleanup_exit, kvs_schema_value_log_measure(&collection, store));
+  for (idx = 0; idx < num; ++idx) {
+    if (collection.live[idx] <= max_live * collection.sizes[idx]) {
+      moved += collection.live[idx] > 0;
+      collection.segments[victims++] = collection.segments[idx];
+    }
+  }
+  collection.num_segments = victims;
+  if (moved > 0) {
+    KVS_DO_GOTO(st, cleanup_exit, kvs_store_rewrite(store, kvs_schema_value_log_relocate, &collection, KVS_SCHEMA_VALUE_LOG_ROWS_PER_TXN));
+  }
+  for (idx = 0; idx < victims; ++idx) {
+    KVS_DO_GOTO(st, cleanup_exit, kvs_vlog_retire(collection.vlog, collection.segments[idx]));
+  }
+cleanup_exit:
+  if (victims > 0) {
+    kvs_store_reader_fence(store);
+  }
+  free(memory);
+  return st;
+}
+
+struct kvs_schema_value_log_gc {
+  const kvs_schema *schema;
+  kvs_store *store;
+  double max_live;
+  uint32_t interval_ms;
+  int32_t stopped;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+};
+
+static void *kvs_schema_value_log_gc_run(void *arg) {
+  kvs_schema_value_log_gc *gc = arg;
+  struct timespec deadline;
+  pthread_mutex_lock(&gc->lock);
+  while (!gc->stopped) {
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += gc->interval_ms / 1000;
+    if ((deadline.tv_nsec += (gc->interval_ms % 1000) * 1000000L) >= 1000000000L) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000L;
+    }
+    while (!gc->stopped && pthread_cond_timedwait(&gc->wake, &gc->lock, &deadline) != ETIMEDOUT) {
+    }
+    if (gc->stopped) {
+      break;
+    }
+    pthread_mutex_unlock(&gc->lock);
+    /* a failed collection is simply retried on the next round */
+    kvs_schema_value_log_collect(gc->schema, gc->store, gc->max_live);
+    pthread_mutex_lock(&gc->lock);
+  }
+  pthread_mutex_unlock(&gc->lock);
+  return NULL;
+}
+
+kvs_schema_value_log_gc *kvs_schema_value_log_gc_start(const kvs_schema *schema, kvs_store *store, double max_live, uint32_t interval_ms) {
+  kvs_schema_value_log_gc *gc = calloc(1, sizeof(kvs_schema_value_log_gc));
+  if (gc == NULL) {
+    return NULL;
+  }
+  gc->schema = schema;
+  gc->store = store;
+  gc->max_live = max_live;
+  gc->interval_ms = interval_ms;
+  pthread_mutex_init(&gc->lock, NULL);
+  pthread_cond_init(&gc->wake, NULL);
+  if (pthread_create(&gc->thread, NULL, kvs_schema_value_log_gc_run, gc) != 0) {
+    pthread_cond_destroy(&gc->wake);
+    pthread_mutex_destroy(&gc->lock);
+    free(gc);
+    return NULL;
+  }
+  return gc;
+}
+
+/* waits for a collection in progress */
+void kvs_schema_value_log_gc_stop(kvs_schema_value_log_gc *gc) {
+  if (gc == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&gc->lock);
+  gc->stopped = 1;
+  pthread_cond_signal(&gc->wake);
+  pthread_mutex_unlock(&gc->lock);
+  pthread_join(gc->thread, NULL);
+  pthread_cond_destroy(&gc->wake);
+  pthread_mutex_destroy(&gc->lock);
+  free(gc);
+}
@@ -1,43 +1,186 @@
 #ifndef __KVS_SCHEMA_H__
 #define __KVS_SCHEMA_H__
+#include <stdarg.h>
 #include "variant.h"
 #include "buffer.h"
 #include "record.h"
+#include "dictionary.h"
+#include "batch.h"
+#include "store.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+typedef enum kvs_column_flag {
+  KVS_COLUMN_FLAG_DEFAULT = 0,
+  /* store codes of a per-schema dictionary instead of bytes, only valid for non-key opaque columns */
+  KVS_COLUMN_FLAG_DICTIONARY = 1 << 0,
+  /* keep values longer than threshold in the value log of the store, only valid for non-key opaque columns without dictionary */
+  KVS_COLUMN_FLAG_SEPARATE = 1 << 1
+} kvs_column_flag;
+
 typedef struct kvs_column {
   const char *name;
   kvs_variant_type type;
   int32_t pk;
-  /* leave the next field for schema to initialize */
+  int32_t flags;
+  /* with KVS_COLUMN_FLAG_SEPARATE, 0 for KVS_VLOG_DEFAULT_THRESHOLD */
+  int32_t threshold;
+  /* leave the next fields for schema to initialize */
   size_t index;
+  kvs_dictionary *dictionary;
+  kvs_vlog_binding *vlog;
 } kvs_column;
 
+/**
+ * A schema, its projections and struct bindings are not modified by codec calls and may be
+ * shared by any number of threads, dictionaries lock to add values and decode without it.
+ * Records, flat records, buffers, cursors and transactions belong to one thread at a time.
+ * Dictionary loading, kvs_schema_set_checksum_sampling and destroy must not race with codec calls.
+ **/
 typedef struct kvs_schema kvs_schema;
 
 typedef enum kvs_schema_flag {
   KVS_SCHEMA_FLAG_DEFAULT = 0,
   KVS_SCHEMA_FLAG_INTERPRETED = 0,
   KVS_SCHEMA_FLAG_PREPARED = 1 << 0,
-  KVS_SCHEMA_FLAG_JIT = 1 << 1
+  KVS_SCHEMA_FLAG_JIT = 1 << 1,
+  /* append a CRC32C of the encoded key and value to every value and verify it on deserialize */
+  KVS_SCHEMA_FLAG_CHECKSUM = 1 << 2,
+  /* with KVS_SCHEMA_FLAG_JIT, start on the prepared codec and switch once the jit codec is compiled in background */
+  KVS_SCHEMA_FLAG_TIERED = 1 << 3,
+  /* with KVS_SCHEMA_FLAG_JIT, compile serializer and deserializer on their first use, ignored when tiered */
+  KVS_SCHEMA_FLAG_JIT_LAZY = 1 << 4,
+  /* use the codec generated ahead of time for these columns when one is linked in, other codec flags apply otherwise */
+  KVS_SCHEMA_FLAG_AOT = 1 << 5
 } kvs_schema_flag;
 
+typedef enum kvs_schema_tier {
+  KVS_SCHEMA_TIER_INTERPRETED = 0,
+  KVS_SCHEMA_TIER_PREPARED,
+  KVS_SCHEMA_TIER_JIT,
+  KVS_SCHEMA_TIER_AOT
+} kvs_schema_tier;
+
 typedef struct kvs_schema_projection kvs_schema_projection;
 
+/**
+ * Binds a column to a field of a caller defined struct. Fixed size columns live at offset
+ * as their C type (int32_t, int64_t, float, double), opaque columns as a const void * at
+ * offset with its size_t length at size_offset. Fields must be naturally aligned.
+ **/
+typedef struct kvs_schema_struct_field {
+  const char *column;
+  kvs_variant_type type;
+  size_t offset;
+  size_t size_offset;
+} kvs_schema_struct_field;
+
+typedef struct kvs_schema_struct kvs_schema_struct;
+
 kvs_record *kvs_schema_record_create(const kvs_schema *schema);
 kvs_schema *kvs_schema_create(const kvs_column *columns, size_t size, int32_t flags);
 void kvs_schema_destroy(kvs_schema *schema);
+/* key and value columns in encoding order, as passed to codecs */
+const kvs_column **kvs_schema_keys(const kvs_schema *schema, size_t *size);
+const kvs_column **kvs_schema_values(const kvs_schema *schema, size_t *size);
+kvs_schema_tier kvs_schema_codec_tier(const kvs_schema *schema);
+/* block until a tiered schema finished background compilation, must not race with destroy */
+void kvs_schema_codec_wait(kvs_schema *schema);
 
-void kvs_schema_record_serialize(const kvs_schema *schema, kvs_record *record, kvs_buffer *key, kvs_buffer *value);
-void kvs_schema_record_deserialize(const kvs_schema *schema, kvs_buffer *key, kvs_buffer *value, kvs_record *dest);
+/* fails when a dictionary value can not be encoded, key and value then hold an incomplete record */
+kvs_status kvs_schema_record_serialize(const kvs_schema *schema, kvs_record *record, kvs_buffer *key, kvs_buffer *value);
+kvs_status kvs_schema_record_serialize_batch(const kvs_schema *schema, kvs_record **records, size_t num_records, kvs_batch *batch);
+/**
+ * Put record into txn, serializing the value straight into the memory the store reserves
+ * for it instead of copying it from a buffer. The key is encoded into key and consumed.
+ * Values of separated columns are only sized once encoded, such schemas serialize into
+ * value and copy it as kvs_store_txn_put does, value is left untouched otherwise.
+ * Dictionary codes added since the last save are saved in txn along with the record.
+ **/
+kvs_status kvs_schema_record_put(const kvs_schema *schema, kvs_store_txn *txn, kvs_record *record, kvs_buffer *key, kvs_buffer *value);
+/* kvs_store_txn_put_batch of a serialized batch, saving new dictionary codes as record_put does */
+kvs_status kvs_schema_record_put_batch(const kvs_schema *schema, kvs_store_txn *txn, const kvs_batch *batch);
+/**
+ * Encode the first num_keys primary key columns in comparable form without building variants.
+ * Arguments follow the key column types: int32_t, int64_t, float and double are passed by value
+ * (float promoted to double), opaque as a (const void *, size_t) pair. On input *size is the
+ * capacity of dest, on output the encoded size, KVS_INSUFFICIENT_BUFFER reports the required size.
+ **/
+kvs_status kvs_schema_key_encode(const kvs_schema *schema, void *dest, size_t *size, size_t num_keys, ...);
+kvs_status kvs_schema_key_vencode(const kvs_schema *schema, void *dest, size_t *size, size_t num_keys, va_list args);
+kvs_status kvs_schema_record_deserialize(const kvs_schema *schema, kvs_buffer *key, kvs_buffer *value, kvs_record *dest);
+/* verify one in every interval checksums on deserialize, 0 or 1 verifies all of them */
+void kvs_schema_set_checksum_sampling(kvs_schema *schema, uint32_t interval);
 kvs_variant **kvs_schema_record_get(const kvs_schema *schema, kvs_record *record, const char *column);
 kvs_schema_projection *kvs_schema_projection_create(const kvs_schema *schema, const char **columns, size_t num_column);
 void kvs_schema_projection_destroy(kvs_schema_projection *projection);
 kvs_variant **kvs_schema_projection_record_get(const kvs_schema_projection *projection, kvs_record *record, size_t index);
 
+/**
+ * Bind a codec encoding from and decoding straight into a caller struct, every column of
+ * schema must be bound exactly once. The codec follows the schema flags, jit schemas fall
+ * back to prepared when the jit is not available. Returns NULL on a bad binding. Decoded
+ * opaque fields point into heap, or into the dictionary for dictionary columns, and stay
+ * valid until heap is skipped or destroyed.
+ **/
+kvs_schema_struct *kvs_schema_struct_create(const kvs_schema *schema, const kvs_schema_struct_field *fields, size_t num_fields);
+void kvs_schema_struct_destroy(kvs_schema_struct *binding);
+kvs_schema_tier kvs_schema_struct_tier(const kvs_schema_struct *binding);
+kvs_status kvs_schema_struct_serialize(const kvs_schema_struct *binding, const void *object, kvs_buffer *key, kvs_buffer *value);
+kvs_status kvs_schema_struct_deserialize(const kvs_schema_struct *binding, kvs_buffer *key, kvs_buffer *value, kvs_buffer *heap, void *object);
+
+/**
+ * Binding over a layout computed by the schema for flat records: opaque columns as pointer
+ * and size pairs first, then 8 and 4 byte columns. Decoding a flat record releases its
+ * arena and refills it, opaque data read before stays valid only until the next decode.
+ * Columns are addressed by the index kvs_schema_flat_column returns.
+ **/
+kvs_schema_struct *kvs_schema_flat_create(const kvs_schema *schema);
+kvs_flat_record *kvs_schema_flat_record_create(const kvs_schema_struct *flat);
+kvs_status kvs_schema_flat_record_serialize(const kvs_schema_struct *flat, kvs_flat_record *record, kvs_buffer *key, kvs_buffer *value);
+kvs_status kvs_schema_flat_record_deserialize(const kvs_schema_struct *flat, kvs_buffer *key, kvs_buffer *value, kvs_flat_record *dest);
+kvs_status kvs_schema_flat_column(const kvs_schema_struct *flat, const char *column, size_t *index);
+kvs_status kvs_schema_flat_record_get_int32(const kvs_schema_struct *flat, kvs_flat_record *record, size_t index, int32_t *dest);
+kvs_status kvs_schema_flat_record_get_int64(const kvs_schema_struct *flat, kvs_flat_record *record, size_t index, int64_t *dest);
+kvs_status kvs_schema_flat_record_get_float(const kvs_schema_struct *flat, kvs_flat_record *record, size_t index, float *dest);
+kvs_status kvs_schema_flat_record_get_double(const kvs_schema_struct *flat, kvs_flat_record *record, size_t index, double *dest);
+kvs_status kvs_schema_flat_record_get_opaque(const kvs_schema_struct *flat, kvs_flat_record *record, size_t index, const void **data, size_t *size);
+kvs_status kvs_schema_flat_record_set_int32(const kvs_schema_struct *flat, kvs_flat_record *record, size_t index, int32_t to);
+kvs_status kvs_schema_flat_record_set_int64(const kvs_schema_struct *flat, kvs_flat_record *record, size_t index, int64_t to);
+kvs_status kvs_schema_flat_record_set_float(const kvs_schema_struct *flat, kvs_flat_record *record, size_t index, float to);
+kvs_status kvs_schema_flat_record_set_double(const kvs_schema_struct *flat, kvs_flat_record *record, size_t index, double to);
+/* copies the bytes into the record arena */
+kvs_status kvs_schema_flat_record_set_opaque(const kvs_schema_struct *flat, kvs_flat_record *record, size_t index, const void *to, size_t size);
+
+kvs_status kvs_schema_dictionary_load(const kvs_schema *schema, kvs_store *store);
+kvs_status kvs_schema_dictionary_save(const kvs_schema *schema, kvs_store_txn *txn);
+kvs_status kvs_schema_dictionary_lookup(const kvs_schema *schema, const char *column, const void *data, size_t size, uint32_t *code);
+
+/**
+ * Separated columns write to the value log of store once attached, values written before
+ * stay inline. Schemas with separated columns use the prepared codec where jit or aot
+ * codecs are requested.
+ **/
+kvs_status kvs_schema_value_log_attach(const kvs_schema *schema, kvs_store *store);
+/**
+ * Copy the live values of sealed segments with at most max_live of their bytes referenced
+ * to the active segment, rewriting the rows in transactions of a bounded number of rows,
+ * then delete those segments. They stay mapped until every read transaction and cursor
+ * begun before the collection has ended, later collections do nothing until then. Rows
+ * serialized before a collection starts must be put before it ends, rows read must be
+ * deserialized before their transaction or cursor ends, else a moved value fails with
+ * KVS_STORE_CORRUPTED. Segments sealed since the last write commit are left to a later
+ * collection, as an open write txn may hold pointers into them. Collections of one store
+ * must not run concurrently.
+ **/
+kvs_status kvs_schema_value_log_collect(const kvs_schema *schema, kvs_store *store, double max_live);
+typedef struct kvs_schema_value_log_gc kvs_schema_value_log_gc;
+/* collect every interval_ms on a background thread until stopped */
+kvs_schema_value_log_gc *kvs_schema_value_log_gc_start(const kvs_schema *schema, kvs_store *store, double max_live, uint32_t interval_ms);
+void kvs_schema_value_log_gc_stop(kvs_schema_value_log_gc *gc);
+
 #ifdef __cplusplus
 }
 #endif
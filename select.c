@@ -58,18 +58,6 @@ static void display_opaque(kvs_variant *variant) {
   }
 }
 
-static void display_checksum(kvs_variant *variant) {
-  const void *data;
-  const uint8_t *cdata;
-  size_t size, idx;
-  kvs_variant_get_opaque(variant, &data, &size);
-  cdata = data;
-  printf(" ");
-  for (idx = 0; idx < size; ++idx) {
-    printf("%02x", cdata[idx]);
-  }
-}
-
 static void display_variant(kvs_variant *variant) {
   switch (kvs_variant_get_type(variant)) {
     case KVS_VARIANT_TYPE_INT32:
@@ -94,7 +82,7 @@ static void display_variant(kvs_variant *variant) {
 
 static void display_record(kvs_schema_projection *projection, kvs_record *record) {
   size_t idx;
-  for (idx = 0; idx < columns_num - 1; ++idx) {
+  for (idx = 0; idx < columns_num; ++idx) {
     if (idx == 0) {
       printf("|");
     }
@@ -102,8 +90,7 @@ static void display_record(kvs_schema_projection *projection, kvs_record *record
     display_variant(*kvs_schema_projection_record_get(projection, record, idx));
     printf("' |");
   }
-  display_checksum(*kvs_schema_projection_record_get(projection, record, idx));
-  printf(" |\n");
+  printf("\n");
 }
 
 static void kvs_select(kvs_store *store, const char *prefix, int32_t limit) {
@@ -111,30 +98,37 @@ static void kvs_select(kvs_store *store, const char *prefix, int32_t limit) {
   size_t url_token_size;
   size_t prefix_len = strlen(prefix);
   kvs_store_cursor *cursor;
-  kvs_buffer *key, *value, *seek;
+  kvs_buffer *key, *value;
+  uint8_t stack_seek[256];
+  void *seek = stack_seek;
+  size_t seek_size = sizeof(stack_seek);
   kvs_schema *schema;
   kvs_record *record;
   kvs_schema_projection *projection;
   cursor = kvs_store_cursor_open(store);
-  schema = kvs_schema_create(columns_meta, columns_num, KVS_SCHEMA_FLAG_JIT);
+  schema = kvs_schema_create(columns_meta, columns_num, columns_flags | KVS_SCHEMA_FLAG_AOT | KVS_SCHEMA_FLAG_JIT);
+  if (KVS_FAILED(kvs_schema_dictionary_load(schema, store))) {
+    kvs_cmdline_fatal("Could not load schema dictionaries");
+  }
   projection = kvs_schema_projection_create(schema, columns_name, columns_num);
   record = kvs_schema_record_create(schema);
   key = kvs_buffer_create(4096);
   value = kvs_buffer_create(4096);
-  seek = kvs_buffer_create(128);
-  kvs_variant *prefix_variant = kvs_variant_create_from_opaque_no_copy(prefix, strlen(prefix));
-  kvs_variant_serialize_comparable_opaque(prefix_variant, seek);
-  kvs_variant_destroy(prefix_variant);
+  if (kvs_schema_key_encode(schema, seek, &seek_size, 1, prefix, prefix_len) == KVS_INSUFFICIENT_BUFFER) {
+    if ((seek = malloc(seek_size)) == NULL) {
+      kvs_cmdline_fatal("Could not allocate seek key");
+    }
+    kvs_schema_key_encode(schema, seek, &seek_size, 1, prefix, prefix_len);
+  }
   display_title();
-  if (!KVS_FAILED(kvs_store_cursor_seek(cursor, seek))) {
+  if (!KVS_FAILED(kvs_store_cursor_seek_no_copy(cursor, seek, seek_size))) {
     while (!KVS_FAILED(kvs_store_cursor_next(cursor, key, value)) && limit-- > 0) {
-      kvs_schema_record_deserialize(schema, key, value, record);
-      kvs_variant_get_opaque(*kvs_schema_projection_record_get(projection, record, 0), &url_token_data, &url_token_size);
-      if (url_token_size < prefix_len || memcmp(url_token_data, prefix, prefix_len) != 0) {
+      if (KVS_FAILED(kvs_schema_record_deserialize(schema, key, value, record))) {
+        printf("Corrupted record: invalid record checksum\n");
         break;
       }
-      if (!kvs_record_verify_checksum(projection, record, 18)) {
-        printf("Corrupted record: invalid record checksum\n");
+      kvs_variant_get_opaque(*kvs_schema_projection_record_get(projection, record, 0), &url_token_data, &url_token_size);
+      if (url_token_size < prefix_len || memcmp(url_token_data, prefix, prefix_len) != 0) {
         break;
       }
       display_record(projection, record);
@@ -142,7 +136,9 @@ static void kvs_select(kvs_store *store, const char *prefix, int32_t limit) {
   }
   kvs_buffer_destroy(key);
   kvs_buffer_destroy(value);
-  kvs_buffer_destroy(seek);
+  if (seek != stack_seek) {
+    free(seek);
+  }
   kvs_record_destroy(record);
   kvs_schema_destroy(schema);
   kvs_store_cursor_close(cursor);
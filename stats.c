@@ -0,0 +1,144 @@
+#include "stats.h"
+#include <time.h>
+#include <string.h>
+
+#define KVS_STATS_CACHE_LINE (64)
+
+struct kvs_stats {
+  size_t num_histograms;
+  size_t num_counters;
+  /* bytes per slot, a multiple of the cache line */
+  size_t slot_size;
+  void *slots;
+};
+
+/* slot of the calling thread plus one, handed out round robin on first use */
+static __thread uint32_t stats_thread_slot;
+static uint32_t stats_next_slot;
+
+static inline size_t kvs_stats_bucket(uint64_t ns) {
+  int32_t exponent;
+  if (ns < (1 << KVS_STATS_SUB_BUCKET_BITS)) {
+    return (size_t) ns;
+  }
+  exponent = 63 - __builtin_clzll(ns);
+  if (exponent > KVS_STATS_MAX_EXPONENT) {
+    return KVS_STATS_BUCKETS - 1;
+  }
+  return ((size_t) (exponent - KVS_STATS_SUB_BUCKET_BITS + 1) << KVS_STATS_SUB_BUCKET_BITS) +
+    ((ns >> (exponent - KVS_STATS_SUB_BUCKET_BITS)) & ((1 << KVS_STATS_SUB_BUCKET_BITS) - 1));
+}
+
+static inline uint64_t kvs_stats_bucket_limit(size_t bucket) {
+  int32_t exponent;
+  if (bucket < (1 << KVS_STATS_SUB_BUCKET_BITS)) {
+    return bucket;
+  }
+  exponent = (int32_t) (bucket >> KVS_STATS_SUB_BUCKET_BITS) + KVS_STATS_SUB_BUCKET_BITS - 1;
+  return ((((uint64_t) 1 << KVS_STATS_SUB_BUCKET_BITS) + (bucket & ((1 << KVS_STATS_SUB_BUCKET_BITS) - 1)) + 1)
+      << (exponent - KVS_STATS_SUB_BUCKET_BITS)) - 1;
+}
+
+uint64_t kvs_stats_histogram_percentile(const kvs_stats_histogram *histogram, double percentile) {
+  size_t bucket;
+  uint64_t seen = 0, rank;
+  if (histogram->count == 0) {
+    return 0;
+  }
+  rank = (uint64_t) (percentile / 100.0 * histogram->count + 0.5);
+  rank = rank < 1 ? 1 : rank > histogram->count ? histogram->count : rank;
+  for (bucket = 0; bucket < KVS_STATS_BUCKETS; ++bucket) {
+    if ((seen += histogram->buckets[bucket]) >= rank) {
+      /* the largest value seen is tighter than the bucket it falls into */
+      return kvs_stats_bucket_limit(bucket) < histogram->max_ns ? kvs_stats_bucket_limit(bucket) : histogram->max_ns;
+    }
+  }
+  return histogram->max_ns;
+}
+
+kvs_stats *kvs_stats_create(size_t num_histograms, size_t num_counters) {
+  kvs_stats *stats = malloc(sizeof(kvs_stats));
+  size_t slot_size = num_histograms * sizeof(kvs_stats_histogram) + num_counters * sizeof(uint64_t);
+  if (stats == NULL) {
+    return NULL;
+  }
+  stats->num_histograms = num_histograms;
+  stats->num_counters = num_counters;
+  stats->slot_size = (slot_size + KVS_STATS_CACHE_LINE - 1) / KVS_STATS_CACHE_LINE * KVS_STATS_CACHE_LINE;
+  if (posix_memalign(&stats->slots, KVS_STATS_CACHE_LINE, stats->slot_size * KVS_STATS_SLOTS) != 0) {
+    free(stats);
+    return NULL;
+  }
+  memset(stats->slots, 0, stats->slot_size * KVS_STATS_SLOTS);
+  return stats;
+}
+
+void kvs_stats_destroy(kvs_stats *stats) {
+  if (stats != NULL) {
+    free(stats->slots);
+    free(stats);
+  }
+}
+
+uint64_t kvs_stats_now(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static inline char *kvs_stats_slot(const kvs_stats *stats) {
+  if (stats_thread_slot == 0) {
+    stats_thread_slot = __atomic_fetch_add(&stats_next_slot, 1, __ATOMIC_RELAXED) % KVS_STATS_SLOTS + 1;
+  }
+  return (char *) stats->slots + (stats_thread_slot - 1) * stats->slot_size;
+}
+
+void kvs_stats_record(kvs_stats *stats, size_t histogram, uint64_t start) {
+  uint64_t now = kvs_stats_now(), ns = now > start ? now - start : 0, max;
+  kvs_stats_histogram *dest = (kvs_stats_histogram *) kvs_stats_slot(stats) + histogram;
+  __atomic_fetch_add(&dest->count, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&dest->sum_ns, ns, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&dest->buckets[kvs_stats_bucket(ns)], 1, __ATOMIC_RELAXED);
+  max = __atomic_load_n(&dest->max_ns, __ATOMIC_RELAXED);
+  while (ns > max && !__atomic_compare_exchange_n(&dest->max_ns, &max, ns, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+  }
+}
+
+void kvs_stats_add(kvs_stats *stats, size_t counter, uint64_t value) {
+  uint64_t *counters = (uint64_t *) ((kvs_stats_histogram *) kvs_stats_slot(stats) + stats->num_histograms);
+  __atomic_fetch_add(&counters[counter], value, __ATOMIC_RELAXED);
+}
+
+void kvs_stats_read(const kvs_stats *stats, kvs_stats_histogram *histograms, uint64_t *counters) {
+  size_t slot, idx, bucket;
+  uint64_t max;
+  kvs_stats_histogram *src;
+  uint64_t *src_counters;
+  memset(histograms, 0, stats->num_histograms * sizeof(kvs_stats_histogram));
+  memset(counters, 0, stats->num_counters * sizeof(uint64_t));
+  for (slot = 0; slot < KVS_STATS_SLOTS; ++slot) {
+    src = (kvs_stats_histogram *) ((char *) stats->slots + slot * stats->slot_size);
+    for (idx = 0; idx < stats->num_histograms; ++idx) {
+      histograms[idx].count += __atomic_load_n(&src[idx].count, __ATOMIC_RELAXED);
+      histograms[idx].sum_ns += __atomic_load_n(&src[idx].sum_ns, __ATOMIC_RELAXED);
+      max = __atomic_load_n(&src[idx].max_ns, __ATOMIC_RELAXED);
+      histograms[idx].max_ns = max > histograms[idx].max_ns ? max : histograms[idx].max_ns;
+      for (bucket = 0; bucket < KVS_STATS_BUCKETS; ++bucket) {
+        histograms[idx].buckets[bucket] += __atomic_load_n(&src[idx].buckets[bucket], __ATOMIC_RELAXED);
+      }
+    }
+    src_counters = (uint64_t *) (src + stats->num_histograms);
+    for (idx = 0; idx < stats->num_counters; ++idx) {
+      counters[idx] += __atomic_load_n(&src_counters[idx], __ATOMIC_RELAXED);
+    }
+  }
+}
+
+/* racing updates may survive a reset in part */
+void kvs_stats_reset(kvs_stats *stats) {
+  size_t idx, size = stats->slot_size * KVS_STATS_SLOTS / sizeof(uint64_t);
+  uint64_t *words = stats->slots;
+  for (idx = 0; idx < size; ++idx) {
+    __atomic_store_n(&words[idx], 0, __ATOMIC_RELAXED);
+  }
+}
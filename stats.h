@@ -0,0 +1,56 @@
+#ifndef __KVS_STATS_H__
+#define __KVS_STATS_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Latency histogram in ns with 4 buckets per power of two, so a percentile reads at most
+ * 25% high. Values from 2^40 ns, about 18 minutes, fall into the last bucket.
+ **/
+#define KVS_STATS_SUB_BUCKET_BITS (2)
+#define KVS_STATS_MAX_EXPONENT (39)
+#define KVS_STATS_BUCKETS ((KVS_STATS_MAX_EXPONENT - KVS_STATS_SUB_BUCKET_BITS + 2) << KVS_STATS_SUB_BUCKET_BITS)
+
+typedef struct kvs_stats_histogram {
+  uint64_t count;
+  uint64_t sum_ns;
+  uint64_t max_ns;
+  uint64_t buckets[KVS_STATS_BUCKETS];
+} kvs_stats_histogram;
+
+/* upper bound of the bucket holding the given percentile in [0, 100], 0 when empty */
+uint64_t kvs_stats_histogram_percentile(const kvs_stats_histogram *histogram, double percentile);
+
+/**
+ * Histograms and counters spread over cache line aligned slots. A thread always updates
+ * the slot it was handed first, so threads only share lines once there are more of them
+ * than KVS_STATS_SLOTS. Updates are relaxed atomics, a read sums all slots and may see
+ * another thread's update half applied. Thread safe.
+ **/
+typedef struct kvs_stats kvs_stats;
+
+#ifndef KVS_STATS_SLOTS
+#define KVS_STATS_SLOTS (16)
+#endif
+
+kvs_stats *kvs_stats_create(size_t num_histograms, size_t num_counters);
+void kvs_stats_destroy(kvs_stats *stats);
+/* monotonic clock in ns */
+uint64_t kvs_stats_now(void);
+/* add the time since start, taken from kvs_stats_now, to a histogram */
+void kvs_stats_record(kvs_stats *stats, size_t histogram, uint64_t start);
+void kvs_stats_add(kvs_stats *stats, size_t counter, uint64_t value);
+/* sum of all slots into num_histograms histograms and num_counters counters */
+void kvs_stats_read(const kvs_stats *stats, kvs_stats_histogram *histograms, uint64_t *counters);
+void kvs_stats_reset(kvs_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __KVS_STATS_H__ */
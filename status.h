@@ -15,6 +15,12 @@ typedef int32_t kvs_status;
 #define KVS_SCHEMA_JIT_NOT_SUPPORTED (-201)
 #define KVS_SCHEMA_JIT_INVALID_RUNTIME (-202)
 #define KVS_SCHEMA_JIT_INTERNAL_ERROR (-203)
+#define KVS_SCHEMA_INVALID_DICTIONARY (-204)
+#define KVS_SCHEMA_CHECKSUM_MISMATCH (-205)
+#define KVS_SCHEMA_JIT_CACHE_MISS (-206)
+#define KVS_SCHEMA_AOT_NOT_FOUND (-207)
+#define KVS_DICTIONARY_NOT_FOUND (-300)
+#define KVS_DICTIONARY_CONFLICT (-301)
 
 #define KVS_FAILED(st) ((st) != KVS_OK)
 
@@ -6,21 +6,63 @@
 #include <lmdb.h>
 #include <string.h>
 
+#define KVS_STORE_RECORDS_DBI "records"
+#define KVS_STORE_DICTIONARIES_DBI "dictionaries"
+#define KVS_STORE_READER_SLOTS (16)
+/* words between reader counters, so threads in different slots do not share a cache line */
+#define KVS_STORE_READER_STRIDE (8)
+
 struct kvs_store {
   MDB_env *env;
   MDB_dbi dbi;
+  MDB_dbi dictionary_dbi;
+  kvs_vlog *vlog;
+  /* NULL unless opened with KVS_STORE_FLAG_STATS */
+  kvs_stats *stats;
+  int32_t flags;
+  /* read transactions and cursors by parity of the reader epoch they began in, striped by thread */
+  uint64_t reader_epoch;
+  int64_t readers[2][KVS_STORE_READER_SLOTS * KVS_STORE_READER_STRIDE];
 };
 
+/* dictionary codes written by a transaction, marked persisted once it commits */
+typedef struct kvs_store_dictionary_mark {
+  kvs_dictionary *dictionary;
+  size_t persisted;
+} kvs_store_dictionary_mark;
+
 struct kvs_store_txn {
   MDB_dbi dbi;
+  MDB_dbi dictionary_dbi;
   MDB_txn *txn;
+  kvs_arena *arena;
+  /* synced before commit and its watermark advanced after, NULL for read only transactions */
+  kvs_vlog *vlog;
+  kvs_stats *stats;
+  uint64_t started;
+  kvs_store_op lifetime;
+  kvs_store_dictionary_mark *marks;
+  size_t num_marks;
+  /* reader counter of read only transactions, NULL for write transactions */
+  int64_t *reader;
 };
 
 struct kvs_store_cursor {
+  MDB_dbi dbi;
   MDB_txn *txn;
   MDB_cursor *cursor;
+  kvs_arena *arena;
+  kvs_stats *stats;
+  uint64_t started;
+  int64_t *reader;
 };
 
+typedef enum kvs_store_counter {
+  KVS_STORE_COUNTER_BYTES_READ = 0,
+  KVS_STORE_COUNTER_BYTES_WRITTEN,
+  KVS_STORE_COUNTER_NUM
+} kvs_store_counter;
+
 static inline int32_t kvs_store_convert_lmdb_status(int st) {
   switch (st) {
     case MDB_SUCCESS:
@@ -36,6 +78,60 @@ static inline int32_t kvs_store_convert_lmdb_status(int st) {
   }
 }
 
+/* copies of keys and values spanning buffer blocks, from the attached arena when there is one */
+static void *kvs_store_scratch_allocate(kvs_arena *arena, size_t size) {
+  return arena != NULL ? kvs_arena_allocate(arena, size) : malloc(size);
+}
+
+static void kvs_store_scratch_free(kvs_arena *arena, void *scratch) {
+  if (arena == NULL) {
+    free(scratch);
+  }
+}
+
+/* 0 without stats, so stores that do not collect them never read the clock */
+static inline uint64_t kvs_store_stats_start(kvs_stats *stats) {
+  return stats != NULL ? kvs_stats_now() : 0;
+}
+
+static inline void kvs_store_stats_end(kvs_stats *stats, kvs_store_op op, uint64_t start, kvs_store_counter counter, uint64_t bytes) {
+  if (stats != NULL) {
+    kvs_stats_record(stats, op, start);
+    if (bytes > 0) {
+      kvs_stats_add(stats, counter, bytes);
+    }
+  }
+}
+
+/* slot of the calling thread plus one, handed out round robin on first use */
+static __thread uint32_t store_reader_slot;
+static uint32_t store_next_reader_slot;
+
+/* count a reader in the current epoch, before it takes its snapshot */
+static int64_t *kvs_store_reader_enter(kvs_store *store) {
+  uint64_t epoch;
+  int64_t *counter;
+  if (store_reader_slot == 0) {
+    store_reader_slot = __atomic_fetch_add(&store_next_reader_slot, 1, __ATOMIC_RELAXED) % KVS_STORE_READER_SLOTS + 1;
+  }
+  for (;;) {
+    epoch = __atomic_load_n(&store->reader_epoch, __ATOMIC_SEQ_CST);
+    counter = &store->readers[epoch & 1][(store_reader_slot - 1) * KVS_STORE_READER_STRIDE];
+    __atomic_fetch_add(counter, 1, __ATOMIC_SEQ_CST);
+    /* a fence in between may have found the old epoch drained already */
+    if (__atomic_load_n(&store->reader_epoch, __ATOMIC_SEQ_CST) == epoch) {
+      return counter;
+    }
+    __atomic_fetch_sub(counter, 1, __ATOMIC_SEQ_CST);
+  }
+}
+
+static void kvs_store_reader_leave(int64_t *counter) {
+  if (counter != NULL) {
+    __atomic_fetch_sub(counter, 1, __ATOMIC_RELEASE);
+  }
+}
+
 static uint32_t kvs_store_flags_to_mdb_env_flags(int32_t flags) {
   if ((flags & KVS_STORE_FLAG_VOLATILE) == KVS_STORE_FLAG_VOLATILE) {
     return MDB_NOMETASYNC | MDB_NOSYNC;
@@ -56,6 +152,10 @@ kvs_store *kvs_store_open(const char *path, int32_t flags) {
     goto error;
   }
 
+  if (mdb_env_set_maxdbs(store->env, 2) != 0) {
+    goto error;
+  }
+
   if (mdb_env_open(store->env, path, kvs_store_flags_to_mdb_env_flags(flags), S_IRWXU | S_IRGRP) != 0) {
     goto error;
   }
@@ -64,10 +164,25 @@ kvs_store *kvs_store_open(const char *path, int32_t flags) {
     goto error;
   }
 
-  if (mdb_dbi_open(txn, NULL, MDB_CREATE, &store->dbi) != 0) {
+  if (mdb_dbi_open(txn, KVS_STORE_RECORDS_DBI, MDB_CREATE, &store->dbi) != 0) {
     goto error;
   }
 
+  if (mdb_dbi_open(txn, KVS_STORE_DICTIONARIES_DBI, MDB_CREATE, &store->dictionary_dbi) != 0) {
+    goto error;
+  }
+
+  /* no segment is created until a value is appended */
+  if ((store->vlog = kvs_vlog_open(path, (flags & KVS_STORE_FLAG_VOLATILE) == KVS_STORE_FLAG_VOLATILE ? KVS_VLOG_FLAG_VOLATILE : 0)) == NULL) {
+    goto error;
+  }
+
+  if ((flags & KVS_STORE_FLAG_STATS) == KVS_STORE_FLAG_STATS &&
+      (store->stats = kvs_stats_create(KVS_STORE_OP_NUM, KVS_STORE_COUNTER_NUM)) == NULL) {
+    goto error;
+  }
+
+  store->flags = flags;
   mdb_txn_commit(txn);
   return store;
 
@@ -85,11 +200,18 @@ void kvs_store_destroy(kvs_store *store) {
   }
   if (store->env != NULL) {
     mdb_dbi_close(store->env, store->dbi);
+    mdb_dbi_close(store->env, store->dictionary_dbi);
     mdb_env_close(store->env);
   }
+  kvs_vlog_close(store->vlog);
+  kvs_stats_destroy(store->stats);
   free(store);
 }
 
+kvs_vlog *kvs_store_value_log(kvs_store *store) {
+  return store->vlog;
+}
+
 kvs_status kvs_store_put(kvs_store *store, kvs_buffer *key, kvs_buffer *value) {
   kvs_status st;
   kvs_store_txn *txn = kvs_store_txn_begin(store, 0);
@@ -110,88 +232,350 @@ static uint32_t kvs_store_txn_flags_to_mdb_txn_flags(int32_t flags) {
 }
 
 kvs_store_txn *kvs_store_txn_begin(kvs_store *store, int32_t flags) {
+  uint64_t start = kvs_store_stats_start(store->stats);
   kvs_store_txn *txn = malloc(sizeof(kvs_store_txn));
+  int64_t *reader = (flags & KVS_STORE_TXN_FLAG_READONLY) == KVS_STORE_TXN_FLAG_READONLY ? kvs_store_reader_enter(store) : NULL;
   if (mdb_txn_begin(store->env, NULL, kvs_store_txn_flags_to_mdb_txn_flags(flags), &txn->txn) != 0) {
+    kvs_store_reader_leave(reader);
     free(txn);
     txn = NULL;
   } else {
+    txn->reader = reader;
     txn->dbi = store->dbi;
+    txn->dictionary_dbi = store->dictionary_dbi;
+    txn->arena = NULL;
+    txn->marks = NULL;
+    txn->num_marks = 0;
+    txn->vlog = (flags & KVS_STORE_TXN_FLAG_READONLY) == KVS_STORE_TXN_FLAG_READONLY ? NULL : store->vlog;
+    txn->stats = store->stats;
+    txn->started = start;
+    txn->lifetime = (flags & KVS_STORE_TXN_FLAG_READONLY) == KVS_STORE_TXN_FLAG_READONLY ? KVS_STORE_OP_READ_TXN : KVS_STORE_OP_WRITE_TXN;
   }
   return txn;
 }
 
+void kvs_store_txn_set_arena(kvs_store_txn *txn, kvs_arena *arena) {
+  txn->arena = arena;
+}
+
 kvs_status kvs_store_txn_commit(kvs_store_txn *txn) {
-  int32_t rc = mdb_txn_commit(txn->txn);
+  size_t idx;
+  int32_t rc;
+  kvs_status st;
+  uint32_t watermark = 0;
+  uint64_t start = kvs_store_stats_start(txn->stats);
+  /* rows must never point to values that could be lost */
+  if (txn->vlog != NULL) {
+    watermark = kvs_vlog_active_segment(txn->vlog);
+    if (KVS_FAILED(st = kvs_vlog_sync(txn->vlog))) {
+      kvs_store_txn_abort(txn);
+      return st;
+    }
+  }
+  rc = mdb_txn_commit(txn->txn);
+  /* the rows of txn point no further than the segment active before it committed */
+  if (rc == MDB_SUCCESS && txn->vlog != NULL) {
+    kvs_vlog_commit(txn->vlog, watermark);
+  }
+  for (idx = 0; rc == MDB_SUCCESS && idx < txn->num_marks; ++idx) {
+    kvs_dictionary_mark_persisted(txn->marks[idx].dictionary, txn->marks[idx].persisted);
+  }
+  free(txn->marks);
+  kvs_store_reader_leave(txn->reader);
+  kvs_store_stats_end(txn->stats, KVS_STORE_OP_COMMIT, start, KVS_STORE_COUNTER_BYTES_WRITTEN, 0);
+  kvs_store_stats_end(txn->stats, txn->lifetime, txn->started, KVS_STORE_COUNTER_BYTES_WRITTEN, 0);
   free(txn);
   return kvs_store_convert_lmdb_status(rc);
 }
 
 void kvs_store_txn_abort(kvs_store_txn *txn) {
   mdb_txn_abort(txn->txn);
+  kvs_store_reader_leave(txn->reader);
+  kvs_store_stats_end(txn->stats, txn->lifetime, txn->started, KVS_STORE_COUNTER_BYTES_WRITTEN, 0);
+  free(txn->marks);
   free(txn);
 }
 
 kvs_status kvs_store_txn_put(kvs_store_txn *txn, kvs_buffer *key, kvs_buffer *value) {
   MDB_val mkey, mval;
   int32_t rc;
+  kvs_arena_mark mark;
   void *free_key, *free_value;
+  uint64_t start = kvs_store_stats_start(txn->stats);
+  if (txn->arena != NULL) {
+    kvs_arena_save(txn->arena, &mark);
+  }
   mkey.mv_size = kvs_buffer_size(key);
   mval.mv_size = kvs_buffer_size(value);
   if ((mkey.mv_data = (void *) kvs_buffer_peek(key, mkey.mv_size)) == NULL) {
     /* slow path */
-    kvs_buffer_read(key, free_key = mkey.mv_data = malloc(mkey.mv_size), mkey.mv_size);
+    kvs_buffer_read(key, free_key = mkey.mv_data = kvs_store_scratch_allocate(txn->arena, mkey.mv_size), mkey.mv_size);
   } else {
     free_key = NULL;
   }
   if ((mval.mv_data = (void *) kvs_buffer_peek(value, mval.mv_size)) == NULL) {
     /* slow path */
-    kvs_buffer_read(value, free_value = mval.mv_data = malloc(mval.mv_size), mval.mv_size);
+    kvs_buffer_read(value, free_value = mval.mv_data = kvs_store_scratch_allocate(txn->arena, mval.mv_size), mval.mv_size);
   } else {
     free_value = NULL;
   }
   rc = mdb_put(txn->txn, txn->dbi, &mkey, &mval, 0);
   if (free_key != NULL) {
-    free(free_key);
+    kvs_store_scratch_free(txn->arena, free_key);
   } else {
     kvs_buffer_skip(key, mkey.mv_size);
   }
   if (free_value != NULL) {
-    free(free_value);
+    kvs_store_scratch_free(txn->arena, free_value);
   } else {
     kvs_buffer_skip(value, mval.mv_size);
   }
+  if (txn->arena != NULL) {
+    kvs_arena_restore(txn->arena, &mark);
+  }
+  kvs_store_stats_end(txn->stats, KVS_STORE_OP_PUT, start, KVS_STORE_COUNTER_BYTES_WRITTEN, mkey.mv_size + mval.mv_size);
+  return kvs_store_convert_lmdb_status(rc);
+}
+
+kvs_status kvs_store_txn_put_reserve(kvs_store_txn *txn, kvs_buffer *key, size_t value_size, void **data) {
+  MDB_val mkey, mval;
+  int32_t rc;
+  kvs_arena_mark mark;
+  void *free_key;
+  uint64_t start = kvs_store_stats_start(txn->stats);
+  if (txn->arena != NULL) {
+    kvs_arena_save(txn->arena, &mark);
+  }
+  mkey.mv_size = kvs_buffer_size(key);
+  if ((mkey.mv_data = (void *) kvs_buffer_peek(key, mkey.mv_size)) == NULL) {
+    /* slow path */
+    kvs_buffer_copy(key, 0, free_key = mkey.mv_data = kvs_store_scratch_allocate(txn->arena, mkey.mv_size), mkey.mv_size);
+  } else {
+    free_key = NULL;
+  }
+  mval.mv_size = value_size;
+  mval.mv_data = NULL;
+  rc = mdb_put(txn->txn, txn->dbi, &mkey, &mval, MDB_RESERVE);
+  *data = mval.mv_data;
+  if (free_key != NULL) {
+    kvs_store_scratch_free(txn->arena, free_key);
+  }
+  if (txn->arena != NULL) {
+    kvs_arena_restore(txn->arena, &mark);
+  }
+  kvs_store_stats_end(txn->stats, KVS_STORE_OP_PUT, start, KVS_STORE_COUNTER_BYTES_WRITTEN, mkey.mv_size + value_size);
+  return kvs_store_convert_lmdb_status(rc);
+}
+
+kvs_status kvs_store_txn_del(kvs_store_txn *txn, kvs_buffer *key) {
+  MDB_val mkey;
+  int32_t rc;
+  kvs_arena_mark mark;
+  void *free_key;
+  if (txn->arena != NULL) {
+    kvs_arena_save(txn->arena, &mark);
+  }
+  mkey.mv_size = kvs_buffer_size(key);
+  if ((mkey.mv_data = (void *) kvs_buffer_peek(key, mkey.mv_size)) == NULL) {
+    /* slow path */
+    kvs_buffer_read(key, free_key = mkey.mv_data = kvs_store_scratch_allocate(txn->arena, mkey.mv_size), mkey.mv_size);
+  } else {
+    free_key = NULL;
+  }
+  rc = mdb_del(txn->txn, txn->dbi, &mkey, NULL);
+  if (free_key != NULL) {
+    kvs_store_scratch_free(txn->arena, free_key);
+  } else {
+    kvs_buffer_skip(key, mkey.mv_size);
+  }
+  if (txn->arena != NULL) {
+    kvs_arena_restore(txn->arena, &mark);
+  }
   return kvs_store_convert_lmdb_status(rc);
 }
 
+kvs_status kvs_store_txn_put_batch(kvs_store_txn *txn, const kvs_batch *batch) {
+  MDB_val mkey, mval;
+  size_t idx, size = kvs_batch_size(batch), bytes = 0;
+  int32_t rc = MDB_SUCCESS;
+  uint64_t start = kvs_store_stats_start(txn->stats);
+  for (idx = 0; idx < size && rc == MDB_SUCCESS; ++idx) {
+    mkey.mv_data = (void *) kvs_batch_key(batch, idx, &mkey.mv_size);
+    mval.mv_data = (void *) kvs_batch_value(batch, idx, &mval.mv_size);
+    rc = mdb_put(txn->txn, txn->dbi, &mkey, &mval, 0);
+    bytes += mkey.mv_size + mval.mv_size;
+  }
+  kvs_store_stats_end(txn->stats, KVS_STORE_OP_PUT_BATCH, start, KVS_STORE_COUNTER_BYTES_WRITTEN, bytes);
+  return kvs_store_convert_lmdb_status(rc);
+}
+
+kvs_status kvs_store_rewrite(kvs_store *store, kvs_store_rewriter rewriter, void *arg, size_t rows_per_txn) {
+  MDB_val mkey, mval;
+  MDB_cursor *cursor;
+  kvs_store_txn *txn;
+  kvs_status st = KVS_OK;
+  size_t rows, resume_size = 0, resume_capacity = 0;
+  int32_t rc = MDB_SUCCESS;
+  uint8_t *resume = NULL, *grown;
+  kvs_buffer *dest = kvs_buffer_create_contiguous(4096);
+  if (dest == NULL) {
+    return KVS_OUT_OF_MEMORY;
+  }
+  do {
+    if ((txn = kvs_store_txn_begin(store, 0)) == NULL) {
+      st = KVS_STORE_INTERNAL_ERROR;
+      break;
+    }
+    if ((rc = mdb_cursor_open(txn->txn, txn->dbi, &cursor)) != MDB_SUCCESS) {
+      kvs_store_txn_abort(txn);
+      break;
+    }
+    if (resume == NULL) {
+      rc = mdb_cursor_get(cursor, &mkey, &mval, MDB_FIRST);
+    } else {
+      /* continue after the last row of the previous transaction */
+      mkey.mv_data = resume;
+      mkey.mv_size = resume_size;
+      if ((rc = mdb_cursor_get(cursor, &mkey, &mval, MDB_SET_RANGE)) == MDB_SUCCESS &&
+          mkey.mv_size == resume_size && memcmp(mkey.mv_data, resume, resume_size) == 0) {
+        rc = mdb_cursor_get(cursor, &mkey, &mval, MDB_NEXT);
+      }
+    }
+    for (rows = 0; rc == MDB_SUCCESS && rows < rows_per_txn; ++rows) {
+      if (mkey.mv_size > resume_capacity) {
+        if ((grown = realloc(resume, mkey.mv_size)) == NULL) {
+          st = KVS_OUT_OF_MEMORY;
+          break;
+        }
+        resume = grown;
+        resume_capacity = mkey.mv_size;
+      }
+      memcpy(resume, mkey.mv_data, resume_size = mkey.mv_size);
+      if (store->stats != NULL) {
+        kvs_stats_add(store->stats, KVS_STORE_COUNTER_BYTES_READ, mkey.mv_size + mval.mv_size);
+      }
+      if (KVS_FAILED(st = rewriter(arg, mkey.mv_data, mkey.mv_size, mval.mv_data, mval.mv_size, dest))) {
+        break;
+      }
+      if ((mval.mv_size = kvs_buffer_size(dest)) > 0) {
+        mval.mv_data = (void *) kvs_buffer_peek(dest, mval.mv_size);
+        rc = mdb_cursor_put(cursor, &mkey, &mval, MDB_CURRENT);
+        kvs_buffer_skip(dest, mval.mv_size);
+        if (store->stats != NULL) {
+          kvs_stats_add(store->stats, KVS_STORE_COUNTER_BYTES_WRITTEN, mkey.mv_size + mval.mv_size);
+        }
+        if (rc != MDB_SUCCESS) {
+          break;
+        }
+      }
+      rc = mdb_cursor_get(cursor, &mkey, &mval, MDB_NEXT);
+    }
+    mdb_cursor_close(cursor);
+    if (KVS_FAILED(st) || (rc != MDB_SUCCESS && rc != MDB_NOTFOUND)) {
+      kvs_store_txn_abort(txn);
+      break;
+    }
+    if (KVS_FAILED(st = kvs_store_txn_commit(txn))) {
+      break;
+    }
+  } while (rc == MDB_SUCCESS);
+  if (!KVS_FAILED(st) && rc != MDB_SUCCESS && rc != MDB_NOTFOUND) {
+    st = kvs_store_convert_lmdb_status(rc);
+  }
+  kvs_buffer_destroy(dest);
+  free(resume);
+  return st;
+}
+
+void kvs_store_reader_fence(kvs_store *store) {
+  __atomic_fetch_add(&store->reader_epoch, 1, __ATOMIC_SEQ_CST);
+}
+
+int32_t kvs_store_readers_past_fence(kvs_store *store) {
+  size_t idx;
+  int64_t readers = 0;
+  const int64_t *counters = store->readers[(__atomic_load_n(&store->reader_epoch, __ATOMIC_SEQ_CST) - 1) & 1];
+  for (idx = 0; idx < KVS_STORE_READER_SLOTS; ++idx) {
+    readers += __atomic_load_n(&counters[idx * KVS_STORE_READER_STRIDE], __ATOMIC_ACQUIRE);
+  }
+  return readers == 0;
+}
+
 kvs_store_cursor *kvs_store_cursor_open(kvs_store *store) {
+  uint64_t start = kvs_store_stats_start(store->stats);
   kvs_store_cursor *cursor = calloc(1, sizeof(kvs_store_cursor));
+  cursor->reader = kvs_store_reader_enter(store);
   if (mdb_txn_begin(store->env, NULL, MDB_RDONLY, &cursor->txn) != 0) {
     goto error;
   }
   if (mdb_cursor_open(cursor->txn, store->dbi, &cursor->cursor) != 0) {
     goto error;
   }
+  cursor->dbi = store->dbi;
+  cursor->stats = store->stats;
+  cursor->started = start;
+  kvs_store_stats_end(cursor->stats, KVS_STORE_OP_CURSOR_OPEN, start, KVS_STORE_COUNTER_BYTES_READ, 0);
   return cursor;
 error:
   if (cursor->txn != NULL) {
     mdb_txn_abort(cursor->txn);
   }
+  kvs_store_reader_leave(cursor->reader);
   free(cursor);
   return NULL;
 }
 
+void kvs_store_cursor_set_arena(kvs_store_cursor *cursor, kvs_arena *arena) {
+  cursor->arena = arena;
+}
+
 kvs_status kvs_store_cursor_seek(kvs_store_cursor *cursor, kvs_buffer *key) {
   MDB_val mkey;
+  kvs_arena_mark mark;
   void *to_free = NULL;
   int32_t rc;
+  uint64_t start = kvs_store_stats_start(cursor->stats);
+  if (cursor->arena != NULL) {
+    kvs_arena_save(cursor->arena, &mark);
+  }
   mkey.mv_size = kvs_buffer_size(key);
   if ((mkey.mv_data = (void *) kvs_buffer_peek(key, mkey.mv_size)) == NULL) {
-    kvs_buffer_read(key, mkey.mv_data = to_free = malloc(mkey.mv_size), mkey.mv_size);
+    kvs_buffer_read(key, mkey.mv_data = to_free = kvs_store_scratch_allocate(cursor->arena, mkey.mv_size), mkey.mv_size);
   }
   rc = mdb_cursor_get(cursor->cursor, &mkey, NULL, MDB_SET_RANGE);
   if (to_free != NULL) {
-    free(to_free);
+    kvs_store_scratch_free(cursor->arena, to_free);
+  }
+  if (cursor->arena != NULL) {
+    kvs_arena_restore(cursor->arena, &mark);
   }
+  kvs_store_stats_end(cursor->stats, KVS_STORE_OP_SEEK, start, KVS_STORE_COUNTER_BYTES_READ, 0);
+  return kvs_store_convert_lmdb_status(rc);
+}
+
+kvs_status kvs_store_cursor_seek_no_copy(kvs_store_cursor *cursor, const void *key, size_t key_size) {
+  MDB_val mkey;
+  int32_t rc;
+  uint64_t start = kvs_store_stats_start(cursor->stats);
+  mkey.mv_data = (void *) key;
+  mkey.mv_size = key_size;
+  rc = mdb_cursor_get(cursor->cursor, &mkey, NULL, MDB_SET_RANGE);
+  kvs_store_stats_end(cursor->stats, KVS_STORE_OP_SEEK, start, KVS_STORE_COUNTER_BYTES_READ, 0);
+  return kvs_store_convert_lmdb_status(rc);
+}
+
+kvs_status kvs_store_cursor_get_no_copy(kvs_store_cursor *cursor, const void *key, size_t key_size, const void **value, size_t *value_size) {
+  MDB_val mkey, mval;
+  int32_t rc;
+  uint64_t start = kvs_store_stats_start(cursor->stats);
+  mkey.mv_data = (void *) key;
+  mkey.mv_size = key_size;
+  mval.mv_size = 0;
+  if ((rc = mdb_get(cursor->txn, cursor->dbi, &mkey, &mval)) == MDB_SUCCESS) {
+    *value = mval.mv_data;
+    *value_size = mval.mv_size;
+  }
+  kvs_store_stats_end(cursor->stats, KVS_STORE_OP_GET, start, KVS_STORE_COUNTER_BYTES_READ, rc == MDB_SUCCESS ? mval.mv_size : 0);
   return kvs_store_convert_lmdb_status(rc);
 }
 
@@ -200,12 +584,14 @@ kvs_status kvs_store_cursor_next_no_copy(kvs_store_cursor *cursor, const void **
   memset(&mkey, 0, sizeof(mkey));
   memset(&mval, 0, sizeof(mval));
   int32_t rc;
+  uint64_t start = kvs_store_stats_start(cursor->stats);
   if ((rc = mdb_cursor_get(cursor->cursor, &mkey, &mval, MDB_NEXT)) == MDB_SUCCESS) {
     *key = mkey.mv_data;
     *key_size = mkey.mv_size;
     *value = mval.mv_data;
     *value_size = mval.mv_size;
   }
+  kvs_store_stats_end(cursor->stats, KVS_STORE_OP_NEXT, start, KVS_STORE_COUNTER_BYTES_READ, mkey.mv_size + mval.mv_size);
   return kvs_store_convert_lmdb_status(rc);
 }
 
@@ -223,5 +609,174 @@ kvs_status kvs_store_cursor_next(kvs_store_cursor *cursor, kvs_buffer *key, kvs_
 void kvs_store_cursor_close(kvs_store_cursor *cursor) {
   mdb_cursor_close(cursor->cursor);
   mdb_txn_commit(cursor->txn);
+  kvs_store_reader_leave(cursor->reader);
+  kvs_store_stats_end(cursor->stats, KVS_STORE_OP_READ_TXN, cursor->started, KVS_STORE_COUNTER_BYTES_READ, 0);
   free(cursor);
 }
+
+kvs_status kvs_store_stats_get(kvs_store *store, kvs_store_stats *stats) {
+  MDB_envinfo info;
+  MDB_stat stat;
+  MDB_txn *txn;
+  int32_t rc;
+  uint64_t counters[KVS_STORE_COUNTER_NUM];
+  memset(stats, 0, sizeof(kvs_store_stats));
+  if (store->stats != NULL) {
+    kvs_stats_read(store->stats, stats->ops, counters);
+    stats->bytes_read = counters[KVS_STORE_COUNTER_BYTES_READ];
+    stats->bytes_written = counters[KVS_STORE_COUNTER_BYTES_WRITTEN];
+  }
+  if ((rc = mdb_env_info(store->env, &info)) != MDB_SUCCESS || (rc = mdb_txn_begin(store->env, NULL, MDB_RDONLY, &txn)) != MDB_SUCCESS) {
+    return kvs_store_convert_lmdb_status(rc);
+  }
+  rc = mdb_stat(txn, store->dbi, &stat);
+  mdb_txn_abort(txn);
+  if (rc != MDB_SUCCESS) {
+    return kvs_store_convert_lmdb_status(rc);
+  }
+  stats->depth = stat.ms_depth;
+  stats->entries = stat.ms_entries;
+  stats->branch_pages = stat.ms_branch_pages;
+  stats->leaf_pages = stat.ms_leaf_pages;
+  stats->overflow_pages = stat.ms_overflow_pages;
+  stats->page_size = stat.ms_psize;
+  stats->map_size = info.me_mapsize;
+  stats->map_used = (info.me_last_pgno + 1) * (uint64_t) stat.ms_psize;
+  stats->max_readers = info.me_maxreaders;
+  stats->readers_used = info.me_numreaders;
+  stats->last_txn_id = info.me_last_txnid;
+  return KVS_OK;
+}
+
+void kvs_store_stats_reset(kvs_store *store) {
+  if (store->stats != NULL) {
+    kvs_stats_reset(store->stats);
+  }
+}
+
+/* dictionary entries are keyed by name + '\0' + big endian code so a dictionary loads in code order */
+static size_t kvs_store_dictionary_key(uint8_t *key, const char *name, size_t name_len, uint32_t code) {
+  memcpy(key, name, name_len + 1);
+  key[name_len + 1] = (code >> 24) & 0xFF;
+  key[name_len + 2] = (code >> 16) & 0xFF;
+  key[name_len + 3] = (code >> 8) & 0xFF;
+  key[name_len + 4] = code & 0xFF;
+  return name_len + 1 + sizeof(uint32_t);
+}
+
+kvs_status kvs_store_dictionary_load(kvs_store *store, const char *name, kvs_dictionary *dictionary) {
+  MDB_txn *txn = NULL;
+  MDB_cursor *cursor = NULL;
+  MDB_val mkey, mval;
+  size_t name_len = strlen(name), key_size;
+  uint32_t code, encoded;
+  const uint8_t *ckey;
+  int32_t rc;
+  kvs_status st = KVS_OK;
+  uint8_t *key = malloc(name_len + 1 + sizeof(uint32_t));
+  if (key == NULL) {
+    return KVS_OUT_OF_MEMORY;
+  }
+  if ((rc = mdb_txn_begin(store->env, NULL, MDB_RDONLY, &txn)) != 0 ||
+      (rc = mdb_cursor_open(txn, store->dictionary_dbi, &cursor)) != 0) {
+    st = kvs_store_convert_lmdb_status(rc);
+    goto cleanup_exit;
+  }
+  mkey.mv_data = key;
+  mkey.mv_size = key_size = kvs_store_dictionary_key(key, name, name_len, 0);
+  for (rc = mdb_cursor_get(cursor, &mkey, &mval, MDB_SET_RANGE); rc == MDB_SUCCESS;
+      rc = mdb_cursor_get(cursor, &mkey, &mval, MDB_NEXT)) {
+    ckey = mkey.mv_data;
+    if (mkey.mv_size != key_size || memcmp(ckey, key, name_len + 1) != 0) {
+      break;
+    }
+    code = ((uint32_t) ckey[name_len + 1] << 24) | ((uint32_t) ckey[name_len + 2] << 16) |
+      ((uint32_t) ckey[name_len + 3] << 8) | ((uint32_t) ckey[name_len + 4]);
+    if (code < kvs_dictionary_size(dictionary)) {
+      /* already loaded */
+      continue;
+    }
+    if (code > kvs_dictionary_size(dictionary)) {
+      st = KVS_STORE_CORRUPTED;
+      goto cleanup_exit;
+    }
+    if (KVS_FAILED(st = kvs_dictionary_encode(dictionary, mval.mv_data, mval.mv_size, &encoded))) {
+      goto cleanup_exit;
+    }
+    if (encoded != code) {
+      st = KVS_STORE_CORRUPTED;
+      goto cleanup_exit;
+    }
+  }
+  if (rc != MDB_SUCCESS && rc != MDB_NOTFOUND) {
+    st = kvs_store_convert_lmdb_status(rc);
+  } else {
+    kvs_dictionary_mark_persisted(dictionary, kvs_dictionary_size(dictionary));
+  }
+cleanup_exit:
+  if (cursor != NULL) {
+    mdb_cursor_close(cursor);
+  }
+  if (txn != NULL) {
+    mdb_txn_abort(txn);
+  }
+  free(key);
+  return st;
+}
+
+/* the pending mark of dictionary in txn, added at the persisted size when there is none yet */
+static kvs_store_dictionary_mark *kvs_store_txn_dictionary_mark(kvs_store_txn *txn, kvs_dictionary *dictionary) {
+  size_t idx;
+  kvs_store_dictionary_mark *marks;
+  for (idx = 0; idx < txn->num_marks; ++idx) {
+    if (txn->marks[idx].dictionary == dictionary) {
+      return &txn->marks[idx];
+    }
+  }
+  if ((marks = realloc(txn->marks, sizeof(kvs_store_dictionary_mark) * (txn->num_marks + 1))) == NULL) {
+    return NULL;
+  }
+  txn->marks = marks;
+  marks[txn->num_marks].dictionary = dictionary;
+  marks[txn->num_marks].persisted = kvs_dictionary_persisted(dictionary);
+  return &marks[txn->num_marks++];
+}
+
+kvs_status kvs_store_txn_dictionary_save(kvs_store_txn *txn, const char *name, kvs_dictionary *dictionary) {
+  MDB_val mkey, mval;
+  size_t name_len = strlen(name), code, size = kvs_dictionary_size(dictionary);
+  int32_t rc;
+  const void *data;
+  size_t data_size;
+  kvs_status st = KVS_OK;
+  kvs_store_dictionary_mark *mark;
+  uint8_t *key;
+  if ((mark = kvs_store_txn_dictionary_mark(txn, dictionary)) == NULL) {
+    return KVS_OUT_OF_MEMORY;
+  }
+  /* already written by this txn */
+  if (mark->persisted == size) {
+    return KVS_OK;
+  }
+  if ((key = malloc(name_len + 1 + sizeof(uint32_t))) == NULL) {
+    return KVS_OUT_OF_MEMORY;
+  }
+  mkey.mv_data = key;
+  for (code = mark->persisted; code < size && !KVS_FAILED(st); ++code) {
+    kvs_dictionary_decode(dictionary, code, &data, &data_size);
+    mval.mv_data = (void *) data;
+    mval.mv_size = data_size;
+    mkey.mv_size = kvs_store_dictionary_key(key, name, name_len, code);
+    /* another writer may have saved the code, which is fine as long as it maps to the same value */
+    if ((rc = mdb_put(txn->txn, txn->dictionary_dbi, &mkey, &mval, MDB_NOOVERWRITE)) == MDB_KEYEXIST) {
+      st = mval.mv_size == data_size && (data_size == 0 || memcmp(mval.mv_data, data, data_size) == 0) ? KVS_OK : KVS_DICTIONARY_CONFLICT;
+    } else {
+      st = kvs_store_convert_lmdb_status(rc);
+    }
+  }
+  free(key);
+  if (!KVS_FAILED(st)) {
+    mark->persisted = size;
+  }
+  return st;
+}
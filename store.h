@@ -4,12 +4,18 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include "buffer.h"
+#include "batch.h"
+#include "dictionary.h"
+#include "vlog.h"
+#include "stats.h"
 #include "status.h"
 
 typedef struct kvs_store kvs_store;
 
 typedef enum kvs_store_flag {
   KVS_STORE_FLAG_VOLATILE = 1 << 0,
+  /* time operations and count bytes for kvs_store_stats_get, costs a clock read per operation */
+  KVS_STORE_FLAG_STATS = 1 << 1,
 } kvs_store_flag;
 
 typedef struct kvs_store_txn kvs_store_txn;
@@ -20,19 +26,89 @@ typedef enum kvs_store_txn_flag {
 
 typedef struct kvs_store_cursor kvs_store_cursor;
 
+typedef enum kvs_store_op {
+  KVS_STORE_OP_PUT = 0,
+  KVS_STORE_OP_PUT_BATCH,
+  KVS_STORE_OP_COMMIT,
+  KVS_STORE_OP_CURSOR_OPEN,
+  KVS_STORE_OP_SEEK,
+  KVS_STORE_OP_NEXT,
+  KVS_STORE_OP_GET,
+  /* begin to commit or abort of write transactions */
+  KVS_STORE_OP_WRITE_TXN,
+  /* lifetime of read only transactions and cursors, long ones keep lmdb from reusing pages */
+  KVS_STORE_OP_READ_TXN,
+  KVS_STORE_OP_NUM
+} kvs_store_op;
+
+typedef struct kvs_store_stats {
+  kvs_stats_histogram ops[KVS_STORE_OP_NUM];
+  /* keys and values returned by cursors and written by puts */
+  uint64_t bytes_read;
+  uint64_t bytes_written;
+  /* records b-tree */
+  uint32_t depth;
+  uint64_t entries;
+  uint64_t branch_pages;
+  uint64_t leaf_pages;
+  uint64_t overflow_pages;
+  /* environment */
+  uint64_t page_size;
+  uint64_t map_size;
+  uint64_t map_used;
+  uint32_t max_readers;
+  /* reader slots ever taken in the lock table */
+  uint32_t readers_used;
+  uint64_t last_txn_id;
+} kvs_store_stats;
+
+/* called for every row by kvs_store_rewrite, writing a new value to dest replaces the row, leaving it empty keeps it */
+typedef kvs_status (*kvs_store_rewriter)(void *arg, const void *key, size_t key_size, const void *value, size_t value_size, kvs_buffer *dest);
+
 kvs_store *kvs_store_open(const char *path, int32_t flags);
 void kvs_store_destroy(kvs_store *store);
 kvs_status kvs_store_put(kvs_store *store, kvs_buffer *key, kvs_buffer *value);
+/* value log kept in the store directory, synced by every commit of a write transaction */
+kvs_vlog *kvs_store_value_log(kvs_store *store);
+/* pass every row in key order to rewriter, committing after each rows_per_txn rows so writers are not blocked for long */
+kvs_status kvs_store_rewrite(kvs_store *store, kvs_store_rewriter rewriter, void *arg, size_t rows_per_txn);
+/**
+ * Start a new reader epoch. Read transactions and cursors begun before it may still see
+ * rows as they were, kvs_store_readers_past_fence tells once the last of them has ended.
+ * Fence again only after that, the epochs alternate between two sets of counters.
+ **/
+void kvs_store_reader_fence(kvs_store *store);
+int32_t kvs_store_readers_past_fence(kvs_store *store);
+/* operation histograms and byte counts stay zero unless the store is opened with KVS_STORE_FLAG_STATS */
+kvs_status kvs_store_stats_get(kvs_store *store, kvs_store_stats *stats);
+void kvs_store_stats_reset(kvs_store *store);
 
 kvs_store_txn *kvs_store_txn_begin(kvs_store *store, int32_t flags);
 kvs_status kvs_store_txn_commit(kvs_store_txn *txn);
 void kvs_store_txn_abort(kvs_store_txn *txn);
+/* copy keys and values spanning buffer blocks into arena instead of the heap, NULL detaches */
+void kvs_store_txn_set_arena(kvs_store_txn *txn, kvs_arena *arena);
 kvs_status kvs_store_txn_put(kvs_store_txn *txn, kvs_buffer *key, kvs_buffer *value);
+kvs_status kvs_store_txn_put_batch(kvs_store_txn *txn, const kvs_batch *batch);
+/* put key with value_size bytes at *data for the caller to fill, they stay writable until the next write in txn; key is left in its buffer */
+kvs_status kvs_store_txn_put_reserve(kvs_store_txn *txn, kvs_buffer *key, size_t value_size, void **data);
+kvs_status kvs_store_txn_del(kvs_store_txn *txn, kvs_buffer *key);
 
 kvs_store_cursor *kvs_store_cursor_open(kvs_store *store);
+void kvs_store_cursor_set_arena(kvs_store_cursor *cursor, kvs_arena *arena);
 kvs_status kvs_store_cursor_seek(kvs_store_cursor *cursor, kvs_buffer *key);
+kvs_status kvs_store_cursor_seek_no_copy(kvs_store_cursor *cursor, const void *key, size_t key_size);
 kvs_status kvs_store_cursor_next(kvs_store_cursor *cursor, kvs_buffer *key, kvs_buffer *value);
+/* point lookup in the transaction of cursor, value stays valid until the cursor is closed */
+kvs_status kvs_store_cursor_get_no_copy(kvs_store_cursor *cursor, const void *key, size_t key_size, const void **value, size_t *value_size);
 kvs_status kvs_store_cursor_next_no_copy(kvs_store_cursor *cursor, const void **key, size_t *key_size, const void **value, size_t *value_size);
 void kvs_store_cursor_close(kvs_store_cursor *cursor);
 
+kvs_status kvs_store_dictionary_load(kvs_store *store, const char *name, kvs_dictionary *dictionary);
+/**
+ * Write the values added since the last committed save, they only count as persisted once txn
+ * commits. KVS_DICTIONARY_CONFLICT when the store maps one of the codes to a different value.
+ **/
+kvs_status kvs_store_txn_dictionary_save(kvs_store_txn *txn, const char *name, kvs_dictionary *dictionary);
+
 #endif /* __KVS_STORE_H__ */
@@ -1,5 +1,6 @@
 #include "util.h"
 #include "variant.h"
+#include "dictionary.h"
 #include "util.h"
 #include <string.h>
 #include <stdlib.h>
@@ -9,6 +10,7 @@
 #define SIGN_MASK_U64 (0x8000000000000000L)
 #define ESCAPE_LENGTH (9)
 #define ENCODED_SIZE(SIZE) (((SIZE + (ESCAPE_LENGTH - 2)) / (ESCAPE_LENGTH - 1)) * ESCAPE_LENGTH)
+#define VARINT_MAX_SIZE (5)
 static const uint8_t EMPTY_BYTES[] = {
   0, 0, 0, 0, 0, 0, 0, 0
 };
@@ -18,12 +20,18 @@ typedef float kvs_float;
 typedef double kvs_double;
 typedef struct kvs_opaque {
   int32_t size;
-  int32_t capacity;
+  /* negative for data borrowed from a dictionary and holds -(code + 1) */
+  int32_t code;
   const void *data;
 } kvs_opaque;
 
+/* opaque variants start with this much storage so short values never reallocate */
+#define KVS_VARIANT_INLINE_SIZE (32)
+
 struct kvs_variant {
   kvs_variant_type type;
+  /* bytes trailing the variant for opaque data, kept across resets of any type so it never shrinks */
+  int32_t storage;
   union {
     kvs_int32 i32;
     kvs_float f;
@@ -33,76 +41,86 @@ struct kvs_variant {
   } value;
 };
 
-static inline void kvs_variant_serialize_comparable_uint32(uint32_t u32, kvs_buffer *buffer) {
-  uint8_t *ubuffer = kvs_buffer_allocate(buffer, sizeof(int32_t));
-#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
-  ubuffer[3] = (u32 & 0xFF);
-  ubuffer[2] = (u32 & 0xFF00) >> 8;
-  ubuffer[1] = (u32 & 0xFF0000) >> 16;
-  ubuffer[0] = (u32 & 0xFF000000) >> 24;
-#else
-  memcpy(ubuffer, &u32, sizeof(u32));
-#endif
+static kvs_variant *kvs_variant_reserve(kvs_variant *variant, size_t size) {
+  size_t storage = variant->storage;
+  if (storage >= size) {
+    return variant;
+  }
+  storage = storage * 2 > size ? storage * 2 : size;
+  storage = storage < KVS_VARIANT_INLINE_SIZE ? KVS_VARIANT_INLINE_SIZE : storage;
+  variant = realloc(variant, sizeof(kvs_variant) + storage);
+  variant->storage = (int32_t) storage;
+  return variant;
 }
 
-void kvs_variant_serialize_comparable_int32(const kvs_variant *variant, kvs_buffer *buffer) {
-  kvs_variant_serialize_comparable_uint32(((uint32_t) variant->value.i32) ^ SIGN_MASK_U32, buffer);
+static inline kvs_variant *kvs_variant_set_opaque(kvs_variant *variant, size_t size) {
+  variant->type = KVS_VARIANT_TYPE_OPAQUE;
+  variant->value.opaque.data = KVS_UNSAFE_CAST(variant, sizeof(kvs_variant));
+  variant->value.opaque.size = size;
+  variant->value.opaque.code = 0;
+  return variant;
 }
 
-static void kvs_variant_serialize_comparable_uint64(uint64_t u64, kvs_buffer *buffer) {
-  uint8_t *ubuffer = kvs_buffer_allocate(buffer, sizeof(int64_t));
+static inline size_t kvs_variant_encode_comparable_uint32(uint32_t u32, void *dest) {
 #if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
-  ubuffer[7] = (u64 & 0xFFL);
-  ubuffer[6] = (u64 & 0xFF00L) >> 8;
-  ubuffer[5] = (u64 & 0xFF0000L) >> 16;
-  ubuffer[4] = (u64 & 0xFF000000L) >> 24;
-  ubuffer[3] = (u64 & 0xFF00000000L) >> 32;
-  ubuffer[2] = (u64 & 0xFF0000000000L) >> 40;
-  ubuffer[1] = (u64 & 0xFF000000000000L) >> 48;
-  ubuffer[0] = (u64 & 0xFF00000000000000L) >> 56;
-#else
-  memcpy(ubuffer, &u64, sizeof(u64));
+  u32 = __builtin_bswap32(u32);
 #endif
+  memcpy(dest, &u32, sizeof(u32));
+  return sizeof(u32);
 }
 
-void kvs_variant_serialize_comparable_int64(const kvs_variant *variant, kvs_buffer *buffer) {
-  kvs_variant_serialize_comparable_uint64(((uint64_t) variant->value.i64) ^ SIGN_MASK_U64, buffer);
+static inline size_t kvs_variant_encode_comparable_uint64(uint64_t u64, void *dest) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  u64 = __builtin_bswap64(u64);
+#endif
+  memcpy(dest, &u64, sizeof(u64));
+  return sizeof(u64);
 }
 
-void kvs_variant_serialize_comparable_float(const kvs_variant *variant, kvs_buffer *buffer) {
+size_t kvs_variant_encode_comparable_int32(int32_t i32, void *dest) {
+  return kvs_variant_encode_comparable_uint32(((uint32_t) i32) ^ SIGN_MASK_U32, dest);
+}
+
+size_t kvs_variant_encode_comparable_int64(int64_t i64, void *dest) {
+  return kvs_variant_encode_comparable_uint64(((uint64_t) i64) ^ SIGN_MASK_U64, dest);
+}
+
+size_t kvs_variant_encode_comparable_float(float f, void *dest) {
   uint32_t u32;
-  memcpy(&u32, &variant->value.f, sizeof(u32));
-  if (variant->value.f >= 0) {
+  memcpy(&u32, &f, sizeof(u32));
+  if (f >= 0) {
     u32 |= SIGN_MASK_U32;
   } else {
     u32 = ~u32;
   }
-  kvs_variant_serialize_comparable_uint32(u32, buffer);
+  return kvs_variant_encode_comparable_uint32(u32, dest);
 }
 
-void kvs_variant_serialize_comparable_double(const kvs_variant *variant, kvs_buffer *buffer) {
+size_t kvs_variant_encode_comparable_double(double d, void *dest) {
   uint64_t u64;
-  memcpy(&u64, &variant->value.d, sizeof(u64));;
-  if (variant->value.d >= 0) {
+  memcpy(&u64, &d, sizeof(u64));
+  if (d >= 0) {
     u64 |= SIGN_MASK_U64;
   } else {
     u64 = ~u64;
   }
-  kvs_variant_serialize_comparable_uint64(u64, buffer);
+  return kvs_variant_encode_comparable_uint64(u64, dest);
 }
 
-void kvs_variant_serialize_comparable_opaque(const kvs_variant *variant, kvs_buffer *buffer) {
-  size_t size = variant->value.opaque.size;
+size_t kvs_variant_comparable_opaque_size(size_t size) {
   size_t encoded_size = ENCODED_SIZE(size);
-  if (encoded_size == 0) {
-    encoded_size = ESCAPE_LENGTH;
-  }
-  const char *cdata = variant->value.opaque.data;
-  char *cbuffer = kvs_buffer_allocate(buffer, encoded_size);
+  return encoded_size == 0 ? ESCAPE_LENGTH : encoded_size;
+}
+
+size_t kvs_variant_encode_comparable_opaque(const void *data, size_t size, void *dest) {
+  const char *cdata = data;
+  char *cbuffer = dest;
   while (1) {
     // Figure out how many bytes to copy, copy them and adjust pointers
     size_t copy_len = ESCAPE_LENGTH - 1 < size ? ESCAPE_LENGTH - 1 : size;
-    memcpy(cbuffer, cdata, copy_len);
+    if (copy_len > 0) {
+      memcpy(cbuffer, cdata, copy_len);
+    }
     cdata += copy_len;
     cbuffer += copy_len;
     size -= copy_len;
@@ -121,55 +139,58 @@ void kvs_variant_serialize_comparable_opaque(const kvs_variant *variant, kvs_buf
     // We have more data - put the flag byte (N) in and continue
     *(cbuffer++) = ESCAPE_LENGTH;
   }
+  return cbuffer - (char *) dest;
+}
+
+void kvs_variant_serialize_comparable_int32(const kvs_variant *variant, kvs_buffer *buffer) {
+  kvs_variant_encode_comparable_int32(variant->value.i32, kvs_buffer_allocate(buffer, sizeof(int32_t)));
+}
+
+void kvs_variant_serialize_comparable_int64(const kvs_variant *variant, kvs_buffer *buffer) {
+  kvs_variant_encode_comparable_int64(variant->value.i64, kvs_buffer_allocate(buffer, sizeof(int64_t)));
+}
+
+void kvs_variant_serialize_comparable_float(const kvs_variant *variant, kvs_buffer *buffer) {
+  kvs_variant_encode_comparable_float(variant->value.f, kvs_buffer_allocate(buffer, sizeof(float)));
+}
+
+void kvs_variant_serialize_comparable_double(const kvs_variant *variant, kvs_buffer *buffer) {
+  kvs_variant_encode_comparable_double(variant->value.d, kvs_buffer_allocate(buffer, sizeof(double)));
+}
+
+void kvs_variant_serialize_comparable_opaque(const kvs_variant *variant, kvs_buffer *buffer) {
+  size_t size = variant->value.opaque.size;
+  kvs_variant_encode_comparable_opaque(variant->value.opaque.data, size,
+      kvs_buffer_allocate(buffer, kvs_variant_comparable_opaque_size(size)));
 }
 
 static inline uint32_t kvs_variant_deserialize_comparable_uint32(kvs_buffer *data) {
   uint32_t u32;
+  kvs_buffer_read(data, &u32, sizeof(u32));
 #if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
-  uint8_t ubuffer[sizeof(uint32_t)];
-  kvs_buffer_read(data, ubuffer, sizeof(ubuffer));
-  u32 = ((uint32_t) ubuffer[3]) | (((uint32_t) ubuffer[2]) << 8) | 
-    (((uint32_t) ubuffer[1]) << 16) | (((uint32_t) ubuffer[0]) << 24);
-#else
-  kvs_buffer_read(buffer, &u32, sizeof(u32));
+  u32 = __builtin_bswap32(u32);
 #endif
   return u32;
 }
 
-kvs_variant *kvs_variant_deserialize_comparable_int32(kvs_variant *dest, kvs_buffer *data) {
-  uint32_t u32 = kvs_variant_deserialize_comparable_uint32(data) ^ SIGN_MASK_U32;
-  if (dest == NULL) {
-    dest = kvs_variant_create_from_int32(0);
-  }
-  kvs_variant_reset_int32(dest, (int32_t) u32);
-  return dest;
-}
-
 static inline uint64_t kvs_variant_deserialize_comparable_uint64(kvs_buffer *data) {
   uint64_t u64;
+  kvs_buffer_read(data, &u64, sizeof(u64));
 #if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
-  uint8_t ubuffer[sizeof(uint64_t)];
-  kvs_buffer_read(data, ubuffer, sizeof(ubuffer));
-  u64 = ((uint64_t) ubuffer[7]) | (((uint64_t) ubuffer[6]) << 8) | 
-    (((uint64_t) ubuffer[5]) << 16) | (((uint64_t) ubuffer[4]) << 24) | 
-    (((uint64_t) ubuffer[3]) << 32) | (((uint64_t) ubuffer[2]) << 40) | 
-    (((uint64_t) ubuffer[1]) << 48) | (((uint64_t) ubuffer[0]) << 56);
-#else
-  kvs_buffer_read(buffer, &u64, sizeof(u64));
+  u64 = __builtin_bswap64(u64);
 #endif
   return u64;
 }
 
-kvs_variant *kvs_variant_deserialize_comparable_int64(kvs_variant *dest, kvs_buffer *data) {
-  uint64_t u64 = kvs_variant_deserialize_comparable_uint64(data) ^ SIGN_MASK_U64;
-  if (dest == NULL) {
-    dest = kvs_variant_create_from_int64(0);
-  }
-  kvs_variant_reset_int64(dest, (int64_t) u64);
-  return dest;
+int32_t kvs_variant_decode_comparable_int32(kvs_buffer *data) {
+  return (int32_t) (kvs_variant_deserialize_comparable_uint32(data) ^ SIGN_MASK_U32);
 }
 
-kvs_variant *kvs_variant_deserialize_comparable_float(kvs_variant *dest, kvs_buffer *data) {
+int64_t kvs_variant_decode_comparable_int64(kvs_buffer *data) {
+  return (int64_t) (kvs_variant_deserialize_comparable_uint64(data) ^ SIGN_MASK_U64);
+}
+
+float kvs_variant_decode_comparable_float(kvs_buffer *data) {
   uint32_t u32 = kvs_variant_deserialize_comparable_uint32(data);
   float f;
   if ((u32 & SIGN_MASK_U32) > 0) {
@@ -177,15 +198,11 @@ kvs_variant *kvs_variant_deserialize_comparable_float(kvs_variant *dest, kvs_buf
   } else {
     u32 = ~u32;
   }
-  if (dest == NULL) {
-    dest = kvs_variant_create_from_float(0.0f);
-  }
   memcpy(&f, &u32, sizeof(f));
-  kvs_variant_reset_float(dest, f);
-  return dest;
+  return f;
 }
 
-kvs_variant *kvs_variant_deserialize_comparable_double(kvs_variant *dest, kvs_buffer *data) {
+double kvs_variant_decode_comparable_double(kvs_buffer *data) {
   uint64_t u64 = kvs_variant_deserialize_comparable_uint64(data);
   double d;
   if ((u64 & SIGN_MASK_U64) > 0) {
@@ -193,25 +210,54 @@ kvs_variant *kvs_variant_deserialize_comparable_double(kvs_variant *dest, kvs_bu
   } else {
     u64 = ~u64;
   }
+  memcpy(&d, &u64, sizeof(d));
+  return d;
+}
+
+kvs_variant *kvs_variant_deserialize_comparable_int32(kvs_variant *dest, kvs_buffer *data) {
+  int32_t i32 = kvs_variant_decode_comparable_int32(data);
+  if (dest == NULL) {
+    dest = kvs_variant_create_from_int32(0);
+  }
+  kvs_variant_reset_int32(dest, i32);
+  return dest;
+}
+
+kvs_variant *kvs_variant_deserialize_comparable_int64(kvs_variant *dest, kvs_buffer *data) {
+  int64_t i64 = kvs_variant_decode_comparable_int64(data);
+  if (dest == NULL) {
+    dest = kvs_variant_create_from_int64(0);
+  }
+  kvs_variant_reset_int64(dest, i64);
+  return dest;
+}
+
+kvs_variant *kvs_variant_deserialize_comparable_float(kvs_variant *dest, kvs_buffer *data) {
+  float f = kvs_variant_decode_comparable_float(data);
+  if (dest == NULL) {
+    dest = kvs_variant_create_from_float(0.0f);
+  }
+  kvs_variant_reset_float(dest, f);
+  return dest;
+}
+
+kvs_variant *kvs_variant_deserialize_comparable_double(kvs_variant *dest, kvs_buffer *data) {
+  double d = kvs_variant_decode_comparable_double(data);
   if (dest == NULL) {
     dest = kvs_variant_create_from_double(0.0);
   }
-  memcpy(&d, &u64, sizeof(d));
   kvs_variant_reset_double(dest, d);
   return dest;
 }
 
-kvs_variant *kvs_variant_deserialize_comparable_opaque(kvs_variant *dest, kvs_buffer *data) {
-  kvs_buffer *result = kvs_buffer_create(512);
+/* validates the groups without consuming them, so the decoded size is known before any storage is reserved */
+static size_t kvs_variant_comparable_opaque_decoded_size(kvs_buffer *data) {
   uint8_t group[ESCAPE_LENGTH], group_size;
-  const uint8_t *flat;
-  uint8_t *to_free = NULL;
-  size_t size;
-  while (1) {
-    if (kvs_buffer_size(data) < ESCAPE_LENGTH) {
+  size_t offset, size = 0;
+  for (offset = 0;; offset += ESCAPE_LENGTH) {
+    if (kvs_buffer_copy(data, offset, group, sizeof(group)) != sizeof(group)) {
       abort();
     }
-    kvs_buffer_read(data, &group, sizeof(group));
     if ((group_size = group[ESCAPE_LENGTH - 1]) > ESCAPE_LENGTH) {
       abort();
     }
@@ -220,45 +266,241 @@ kvs_variant *kvs_variant_deserialize_comparable_opaque(kvs_variant *dest, kvs_bu
       if (memcmp(group + group_size, EMPTY_BYTES, ESCAPE_LENGTH - 1 - group_size) != 0) {
         abort();
       }
-      memcpy(kvs_buffer_allocate(result, group_size), group, group_size);
-      break;
-    } else {
-      memcpy(kvs_buffer_allocate(result, ESCAPE_LENGTH - 1), group, ESCAPE_LENGTH - 1);
+      return size + group_size;
     }
+    size += ESCAPE_LENGTH - 1;
   }
-  if ((size = kvs_buffer_size(result)) > 0) {
-    if ((flat = kvs_buffer_peek(result, size)) == NULL) {
-      flat = to_free = malloc(size);
-      kvs_buffer_read(result, to_free, size);
+}
+
+static void kvs_variant_comparable_opaque_read(kvs_buffer *data, uint8_t *dest) {
+  uint8_t group[ESCAPE_LENGTH], group_size;
+  while (1) {
+    kvs_buffer_read(data, &group, sizeof(group));
+    if ((group_size = group[ESCAPE_LENGTH - 1]) < ESCAPE_LENGTH) {
+      memcpy(dest, group, group_size);
+      break;
     }
-  } else {
-    flat = NULL;
+    memcpy(dest, group, ESCAPE_LENGTH - 1);
+    dest += ESCAPE_LENGTH - 1;
+  }
+}
+
+kvs_variant *kvs_variant_deserialize_comparable_opaque(kvs_variant *dest, kvs_buffer *data) {
+  size_t size = kvs_variant_comparable_opaque_decoded_size(data);
+  if (dest == NULL) {
+    dest = kvs_variant_create_from_opaque(NULL, 0);
+  }
+  dest = kvs_variant_set_opaque(kvs_variant_reserve(dest, size), size);
+  kvs_variant_comparable_opaque_read(data, KVS_UNSAFE_CAST(dest, sizeof(kvs_variant)));
+  return dest;
+}
+
+const void *kvs_variant_decode_comparable_opaque(kvs_buffer *data, kvs_buffer *heap, size_t *size) {
+  uint8_t *dest;
+  if ((*size = kvs_variant_comparable_opaque_decoded_size(data)) == 0) {
+    kvs_buffer_skip(data, ESCAPE_LENGTH);
+    return NULL;
   }
-  dest = dest == NULL ? kvs_variant_create_from_opaque(flat, size) : kvs_variant_reset_opaque(dest, flat, size);
-  kvs_buffer_destroy(result);
-  if (to_free != NULL) {
-    free(to_free);
+  dest = kvs_buffer_allocate(heap, *size);
+  kvs_variant_comparable_opaque_read(data, dest);
+  return dest;
+}
+
+const void *kvs_variant_decode_opaque(kvs_buffer *data, kvs_buffer *heap, size_t *size) {
+  int32_t nbytes = 0;
+  void *dest = NULL;
+  kvs_buffer_read(data, &nbytes, sizeof(nbytes));
+  if (nbytes > 0) {
+    dest = kvs_buffer_allocate(heap, nbytes);
+    kvs_buffer_read(data, dest, nbytes);
   }
+  *size = nbytes;
   return dest;
 }
 
 kvs_variant *kvs_variant_deserialize_opaque(kvs_variant *dest, kvs_buffer *data) {
   int32_t nbytes;
-  char *buffer;
   if (kvs_buffer_size(data) < sizeof(int32_t)) {
     return NULL;
   }
   kvs_buffer_read(data, &nbytes, sizeof(nbytes));
-  if (dest->type != KVS_VARIANT_TYPE_OPAQUE || dest->value.opaque.capacity < nbytes) {
-    /* reallocate a new variant */
-    dest = realloc(dest, sizeof(kvs_variant) + nbytes);
-    dest->value.opaque.capacity = nbytes;
-  }
-  buffer = KVS_UNSAFE_CAST(dest, sizeof(*dest));
-  dest->value.opaque.data = buffer;
-  kvs_buffer_read(data, buffer, nbytes);
-  dest->value.opaque.size = nbytes;
+  dest = kvs_variant_set_opaque(kvs_variant_reserve(dest, nbytes), nbytes);
+  kvs_buffer_read(data, (void *) dest->value.opaque.data, nbytes);
+  return dest;
+}
+
+static inline size_t kvs_variant_varint_size(uint32_t u32) {
+  size_t size = 1;
+  while (u32 >= 0x80) {
+    u32 >>= 7;
+    ++size;
+  }
+  return size;
+}
+
+/* first failure of the dictionary and separated codecs on the thread since kvs_variant_codec_status last reset it */
+static __thread kvs_status codec_status = KVS_OK;
+
+kvs_status kvs_variant_codec_status(void) {
+  kvs_status st = codec_status;
+  codec_status = KVS_OK;
+  return st;
+}
+
+static inline kvs_status kvs_variant_codec_check(kvs_status st) {
+  if (KVS_FAILED(st) && !KVS_FAILED(codec_status)) {
+    codec_status = st;
+  }
+  return st;
+}
+
+void kvs_variant_encode_dictionary(const void *data, size_t size, kvs_dictionary *dictionary, kvs_buffer *buffer) {
+  uint32_t code;
+  uint8_t *ubuffer;
+  /* an unencodable value writes nothing, the caller fails on the codec status */
+  if (KVS_FAILED(kvs_variant_codec_check(kvs_dictionary_encode(dictionary, data, size, &code)))) {
+    return;
+  }
+  if ((ubuffer = kvs_buffer_allocate(buffer, kvs_variant_varint_size(code))) == NULL) {
+    kvs_variant_codec_check(KVS_OUT_OF_MEMORY);
+    return;
+  }
+  while (code >= 0x80) {
+    *(ubuffer++) = (code & 0x7F) | 0x80;
+    code >>= 7;
+  }
+  *ubuffer = code;
+}
+
+void kvs_variant_serialize_dictionary(const kvs_variant *variant, kvs_dictionary *dictionary, kvs_buffer *buffer) {
+  kvs_variant_encode_dictionary(variant->value.opaque.data, variant->value.opaque.size, dictionary, buffer);
+}
+
+size_t kvs_variant_dictionary_serialized_size(const kvs_variant *variant, kvs_dictionary *dictionary) {
+  uint32_t code;
+  if (KVS_FAILED(kvs_dictionary_encode(dictionary, variant->value.opaque.data, variant->value.opaque.size, &code))) {
+    return 0;
+  }
+  return kvs_variant_varint_size(code);
+}
+
+kvs_status kvs_variant_decode_dictionary(const kvs_dictionary *dictionary, kvs_buffer *data, uint32_t *code, const void **value, size_t *size) {
+  uint8_t byte = 0x80;
+  int32_t shift;
+  kvs_status st;
+  *code = 0;
+  *value = NULL;
+  *size = 0;
+  for (shift = 0; (byte & 0x80) != 0; shift += 7) {
+    if (shift >= VARINT_MAX_SIZE * 7 || kvs_buffer_read(data, &byte, sizeof(byte)) != sizeof(byte)) {
+      return kvs_variant_codec_check(KVS_INSUFFICIENT_BUFFER);
+    }
+    *code |= ((uint32_t) (byte & 0x7F)) << shift;
+  }
+  /* a code missing from the dictionary decodes as empty */
+  if (KVS_FAILED(st = kvs_variant_codec_check(kvs_dictionary_decode(dictionary, *code, value, size)))) {
+    *value = NULL;
+    *size = 0;
+  }
+  return st;
+}
+
+kvs_variant *kvs_variant_deserialize_dictionary(kvs_variant *dest, const kvs_dictionary *dictionary, kvs_buffer *data) {
+  uint32_t code;
+  const void *value;
+  size_t size;
+  kvs_status st = kvs_variant_decode_dictionary(dictionary, data, &code, &value, &size);
+  if (dest == NULL) {
+    dest = kvs_variant_create(KVS_VARIANT_TYPE_OPAQUE);
+  }
   dest->type = KVS_VARIANT_TYPE_OPAQUE;
+  dest->value.opaque.data = value;
+  dest->value.opaque.size = size;
+  /* a failed decode leaves an empty value without a code */
+  dest->value.opaque.code = KVS_FAILED(st) ? 0 : -((int32_t) code) - 1;
+  return dest;
+}
+
+kvs_status kvs_variant_get_dictionary_code(const kvs_variant *variant, uint32_t *code) {
+  if (variant->type != KVS_VARIANT_TYPE_OPAQUE || variant->value.opaque.code >= 0) {
+    return KVS_INVALID_VARIANT_TYPE;
+  }
+  *code = (uint32_t) (-(variant->value.opaque.code + 1));
+  return KVS_OK;
+}
+
+void kvs_variant_encode_separated(const void *data, size_t size, const kvs_vlog_binding *binding, kvs_buffer *buffer) {
+  int32_t tag = KVS_VLOG_POINTER_TAG;
+  kvs_vlog_pointer pointer;
+  uint8_t *dest;
+  /* unbound columns and failed appends keep the value inline */
+  if (binding->log == NULL || size <= binding->threshold || KVS_FAILED(kvs_vlog_append(binding->log, data, size, &pointer))) {
+    kvs_variant_encode_opaque(data, size, buffer);
+    return;
+  }
+  dest = kvs_buffer_allocate(buffer, sizeof(tag) + KVS_VLOG_POINTER_SIZE);
+  memcpy(dest, &tag, sizeof(tag));
+  kvs_vlog_pointer_encode(&pointer, dest + sizeof(tag));
+}
+
+void kvs_variant_serialize_separated(const kvs_variant *variant, const kvs_vlog_binding *binding, kvs_buffer *buffer) {
+  kvs_variant_encode_separated(variant->value.opaque.data, variant->value.opaque.size, binding, buffer);
+}
+
+/* the pointer following the tag */
+static kvs_status kvs_variant_resolve_separated(const kvs_vlog_binding *binding, kvs_buffer *data, kvs_vlog_pointer *pointer) {
+  uint8_t encoded[KVS_VLOG_POINTER_SIZE];
+  if (kvs_buffer_read(data, encoded, sizeof(encoded)) != sizeof(encoded) || binding->log == NULL) {
+    return KVS_STORE_CORRUPTED;
+  }
+  kvs_vlog_pointer_decode(encoded, pointer);
+  return KVS_OK;
+}
+
+/* a value that can not be read decodes as empty and fails the thread's separated status */
+const void *kvs_variant_decode_separated(const kvs_vlog_binding *binding, kvs_buffer *data, kvs_buffer *heap, size_t *size) {
+  int32_t nbytes = 0;
+  kvs_vlog_pointer pointer;
+  void *dest = NULL;
+  kvs_buffer_read(data, &nbytes, sizeof(nbytes));
+  if (nbytes == KVS_VLOG_POINTER_TAG) {
+    *size = 0;
+    if (KVS_FAILED(kvs_variant_codec_check(kvs_variant_resolve_separated(binding, data, &pointer)))) {
+      return NULL;
+    }
+    dest = kvs_buffer_allocate(heap, pointer.size);
+    if (KVS_FAILED(kvs_variant_codec_check(kvs_vlog_read(binding->log, &pointer, dest)))) {
+      return NULL;
+    }
+    *size = pointer.size;
+    return dest;
+  }
+  if (nbytes > 0) {
+    dest = kvs_buffer_allocate(heap, nbytes);
+    kvs_buffer_read(data, dest, nbytes);
+  }
+  *size = nbytes;
+  return dest;
+}
+
+kvs_variant *kvs_variant_deserialize_separated(kvs_variant *dest, const kvs_vlog_binding *binding, kvs_buffer *data) {
+  int32_t nbytes;
+  kvs_vlog_pointer pointer;
+  if (kvs_buffer_size(data) < sizeof(int32_t)) {
+    return NULL;
+  }
+  kvs_buffer_copy(data, 0, &nbytes, sizeof(nbytes));
+  if (nbytes != KVS_VLOG_POINTER_TAG) {
+    return kvs_variant_deserialize_opaque(dest, data);
+  }
+  kvs_buffer_skip(data, sizeof(nbytes));
+  if (KVS_FAILED(kvs_variant_codec_check(kvs_variant_resolve_separated(binding, data, &pointer)))) {
+    return kvs_variant_set_opaque(kvs_variant_reserve(dest, 0), 0);
+  }
+  dest = kvs_variant_set_opaque(kvs_variant_reserve(dest, pointer.size), pointer.size);
+  if (KVS_FAILED(kvs_variant_codec_check(kvs_vlog_read(binding->log, &pointer, (void *) dest->value.opaque.data)))) {
+    dest = kvs_variant_set_opaque(dest, 0);
+  }
   return dest;
 }
 
@@ -284,6 +526,7 @@ size_t kvs_variant_type_size(kvs_variant_type ty) {
 static kvs_variant *kvs_variant_create_internal(kvs_variant_type type, size_t extra_size) {
   kvs_variant *variant = calloc(1, sizeof(kvs_variant) + extra_size);
   variant->type = type;
+  variant->storage = (int32_t) extra_size;
   return variant;
 }
 
@@ -338,11 +581,11 @@ kvs_variant *kvs_variant_create_from_double(double from) {
 }
 
 kvs_variant *kvs_variant_create_from_opaque(const void *from, size_t size) {
-  kvs_variant *variant = kvs_variant_create_internal(KVS_VARIANT_TYPE_OPAQUE, size);
-  void *buffer = KVS_UNSAFE_CAST(variant, sizeof(*variant));
-  memcpy(buffer, from, size);
-  variant->value.opaque.data = buffer;
-  variant->value.opaque.size = size;
+  kvs_variant *variant = kvs_variant_create_internal(KVS_VARIANT_TYPE_OPAQUE, size > KVS_VARIANT_INLINE_SIZE ? size : KVS_VARIANT_INLINE_SIZE);
+  kvs_variant_set_opaque(variant, size);
+  if (size > 0) {
+    memcpy((void *) variant->value.opaque.data, from, size);
+  }
   return variant;
 }
 
@@ -378,15 +621,10 @@ kvs_variant *kvs_variant_reset_double(kvs_variant *variant, double to) {
 }
 
 kvs_variant *kvs_variant_reset_opaque(kvs_variant *variant, const void *to, size_t size) {
-  if (variant->type != KVS_VARIANT_TYPE_OPAQUE || variant->value.opaque.capacity < (int32_t) size) {
-    /* reallocate a new variant */
-    variant = realloc(variant, sizeof(kvs_variant) + size);
-    variant->value.opaque.data = KVS_UNSAFE_CAST(variant, sizeof(kvs_variant));
-    variant->value.opaque.capacity = size;
+  variant = kvs_variant_set_opaque(kvs_variant_reserve(variant, size), size);
+  if (size > 0) {
+    memcpy((void *) variant->value.opaque.data, to, size);
   }
-  variant->type = KVS_VARIANT_TYPE_OPAQUE;
-  memcpy((void *) variant->value.opaque.data, to, size);
-  variant->value.opaque.size = size;
   return variant;
 }
 
@@ -394,7 +632,7 @@ kvs_variant *kvs_variant_reset_opaque_no_copy(kvs_variant *variant, const void *
   variant->type = KVS_VARIANT_TYPE_OPAQUE;
   variant->value.opaque.data = to;
   variant->value.opaque.size = size;
-  variant->value.opaque.capacity = 0;
+  variant->value.opaque.code = 0;
   return variant;
 }
 
@@ -599,10 +837,16 @@ void kvs_variant_serialize_double(const kvs_variant *variant, kvs_buffer *buffer
   kvs_variant_serialize_primitive(variant, kvs_variant_double_offset(), sizeof(kvs_double), buffer);
 }
 
+void kvs_variant_encode_opaque(const void *data, size_t size, kvs_buffer *buffer) {
+  int32_t nbytes = (int32_t) size;
+  memcpy(kvs_buffer_allocate(buffer, sizeof(nbytes)), &nbytes, sizeof(nbytes));
+  if (size > 0) {
+    memcpy(kvs_buffer_allocate(buffer, size), data, size);
+  }
+}
+
 void kvs_variant_serialize_opaque(const kvs_variant *variant, kvs_buffer *buffer) {
-  int32_t size = variant->value.opaque.size;
-  memcpy(kvs_buffer_allocate(buffer, sizeof(size)), &size, sizeof(size));
-  memcpy(kvs_buffer_allocate(buffer, variant->value.opaque.size), variant->value.opaque.data, variant->value.opaque.size);
+  kvs_variant_encode_opaque(variant->value.opaque.data, variant->value.opaque.size, buffer);
 }
 
 void kvs_variant_serialize(const kvs_variant *variant, kvs_buffer *buffer) {
@@ -4,6 +4,8 @@
 #include <stdint.h>
 #include <stddef.h>
 #include "buffer.h"
+#include "dictionary.h"
+#include "vlog.h"
 #include "status.h"
 
 #ifdef __cplusplus
@@ -48,6 +50,7 @@ kvs_status kvs_variant_get_float(const kvs_variant *variant, float *dest);
 kvs_status kvs_variant_get_double(const kvs_variant *variant, double *dest);
 kvs_status kvs_variant_get_opaque(const kvs_variant *variant, const void **data, size_t *size);
 kvs_status kvs_variant_copy_opaque(const kvs_variant *variant, void *buffer, size_t *size);
+kvs_status kvs_variant_get_dictionary_code(const kvs_variant *variant, uint32_t *code);
 size_t kvs_variant_serialized_size(const kvs_variant *variant);
 void kvs_variant_destroy(kvs_variant *variant);
 int32_t kvs_variant_compare(const kvs_variant *lhs, const kvs_variant *rhs);
@@ -66,6 +69,8 @@ void kvs_variant_serialize_int64(const kvs_variant *variant, kvs_buffer *buffer)
 void kvs_variant_serialize_float(const kvs_variant *variant, kvs_buffer *buffer);
 void kvs_variant_serialize_double(const kvs_variant *variant, kvs_buffer *buffer);
 void kvs_variant_serialize_opaque(const kvs_variant *variant, kvs_buffer *buffer);
+void kvs_variant_encode_opaque(const void *data, size_t size, kvs_buffer *buffer);
+const void *kvs_variant_decode_opaque(kvs_buffer *data, kvs_buffer *heap, size_t *size);
 
 kvs_variant *kvs_variant_deserialize(kvs_variant *dest, kvs_variant_type type, kvs_buffer *buffer);
 kvs_variant *kvs_variant_deserialize_int32(kvs_variant *dest, kvs_buffer *data);
@@ -74,6 +79,22 @@ kvs_variant *kvs_variant_deserialize_float(kvs_variant *dest, kvs_buffer *data);
 kvs_variant *kvs_variant_deserialize_double(kvs_variant *dest, kvs_buffer *data);
 kvs_variant *kvs_variant_deserialize_opaque(kvs_variant *dest, kvs_buffer *data);
 
+/* a value that can not be encoded writes nothing, an unknown code decodes as empty, both fail the codec status */
+void kvs_variant_serialize_dictionary(const kvs_variant *variant, kvs_dictionary *dictionary, kvs_buffer *buffer);
+kvs_variant *kvs_variant_deserialize_dictionary(kvs_variant *dest, const kvs_dictionary *dictionary, kvs_buffer *data);
+void kvs_variant_encode_dictionary(const void *data, size_t size, kvs_dictionary *dictionary, kvs_buffer *buffer);
+/* encoded size of the code of variant, adding it to dictionary like serialize does, 0 when that fails */
+size_t kvs_variant_dictionary_serialized_size(const kvs_variant *variant, kvs_dictionary *dictionary);
+kvs_status kvs_variant_decode_dictionary(const kvs_dictionary *dictionary, kvs_buffer *data, uint32_t *code, const void **value, size_t *size);
+
+/* opaque encoding, except values above the threshold of a bound column are replaced by a value log pointer */
+void kvs_variant_serialize_separated(const kvs_variant *variant, const kvs_vlog_binding *binding, kvs_buffer *buffer);
+kvs_variant *kvs_variant_deserialize_separated(kvs_variant *dest, const kvs_vlog_binding *binding, kvs_buffer *data);
+void kvs_variant_encode_separated(const void *data, size_t size, const kvs_vlog_binding *binding, kvs_buffer *buffer);
+const void *kvs_variant_decode_separated(const kvs_vlog_binding *binding, kvs_buffer *data, kvs_buffer *heap, size_t *size);
+/* first dictionary or separated value this thread failed to encode or decode since the last call, resets it */
+kvs_status kvs_variant_codec_status(void);
+
 void kvs_variant_serialize_comparable(const kvs_variant *variant, kvs_buffer *buffer);
 void kvs_variant_serialize_comparable_int32(const kvs_variant *variant, kvs_buffer *buffer);
 void kvs_variant_serialize_comparable_int64(const kvs_variant *variant, kvs_buffer *buffer);
@@ -81,6 +102,18 @@ void kvs_variant_serialize_comparable_float(const kvs_variant *variant, kvs_buff
 void kvs_variant_serialize_comparable_double(const kvs_variant *variant, kvs_buffer *buffer);
 void kvs_variant_serialize_comparable_opaque(const kvs_variant *variant, kvs_buffer *buffer);
 
+size_t kvs_variant_comparable_opaque_size(size_t size);
+size_t kvs_variant_encode_comparable_int32(int32_t i32, void *dest);
+size_t kvs_variant_encode_comparable_int64(int64_t i64, void *dest);
+size_t kvs_variant_encode_comparable_float(float f, void *dest);
+size_t kvs_variant_encode_comparable_double(double d, void *dest);
+size_t kvs_variant_encode_comparable_opaque(const void *data, size_t size, void *dest);
+int32_t kvs_variant_decode_comparable_int32(kvs_buffer *data);
+int64_t kvs_variant_decode_comparable_int64(kvs_buffer *data);
+float kvs_variant_decode_comparable_float(kvs_buffer *data);
+double kvs_variant_decode_comparable_double(kvs_buffer *data);
+const void *kvs_variant_decode_comparable_opaque(kvs_buffer *data, kvs_buffer *heap, size_t *size);
+
 kvs_variant *kvs_variant_deserialize_comparable(kvs_variant *dest, kvs_variant_type type, kvs_buffer *buffer);
 kvs_variant *kvs_variant_deserialize_comparable_int32(kvs_variant *dest, kvs_buffer *data);
 kvs_variant *kvs_variant_deserialize_comparable_int64(kvs_variant *dest, kvs_buffer *data);
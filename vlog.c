@@ -0,0 +1,435 @@
+#include "vlog.h"
+#include "checksum.h"
+#include "util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define KVS_VLOG_SUFFIX ".vlog"
+/* path + '/' + 10 digits + suffix + '\0' */
+#define KVS_VLOG_NAME_SIZE(PATH_LEN) ((PATH_LEN) + 1 + 10 + sizeof(KVS_VLOG_SUFFIX))
+#define KVS_VLOG_INITIAL_SEGMENTS (16)
+
+typedef struct kvs_vlog_segment {
+  uint32_t id;
+  int32_t retired;
+  /* only the active segment, the last one, keeps its file open */
+  int fd;
+  const uint8_t *map;
+  size_t capacity;
+  /* bytes appended, stored with release so readers can bound pointers */
+  uint64_t size;
+} kvs_vlog_segment;
+
+struct kvs_vlog {
+  char *path;
+  int32_t flags;
+  /* the segment table in id order, appends hold the read side while writing */
+  pthread_rwlock_t lock;
+  kvs_vlog_segment *segments;
+  size_t num_segments;
+  size_t capacity;
+  /* serializes appends, rolls and syncs */
+  pthread_mutex_t append_lock;
+  uint32_t next_id;
+  uint64_t synced;
+  /* segments below it only hold values of committed rows, the rest may still gain pointers from an open txn */
+  uint32_t committed;
+};
+
+static void kvs_vlog_segment_name(const kvs_vlog *vlog, uint32_t id, char *name) {
+  sprintf(name, "%s/%010u" KVS_VLOG_SUFFIX, vlog->path, id);
+}
+
+static int kvs_vlog_segment_compare(const void *left, const void *right) {
+  uint32_t lid = ((const kvs_vlog_segment *) left)->id, rid = ((const kvs_vlog_segment *) right)->id;
+  return lid < rid ? -1 : lid > rid;
+}
+
+/* requires the table lock */
+static kvs_vlog_segment *kvs_vlog_segment_find(const kvs_vlog *vlog, uint32_t id) {
+  kvs_vlog_segment key;
+  key.id = id;
+  return bsearch(&key, vlog->segments, vlog->num_segments, sizeof(kvs_vlog_segment), kvs_vlog_segment_compare);
+}
+
+/* requires the table write lock */
+static kvs_vlog_segment *kvs_vlog_segment_push(kvs_vlog *vlog) {
+  size_t capacity;
+  kvs_vlog_segment *segments;
+  if (vlog->num_segments == vlog->capacity) {
+    capacity = vlog->capacity == 0 ? KVS_VLOG_INITIAL_SEGMENTS : vlog->capacity * 2;
+    if ((segments = realloc(vlog->segments, sizeof(kvs_vlog_segment) * capacity)) == NULL) {
+      return NULL;
+    }
+    vlog->segments = segments;
+    vlog->capacity = capacity;
+  }
+  return vlog->segments + vlog->num_segments++;
+}
+
+/* segments found on open are sealed, the first append starts a new one */
+static kvs_status kvs_vlog_segment_load(kvs_vlog *vlog, uint32_t id, char *name) {
+  int fd;
+  struct stat st;
+  void *map = NULL;
+  kvs_vlog_segment *segment;
+  kvs_vlog_segment_name(vlog, id, name);
+  if ((fd = open(name, O_RDONLY)) < 0) {
+    return KVS_STORE_INTERNAL_ERROR;
+  }
+  if (fstat(fd, &st) != 0 || (st.st_size > 0 && (map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED)) {
+    close(fd);
+    return KVS_STORE_INTERNAL_ERROR;
+  }
+  close(fd);
+  if ((segment = kvs_vlog_segment_push(vlog)) == NULL) {
+    if (map != NULL) {
+      munmap(map, st.st_size);
+    }
+    return KVS_OUT_OF_MEMORY;
+  }
+  segment->id = id;
+  segment->retired = 0;
+  segment->fd = -1;
+  segment->map = map;
+  segment->capacity = st.st_size;
+  segment->size = st.st_size;
+  if (id >= vlog->next_id) {
+    vlog->next_id = id + 1;
+  }
+  return KVS_OK;
+}
+
+kvs_vlog *kvs_vlog_open(const char *path, int32_t flags) {
+  DIR *dir;
+  struct dirent *entry;
+  uint32_t id;
+  int32_t consumed;
+  char *name;
+  kvs_vlog *vlog = calloc(1, sizeof(kvs_vlog));
+  if (vlog == NULL) {
+    return NULL;
+  }
+  pthread_rwlock_init(&vlog->lock, NULL);
+  pthread_mutex_init(&vlog->append_lock, NULL);
+  vlog->flags = flags;
+  vlog->next_id = 1;
+  if ((vlog->path = strdup(path)) == NULL || (name = malloc(KVS_VLOG_NAME_SIZE(strlen(path)))) == NULL) {
+    kvs_vlog_close(vlog);
+    return NULL;
+  }
+  if ((dir = opendir(path)) == NULL) {
+    free(name);
+    kvs_vlog_close(vlog);
+    return NULL;
+  }
+  while ((entry = readdir(dir)) != NULL) {
+    consumed = 0;
+    if (sscanf(entry->d_name, "%10u" KVS_VLOG_SUFFIX "%n", &id, &consumed) != 1 || consumed == 0 || entry->d_name[consumed] != '\0') {
+      continue;
+    }
+    if (KVS_FAILED(kvs_vlog_segment_load(vlog, id, name))) {
+      closedir(dir);
+      free(name);
+      kvs_vlog_close(vlog);
+      return NULL;
+    }
+  }
+  closedir(dir);
+  free(name);
+  vlog->committed = vlog->next_id;
+  if (vlog->num_segments > 0) {
+    qsort(vlog->segments, vlog->num_segments, sizeof(kvs_vlog_segment), kvs_vlog_segment_compare);
+  }
+  return vlog;
+}
+
+void kvs_vlog_close(kvs_vlog *vlog) {
+  size_t idx;
+  kvs_vlog_segment *segment;
+  if (vlog == NULL) {
+    return;
+  }
+  for (idx = 0; idx < vlog->num_segments; ++idx) {
+    segment = vlog->segments + idx;
+    if (segment->fd >= 0) {
+      if ((vlog->flags & KVS_VLOG_FLAG_VOLATILE) != KVS_VLOG_FLAG_VOLATILE) {
+        fdatasync(segment->fd);
+      }
+      close(segment->fd);
+    }
+    if (segment->map != NULL) {
+      munmap((void *) segment->map, segment->capacity);
+    }
+  }
+  pthread_rwlock_destroy(&vlog->lock);
+  pthread_mutex_destroy(&vlog->append_lock);
+  free(vlog->segments);
+  free(vlog->path);
+  free(vlog);
+}
+
+static int32_t kvs_vlog_sync_directory(const kvs_vlog *vlog) {
+  int32_t rc;
+  int fd = open(vlog->path, O_RDONLY | O_DIRECTORY);
+  if (fd < 0) {
+    return -1;
+  }
+  rc = fsync(fd);
+  close(fd);
+  return rc;
+}
+
+/* requires the append lock, seals the active segment and starts one with room for size bytes */
+static kvs_status kvs_vlog_roll(kvs_vlog *vlog, size_t size) {
+  int fd;
+  void *map;
+  char *name;
+  uint32_t id = vlog->next_id;
+  size_t capacity = size > KVS_VLOG_SEGMENT_SIZE ? size : KVS_VLOG_SEGMENT_SIZE;
+  kvs_vlog_segment *segment;
+  int32_t durable = (vlog->flags & KVS_VLOG_FLAG_VOLATILE) != KVS_VLOG_FLAG_VOLATILE;
+  KVS_CHECK_OOM(name = malloc(KVS_VLOG_NAME_SIZE(strlen(vlog->path))));
+  kvs_vlog_segment_name(vlog, id, name);
+  fd = open(name, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR | S_IRGRP);
+  free(name);
+  if (fd < 0) {
+    return KVS_STORE_INTERNAL_ERROR;
+  }
+  /* mapping past the end of the file is fine as long as only appended bytes are read */
+  if ((map = mmap(NULL, capacity, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED || (durable && kvs_vlog_sync_directory(vlog) != 0)) {
+    if (map != MAP_FAILED) {
+      munmap(map, capacity);
+    }
+    close(fd);
+    return KVS_STORE_INTERNAL_ERROR;
+  }
+  pthread_rwlock_wrlock(&vlog->lock);
+  if (vlog->num_segments > 0 && (segment = vlog->segments + vlog->num_segments - 1)->fd >= 0) {
+    if (durable && segment->size > vlog->synced) {
+      fdatasync(segment->fd);
+    }
+    close(segment->fd);
+    segment->fd = -1;
+  }
+  if ((segment = kvs_vlog_segment_push(vlog)) == NULL) {
+    pthread_rwlock_unlock(&vlog->lock);
+    munmap(map, capacity);
+    close(fd);
+    return KVS_OUT_OF_MEMORY;
+  }
+  segment->id = id;
+  segment->retired = 0;
+  segment->fd = fd;
+  segment->map = map;
+  segment->capacity = capacity;
+  segment->size = 0;
+  pthread_rwlock_unlock(&vlog->lock);
+  vlog->next_id = id + 1;
+  vlog->synced = 0;
+  return KVS_OK;
+}
+
+/* requires the table lock */
+static kvs_vlog_segment *kvs_vlog_active(const kvs_vlog *vlog, size_t size) {
+  kvs_vlog_segment *segment;
+  if (vlog->num_segments == 0 || (segment = vlog->segments + vlog->num_segments - 1)->fd < 0 ||
+      segment->size + size > segment->capacity) {
+    return NULL;
+  }
+  return segment;
+}
+
+static int32_t kvs_vlog_write(int fd, const void *data, size_t size, uint64_t offset) {
+  ssize_t written;
+  const uint8_t *cdata = data;
+  while (size > 0) {
+    if ((written = pwrite(fd, cdata, size, offset)) < 0) {
+      return -1;
+    }
+    cdata += written;
+    offset += written;
+    size -= written;
+  }
+  return 0;
+}
+
+kvs_status kvs_vlog_append(kvs_vlog *vlog, const void *data, size_t size, kvs_vlog_pointer *pointer) {
+  kvs_status st = KVS_OK;
+  kvs_vlog_segment *segment;
+  uint64_t offset;
+  pthread_mutex_lock(&vlog->append_lock);
+  pthread_rwlock_rdlock(&vlog->lock);
+  if ((segment = kvs_vlog_active(vlog, size)) == NULL) {
+    pthread_rwlock_unlock(&vlog->lock);
+    KVS_DO_GOTO(st, cleanup_exit, kvs_vlog_roll(vlog, size));
+    pthread_rwlock_rdlock(&vlog->lock);
+    segment = kvs_vlog_active(vlog, size);
+  }
+  offset = segment->size;
+  if (kvs_vlog_write(segment->fd, data, size, offset) == 0) {
+    pointer->segment = segment->id;
+    pointer->size = (uint32_t) size;
+    pointer->offset = offset;
+    pointer->checksum = kvs_crc32c(0, data, size);
+    __atomic_store_n(&segment->size, offset + size, __ATOMIC_RELEASE);
+  } else {
+    st = KVS_STORE_INTERNAL_ERROR;
+  }
+  pthread_rwlock_unlock(&vlog->lock);
+cleanup_exit:
+  pthread_mutex_unlock(&vlog->append_lock);
+  return st;
+}
+
+kvs_status kvs_vlog_get(kvs_vlog *vlog, const kvs_vlog_pointer *pointer, const void **data) {
+  kvs_status st = KVS_STORE_CORRUPTED;
+  const kvs_vlog_segment *segment;
+  pthread_rwlock_rdlock(&vlog->lock);
+  if ((segment = kvs_vlog_segment_find(vlog, pointer->segment)) != NULL &&
+      pointer->offset + pointer->size <= __atomic_load_n(&segment->size, __ATOMIC_ACQUIRE)) {
+    *data = segment->map + pointer->offset;
+    st = KVS_OK;
+  }
+  pthread_rwlock_unlock(&vlog->lock);
+  if (st == KVS_OK && kvs_crc32c(0, *data, pointer->size) != pointer->checksum) {
+    st = KVS_STORE_CORRUPTED;
+  }
+  return st;
+}
+
+kvs_status kvs_vlog_read(kvs_vlog *vlog, const kvs_vlog_pointer *pointer, void *dest) {
+  kvs_status st = KVS_STORE_CORRUPTED;
+  const kvs_vlog_segment *segment;
+  /* the table read lock keeps the segment mapped while copying */
+  pthread_rwlock_rdlock(&vlog->lock);
+  if ((segment = kvs_vlog_segment_find(vlog, pointer->segment)) != NULL &&
+      pointer->offset + pointer->size <= __atomic_load_n(&segment->size, __ATOMIC_ACQUIRE)) {
+    memcpy(dest, segment->map + pointer->offset, pointer->size);
+    st = KVS_OK;
+  }
+  pthread_rwlock_unlock(&vlog->lock);
+  if (st == KVS_OK && kvs_crc32c(0, dest, pointer->size) != pointer->checksum) {
+    st = KVS_STORE_CORRUPTED;
+  }
+  return st;
+}
+
+kvs_status kvs_vlog_sync(kvs_vlog *vlog) {
+  kvs_status st = KVS_OK;
+  const kvs_vlog_segment *segment;
+  if ((vlog->flags & KVS_VLOG_FLAG_VOLATILE) == KVS_VLOG_FLAG_VOLATILE) {
+    return KVS_OK;
+  }
+  pthread_mutex_lock(&vlog->append_lock);
+  pthread_rwlock_rdlock(&vlog->lock);
+  if (vlog->num_segments > 0 && (segment = vlog->segments + vlog->num_segments - 1)->fd >= 0 && segment->size > vlog->synced) {
+    if (fdatasync(segment->fd) == 0) {
+      vlog->synced = segment->size;
+    } else {
+      st = KVS_STORE_INTERNAL_ERROR;
+    }
+  }
+  pthread_rwlock_unlock(&vlog->lock);
+  pthread_mutex_unlock(&vlog->append_lock);
+  return st;
+}
+
+uint32_t kvs_vlog_active_segment(kvs_vlog *vlog) {
+  uint32_t id;
+  pthread_mutex_lock(&vlog->append_lock);
+  pthread_rwlock_rdlock(&vlog->lock);
+  /* without an active segment the next append starts next_id */
+  id = vlog->num_segments > 0 && vlog->segments[vlog->num_segments - 1].fd >= 0 ? vlog->next_id - 1 : vlog->next_id;
+  pthread_rwlock_unlock(&vlog->lock);
+  pthread_mutex_unlock(&vlog->append_lock);
+  return id;
+}
+
+void kvs_vlog_commit(kvs_vlog *vlog, uint32_t watermark) {
+  pthread_mutex_lock(&vlog->append_lock);
+  if (watermark > vlog->committed) {
+    __atomic_store_n(&vlog->committed, watermark, __ATOMIC_RELEASE);
+  }
+  pthread_mutex_unlock(&vlog->append_lock);
+}
+
+size_t kvs_vlog_sealed(kvs_vlog *vlog, uint32_t *segments, uint64_t *sizes, size_t max) {
+  size_t idx, num = 0;
+  const kvs_vlog_segment *segment;
+  uint32_t committed = __atomic_load_n(&vlog->committed, __ATOMIC_ACQUIRE);
+  pthread_rwlock_rdlock(&vlog->lock);
+  for (idx = 0; idx < vlog->num_segments; ++idx) {
+    segment = vlog->segments + idx;
+    if (segment->fd >= 0 || segment->retired || segment->id >= committed) {
+      continue;
+    }
+    if (num < max) {
+      segments[num] = segment->id;
+      sizes[num] = segment->size;
+    }
+    num++;
+  }
+  pthread_rwlock_unlock(&vlog->lock);
+  return num;
+}
+
+kvs_status kvs_vlog_retire(kvs_vlog *vlog, uint32_t id) {
+  kvs_status st = KVS_OK;
+  kvs_vlog_segment *segment;
+  char *name;
+  KVS_CHECK_OOM(name = malloc(KVS_VLOG_NAME_SIZE(strlen(vlog->path))));
+  kvs_vlog_segment_name(vlog, id, name);
+  pthread_rwlock_wrlock(&vlog->lock);
+  if ((segment = kvs_vlog_segment_find(vlog, id)) == NULL || segment->fd >= 0) {
+    st = KVS_STORE_INTERNAL_ERROR;
+  } else if (!segment->retired) {
+    if (unlink(name) != 0) {
+      st = KVS_STORE_INTERNAL_ERROR;
+    } else {
+      segment->retired = 1;
+    }
+  }
+  pthread_rwlock_unlock(&vlog->lock);
+  free(name);
+  return st;
+}
+
+void kvs_vlog_release(kvs_vlog *vlog) {
+  size_t idx, kept = 0;
+  kvs_vlog_segment *segment;
+  pthread_rwlock_wrlock(&vlog->lock);
+  for (idx = 0; idx < vlog->num_segments; ++idx) {
+    segment = vlog->segments + idx;
+    if (!segment->retired) {
+      vlog->segments[kept++] = *segment;
+    } else if (segment->map != NULL) {
+      munmap((void *) segment->map, segment->capacity);
+    }
+  }
+  vlog->num_segments = kept;
+  pthread_rwlock_unlock(&vlog->lock);
+}
+
+void kvs_vlog_pointer_encode(const kvs_vlog_pointer *pointer, void *dest) {
+  uint8_t *cdest = dest;
+  memcpy(cdest, &pointer->segment, sizeof(pointer->segment));
+  memcpy(cdest + 4, &pointer->size, sizeof(pointer->size));
+  memcpy(cdest + 8, &pointer->offset, sizeof(pointer->offset));
+  memcpy(cdest + 16, &pointer->checksum, sizeof(pointer->checksum));
+}
+
+void kvs_vlog_pointer_decode(const void *data, kvs_vlog_pointer *pointer) {
+  const uint8_t *cdata = data;
+  memcpy(&pointer->segment, cdata, sizeof(pointer->segment));
+  memcpy(&pointer->size, cdata + 4, sizeof(pointer->size));
+  memcpy(&pointer->offset, cdata + 8, sizeof(pointer->offset));
+  memcpy(&pointer->checksum, cdata + 16, sizeof(pointer->checksum));
+}
@@ -0,0 +1,77 @@
+#ifndef __KVS_VLOG_H__
+#define __KVS_VLOG_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "status.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Append only log of large opaque values kept next to the lmdb environment, so rows only
+ * hold a pointer and the b-tree stays dense. Values are appended to the active segment
+ * file and read back through read only mappings of the segments. A segment is sealed and
+ * synced once full, collection copies its live values to the active segment and retires
+ * it. Retired segments are deleted at once but stay mapped until kvs_vlog_release, so a
+ * reader that picked up a pointer before can still resolve it; the schema releases them
+ * once no read transaction from before the collection is left. Thread safe.
+ **/
+typedef struct kvs_vlog kvs_vlog;
+
+typedef enum kvs_vlog_flag {
+  /* never sync segments, for stores opened with KVS_STORE_FLAG_VOLATILE */
+  KVS_VLOG_FLAG_VOLATILE = 1 << 0,
+} kvs_vlog_flag;
+
+typedef struct kvs_vlog_pointer {
+  uint32_t segment;
+  uint32_t size;
+  uint64_t offset;
+  /* CRC32C of the value */
+  uint32_t checksum;
+} kvs_vlog_pointer;
+
+/* encoded in place of the size of an opaque value to mark a pointer into the value log */
+#define KVS_VLOG_POINTER_TAG (-1)
+#define KVS_VLOG_POINTER_SIZE (20)
+/* values above this many bytes are logged when a separated column does not set its own threshold */
+#define KVS_VLOG_DEFAULT_THRESHOLD (1024)
+#ifndef KVS_VLOG_SEGMENT_SIZE
+#define KVS_VLOG_SEGMENT_SIZE (64 << 20)
+#endif
+
+/* a separated column, the schema binds it to the value log of a store */
+typedef struct kvs_vlog_binding {
+  kvs_vlog *log;
+  size_t threshold;
+} kvs_vlog_binding;
+
+kvs_vlog *kvs_vlog_open(const char *path, int32_t flags);
+void kvs_vlog_close(kvs_vlog *vlog);
+kvs_status kvs_vlog_append(kvs_vlog *vlog, const void *data, size_t size, kvs_vlog_pointer *pointer);
+/* data points into the segment mapping and is only valid until the next kvs_vlog_release, the checksum is verified on every read */
+kvs_status kvs_vlog_get(kvs_vlog *vlog, const kvs_vlog_pointer *pointer, const void **data);
+/* copy the value to dest of pointer->size bytes, safe against a concurrent kvs_vlog_release */
+kvs_status kvs_vlog_read(kvs_vlog *vlog, const kvs_vlog_pointer *pointer, void *dest);
+/* make everything appended so far durable, call before committing rows that point to it */
+kvs_status kvs_vlog_sync(kvs_vlog *vlog);
+/* id of the segment the next append goes to unless it rolls */
+uint32_t kvs_vlog_active_segment(kvs_vlog *vlog);
+/* rows pointing below watermark are all committed, the store advances it on every write commit */
+void kvs_vlog_commit(kvs_vlog *vlog, uint32_t watermark);
+/* ids and sizes of the segments below the commit watermark no longer appended to in id order, returns their number which may exceed max */
+size_t kvs_vlog_sealed(kvs_vlog *vlog, uint32_t *segments, uint64_t *sizes, size_t max);
+kvs_status kvs_vlog_retire(kvs_vlog *vlog, uint32_t segment);
+/* unmap the segments retired so far */
+void kvs_vlog_release(kvs_vlog *vlog);
+
+void kvs_vlog_pointer_encode(const kvs_vlog_pointer *pointer, void *dest);
+void kvs_vlog_pointer_decode(const void *data, kvs_vlog_pointer *pointer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __KVS_VLOG_H__ */